@@ -104,8 +104,10 @@ endif
 
 LOCAL_SRC_FILES := \
         util/QCameraCmdThread.cpp \
+        util/QCameraExecutor.cpp \
         util/QCameraQueue.cpp \
         util/QCameraBufferMaps.cpp \
+        util/QCameraCacheTracker.cpp \
         QCamera2Hal.cpp \
         QCamera2Factory.cpp
 
@@ -117,7 +119,9 @@ LOCAL_SRC_FILES += \
         HAL3/QCamera3Channel.cpp \
         HAL3/QCamera3VendorTags.cpp \
         HAL3/QCamera3PostProc.cpp \
-        HAL3/QCamera3CropRegionMapper.cpp
+        HAL3/QCamera3CropRegionMapper.cpp \
+        HAL3/QCamera3MetadataPool.cpp \
+        HAL3/QCamera3SettingsCache.cpp
 
 #HAL 1.0 source
 LOCAL_SRC_FILES += \
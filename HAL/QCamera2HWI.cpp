@@ -44,6 +44,7 @@
 #include <dlfcn.h>
 
 #include "QCamera2HWI.h"
+#include "QCamera2Factory.h"
 #include "QCameraBufferMaps.h"
 #include "QCameraMem.h"
 
@@ -291,6 +292,12 @@ int QCamera2HardwareInterface::msg_type_enabled(struct camera_device *device, in
     }
     CDBG("%s: E camera id %d", __func__, hw->getCameraId());
 
+    ret = hw->m_stateMachine.queryMsgTypeEnabled(msg_type);
+    if (ret >= 0) {
+        CDBG("%s: X camera id %d", __func__, hw->getCameraId());
+        return ret;
+    }
+
     hw->lockAPI();
     qcamera_api_result_t apiResult;
     ret = hw->processAPI(QCAMERA_SM_EVT_MSG_TYPE_ENABLED, (void *)&msg_type);
@@ -437,6 +444,15 @@ int QCamera2HardwareInterface::preview_enabled(struct camera_device *device)
     }
     CDBG("%s: E camera id %d", __func__, hw->getCameraId());
 
+    ret = hw->m_stateMachine.queryPreviewEnabled();
+    if (ret >= 0) {
+        if (ret) {
+            hw->mParameters.setPreviewCallbackNeeded(true);
+        }
+        CDBG("%s: X camera id %d", __func__, hw->getCameraId());
+        return ret;
+    }
+
     hw->lockAPI();
     qcamera_api_result_t apiResult;
     ret = hw->processAPI(QCAMERA_SM_EVT_PREVIEW_ENABLED, NULL);
@@ -716,6 +732,13 @@ int QCamera2HardwareInterface::recording_enabled(struct camera_device *device)
         return BAD_VALUE;
     }
     CDBG("%s: E camera id %d", __func__, hw->getCameraId());
+
+    ret = hw->m_stateMachine.queryRecordingEnabled();
+    if (ret >= 0) {
+        CDBG("%s: X camera id %d", __func__, hw->getCameraId());
+        return ret;
+    }
+
     hw->lockAPI();
     qcamera_api_result_t apiResult;
     ret = hw->processAPI(QCAMERA_SM_EVT_RECORDING_ENABLED, NULL);
@@ -1211,6 +1234,14 @@ char* QCamera2HardwareInterface::get_parameters(struct camera_device *device)
         return NULL;
     }
     CDBG("%s: E camera id %d", __func__, hw->getCameraId());
+
+    // unchanged since the last get, hand out the cached string
+    ret = hw->m_stateMachine.queryParameters();
+    if (ret != NULL) {
+        CDBG("%s: X camera id %d", __func__, hw->getCameraId());
+        return ret;
+    }
+
     hw->lockAPI();
     qcamera_api_result_t apiResult;
     int32_t rc = hw->processAPI(QCAMERA_SM_EVT_GET_PARAMS, NULL);
@@ -1577,6 +1608,7 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
       m_pre_video_width(0),
       m_pre_video_height(0),
 #endif
+      m_memoryPool(QCamera2Factory::getMemoryPool(cameraId)),
       m_bPreviewStarted(false),
       m_bRecordStarted(false),
       m_currentFocusState(CAM_AF_STATE_INACTIVE),
@@ -1855,6 +1887,9 @@ int QCamera2HardwareInterface::openCamera()
         return ALREADY_EXISTS;
     }
 
+    // preallocate the stream buffers of the last session, if any
+    m_memoryPool.startSession();
+
     // alloc param buffer
     DeferWorkArgs args;
     memset(&args, 0, sizeof(args));
@@ -1909,6 +1944,12 @@ int QCamera2HardwareInterface::openCamera()
                 (void *) this);
     }
 
+    // Stream buffers all come from QCameraMemory, which reports freed fds,
+    // so their mappings can be kept across stream restarts
+    property_get("persist.camera.map.cache", value, "1");
+    mCameraHandle->ops->set_buf_map_cache(mCameraHandle->camera_handle,
+            (uint8_t)(atoi(value) > 0));
+
     // Init params in the background
     // 1. It's safe to queue init job, even if alloc job is not yet complete.
     // It will be queued to the same thread, so the alloc is guaranteed to
@@ -2205,6 +2246,9 @@ int QCamera2HardwareInterface::closeCamera()
         }
     }
 
+    // stream buffers are back in the pool, keep them for the next session
+    m_memoryPool.endSession();
+
     //free all pending api results here
     if(m_apiResultList != NULL) {
         api_result_list *apiResultList = m_apiResultList;
@@ -3244,7 +3288,8 @@ int QCamera2HardwareInterface::enableMsgType(int32_t msg_type)
         }
     }
 
-    mMsgEnabled |= msg_type;
+    // written on the state machine thread only, read lock free
+    __atomic_store_n(&mMsgEnabled, mMsgEnabled | msg_type, __ATOMIC_RELEASE);
     CDBG_HIGH("%s (0x%x) : mMsgEnabled = 0x%x", __func__, msg_type , mMsgEnabled );
     return rc;
 }
@@ -3278,7 +3323,7 @@ int QCamera2HardwareInterface::disableMsgType(int32_t msg_type)
         }
     }
 
-    mMsgEnabled &= ~msg_type;
+    __atomic_store_n(&mMsgEnabled, mMsgEnabled & ~msg_type, __ATOMIC_RELEASE);
     CDBG_HIGH("%s (0x%x) : mMsgEnabled = 0x%x", __func__, msg_type , mMsgEnabled );
     return rc;
 }
@@ -3296,7 +3341,7 @@ int QCamera2HardwareInterface::disableMsgType(int32_t msg_type)
  *==========================================================================*/
 int QCamera2HardwareInterface::msgTypeEnabled(int32_t msg_type)
 {
-    return (mMsgEnabled & msg_type);
+    return (__atomic_load_n(&mMsgEnabled, __ATOMIC_ACQUIRE) & msg_type);
 }
 
 /*===========================================================================
@@ -4012,6 +4057,9 @@ int32_t QCamera2HardwareInterface::unconfigureAdvancedCapture()
 
         mAdvancedCaptureConfigured = false;
 
+        // 3A unlock and the feature reset go to backend in one commit
+        mParameters.beginSetBatch();
+
         if(mIs3ALocked) {
             mParameters.set3ALock(QCameraParameters::VALUE_FALSE);
             mIs3ALocked = false;
@@ -4048,6 +4096,14 @@ int32_t QCamera2HardwareInterface::unconfigureAdvancedCapture()
             ALOGE("%s: No Advanced Capture feature enabled!! ", __func__);
             rc = BAD_VALUE;
         }
+
+        int32_t commit_rc = mParameters.endSetBatch();
+        if (commit_rc != NO_ERROR) {
+            ALOGE("%s: Failed to commit advanced capture reset", __func__);
+            if (rc == NO_ERROR) {
+                rc = commit_rc;
+            }
+        }
     }
 
     return rc;
@@ -4481,6 +4537,7 @@ int QCamera2HardwareInterface::preTakePicture()
 int QCamera2HardwareInterface::takePicture()
 {
     int rc = NO_ERROR;
+    nsecs_t shutterTs = systemTime(SYSTEM_TIME_MONOTONIC);
 #ifdef TCT_TSHDR_FEATURE
     //ts hdr
     bool bIsHDR = mParameters.getInt(QCameraParameters::KEY_TSVIDEOPROCESSMODE_HDRCHECKER) == 1;
@@ -4608,6 +4665,17 @@ int QCamera2HardwareInterface::takePicture()
                 buf.type = MM_CAMERA_REQ_SUPER_BUF;
                 buf.num_buf_requested = numSnapshots;
                 buf.num_retro_buf_requested = numRetroSnapshots;
+                // For a plain single shot, let the interface pick the best
+                // scored ZSL frame around the shutter instead of the oldest
+                if ((numSnapshots == 1) && (numRetroSnapshots == 0) &&
+                        !mLongshotEnabled && !mFlashNeeded &&
+                        !mParameters.isAdvCamFeaturesEnabled()) {
+                    char prop[PROPERTY_VALUE_MAX];
+                    memset(prop, 0, sizeof(prop));
+                    property_get("persist.camera.zsl.select_us", prop, "50000");
+                    buf.shutter_ts_ns = (uint64_t)shutterTs;
+                    buf.select_window_us = (uint32_t)atoi(prop);
+                }
                 rc = pZSLChannel->takePicture(&buf);
                 if (rc != NO_ERROR) {
                     ALOGE("%s: cannot take ZSL picture, stop pproc", __func__);
@@ -5460,7 +5528,6 @@ int QCamera2HardwareInterface::cancelLiveSnapshot()
 char* QCamera2HardwareInterface::getParameters()
 {
     char* strParams = NULL;
-    String8 str;
 
     int cur_width, cur_height;
     pthread_mutex_lock(&m_parm_lock);
@@ -5479,13 +5546,8 @@ char* QCamera2HardwareInterface::getParameters()
         mParameters.set(CameraParameters::KEY_PICTURE_SIZE, pic_size);
     }
 
-    str = mParameters.flatten( );
-    strParams = (char *)malloc(sizeof(char)*(str.length()+1));
-    if(strParams != NULL){
-        memset(strParams, 0, sizeof(char)*(str.length()+1));
-        strlcpy(strParams, str.string(), str.length()+1);
-        strParams[str.length()] = 0;
-    }
+    // shared with the other callers, rebuilt only if a parameter changed
+    strParams = mParameters.getFlatParams();
 
     if(mParameters.m_reprocScaleParam.isScaleEnabled() &&
         mParameters.m_reprocScaleParam.isUnderScaling()){
@@ -5514,7 +5576,7 @@ char* QCamera2HardwareInterface::getParameters()
  *==========================================================================*/
 int QCamera2HardwareInterface::putParameters(char *parms)
 {
-    free(parms);
+    QCameraParameters::putFlatParams(parms);
     return NO_ERROR;
 }
 
@@ -5763,6 +5825,15 @@ int QCamera2HardwareInterface::dump(int fd)
     dprintf(fd, "StoreMetaDataInFrame: %d \n", mStoreMetaDataInFrame);
     dprintf(fd, "\n Configuration: %s", mParameters.dump().string());
     dprintf(fd, "\n State Information: %s", m_stateMachine.dump().string());
+    dprintf(fd, "\n %s", QCameraExecutor::getInstance().dump().string());
+    dprintf(fd, "\n %s", QCameraCacheTracker::dump().string());
+    if (mCameraHandle != NULL) {
+        mCameraHandle->ops->dump_latency(mCameraHandle->camera_handle, fd);
+    }
+    if (g_mm_camera_trace_enabled) {
+        dprintf(fd, "\n Frame trace (Chrome JSON):\n");
+        mm_camera_trace_dump(fd);
+    }
     dprintf(fd, "\n Camera HAL information End \n");
 
     /* send UPDATE_DEBUG_LEVEL to the backend so that they can read the
@@ -6587,6 +6658,9 @@ void QCamera2HardwareInterface::unlockAPI()
  *==========================================================================*/
 void QCamera2HardwareInterface::signalAPIResult(qcamera_api_result_t *result)
 {
+    // the caller may query right after the result, publish the state the
+    // API left behind first
+    m_stateMachine.publishState();
 
     pthread_mutex_lock(&m_lock);
     api_result_list *apiResult = (api_result_list *)malloc(sizeof(api_result_list));
@@ -10169,8 +10243,9 @@ void QCamera2HardwareInterface::dumpYuvToFile(const int width, const int height,
 bool QCamera2HardwareInterface::tsHDRProcess(mm_camera_buf_def_t * p_mainFrame, QCameraStream * pStream){
     ALOGD("thundersoft start");
     bool ret = false;
-    int  curEV = mParameters.getInt(QCameraParameters::KEY_EXPOSURE_COMPENSATION);
-    bool bIsHDR = mParameters.getInt(QCameraParameters::KEY_TSPHOTOPROCESSMODE_HDR) == 1;
+    QCameraFrameParams frameParams = *mParameters.getFrameParams();
+    int  curEV = frameParams.exposure_compensation;
+    bool bIsHDR = frameParams.ts_photo_hdr == 1;
     ALOGD("thundersoft tsHDRProcess bIsHDR=%d,mTsHDR_SNAPSHOT_NUM=%d,curEV=%d",bIsHDR,mTsHDR_SNAPSHOT_NUM,curEV);
     if (bIsHDR && mTsHDR_SNAPSHOT_NUM > 1) {
             ALOGD("thundersoft tsHDRProcess mTsNumPictureSnapshot=%d",mTsNumPictureSnapshot);
@@ -10198,7 +10273,13 @@ bool QCamera2HardwareInterface::tsHDRProcess(mm_camera_buf_def_t * p_mainFrame,
                    mTsPhotoProcessHDR.doProcess(mTsYUVBufferHDR + offset.mp[0].offset, mTsYUVBufferHDR + offset.mp[0].len+offset.mp[1].offset, offset.mp[0].stride, input_dim.height);
                    ALOGD("thundersoft Tshdr process done");
                    QCameraMemory *memory = (QCameraMemory *)main_frame->mem_info;
-                   memory->cleanCache(main_frame->buf_idx);
+                   // only the Y and UV planes are rewritten
+                   memory->markCpuWrite(main_frame->buf_idx,
+                           offset.mp[0].offset, offset.mp[0].len - offset.mp[0].offset);
+                   memory->markCpuWrite(main_frame->buf_idx,
+                           offset.mp[0].len + offset.mp[1].offset,
+                           offset.mp[1].len - offset.mp[1].offset);
+                   memory->flushCpuWrites(main_frame->buf_idx);
                    mParameters.set(QCameraParameters::KEY_QC_AE_BRACKET_HDR,QCameraParameters::AE_BRACKET_OFF);
                    mParameters.set(QCameraParameters::KEY_QC_CAPTURE_BURST_EXPOSURE,0);
                    mParameters.setAEBracket(QCameraParameters::AE_BRACKET_OFF);
@@ -193,6 +193,8 @@ public:
                           mJpegCb(NULL),
                           mJpegCallbackCookie(NULL),
                           mParent (parent),
+                          // unbounded, a full ring would drop callbacks
+                          // whose frames only release_cb returns
                           mDataQ(releaseNotifications, this),
                           mActive(false){}
 
@@ -452,7 +454,7 @@ private:
             uint32_t frame_idx);
 
     int32_t sendPreviewCallback(QCameraStream *stream,
-            QCameraMemory *memory, uint32_t idx);
+            QCameraMemory *memory, uint32_t idx, uint32_t frame_idx);
     int32_t selectScene(QCameraChannel *pChannel,
             mm_camera_super_buf_t *recvd_frame);
 
@@ -646,7 +648,7 @@ private:
     pthread_mutex_t m_lock;
     pthread_cond_t m_cond;
     api_result_list *m_apiResultList;
-    QCameraMemoryPool m_memoryPool;
+    QCameraMemoryPool &m_memoryPool;
 
     pthread_mutex_t m_evtLock;
     pthread_cond_t m_evtCond;
@@ -343,7 +343,8 @@ int32_t QCamera2HardwareInterface::selectScene(QCameraChannel *pChannel,
             if (preview_frame) {
                 QCameraGrallocMemory *memory = (QCameraGrallocMemory *)preview_frame->mem_info;
                 uint32_t idx = preview_frame->buf_idx;
-                rc = sendPreviewCallback(pStream, memory, idx);
+                rc = sendPreviewCallback(pStream, memory, idx,
+                        preview_frame->frame_idx);
                 if (NO_ERROR != rc) {
                     ALOGE("%s: Error triggering scene select preview callback", __func__);
                 } else {
@@ -567,24 +568,16 @@ bool QCamera2HardwareInterface::TsMakeupProcess(mm_camera_buf_def_t *pFrame,
         CDBG_HIGH("%s pStream == NULL || pFrame == NULL ",__func__);
         return false;
     }
-    pthread_mutex_lock(&m_parm_lock);
-    const char* pch_makeup_enable = mParameters.get(QCameraParameters::KEY_TS_MAKEUP);
-    pthread_mutex_unlock(&m_parm_lock);
-    if (pch_makeup_enable == NULL) {
-        CDBG_HIGH("%s pch_makeup_enable = null",__func__);
-        return false;
-    }
-    bool enableMakeUp = (strcmp(pch_makeup_enable,"On") == 0) && (faceRect.left > -1);
-    CDBG("%s pch_makeup_enable = %s ",__func__,pch_makeup_enable);
+    QCameraFrameParams frameParams = *mParameters.getFrameParams();
+    bool enableMakeUp = frameParams.ts_makeup_on && (faceRect.left > -1);
+    CDBG("%s makeup enable = %d ",__func__,frameParams.ts_makeup_on);
     if (enableMakeUp) {
         cam_dimension_t dim;
         cam_frame_len_offset_t offset;
         pStream->getFrameDimension(dim);
         pStream->getFrameOffset(offset);
-        pthread_mutex_lock(&m_parm_lock);
-        int whiteLevel = mParameters.getInt(QCameraParameters::KEY_TS_MAKEUP_WHITEN),
-        cleanLevel = mParameters.getInt(QCameraParameters::KEY_TS_MAKEUP_CLEAN);
-        pthread_mutex_unlock(&(m_parm_lock));
+        int whiteLevel = frameParams.ts_makeup_whiten,
+        cleanLevel = frameParams.ts_makeup_clean;
         unsigned char *tempOriBuf = NULL;
 
         tempOriBuf = (unsigned char*)pFrame->buffer;
@@ -616,7 +609,8 @@ bool QCamera2HardwareInterface::TsMakeupProcess(mm_camera_buf_def_t *pFrame,
         ts_makeup_skin_beautyEx(&inMakeupData, &outMakeupData, &(faceRect),cleanLevel,whiteLevel);
         memcpy((unsigned char*)pFrame->buffer, tmpBuf, offset.frame_len);
         QCameraMemory *memory = (QCameraMemory *)pFrame->mem_info;
-        memory->cleanCache(pFrame->buf_idx);
+        memory->markCpuWrite(pFrame->buf_idx, 0, offset.frame_len);
+        memory->flushCpuWrites(pFrame->buf_idx);
         if (tmpBuf != NULL) {
             delete[] tmpBuf;
             tmpBuf = NULL;
@@ -815,11 +809,12 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
         return;
     }
 #ifdef TCT_TSHDR_FEATURE
-    int32_t isOpen = pme->mParameters.getInt(QCameraParameters::KEY_TSVIDEOPROCESSMODE_HDRCHECKER);
+    int32_t isOpen = pme->mParameters.getFrameParams()->ts_video_hdr_checker;
      if( isOpen == 1 && pme->mTsNeedChecker == true ){
         QCameraMemory *videoMemObj = (QCameraMemory *)frame->mem_info;
         pme->mTsHDRCheckerStatus = pme->tsHdrCheckProcess(videoMemObj->getPtr(frame->buf_idx), stream,&pme->mTsHDRCheckerProcess);
-        videoMemObj->cleanCache(frame->buf_idx);
+        // the checker only reads the frame
+        videoMemObj->flushCpuWrites(frame->buf_idx);
     }
     else{
         pme->mTsHDRCheckerStatus = 0;
@@ -919,7 +914,8 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
 	/*modified by xiaoming.hu for panorama apk need preview call back*/
         //if (pme->needSendPreviewCallback() &&
           if ((!pme->mParameters.isSceneSelectionEnabled())) {
-            int32_t rc = pme->sendPreviewCallback(stream, memory, idx);
+            int32_t rc = pme->sendPreviewCallback(stream, memory, idx,
+                    frame->frame_idx);
             if (NO_ERROR != rc) {
                 ALOGE("%s: Preview callback was not sent succesfully", __func__);
             }
@@ -940,13 +936,14 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
  *   @stream    : stream object
  *   @memory    : Stream memory allocator
  *   @idx       : buffer index
+ *   @frame_idx : frame index, for frame trace
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *==========================================================================*/
 int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
-        QCameraMemory *memory, uint32_t idx)
+        QCameraMemory *memory, uint32_t idx, uint32_t frame_idx)
 {
     camera_memory_t *previewMem = NULL;
     camera_memory_t *data = NULL;
@@ -1073,6 +1070,7 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
     memset(&cbArg, 0, sizeof(qcamera_callback_argm_t));
     cbArg.cb_type = QCAMERA_DATA_CALLBACK;
     cbArg.msg_type = CAMERA_MSG_PREVIEW_FRAME;
+    cbArg.frame_index = frame_idx;
     if (previewBufSize != 0 && previewBufSizeFromCallback != 0 &&
             previewBufSize == previewBufSizeFromCallback) {
         cbArg.data = data;
@@ -1165,6 +1163,7 @@ void QCamera2HardwareInterface::nodisplay_preview_stream_cb_routine(
             memset(&cbArg, 0, sizeof(qcamera_callback_argm_t));
             cbArg.cb_type = QCAMERA_DATA_CALLBACK;
             cbArg.msg_type = CAMERA_MSG_PREVIEW_FRAME;
+            cbArg.frame_index = frame->frame_idx;
             cbArg.data = preview_mem;
             cbArg.user_data = (void *) &frame->buf_idx;
             cbArg.cookie = stream;
@@ -1237,7 +1236,13 @@ void QCamera2HardwareInterface::rdi_mode_stream_cb_routine(
 
         camera_memory_t *preview_mem = previewMemObj->getMemory(frame->buf_idx, false);
         if (NULL != preview_mem) {
-            previewMemObj->cleanCache(frame->buf_idx);
+#ifdef TCT_VISIDON_FEATURE
+            // face beauty rewrote the frame in mm-camera-interface
+            if (VISIDON_FACE_BEAUTY_MODE == g_cam_visidon_para.fb_enable) {
+                previewMemObj->markCpuWrite(frame->buf_idx, 0, frame->frame_len);
+            }
+#endif
+            previewMemObj->flushCpuWrites(frame->buf_idx);
             // Dump RAW frame
             pme->dumpFrameToFile(stream, frame, QCAMERA_DUMP_FRM_RAW);
             // Notify Preview callback frame
@@ -1248,6 +1253,7 @@ void QCamera2HardwareInterface::rdi_mode_stream_cb_routine(
                 memset(&cbArg, 0, sizeof(qcamera_callback_argm_t));
                 cbArg.cb_type    = QCAMERA_DATA_CALLBACK;
                 cbArg.msg_type   = CAMERA_MSG_PREVIEW_FRAME;
+                cbArg.frame_index = frame->frame_idx;
                 cbArg.data       = preview_mem;
                 cbArg.user_data = (void *) &frame->buf_idx;
                 cbArg.cookie     = stream;
@@ -1460,6 +1466,8 @@ void QCamera2HardwareInterface::video_stream_cb_routine(mm_camera_super_buf_t *s
                                    &pme->m_Video_BeautyInst);
         }
         pme->VisidonFaceBeauty((unsigned char*)srcBuffer, resolution, VISIDON_FACE_BEAUTY_VIDEO);
+        origMemObj->markCpuWrite(frame->buf_idx, 0, offset.frame_len);
+        origMemObj->flushCpuWrites(frame->buf_idx);
     }
 #endif
 
@@ -1631,6 +1639,8 @@ void QCamera2HardwareInterface::video_stream_cb_routine(mm_camera_super_buf_t *s
 	            if (status == 0) {
 	                unsigned char *tempBuff =  (unsigned char *)(origMemObj->getPtr(frame->buf_idx));
 	                getYUVBuffer(offset, tempBuff, dstBuffer, true);
+	                origMemObj->markCpuWrite(frame->buf_idx, 0, offset.frame_len);
+	                origMemObj->flushCpuWrites(frame->buf_idx);
 	            }
 	            videoMemObj = origMemObj;
 	        }
@@ -1670,6 +1680,7 @@ void QCamera2HardwareInterface::video_stream_cb_routine(mm_camera_super_buf_t *s
                 memset(&cbArg, 0, sizeof(qcamera_callback_argm_t));
                 cbArg.cb_type = QCAMERA_DATA_TIMESTAMP_CALLBACK;
                 cbArg.msg_type = CAMERA_MSG_VIDEO_FRAME;
+                cbArg.frame_index = frame->frame_idx;
                 cbArg.data = video_mem;
                 cbArg.timestamp = timeStamp;
                 int32_t rc = pme->m_cbNotifier.notifyCallback(cbArg);
@@ -1735,6 +1746,7 @@ void QCamera2HardwareInterface::video_stream_cb_routine(mm_camera_super_buf_t *s
                 memset(&cbArg, 0, sizeof(qcamera_callback_argm_t));
                 cbArg.cb_type = QCAMERA_DATA_TIMESTAMP_CALLBACK;
                 cbArg.msg_type = CAMERA_MSG_VIDEO_FRAME;
+                cbArg.frame_index = frame->frame_idx;
                 cbArg.data = video_mem;
                 cbArg.timestamp = timeStamp;
                 int32_t rc = pme->m_cbNotifier.notifyCallback(cbArg);
@@ -2584,7 +2596,8 @@ void QCamera2HardwareInterface::callback_stream_cb_routine(mm_camera_super_buf_t
     if (pme->mDataCb != NULL &&
             (pme->msgTypeEnabledWithLock(CAMERA_MSG_PREVIEW_FRAME) > 0) &&
             (!pme->mParameters.isSceneSelectionEnabled())) {
-        int32_t rc = pme->sendPreviewCallback(stream, previewMemObj, frame->buf_idx);
+        int32_t rc = pme->sendPreviewCallback(stream, previewMemObj,
+                frame->buf_idx, frame->frame_idx);
         if (NO_ERROR != rc) {
             ALOGE("%s: Preview callback was not sent succesfully", __func__);
         }
@@ -3071,6 +3084,32 @@ bool QCameraCbNotifier::matchPreviewNotifications(void *data,
     return false;
 }
 
+/*===========================================================================
+ * FUNCTION   : cbTraceStreamType
+ *
+ * DESCRIPTION: stream type reported in the frame trace for a callback
+ *
+ * PARAMETERS :
+ *   @msg_type : callback msg type
+ *
+ * RETURN     : cam_stream_type_t
+ *==========================================================================*/
+static cam_stream_type_t cbTraceStreamType(int32_t msg_type)
+{
+    switch (msg_type) {
+    case CAMERA_MSG_PREVIEW_FRAME:
+        return CAM_STREAM_TYPE_PREVIEW;
+    case CAMERA_MSG_VIDEO_FRAME:
+        return CAM_STREAM_TYPE_VIDEO;
+    case CAMERA_MSG_RAW_IMAGE:
+        return CAM_STREAM_TYPE_RAW;
+    case CAMERA_MSG_COMPRESSED_IMAGE:
+        return CAM_STREAM_TYPE_SNAPSHOT;
+    default:
+        return CAM_STREAM_TYPE_DEFAULT;
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : cbNotifyRoutine
  *
@@ -3098,7 +3137,7 @@ void * QCameraCbNotifier::cbNotifyRoutine(void * data)
     CDBG("%s: E", __func__);
     do {
         do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            ret = cmdThread->waitCmd();
             if (ret != 0 && errno != EINVAL) {
                 CDBG("%s: cam_sem_wait error (%s)",
                            __func__, strerror(errno));
@@ -3137,6 +3176,8 @@ void * QCameraCbNotifier::cbNotifyRoutine(void * data)
                     CDBG("%s: cb type %d received",
                           __func__,
                           cb->cb_type);
+                    CAM_FRAME_TRACE_SCOPE("QCameraCbNotifier_cb",
+                            cbTraceStreamType(cb->msg_type), cb->frame_index);
 
                     if (pme->mParent->msgTypeEnabledWithLock(cb->msg_type)) {
                         switch (cb->cb_type) {
@@ -3214,7 +3255,7 @@ void * QCameraCbNotifier::cbNotifyRoutine(void * data)
                                       #ifdef TCT_TSHDR_FEATURE
 						 /* MODIFIED-BEGIN by sichao.hu, 2016-06-16,BUG-2152849*/
 						 // have to check if it is -1 , or this key could be invalid in the parameter map
-                                            ||( pme->mParent->mParameters.getInt(QCameraParameters::KEY_TSPHOTOPROCESSMODE_HDR)>0)
+                                            ||( pme->mParent->mParameters.getFrameParams()->ts_photo_hdr>0)
                                             /* MODIFIED-END by sichao.hu,BUG-2152849*/
                                       #endif
                                          ){
@@ -3323,6 +3364,10 @@ int32_t QCameraCbNotifier::notifyCallback(qcamera_callback_argm_t &cbArgs)
     }
     memset(cbArg, 0, sizeof(qcamera_callback_argm_t));
     *cbArg = cbArgs;
+    if (0 != cbArg->frame_index) {
+        CAM_FRAME_TRACE("QCameraCbNotifier_enqueue",
+                cbTraceStreamType(cbArg->msg_type), cbArg->frame_index);
+    }
 
     if (mDataQ.enqueue((void *)cbArg)) {
         return mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
@@ -3362,6 +3407,7 @@ void QCameraCbNotifier::setCallbacks(camera_notify_callback notifyCb,
         mDataCbTimestamp = dataCbTimestamp;
         mCallbackCookie = callbackCookie;
         mActive = true;
+        mProcTh.setJobCoalescing(true);
         mProcTh.launch(cbNotifyRoutine, this);
     } else {
         ALOGE("%s : Camera callback notifier already initialized!",
@@ -682,7 +682,8 @@ QCameraPicChannel::~QCameraPicChannel()
 /*===========================================================================
  * FUNCTION   : takePicture
  *
- * DESCRIPTION: send request for queued snapshot frames
+ * DESCRIPTION: send request for queued snapshot frames. If frame selection
+ *              is requested without a shutter time, the request time is used.
  *
  * PARAMETERS :
  *   @buf : request buf info
@@ -693,6 +694,9 @@ QCameraPicChannel::~QCameraPicChannel()
  *==========================================================================*/
 int32_t QCameraPicChannel::takePicture (mm_camera_req_buf_t *buf)
 {
+    if ((buf->select_window_us != 0) && (buf->shutter_ts_ns == 0)) {
+        buf->shutter_ts_ns = (uint64_t)systemTime(SYSTEM_TIME_MONOTONIC);
+    }
     int32_t rc = m_camOps->request_super_buf(m_camHandle, m_handle, buf);
     return rc;
 }
@@ -29,10 +29,12 @@
 #define LOG_TAG "QCameraHWI_Mem"
 
 #include <string.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <utils/Errors.h>
 #include <utils/Log.h>
+#include <cutils/properties.h>
 #include <gralloc_priv.h>
 #include <QComOMXMetadata.h>
 #include "OMX_QCOMExtns.h"
@@ -96,12 +98,15 @@ QCameraMemory::~QCameraMemory()
  *   @index   : index of the buffer
  *   @cmd     : cache ops command
  *   @vaddr   : ptr to the virtual address
+ *   @offset  : offset of the range to maintain
+ *   @len     : length of the range, 0 for the whole buffer
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *==========================================================================*/
-int QCameraMemory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr)
+int QCameraMemory::cacheOpsInternal(uint32_t index, unsigned int cmd,
+        void *vaddr, size_t offset, size_t len)
 {
     if (!m_bCached) {
         // Memory is not cached, no need for cache ops
@@ -120,12 +125,18 @@ int QCameraMemory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vadd
 
     memset(&cache_inv_data, 0, sizeof(cache_inv_data));
     memset(&custom_data, 0, sizeof(custom_data));
-    cache_inv_data.vaddr = vaddr;
+    if ((0 == len) || (offset + len > mMemInfo[index].size)) {
+        offset = 0;
+        len = mMemInfo[index].size;
+    }
+    cache_inv_data.vaddr = (uint8_t *)vaddr + offset;
     cache_inv_data.fd = mMemInfo[index].fd;
     cache_inv_data.handle = mMemInfo[index].handle;
+    cache_inv_data.offset = ( /* FIXME: Should remove this after ION interface changes */ unsigned int)
+            offset;
     cache_inv_data.length =
             ( /* FIXME: Should remove this after ION interface changes */ unsigned int)
-            mMemInfo[index].size;
+            len;
     custom_data.cmd = cmd;
     custom_data.arg = (unsigned long)&cache_inv_data;
 
@@ -140,6 +151,186 @@ int QCameraMemory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vadd
     return ret;
 }
 
+/*===========================================================================
+ * FUNCTION   : cacheOpsTracked
+ *
+ * DESCRIPTION: issues the cache op planned by the cache tracker
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *   @plan    : op and range to maintain
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraMemory::cacheOpsTracked(uint32_t index,
+        const qcamera_cache_plan_t &plan)
+{
+    unsigned int cmd;
+
+    switch (plan.op) {
+    case QCAMERA_CACHE_OP_CLEAN:
+        cmd = ION_IOC_CLEAN_CACHES;
+        break;
+    case QCAMERA_CACHE_OP_INV:
+        cmd = ION_IOC_INV_CACHES;
+        break;
+    case QCAMERA_CACHE_OP_CLEAN_INV:
+        cmd = ION_IOC_CLEAN_INV_CACHES;
+        break;
+    default:
+        return OK;
+    }
+
+    if ((0 == plan.offset) && (plan.len >= mMemInfo[index].size)) {
+        return cacheOps(index, cmd);
+    }
+
+    // partial range, the subclass only knows how to maintain it all
+    void *vaddr = getPtr(index);
+    if ((NULL == vaddr) || ((void *)BAD_INDEX == vaddr)) {
+        return cacheOps(index, cmd);
+    }
+    return cacheOpsInternal(index, cmd, vaddr, plan.offset, plan.len);
+}
+
+/*===========================================================================
+ * FUNCTION   : syncForDevice
+ *
+ * DESCRIPTION: cache maintenance before a buffer is queued to the hardware.
+ *              Nothing is done unless the CPU reported writes to it.
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraMemory::syncForDevice(uint32_t index)
+{
+    if (!m_bCached) {
+        return OK;
+    }
+    if (index >= mBufferCount) {
+        ALOGE("%s: index %d out of bound [0, %d)", __func__, index, mBufferCount);
+        return BAD_INDEX;
+    }
+
+    return cacheOpsTracked(index,
+            mCacheTracker.toDevice(index, mMemInfo[index].size));
+}
+
+/*===========================================================================
+ * FUNCTION   : syncForCpu
+ *
+ * DESCRIPTION: cache maintenance after a buffer is dequeued from the
+ *              hardware
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraMemory::syncForCpu(uint32_t index)
+{
+    if (!m_bCached) {
+        return OK;
+    }
+    if (index >= mBufferCount) {
+        ALOGE("%s: index %d out of bound [0, %d)", __func__, index, mBufferCount);
+        return BAD_INDEX;
+    }
+
+    return cacheOpsTracked(index,
+            mCacheTracker.toCpu(index, mMemInfo[index].size));
+}
+
+/*===========================================================================
+ * FUNCTION   : flushCpuWrites
+ *
+ * DESCRIPTION: writes back the range reported by markCpuWrite, so that a
+ *              hardware or other process reader sees it
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraMemory::flushCpuWrites(uint32_t index)
+{
+    if (!m_bCached) {
+        return OK;
+    }
+    if (index >= mBufferCount) {
+        ALOGE("%s: index %d out of bound [0, %d)", __func__, index, mBufferCount);
+        return BAD_INDEX;
+    }
+
+    return cacheOpsTracked(index,
+            mCacheTracker.flush(index, mMemInfo[index].size));
+}
+
+/*===========================================================================
+ * FUNCTION   : markCpuWrite
+ *
+ * DESCRIPTION: reports a CPU write to a buffer. Any CPU code writing a
+ *              stream buffer must report it, otherwise the write may not
+ *              be flushed before the buffer goes back to the hardware.
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *   @offset  : offset of the written range
+ *   @len     : length of the written range
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::markCpuWrite(uint32_t index, size_t offset, size_t len)
+{
+    mCacheTracker.markCpuWrite(index, offset, len);
+}
+
+/*===========================================================================
+ * FUNCTION   : flushSuperBuf
+ *
+ * DESCRIPTION: flushes the reported CPU writes of all buffers of a super
+ *              buffer in one call
+ *
+ * PARAMETERS :
+ *   @frame   : super buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraMemory::flushSuperBuf(mm_camera_super_buf_t *frame)
+{
+    int rc = OK;
+
+    if (NULL == frame) {
+        return BAD_VALUE;
+    }
+
+    for (uint32_t i = 0; i < frame->num_bufs; i++) {
+        mm_camera_buf_def_t *buf = frame->bufs[i];
+        if ((NULL == buf) || (NULL == buf->mem_info)) {
+            continue;
+        }
+        QCameraMemory *memory = (QCameraMemory *)buf->mem_info;
+        int ret = memory->flushCpuWrites(buf->buf_idx);
+        if (OK != ret) {
+            rc = ret;
+        }
+    }
+
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : getFd
  *
@@ -210,6 +401,7 @@ void QCameraMemory::reset()
         mMemInfo[i].fd = -1;
         mMemInfo[i].main_ion_fd = -1;
     }
+    mCacheTracker.resetAll();
 
     return;
 }
@@ -412,6 +604,7 @@ void QCameraMemory::dealloc()
             mMemoryPool->releaseBuffer(mMemInfo[i], mStreamType);
         }
     }
+    mCacheTracker.resetAll();
 }
 
 /*===========================================================================
@@ -480,6 +673,7 @@ int QCameraMemory::allocOneBuffer(QCameraMemInfo &memInfo,
     memInfo.handle = ion_info_fd.handle;
     memInfo.size = alloc.len;
     memInfo.cached = cached;
+    memInfo.secure = (secure_mode == SECURE);
     memInfo.heap_id = heap_id;
 
     ALOGD("%s : ION buffer %lx with size %d allocated",
@@ -511,6 +705,8 @@ void QCameraMemory::deallocOneBuffer(QCameraMemInfo &memInfo)
     struct ion_handle_data handle_data;
 
     if (memInfo.fd >= 0) {
+        // the fd number may come back with the next allocation
+        mm_camera_invalidate_buf_mapping(memInfo.fd);
         close(memInfo.fd);
         memInfo.fd = -1;
     }
@@ -536,7 +732,22 @@ void QCameraMemory::deallocOneBuffer(QCameraMemInfo &memInfo)
  * RETURN     : None
  *==========================================================================*/
 QCameraMemoryPool::QCameraMemoryPool()
-{
+    : mTotalBytes(0),
+      mMaxBytes((size_t)QCAMERA_MEM_POOL_MAX_MB << 20),
+      mIdleBytes((size_t)QCAMERA_MEM_POOL_IDLE_MB << 20),
+      mSeq(0),
+      mNumConfigs(0),
+      mOutstandingBytes(0),
+      mPeakBytes(0),
+      mWarmUpThread(0),
+      mWarmUpActive(false),
+      mWarmUpAbort(false),
+      mHits(0),
+      mMisses(0),
+      mEvictions(0),
+      mWarmUpAllocs(0)
+{
+    memset(mConfig, 0, sizeof(mConfig));
     pthread_mutex_init(&mLock, NULL);
 }
 
@@ -556,6 +767,204 @@ QCameraMemoryPool::~QCameraMemoryPool()
     pthread_mutex_destroy(&mLock);
 }
 
+/*===========================================================================
+ * FUNCTION   : sizeClass
+ *
+ * DESCRIPTION: maps a buffer size to its size class. Every power of two is
+ *              split in 4 classes, so buffers of one class differ by less
+ *              than 25% in size.
+ *
+ * PARAMETERS :
+ *   @size    : size of the buffer
+ *
+ * RETURN     : size class, below QCAMERA_MEM_POOL_CLASSES
+ *==========================================================================*/
+uint32_t QCameraMemoryPool::sizeClass(size_t size)
+{
+    if (size < 4) {
+        return (uint32_t)size;
+    }
+    if ((uint64_t)size > 0xFFFFFFFFULL) {
+        return QCAMERA_MEM_POOL_CLASSES - 1;
+    }
+
+    uint32_t log2 = 31U - (uint32_t)__builtin_clz((uint32_t)size);
+    return log2 * 4U + (uint32_t)((size >> (log2 - 2)) & 3U);
+}
+
+/*===========================================================================
+ * FUNCTION   : insertLocked
+ *
+ * DESCRIPTION: adds a released buffer to the bucket of its size class,
+ *              behind the buffers released before it
+ *
+ * PARAMETERS :
+ *   @memInfo : reference to struct that stores additional memory allocation info
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::insertLocked(
+        const QCameraMemory::QCameraMemInfo &memInfo)
+{
+    PoolEntry entry;
+
+    entry.memInfo = memInfo;
+    entry.seq = mSeq++;
+    mBuckets[sizeClass(memInfo.size)].push_back(entry);
+    mTotalBytes += memInfo.size;
+}
+
+/*===========================================================================
+ * FUNCTION   : trimLocked
+ *
+ * DESCRIPTION: frees the least recently released buffers until the pool
+ *              holds no more than maxBytes
+ *
+ * PARAMETERS :
+ *   @maxBytes : byte cap to trim the pool to
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::trimLocked(size_t maxBytes)
+{
+    while (mTotalBytes > maxBytes) {
+        // every bucket is in release order, the oldest buffer is one of
+        // the bucket fronts
+        int oldest = -1;
+        for (int i = 0; i < QCAMERA_MEM_POOL_CLASSES; i++) {
+            if (!mBuckets[i].empty() && ((oldest < 0) ||
+                    (mBuckets[i].begin()->seq <
+                    mBuckets[oldest].begin()->seq))) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) {
+            mTotalBytes = 0;
+            break;
+        }
+
+        List<PoolEntry>::iterator it = mBuckets[oldest].begin();
+        mTotalBytes -= it->memInfo.size;
+        QCameraMemory::deallocOneBuffer(it->memInfo);
+        mBuckets[oldest].erase(it);
+        mEvictions++;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : trackLocked
+ *
+ * DESCRIPTION: accounts a buffer handed out or given back by the session.
+ *              The buffers held at the session peak are remembered as the
+ *              configuration to warm up for the next session.
+ *
+ * PARAMETERS :
+ *   @memInfo  : reference to struct that stores additional memory allocation info
+ *   @allocated: true if the buffer was handed out, false if given back
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::trackLocked(
+        const QCameraMemory::QCameraMemInfo &memInfo, bool allocated)
+{
+    ConfigEntry *config = NULL;
+
+    for (uint32_t i = 0; i < mNumConfigs; i++) {
+        if ((mConfig[i].heap_id == memInfo.heap_id) &&
+                (mConfig[i].size == memInfo.size) &&
+                (mConfig[i].cached == memInfo.cached)) {
+            config = &mConfig[i];
+            break;
+        }
+    }
+
+    if (allocated) {
+        mOutstandingBytes += memInfo.size;
+        if (NULL == config && mNumConfigs < QCAMERA_MEM_POOL_MAX_CONFIGS) {
+            config = &mConfig[mNumConfigs++];
+            memset(config, 0, sizeof(*config));
+            config->heap_id = memInfo.heap_id;
+            config->size = memInfo.size;
+            config->cached = memInfo.cached;
+        }
+        if (NULL != config) {
+            config->outstanding++;
+        }
+        if (mOutstandingBytes >= mPeakBytes) {
+            mPeakBytes = mOutstandingBytes;
+            for (uint32_t i = 0; i < mNumConfigs; i++) {
+                mConfig[i].count = mConfig[i].outstanding;
+            }
+        }
+    } else {
+        if (mOutstandingBytes >= memInfo.size) {
+            mOutstandingBytes -= memInfo.size;
+        } else {
+            mOutstandingBytes = 0;
+        }
+        if ((NULL != config) && (config->outstanding > 0)) {
+            config->outstanding--;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : countLocked
+ *
+ * DESCRIPTION: counts the cached buffers of one kind
+ *
+ * PARAMETERS :
+ *   @heap_id : type of heap
+ *   @size    : exact size of the buffer
+ *   @cached  : whether the buffer is cached
+ *
+ * RETURN     : number of cached buffers
+ *==========================================================================*/
+uint32_t QCameraMemoryPool::countLocked(unsigned int heap_id, size_t size,
+        bool cached)
+{
+    uint32_t count = 0;
+    List<PoolEntry> &bucket = mBuckets[sizeClass(size)];
+
+    for (List<PoolEntry>::iterator it = bucket.begin();
+            it != bucket.end(); it++) {
+        if ((it->memInfo.size == size) &&
+                (it->memInfo.heap_id == heap_id) &&
+                (it->memInfo.cached == cached)) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/*===========================================================================
+ * FUNCTION   : warmCountLocked
+ *
+ * DESCRIPTION: counts the buffers of one kind the session has or can take
+ *              right away, i.e. cached plus handed out to its streams
+ *
+ * PARAMETERS :
+ *   @index   : index of the kind in mConfig, kinds are only appended
+ *              while a session runs
+ *   @config  : kind of buffer
+ *
+ * RETURN     : number of buffers
+ *==========================================================================*/
+uint32_t QCameraMemoryPool::warmCountLocked(uint32_t index,
+        const ConfigEntry &config)
+{
+    uint32_t count = countLocked(config.heap_id, config.size, config.cached);
+
+    if ((index < mNumConfigs) &&
+            (mConfig[index].heap_id == config.heap_id) &&
+            (mConfig[index].size == config.size) &&
+            (mConfig[index].cached == config.cached)) {
+        count += mConfig[index].outstanding;
+    }
+    return count;
+}
+
 /*===========================================================================
  * FUNCTION   : releaseBuffer
  *
@@ -569,11 +978,18 @@ QCameraMemoryPool::~QCameraMemoryPool()
  *==========================================================================*/
 void QCameraMemoryPool::releaseBuffer(
         struct QCameraMemory::QCameraMemInfo &memInfo,
-        cam_stream_type_t streamType)
+        cam_stream_type_t /*streamType*/)
 {
     pthread_mutex_lock(&mLock);
 
-    mPools[streamType].push_back(memInfo);
+    trackLocked(memInfo, false);
+    if (memInfo.secure) {
+        // secure buffers come from their own heap and are never shared
+        QCameraMemory::deallocOneBuffer(memInfo);
+    } else {
+        insertLocked(memInfo);
+        trimLocked(mMaxBytes);
+    }
 
     pthread_mutex_unlock(&mLock);
 }
@@ -589,25 +1005,19 @@ void QCameraMemoryPool::releaseBuffer(
  *==========================================================================*/
 void QCameraMemoryPool::clear()
 {
-    pthread_mutex_lock(&mLock);
-
-    for (int i = CAM_STREAM_TYPE_DEFAULT; i < CAM_STREAM_TYPE_MAX; i++ ) {
-        List<struct QCameraMemory::QCameraMemInfo>::iterator it;
-        it = mPools[i].begin();
-        for( ; it != mPools[i].end() ; it++) {
-            QCameraMemory::deallocOneBuffer(*it);
-        }
-
-        mPools[i].clear();
-    }
+    stopWarmUp();
 
+    pthread_mutex_lock(&mLock);
+    trimLocked(0);
     pthread_mutex_unlock(&mLock);
 }
 
 /*===========================================================================
  * FUNCTION   : findBufferLocked
  *
- * DESCRIPTION: search for a appropriate cached buffer
+ * DESCRIPTION: search for a appropriate cached buffer. The smallest cached
+ *              buffer large enough is taken, as long as it wastes less than
+ *              half of the requested size.
  *
  * PARAMETERS :
  *   @memInfo : reference to struct that stores additional memory allocation info
@@ -624,42 +1034,40 @@ int QCameraMemoryPool::findBufferLocked(
         struct QCameraMemory::QCameraMemInfo &memInfo, unsigned int heap_id,
         size_t size, bool cached, cam_stream_type_t streamType)
 {
-    int rc = NAME_NOT_FOUND;
-
-    if (mPools[streamType].empty()) {
-        return NAME_NOT_FOUND;
-    }
-
-    List<struct QCameraMemory::QCameraMemInfo>::iterator it = mPools[streamType].begin();
+    size_t maxSize = size + size / 2;
     if (streamType == CAM_STREAM_TYPE_OFFLINE_PROC) {
-        for( ; it != mPools[streamType].end() ; it++) {
-            if( ((*it).size == size) &&
-                    ((*it).heap_id == heap_id) &&
-                    ((*it).cached == cached) ) {
-                memInfo = *it;
-                ALOGE("%s : Found buffer %lx size %d",
-                        __func__, (unsigned long)memInfo.handle, memInfo.size);
-                mPools[streamType].erase(it);
-                rc = NO_ERROR;
-                break;
+        // offline reprocess buffers are mapped with their exact size
+        maxSize = size;
+    }
+
+    uint32_t last = sizeClass(maxSize);
+    for (uint32_t cls = sizeClass(size); cls <= last; cls++) {
+        List<PoolEntry>::iterator best = mBuckets[cls].end();
+        List<PoolEntry>::iterator it = mBuckets[cls].begin();
+        for ( ; it != mBuckets[cls].end(); it++) {
+            if ((it->memInfo.size >= size) &&
+                    (it->memInfo.size <= maxSize) &&
+                    (it->memInfo.heap_id == heap_id) &&
+                    (it->memInfo.cached == cached) &&
+                    ((best == mBuckets[cls].end()) ||
+                    (it->memInfo.size < best->memInfo.size))) {
+                best = it;
             }
         }
-    } else {
-        for( ; it != mPools[streamType].end() ; it++) {
-            if(((*it).size >= size) &&
-                    ((*it).heap_id == heap_id) &&
-                    ((*it).cached == cached) ) {
-                memInfo = *it;
-                ALOGE("%s : Found buffer %lx size %d",
-                        __func__, (unsigned long)memInfo.handle, memInfo.size);
-                mPools[streamType].erase(it);
-                rc = NO_ERROR;
-                break;
-            }
+
+        // classes are ordered by size, the first fit found is the best
+        if (best != mBuckets[cls].end()) {
+            memInfo = best->memInfo;
+            CDBG("%s : Found buffer %lx size %zu for %zu",
+                    __func__, (unsigned long)memInfo.handle,
+                    memInfo.size, size);
+            mTotalBytes -= memInfo.size;
+            mBuckets[cls].erase(best);
+            return NO_ERROR;
         }
     }
 
-    return rc;
+    return NAME_NOT_FOUND;
 }
 
 /*===========================================================================
@@ -684,20 +1092,218 @@ int QCameraMemoryPool::allocateBuffer(
         size_t size, bool cached, cam_stream_type_t streamType,
         uint32_t secure_mode)
 {
-    int rc = NO_ERROR;
+    int rc = NAME_NOT_FOUND;
 
     pthread_mutex_lock(&mLock);
+    if (secure_mode != SECURE) {
+        rc = findBufferLocked(memInfo, heap_id, size, cached, streamType);
+    }
+    if (NO_ERROR == rc) {
+        mHits++;
+        trackLocked(memInfo, true);
+    }
+    pthread_mutex_unlock(&mLock);
 
-    rc = findBufferLocked(memInfo, heap_id, size, cached, streamType);
-    if (NAME_NOT_FOUND == rc ) {
+    if (NAME_NOT_FOUND == rc) {
         CDBG_HIGH("%s : Buffer not found!", __func__);
         rc = QCameraMemory::allocOneBuffer(memInfo, heap_id, size, cached,
                  secure_mode);
+        if (NO_ERROR == rc) {
+            pthread_mutex_lock(&mLock);
+            mMisses++;
+            trackLocked(memInfo, true);
+            pthread_mutex_unlock(&mLock);
+        }
     }
 
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : startSession
+ *
+ * DESCRIPTION: called when a camera session opens. Reloads the pool caps
+ *              and starts preallocating the buffers the last session held
+ *              at its peak, unless disabled by persist.camera.mem.warmup.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::startSession()
+{
+    char value[PROPERTY_VALUE_MAX];
+    bool warmUpEnabled;
+
+    size_t maxBytes = (size_t)QCAMERA_MEM_POOL_MAX_MB << 20;
+    if (property_get("persist.camera.mem.pool_mb", value, NULL) > 0) {
+        maxBytes = (size_t)atoi(value) << 20;
+    }
+    size_t idleBytes = (size_t)QCAMERA_MEM_POOL_IDLE_MB << 20;
+    if (property_get("persist.camera.mem.pool_idle_mb", value, NULL) > 0) {
+        idleBytes = (size_t)atoi(value) << 20;
+    }
+    property_get("persist.camera.mem.warmup", value, "1");
+    warmUpEnabled = (atoi(value) > 0);
+
+    stopWarmUp();
+
+    pthread_mutex_lock(&mLock);
+    mMaxBytes = maxBytes;
+    mIdleBytes = (idleBytes < maxBytes) ? idleBytes : maxBytes;
+    mHits = 0;
+    mMisses = 0;
+    mEvictions = 0;
+    mWarmUpAllocs = 0;
+    mPeakBytes = 0;
+    trimLocked(mMaxBytes);
+
+    // forget the kinds of buffer the last session did not hold at its peak
+    uint32_t numConfigs = 0;
+    bool warmUpNeeded = false;
+    for (uint32_t i = 0; i < mNumConfigs; i++) {
+        if ((mConfig[i].count > 0) || (mConfig[i].outstanding > 0)) {
+            warmUpNeeded |= (mConfig[i].count > 0);
+            mConfig[numConfigs++] = mConfig[i];
+        }
+    }
+    mNumConfigs = numConfigs;
+
+    if (warmUpEnabled && warmUpNeeded) {
+        mWarmUpAbort = false;
+        if (pthread_create(&mWarmUpThread, NULL, warmUpRoutine, this) == 0) {
+            pthread_setname_np(mWarmUpThread, "CAM_memWarmUp");
+            mWarmUpActive = true;
+        } else {
+            ALOGE("%s: Failed to start memory pool warm-up", __func__);
+        }
+    }
     pthread_mutex_unlock(&mLock);
+}
 
-    return rc;
+/*===========================================================================
+ * FUNCTION   : endSession
+ *
+ * DESCRIPTION: called when a camera session closes. Trims the pool to the
+ *              idle cap, the rest is kept for the next session.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::endSession()
+{
+    stopWarmUp();
+
+    pthread_mutex_lock(&mLock);
+    CDBG_HIGH("%s: hits %u misses %u evictions %u warm-up %u, "
+            "peak %zu bytes, pooled %zu bytes",
+            __func__, mHits, mMisses, mEvictions, mWarmUpAllocs,
+            mPeakBytes, mTotalBytes);
+    trimLocked(mIdleBytes);
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : stopWarmUp
+ *
+ * DESCRIPTION: aborts the warm-up pass if still running and waits for it
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::stopWarmUp()
+{
+    pthread_mutex_lock(&mLock);
+    if (!mWarmUpActive) {
+        pthread_mutex_unlock(&mLock);
+        return;
+    }
+    mWarmUpAbort = true;
+    pthread_mutex_unlock(&mLock);
+
+    pthread_join(mWarmUpThread, NULL);
+
+    pthread_mutex_lock(&mLock);
+    mWarmUpActive = false;
+    mWarmUpAbort = false;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : warmUpRoutine
+ *
+ * DESCRIPTION: thread entry of the warm-up pass
+ *
+ * PARAMETERS :
+ *   @data    : ptr to the QCameraMemoryPool object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void *QCameraMemoryPool::warmUpRoutine(void *data)
+{
+    QCameraMemoryPool *pme = (QCameraMemoryPool *)data;
+
+    pme->warmUp();
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : warmUp
+ *
+ * DESCRIPTION: preallocates the buffers of the last session peak that are
+ *              not already cached. Allocation runs outside the pool lock so
+ *              that streams can take the buffers as soon as they land.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::warmUp()
+{
+    ConfigEntry config[QCAMERA_MEM_POOL_MAX_CONFIGS];
+    uint32_t numConfigs;
+
+    pthread_mutex_lock(&mLock);
+    numConfigs = mNumConfigs;
+    memcpy(config, mConfig, sizeof(ConfigEntry) * numConfigs);
+    pthread_mutex_unlock(&mLock);
+
+    for (uint32_t i = 0; i < numConfigs; i++) {
+        for (;;) {
+            QCameraMemory::QCameraMemInfo memInfo;
+
+            pthread_mutex_lock(&mLock);
+            bool done = mWarmUpAbort ||
+                    (warmCountLocked(i, config[i]) >= config[i].count) ||
+                    (mTotalBytes + config[i].size > mMaxBytes);
+            pthread_mutex_unlock(&mLock);
+            if (done) {
+                break;
+            }
+
+            memset(&memInfo, 0, sizeof(memInfo));
+            if (QCameraMemory::allocOneBuffer(memInfo, config[i].heap_id,
+                    config[i].size, config[i].cached, NON_SECURE) != NO_ERROR) {
+                ALOGE("%s: Warm-up allocation of %zu bytes failed",
+                        __func__, config[i].size);
+                return;
+            }
+
+            pthread_mutex_lock(&mLock);
+            if (mWarmUpAbort ||
+                    (warmCountLocked(i, config[i]) >= config[i].count) ||
+                    (mTotalBytes + memInfo.size > mMaxBytes)) {
+                pthread_mutex_unlock(&mLock);
+                QCameraMemory::deallocOneBuffer(memInfo);
+                return;
+            }
+            insertLocked(memInfo);
+            mWarmUpAllocs++;
+            pthread_mutex_unlock(&mLock);
+        }
+    }
 }
 
 /*===========================================================================
@@ -1771,6 +2377,10 @@ int QCameraGrallocMemory::displayBuffer(uint32_t index)
 
             mMappableBuffers++;
         }
+        if (dequeuedIdx != BAD_INDEX) {
+            // consumers of the window may have written it
+            mCacheTracker.reset((uint32_t)dequeuedIdx);
+        }
     } else {
         CDBG_HIGH("%s: dequeue_buffer, no free buffer from display now", __func__);
     }
@@ -1890,6 +2500,10 @@ int32_t QCameraGrallocMemory::dequeueBuffer()
 
             mMappableBuffers++;
         }
+        if (dequeuedIdx != BAD_INDEX) {
+            // consumers of the window may have written it
+            mCacheTracker.reset((uint32_t)dequeuedIdx);
+        }
     } else {
         CDBG_HIGH("%s: dequeue_buffer, no free buffer from display now", __func__);
     }
@@ -2123,6 +2737,8 @@ void QCameraGrallocMemory::deallocate()
     CDBG("%s: E ", __FUNCTION__);
 
     for (int cnt = 0; cnt < mMappableBuffers; cnt++) {
+        // the window owns the buffer from here on and may free it
+        mm_camera_invalidate_buf_mapping(mMemInfo[cnt].fd);
         mCameraMemory[cnt]->release(mCameraMemory[cnt]);
         struct ion_handle_data ion_handle;
         memset(&ion_handle, 0, sizeof(ion_handle));
@@ -35,6 +35,7 @@
 #include <utils/List.h>
 #include <qdMetaData.h>
 #include <utils/Timers.h>
+#include "QCameraCacheTracker.h"
 
 extern "C" {
 #include <sys/types.h>
@@ -55,16 +56,25 @@ class QCameraMemory {
 public:
     int cleanCache(uint32_t index)
     {
+        mCacheTracker.onFullOp(index, QCAMERA_CACHE_OP_CLEAN);
         return cacheOps(index, ION_IOC_CLEAN_CACHES);
     }
     int invalidateCache(uint32_t index)
     {
+        mCacheTracker.onFullOp(index, QCAMERA_CACHE_OP_INV);
         return cacheOps(index, ION_IOC_INV_CACHES);
     }
     int cleanInvalidateCache(uint32_t index)
     {
+        mCacheTracker.onFullOp(index, QCAMERA_CACHE_OP_CLEAN_INV);
         return cacheOps(index, ION_IOC_CLEAN_INV_CACHES);
     }
+    // tracked cache maintenance, only issues what the transition needs
+    int syncForDevice(uint32_t index);
+    int syncForCpu(uint32_t index);
+    int flushCpuWrites(uint32_t index);
+    void markCpuWrite(uint32_t index, size_t offset, size_t len);
+    static int flushSuperBuf(mm_camera_super_buf_t *frame);
     int getFd(uint32_t index) const;
     ssize_t getSize(uint32_t index) const;
     uint8_t getCnt() const;
@@ -105,6 +115,7 @@ protected:
         ion_user_handle_t handle;
         size_t size;
         bool cached;
+        bool secure;
         unsigned int heap_id;
     };
 
@@ -114,7 +125,9 @@ protected:
     static int allocOneBuffer(struct QCameraMemInfo &memInfo,
             unsigned int heap_id, size_t size, bool cached, uint32_t is_secure);
     static void deallocOneBuffer(struct QCameraMemInfo &memInfo);
-    int cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr);
+    int cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr,
+            size_t offset = 0, size_t len = 0);
+    int cacheOpsTracked(uint32_t index, const qcamera_cache_plan_t &plan);
 
     bool m_bCached;
     uint8_t mBufferCount;
@@ -122,8 +135,22 @@ protected:
     QCameraMemoryPool *mMemoryPool;
     cam_stream_type_t mStreamType;
     cam_stream_buf_type mBufType;
+    QCameraCacheTracker mCacheTracker;
 };
 
+// size classes split every power of two in 4
+#define QCAMERA_MEM_POOL_CLASSES (32 * 4)
+// distinct buffer configurations remembered for warm-up
+#define QCAMERA_MEM_POOL_MAX_CONFIGS 16
+// pool caps in MB, persist.camera.mem.pool_mb and .pool_idle_mb
+#define QCAMERA_MEM_POOL_MAX_MB 96
+#define QCAMERA_MEM_POOL_IDLE_MB 32
+
+// Pool of released ion buffers, reused best fit by size class. The pool
+// outlives camera sessions (see QCamera2Factory::getMemoryPool): it is
+// capped in bytes with LRU eviction, trimmed to an idle cap when the
+// session ends, and can preallocate the buffers of the last session when
+// the next one starts.
 class QCameraMemoryPool {
 
 public:
@@ -137,14 +164,60 @@ public:
     void releaseBuffer(struct QCameraMemory::QCameraMemInfo &memInfo,
             cam_stream_type_t streamType);
     void clear();
+    void startSession();
+    void endSession();
 
 protected:
 
+    struct PoolEntry {
+        QCameraMemory::QCameraMemInfo memInfo;
+        uint64_t seq;           // release order, for LRU eviction
+    };
+
+    // buffers of one kind held by the session
+    struct ConfigEntry {
+        unsigned int heap_id;
+        size_t size;
+        bool cached;
+        uint32_t outstanding;
+        uint32_t count;         // in the last session peak configuration
+    };
+
     int findBufferLocked(struct QCameraMemory::QCameraMemInfo &memInfo,
             unsigned int heap_id, size_t size, bool cached,
             cam_stream_type_t streamType);
+    void insertLocked(const QCameraMemory::QCameraMemInfo &memInfo);
+    void trimLocked(size_t maxBytes);
+    void trackLocked(const QCameraMemory::QCameraMemInfo &memInfo,
+            bool allocated);
+    uint32_t countLocked(unsigned int heap_id, size_t size, bool cached);
+    uint32_t warmCountLocked(uint32_t index, const ConfigEntry &config);
+    void stopWarmUp();
+    void warmUp();
+    static void *warmUpRoutine(void *data);
+    static uint32_t sizeClass(size_t size);
+
+    android::List<PoolEntry> mBuckets[QCAMERA_MEM_POOL_CLASSES];
+    size_t mTotalBytes;
+    size_t mMaxBytes;           // cap while a session is open
+    size_t mIdleBytes;          // cap between sessions
+    uint64_t mSeq;
+
+    ConfigEntry mConfig[QCAMERA_MEM_POOL_MAX_CONFIGS];
+    uint32_t mNumConfigs;
+    size_t mOutstandingBytes;
+    size_t mPeakBytes;
+
+    pthread_t mWarmUpThread;
+    bool mWarmUpActive;
+    bool mWarmUpAbort;
+
+    // stats of the current session
+    uint32_t mHits;
+    uint32_t mMisses;
+    uint32_t mEvictions;
+    uint32_t mWarmUpAllocs;
 
-    android::List<QCameraMemory::QCameraMemInfo> mPools[CAM_STREAM_TYPE_MAX];
     pthread_mutex_t mLock;
 };
 
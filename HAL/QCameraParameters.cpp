@@ -35,6 +35,7 @@
 #include <utils/Log.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <gralloc_priv.h>
 #include <sys/sysinfo.h>
 #include "QCameraBufferMaps.h"
@@ -802,6 +803,36 @@ const QCameraParameters::QCameraMap<int>
     { VALUE_HIGH_QUALITY,  2 }
 };
 
+/* Parameters that only hold a setting, re-sending the committed value does
+ * nothing but make the backend re-apply it. Commands and parameters the
+ * backend changes on its own (locks, LED, capture config) are always sent. */
+const cam_intf_parm_type_t QCameraParameters::DELTA_PARAMS[] = {
+    CAM_INTF_PARM_EFFECT,
+    CAM_INTF_PARM_BRIGHTNESS,
+    CAM_INTF_PARM_SHARPNESS,
+    CAM_INTF_PARM_SATURATION,
+    CAM_INTF_PARM_CONTRAST,
+    CAM_INTF_PARM_SCE_FACTOR,
+    CAM_INTF_PARM_ZOOM,
+    CAM_INTF_PARM_ISO,
+    CAM_INTF_PARM_EXPOSURE_TIME,
+    CAM_INTF_PARM_EXPOSURE_COMPENSATION,
+    CAM_INTF_PARM_WHITE_BALANCE,
+    CAM_INTF_PARM_ANTIBANDING,
+    CAM_INTF_PARM_MCE,
+    CAM_INTF_PARM_DIS_ENABLE,
+    CAM_INTF_PARM_TINTLESS,
+    CAM_INTF_PARM_CDS_MODE,
+    CAM_INTF_PARM_TEMPORAL_DENOISE,
+    CAM_INTF_PARM_WAVELET_DENOISE,
+    CAM_INTF_PARM_REDEYE_REDUCTION,
+    CAM_INTF_PARM_AEC_ALGO_TYPE,
+    CAM_INTF_PARM_ASD_ENABLE,
+    CAM_INTF_PARM_FPS_RANGE,
+    CAM_INTF_PARM_STATS_DEBUG_MASK,
+    CAM_INTF_PARM_STATS_AF_PAAF
+};
+
 /* MODIFIED-BEGIN by sichao.hu, 2016-06-16,BUG-2152849*/
 const int KEY_INVALID=-1;
 
@@ -852,6 +883,7 @@ QCameraParameters::QCameraParameters()
       mAppPreviewFormat(CAM_FORMAT_YUV_420_NV21),
       mPictureFormat(CAM_FORMAT_JPEG),
       m_bNeedRestart(false),
+      m_bParamDiff(true),
       m_bNoDisplayMode(false),
       m_bWNROn(false),
       m_bTNRPreviewOn(false),
@@ -934,6 +966,14 @@ QCameraParameters::QCameraParameters()
     property_get("persist.camera.ltmforseemore", value, "1");
     m_bLtmForSeeMoreEnabled = atoi(value);
 
+    // run only the updateParameters handlers whose keys changed
+    property_get("persist.camera.param.diff", value, "1");
+    m_bParamDiff = atoi(value) > 0 ? true : false;
+
+    // send only the set batch entries that changed since the last commit
+    property_get("persist.camera.param.delta", value, "1");
+    m_bParamDelta = atoi(value) > 0 ? true : false;
+
     memset(&m_LiveSnapshotSize, 0, sizeof(m_LiveSnapshotSize));
     memset(&m_default_fps_range, 0, sizeof(m_default_fps_range));
     memset(&m_hfrFpsRange, 0, sizeof(m_hfrFpsRange));
@@ -947,6 +987,23 @@ QCameraParameters::QCameraParameters()
     mBufBatchCnt = 0;
     mRotation = 0;
     mJpegRotation = 0;
+    memset(m_FrameParams, 0, sizeof(m_FrameParams));
+    m_pFrameParams = &m_FrameParams[0];
+    m_nParamGen = 1;
+    m_pFlatParams = NULL;
+    memset(m_DeltaSlot, 0, sizeof(m_DeltaSlot));
+    for (size_t i = 0; i < PARAM_MAP_SIZE(DELTA_PARAMS); i++) {
+        if (i >= PARAM_DELTA_ENTRIES) {
+            ALOGE("%s: Only %d delta parameters are tracked", __func__,
+                    PARAM_DELTA_ENTRIES);
+            break;
+        }
+        m_DeltaSlot[DELTA_PARAMS[i]] = (uint8_t)(i + 1);
+    }
+    resetSentParams();
+    m_nSetBatchDepth = 0;
+    m_bSetBatchOpen = false;
+    m_bSetBatchPending = false;
 }
 
 /*===========================================================================
@@ -982,6 +1039,7 @@ QCameraParameters::QCameraParameters(const String8 &params)
     mAppPreviewFormat(CAM_FORMAT_YUV_420_NV21),
     mPictureFormat(CAM_FORMAT_JPEG),
     m_bNeedRestart(false),
+    m_bParamDiff(true),
     m_bNoDisplayMode(false),
     m_bWNROn(false),
     m_bTNRPreviewOn(false),
@@ -1047,6 +1105,16 @@ QCameraParameters::QCameraParameters(const String8 &params)
     mCurPPCount = 0;
     mRotation = 0;
     mJpegRotation = 0;
+    memset(m_FrameParams, 0, sizeof(m_FrameParams));
+    m_pFrameParams = &m_FrameParams[0];
+    m_nParamGen = 1;
+    m_pFlatParams = NULL;
+    m_bParamDelta = false;
+    memset(m_DeltaSlot, 0, sizeof(m_DeltaSlot));
+    resetSentParams();
+    m_nSetBatchDepth = 0;
+    m_bSetBatchOpen = false;
+    m_bSetBatchPending = false;
 }
 
 /*===========================================================================
@@ -1061,6 +1129,284 @@ QCameraParameters::QCameraParameters(const String8 &params)
 QCameraParameters::~QCameraParameters()
 {
     deinit();
+    if (m_pFlatParams != NULL) {
+        putFlatParams(m_pFlatParams->str);
+        m_pFlatParams = NULL;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : set
+ *
+ * DESCRIPTION: set a parameter, the parameter generation is bumped only if
+ *              the value changes
+ *
+ * PARAMETERS :
+ *   @key     : parameter key
+ *   @value   : parameter value
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::set(const char *key, const char *value)
+{
+    const char *prev = CameraParameters::get(key);
+    if ((prev != NULL) && (value != NULL) && !strcmp(prev, value)) {
+        return;
+    }
+    CameraParameters::set(key, value);
+    __atomic_add_fetch(&m_nParamGen, 1, __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : set
+ *
+ * DESCRIPTION: set an integer parameter
+ *
+ * PARAMETERS :
+ *   @key     : parameter key
+ *   @value   : parameter value
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::set(const char *key, int value)
+{
+    char str[16];
+    snprintf(str, sizeof(str), "%d", value);
+    set(key, str);
+}
+
+/*===========================================================================
+ * FUNCTION   : setFloat
+ *
+ * DESCRIPTION: set a float parameter
+ *
+ * PARAMETERS :
+ *   @key     : parameter key
+ *   @value   : parameter value
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setFloat(const char *key, float value)
+{
+    char str[16];
+    snprintf(str, sizeof(str), "%g", value);
+    set(key, str);
+}
+
+/*===========================================================================
+ * FUNCTION   : remove
+ *
+ * DESCRIPTION: remove a parameter
+ *
+ * PARAMETERS :
+ *   @key     : parameter key
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::remove(const char *key)
+{
+    if (CameraParameters::get(key) == NULL) {
+        return;
+    }
+    CameraParameters::remove(key);
+    __atomic_add_fetch(&m_nParamGen, 1, __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPreviewSize
+ *
+ * DESCRIPTION: set preview size parameter
+ *
+ * PARAMETERS :
+ *   @width   : preview width
+ *   @height  : preview height
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setPreviewSize(int width, int height)
+{
+    char str[32];
+    snprintf(str, sizeof(str), "%dx%d", width, height);
+    set(KEY_PREVIEW_SIZE, str);
+}
+
+/*===========================================================================
+ * FUNCTION   : setVideoSize
+ *
+ * DESCRIPTION: set video size parameter
+ *
+ * PARAMETERS :
+ *   @width   : video width
+ *   @height  : video height
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setVideoSize(int width, int height)
+{
+    char str[32];
+    snprintf(str, sizeof(str), "%dx%d", width, height);
+    set(KEY_VIDEO_SIZE, str);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPictureSize
+ *
+ * DESCRIPTION: set picture size parameter
+ *
+ * PARAMETERS :
+ *   @width   : picture width
+ *   @height  : picture height
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setPictureSize(int width, int height)
+{
+    char str[32];
+    snprintf(str, sizeof(str), "%dx%d", width, height);
+    set(KEY_PICTURE_SIZE, str);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPreviewFormat
+ *
+ * DESCRIPTION: set preview format parameter
+ *
+ * PARAMETERS :
+ *   @format  : preview format string
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setPreviewFormat(const char *format)
+{
+    set(KEY_PREVIEW_FORMAT, format);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPictureFormat
+ *
+ * DESCRIPTION: set picture format parameter
+ *
+ * PARAMETERS :
+ *   @format  : picture format string
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setPictureFormat(const char *format)
+{
+    set(KEY_PICTURE_FORMAT, format);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPreviewFrameRate
+ *
+ * DESCRIPTION: set legacy preview frame rate parameter
+ *
+ * PARAMETERS :
+ *   @fps     : frame rate
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setPreviewFrameRate(int fps)
+{
+    set(KEY_PREVIEW_FRAME_RATE, fps);
+}
+
+/*===========================================================================
+ * FUNCTION   : getFlatParams
+ *
+ * DESCRIPTION: get the flattened parameter string. The string is built
+ *              once per parameter generation and shared, the caller gets
+ *              a reference to it.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : flattened parameters, to be released with putFlatParams
+ *              NULL on allocation failure
+ *==========================================================================*/
+char *QCameraParameters::getFlatParams()
+{
+    uint32_t gen = getParamGeneration();
+    QCameraFlatParams *flat = m_pFlatParams;
+
+    if ((flat == NULL) || (flat->generation != gen)) {
+        String8 str = flatten();
+        size_t len = str.length();
+        flat = (QCameraFlatParams *)malloc(
+                offsetof(QCameraFlatParams, str) + len + 1);
+        if (flat == NULL) {
+            ALOGE("%s: No memory for %zu bytes of parameters", __func__, len);
+            return NULL;
+        }
+        // one reference held by the cache
+        flat->refs = 1;
+        flat->generation = gen;
+        flat->len = len;
+        memcpy(flat->str, str.string(), len + 1);
+
+        QCameraFlatParams *old;
+        {
+            Mutex::Autolock l(m_FlatParamsLock);
+            old = m_pFlatParams;
+            m_pFlatParams = flat;
+            __atomic_add_fetch(&flat->refs, 1, __ATOMIC_RELAXED);
+        }
+        if (old != NULL) {
+            putFlatParams(old->str);
+        }
+        return flat->str;
+    }
+
+    Mutex::Autolock l(m_FlatParamsLock);
+    __atomic_add_fetch(&flat->refs, 1, __ATOMIC_RELAXED);
+    return flat->str;
+}
+
+/*===========================================================================
+ * FUNCTION   : getCachedFlatParams
+ *
+ * DESCRIPTION: get the cached flattened parameter string if it was built
+ *              from the current parameter generation. Does not touch the
+ *              parameter map, so it is safe to call while the map is
+ *              being updated.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : flattened parameters, to be released with putFlatParams
+ *              NULL if there is no current cached string
+ *==========================================================================*/
+char *QCameraParameters::getCachedFlatParams()
+{
+    uint32_t gen = getParamGeneration();
+
+    Mutex::Autolock l(m_FlatParamsLock);
+    QCameraFlatParams *flat = m_pFlatParams;
+    if ((flat == NULL) || (flat->generation != gen)) {
+        return NULL;
+    }
+    __atomic_add_fetch(&flat->refs, 1, __ATOMIC_RELAXED);
+    return flat->str;
+}
+
+/*===========================================================================
+ * FUNCTION   : putFlatParams
+ *
+ * DESCRIPTION: release a string returned by getFlatParams
+ *
+ * PARAMETERS :
+ *   @str     : flattened parameters
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::putFlatParams(char *str)
+{
+    if (str == NULL) {
+        return;
+    }
+    QCameraFlatParams *flat = (QCameraFlatParams *)
+            (str - offsetof(QCameraFlatParams, str));
+    if (__atomic_sub_fetch(&flat->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(flat);
+    }
 }
 
 /*===========================================================================
@@ -1422,7 +1768,7 @@ int32_t QCameraParameters::setPreviewSize(const QCameraParameters& params)
             }
             // set the new value
             CDBG_HIGH("%s: Requested preview size %d x %d", __func__, width, height);
-            CameraParameters::setPreviewSize(width, height);
+            setPreviewSize(width, height);
             return NO_ERROR;
         }
     }
@@ -1446,7 +1792,7 @@ int32_t QCameraParameters::setPreviewSize(const QCameraParameters& params)
         if (width != old_width || height != old_height) {
             m_bNeedRestart = true;
         }
-        CameraParameters::setPreviewSize(width, height);
+        setPreviewSize(width, height);
         CDBG_HIGH("%s: Secondary Camera: preview size %d x %d", __func__, width, height);
         return NO_ERROR;
     }
@@ -1487,7 +1833,7 @@ int32_t QCameraParameters::setPictureSize(const QCameraParameters& params)
                 }
                 // set the new value
                 CDBG_HIGH("%s: Requested picture size %d x %d", __func__, width, height);
-                CameraParameters::setPictureSize(width, height);
+                setPictureSize(width, height);
                 // Update View angles based on Picture Aspect ratio
                 updateViewAngles();
                 return NO_ERROR;
@@ -1639,7 +1985,7 @@ int32_t QCameraParameters::setVideoSize(const QCameraParameters& params)
 
             // set the new value
             CDBG_HIGH("%s: Requested video size %d x %d", __func__, width, height);
-            CameraParameters::setVideoSize(width, height);
+            setVideoSize(width, height);
             return NO_ERROR;
         }
     }
@@ -1652,7 +1998,7 @@ int32_t QCameraParameters::setVideoSize(const QCameraParameters& params)
             m_bNeedRestart = true;
         }
 
-        CameraParameters::setVideoSize(width, height);
+        setVideoSize(width, height);
         CDBG_HIGH("%s: Secondary Camera: video size %d x %d",
                 __func__, width, height);
         return NO_ERROR;
@@ -1894,7 +2240,7 @@ int32_t QCameraParameters::setPreviewFormat(const QCameraParameters& params)
             mPreviewFormat = (cam_format_t)previewFormat;
             mAppPreviewFormat = (cam_format_t)previewFormat;
         }
-        CameraParameters::setPreviewFormat(str);
+        setPreviewFormat(str);
         CDBG_HIGH("%s: format %d\n", __func__, mPreviewFormat);
         return NO_ERROR;
     }
@@ -1921,7 +2267,7 @@ int32_t QCameraParameters::setPictureFormat(const QCameraParameters& params)
     if (pictureFormat != NAME_NOT_FOUND) {
         mPictureFormat = pictureFormat;
 
-        CameraParameters::setPictureFormat(str);
+        setPictureFormat(str);
         CDBG_HIGH("%s: format %d\n", __func__, mPictureFormat);
         return NO_ERROR;
     }
@@ -4941,6 +5287,158 @@ int32_t QCameraParameters::setDualLedCalibration()
     return NO_ERROR;
 }
 
+/* Setters run by updateParameters, in order. A handler only runs when one
+ * of its keys differs from the current value, so keys are only given for
+ * setters that do nothing for an unchanged value. Handlers without keys
+ * always run: they depend on state set by other handlers (sizes, fps/HFR,
+ * recording hint), or apply a property default when the app leaves their
+ * key out, which no key comparison can see. */
+const QCameraParameters::QCameraParamHandler QCameraParameters::PARAM_HANDLERS[] = {
+#ifdef TCT_TSHDR_FEATURE
+    { &QCameraParameters::setTsMode,              {NULL}, false },
+#endif
+    { &QCameraParameters::setPreviewSize,         {NULL}, false },
+    { &QCameraParameters::setVideoSize,           {NULL}, false },
+    { &QCameraParameters::setPictureSize,         {NULL}, false },
+    { &QCameraParameters::setPreviewFormat,       {NULL}, false },
+    { &QCameraParameters::setPictureFormat,       {NULL}, false },
+    { &QCameraParameters::setJpegQuality,
+            {KEY_JPEG_QUALITY, KEY_JPEG_THUMBNAIL_QUALITY}, false },
+    { &QCameraParameters::setOrientation,         {KEY_QC_ORIENTATION}, false },
+    { &QCameraParameters::setRotation,            {KEY_ROTATION}, false },
+    { &QCameraParameters::setVideoRotation,       {KEY_QC_VIDEO_ROTATION}, false },
+    { &QCameraParameters::setNoDisplayMode,       {NULL}, false },
+    { &QCameraParameters::setZslMode,             {NULL}, false },
+    { &QCameraParameters::setZslAttributes,       {NULL}, false },
+    { &QCameraParameters::setCameraMode,          {KEY_QC_CAMERA_MODE}, false },
+    { &QCameraParameters::setSceneSelectionMode,  {KEY_QC_SCENE_SELECTION}, false },
+    { &QCameraParameters::setRecordingHint,       {KEY_RECORDING_HINT}, false },
+    { &QCameraParameters::setRdiMode,             {NULL}, false },
+    { &QCameraParameters::setSecureMode,          {NULL}, false },
+    { &QCameraParameters::setPreviewFrameRate,    {NULL}, false },
+    { &QCameraParameters::setPreviewFpsRange,     {NULL}, false },
+    { &QCameraParameters::setAutoExposure,        {KEY_QC_AUTO_EXPOSURE}, false },
+    { &QCameraParameters::setEffect,              {KEY_EFFECT}, false },
+    { &QCameraParameters::setBrightness,          {KEY_QC_BRIGHTNESS}, false },
+    { &QCameraParameters::setZoom,                {KEY_ZOOM}, false },
+    { &QCameraParameters::setSharpness,           {KEY_QC_SHARPNESS}, false },
+    { &QCameraParameters::setSaturation,          {KEY_QC_SATURATION}, false },
+    { &QCameraParameters::setContrast,            {KEY_QC_CONTRAST}, false },
+    { &QCameraParameters::setFocusMode,           {KEY_FOCUS_MODE}, false },
+    { &QCameraParameters::setISOValue,            {KEY_QC_ISO_MODE}, false },
+    { &QCameraParameters::setContinuousISO,
+            {KEY_QC_ISO_MODE, KEY_QC_CONTINUOUS_ISO}, false },
+    { &QCameraParameters::setExposureTime,        {KEY_QC_EXPOSURE_TIME}, false },
+    { &QCameraParameters::setSkinToneEnhancement, {KEY_QC_SCE_FACTOR}, false },
+    { &QCameraParameters::setFlash,               {KEY_FLASH_MODE}, false },
+    { &QCameraParameters::setAecLock,             {KEY_AUTO_EXPOSURE_LOCK}, false },
+    { &QCameraParameters::setAwbLock,             {KEY_AUTO_WHITEBALANCE_LOCK}, false },
+    { &QCameraParameters::setLensShadeValue,      {KEY_QC_LENSSHADE}, false },
+    { &QCameraParameters::setMCEValue,            {KEY_QC_MEMORY_COLOR_ENHANCEMENT}, false },
+    { &QCameraParameters::setDISValue,            {KEY_QC_DIS}, false },
+    { &QCameraParameters::setAntibanding,         {KEY_ANTIBANDING}, false },
+    { &QCameraParameters::setExposureCompensation, {KEY_EXPOSURE_COMPENSATION}, false },
+    { &QCameraParameters::setWhiteBalance,        {KEY_WHITE_BALANCE}, false },
+    { &QCameraParameters::setHDRMode,             {KEY_QC_HDR_MODE}, false },
+    { &QCameraParameters::setHDRNeed1x,           {KEY_QC_HDR_NEED_1X}, false },
+    { &QCameraParameters::setManualWhiteBalance,
+            {KEY_WHITE_BALANCE, KEY_QC_MANUAL_WB_TYPE, KEY_QC_MANUAL_WB_VALUE}, false },
+    { &QCameraParameters::setSceneMode,           {KEY_SCENE_MODE}, false },
+    { &QCameraParameters::setFocusAreas,          {KEY_FOCUS_AREAS}, false },
+    { &QCameraParameters::setFocusPosition,
+            {KEY_FOCUS_MODE, KEY_QC_MANUAL_FOCUS_POSITION,
+            KEY_QC_MANUAL_FOCUS_POS_TYPE}, false },
+    // metering areas are re-applied when a restart is needed
+    { &QCameraParameters::setMeteringAreas,       {KEY_METERING_AREAS}, true },
+    { &QCameraParameters::setSelectableZoneAf,    {KEY_QC_SELECTABLE_ZONE_AF}, false },
+    { &QCameraParameters::setRedeyeReduction,     {KEY_QC_REDEYE_REDUCTION}, false },
+    // depends on the HDR state set by scene mode, and falls back to the
+    // burst exposure property when the key is not set
+    { &QCameraParameters::setAEBracket,           {NULL}, false },
+    { &QCameraParameters::setAutoHDR,             {NULL}, false },
+    { &QCameraParameters::setGpsLocation,         {NULL}, false },
+    { &QCameraParameters::setWaveletDenoise,      {KEY_QC_DENOISE}, false },
+    { &QCameraParameters::setFaceRecognition,
+            {KEY_QC_FACE_RECOGNITION, KEY_QC_MAX_NUM_REQUESTED_FACES}, false },
+    { &QCameraParameters::setFlip,                {NULL}, false },
+    { &QCameraParameters::setVideoHDR,            {KEY_QC_VIDEO_HDR}, false },
+    { &QCameraParameters::setVtEnable,            {KEY_QC_VT_ENABLE}, false },
+    { &QCameraParameters::setAFBracket,           {KEY_QC_AF_BRACKET}, false },
+    { &QCameraParameters::setReFocus,             {KEY_QC_RE_FOCUS}, false },
+    { &QCameraParameters::setChromaFlash,         {KEY_QC_CHROMA_FLASH}, false },
+    { &QCameraParameters::setTruePortrait,        {KEY_QC_TRUE_PORTRAIT}, false },
+    { &QCameraParameters::setOptiZoom,            {KEY_QC_OPTI_ZOOM}, false },
+#ifdef TCT_VISIDON_FEATURE
+    { &QCameraParameters::setVisidonMode,         {NULL}, false },
+    { &QCameraParameters::setVisidonFaceBeautyPara, {NULL}, false },
+#endif
+#ifdef TCT_TARGET_EIS_DXO_ENABLE
+    { &QCameraParameters::setVideoEis,            {NULL}, false },
+#endif
+    { &QCameraParameters::setBurstNum,            {NULL}, false },
+    { &QCameraParameters::setBurstLEDOnPeriod,    {NULL}, false },
+    { &QCameraParameters::setRetroActiveBurstNum, {NULL}, false },
+    { &QCameraParameters::setSnapshotFDReq,       {NULL}, false },
+    { &QCameraParameters::setTintlessValue,       {NULL}, false },
+    { &QCameraParameters::setCDSMode,             {NULL}, false },
+    { &QCameraParameters::setTemporalDenoise,     {NULL}, false },
+    { &QCameraParameters::setCacheVideoBuffers,   {KEY_QC_CACHE_VIDEO_BUFFERS}, false },
+    { &QCameraParameters::setInstantCapture,      {NULL}, false },
+    { &QCameraParameters::setInstantAEC,          {NULL}, false },
+};
+
+/*===========================================================================
+ * FUNCTION   : isParamChanged
+ *
+ * DESCRIPTION: check if a key in the new parameters differs from the
+ *              current value, a key added or removed counts as changed
+ *
+ * PARAMETERS :
+ *   @params  : new parameters
+ *   @key     : parameter key
+ *
+ * RETURN     : true if the value changed
+ *==========================================================================*/
+bool QCameraParameters::isParamChanged(const QCameraParameters& params,
+        const char *key)
+{
+    const char *str = params.get(key);
+    const char *prev_str = get(key);
+    if ((str == NULL) || (prev_str == NULL)) {
+        return str != prev_str;
+    }
+    return strcmp(str, prev_str) != 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : needParamHandler
+ *
+ * DESCRIPTION: check if an updateParameters handler has to run for the new
+ *              parameters
+ *
+ * PARAMETERS :
+ *   @params  : new parameters
+ *   @handler : entry of PARAM_HANDLERS
+ *
+ * RETURN     : true if the handler has to run
+ *==========================================================================*/
+bool QCameraParameters::needParamHandler(const QCameraParameters& params,
+        const QCameraParamHandler &handler)
+{
+    if (!m_bParamDiff || (handler.keys[0] == NULL)) {
+        return true;
+    }
+    if (handler.on_restart && m_bNeedRestart) {
+        return true;
+    }
+    for (size_t i = 0; (i < PARAM_HANDLER_KEYS) && (handler.keys[i] != NULL); i++) {
+        if (isParamChanged(params, handler.keys[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /*===========================================================================
  * FUNCTION   : updateParameters
  *
@@ -4967,89 +5465,13 @@ int32_t QCameraParameters::updateParameters(QCameraParameters& params,
         goto UPDATE_PARAM_DONE;
     }
 
-#ifdef TCT_TSHDR_FEATURE
-    if ((rc = setTsMode(params)))                       final_rc = rc;
-#endif
-    if ((rc = setPreviewSize(params)))                  final_rc = rc;
-    if ((rc = setVideoSize(params)))                    final_rc = rc;
-    if ((rc = setPictureSize(params)))                  final_rc = rc;
-    if ((rc = setPreviewFormat(params)))                final_rc = rc;
-    if ((rc = setPictureFormat(params)))                final_rc = rc;
-    if ((rc = setJpegQuality(params)))                  final_rc = rc;
-    if ((rc = setOrientation(params)))                  final_rc = rc;
-    if ((rc = setRotation(params)))                     final_rc = rc;
-    if ((rc = setVideoRotation(params)))                final_rc = rc;
-    if ((rc = setNoDisplayMode(params)))                final_rc = rc;
-    if ((rc = setZslMode(params)))                      final_rc = rc;
-    if ((rc = setZslAttributes(params)))                final_rc = rc;
-    if ((rc = setCameraMode(params)))                   final_rc = rc;
-    if ((rc = setSceneSelectionMode(params)))           final_rc = rc;
-    if ((rc = setRecordingHint(params)))                final_rc = rc;
-    if ((rc = setRdiMode(params)))                      final_rc = rc;
-    if ((rc = setSecureMode(params)))                   final_rc = rc;
-    if ((rc = setPreviewFrameRate(params)))             final_rc = rc;
-    if ((rc = setPreviewFpsRange(params)))              final_rc = rc;
-    if ((rc = setAutoExposure(params)))                 final_rc = rc;
-    if ((rc = setEffect(params)))                       final_rc = rc;
-    if ((rc = setBrightness(params)))                   final_rc = rc;
-    if ((rc = setZoom(params)))                         final_rc = rc;
-    if ((rc = setSharpness(params)))                    final_rc = rc;
-    if ((rc = setSaturation(params)))                   final_rc = rc;
-    if ((rc = setContrast(params)))                     final_rc = rc;
-    if ((rc = setFocusMode(params)))                    final_rc = rc;
-    if ((rc = setISOValue(params)))                     final_rc = rc;
-    if ((rc = setContinuousISO(params)))                final_rc = rc;
-    if ((rc = setExposureTime(params)))                 final_rc = rc;
-    if ((rc = setSkinToneEnhancement(params)))          final_rc = rc;
-    if ((rc = setFlash(params)))                        final_rc = rc;
-    if ((rc = setAecLock(params)))                      final_rc = rc;
-    if ((rc = setAwbLock(params)))                      final_rc = rc;
-    if ((rc = setLensShadeValue(params)))               final_rc = rc;
-    if ((rc = setMCEValue(params)))                     final_rc = rc;
-    if ((rc = setDISValue(params)))                     final_rc = rc;
-    if ((rc = setAntibanding(params)))                  final_rc = rc;
-    if ((rc = setExposureCompensation(params)))         final_rc = rc;
-    if ((rc = setWhiteBalance(params)))                 final_rc = rc;
-    if ((rc = setHDRMode(params)))                      final_rc = rc;
-    if ((rc = setHDRNeed1x(params)))                    final_rc = rc;
-    if ((rc = setManualWhiteBalance(params)))           final_rc = rc;
-    if ((rc = setSceneMode(params)))                    final_rc = rc;
-    if ((rc = setFocusAreas(params)))                   final_rc = rc;
-    if ((rc = setFocusPosition(params)))                final_rc = rc;
-    if ((rc = setMeteringAreas(params)))                final_rc = rc;
-    if ((rc = setSelectableZoneAf(params)))             final_rc = rc;
-    if ((rc = setRedeyeReduction(params)))              final_rc = rc;
-    if ((rc = setAEBracket(params)))                    final_rc = rc;
-    if ((rc = setAutoHDR(params)))                      final_rc = rc;
-    if ((rc = setGpsLocation(params)))                  final_rc = rc;
-    if ((rc = setWaveletDenoise(params)))               final_rc = rc;
-    if ((rc = setFaceRecognition(params)))              final_rc = rc;
-    if ((rc = setFlip(params)))                         final_rc = rc;
-    if ((rc = setVideoHDR(params)))                     final_rc = rc;
-    if ((rc = setVtEnable(params)))                     final_rc = rc;
-    if ((rc = setAFBracket(params)))                    final_rc = rc;
-    if ((rc = setReFocus(params)))                      final_rc = rc;
-    if ((rc = setChromaFlash(params)))                  final_rc = rc;
-    if ((rc = setTruePortrait(params)))                 final_rc = rc;
-    if ((rc = setOptiZoom(params)))                     final_rc = rc;
-#ifdef TCT_VISIDON_FEATURE
-    if ((rc = setVisidonMode(params)))                  final_rc = rc;
-    if ((rc = setVisidonFaceBeautyPara(params)))        final_rc = rc;
-#endif
-#ifdef TCT_TARGET_EIS_DXO_ENABLE
-    if ((rc = setVideoEis(params)))                  final_rc = rc;
-#endif
-
-    if ((rc = setBurstNum(params)))                     final_rc = rc;
-    if ((rc = setBurstLEDOnPeriod(params)))             final_rc = rc;
-    if ((rc = setRetroActiveBurstNum(params)))          final_rc = rc;
-    if ((rc = setSnapshotFDReq(params)))                final_rc = rc;
-    if ((rc = setTintlessValue(params)))                final_rc = rc;
-    if ((rc = setCDSMode(params)))                      final_rc = rc;
-    if ((rc = setTemporalDenoise(params)))              final_rc = rc;
-    if ((rc = setCacheVideoBuffers(params)))            final_rc = rc;
-    if ((rc = setInstantCapture(params)))               final_rc = rc;
-    if ((rc = setInstantAEC(params)))                   final_rc = rc;
+    for (size_t i = 0; i < PARAM_MAP_SIZE(PARAM_HANDLERS); i++) {
+        const QCameraParamHandler &handler = PARAM_HANDLERS[i];
+        if (!needParamHandler(params, handler)) {
+            continue;
+        }
+        if ((rc = (this->*handler.setter)(params)))     final_rc = rc;
+    }
 
     // update live snapshot size after all other parameters are set
     if ((rc = setLiveSnapshotSize(params)))             final_rc = rc;
@@ -5083,6 +5505,7 @@ int32_t QCameraParameters::updateParameters(QCameraParameters& params,
         final_rc = rc;
     }
 #endif
+    publishFrameParams();
 UPDATE_PARAM_DONE:
     needRestart = m_bNeedRestart;
     return final_rc;
@@ -5158,7 +5581,7 @@ int32_t QCameraParameters::initDefaultParameters()
         set(KEY_SUPPORTED_PREVIEW_SIZES, previewSizeValues.string());
         CDBG_HIGH("%s: supported preview sizes: %s", __func__, previewSizeValues.string());
         // Set default preview size
-        CameraParameters::setPreviewSize(m_pCapability->preview_sizes_tbl[0].width,
+        setPreviewSize(m_pCapability->preview_sizes_tbl[0].width,
                                          m_pCapability->preview_sizes_tbl[0].height);
     } else {
         ALOGE("%s: supported preview sizes cnt is 0 or exceeds max!!!", __func__);
@@ -5172,7 +5595,7 @@ int32_t QCameraParameters::initDefaultParameters()
         set(KEY_SUPPORTED_VIDEO_SIZES, videoSizeValues.string());
         CDBG_HIGH("%s: supported video sizes: %s", __func__, videoSizeValues.string());
         // Set default video size
-        CameraParameters::setVideoSize(m_pCapability->video_sizes_tbl[0].width,
+        setVideoSize(m_pCapability->video_sizes_tbl[0].width,
                                        m_pCapability->video_sizes_tbl[0].height);
 
         //Set preferred Preview size for video
@@ -5190,7 +5613,7 @@ int32_t QCameraParameters::initDefaultParameters()
         set(KEY_SUPPORTED_PICTURE_SIZES, pictureSizeValues.string());
         CDBG_HIGH("%s: supported pic sizes: %s", __func__, pictureSizeValues.string());
         // Set default picture size to the smallest resolution
-        CameraParameters::setPictureSize(
+        setPictureSize(
            m_pCapability->picture_sizes_tbl[m_pCapability->picture_sizes_tbl_cnt-1].width,
            m_pCapability->picture_sizes_tbl[m_pCapability->picture_sizes_tbl_cnt-1].height);
     } else {
@@ -5248,7 +5671,7 @@ int32_t QCameraParameters::initDefaultParameters()
             PARAM_MAP_SIZE(PREVIEW_FORMATS_MAP));
     set(KEY_SUPPORTED_PREVIEW_FORMATS, previewFormatValues.string());
     // Set default preview format
-    CameraParameters::setPreviewFormat(PIXEL_FORMAT_YUV420SP);
+    setPreviewFormat(PIXEL_FORMAT_YUV420SP);
 
     // Set default Video Format as OPAQUE
     //Internally both Video and Camera subsystems use NV21_VENUS
@@ -5268,7 +5691,7 @@ int32_t QCameraParameters::initDefaultParameters()
 
     set(KEY_SUPPORTED_PICTURE_FORMATS, pictureTypeValues.string());
     // Set default picture Format
-    CameraParameters::setPictureFormat(PIXEL_FORMAT_JPEG);
+    setPictureFormat(PIXEL_FORMAT_JPEG);
     // Set raw image size
     char raw_size_str[32];
     snprintf(raw_size_str, sizeof(raw_size_str), "%dx%d",
@@ -5302,7 +5725,7 @@ int32_t QCameraParameters::initDefaultParameters()
         String8 fpsValues = createFpsString(m_pCapability->fps_ranges_tbl[default_fps_index]);
         set(KEY_SUPPORTED_PREVIEW_FRAME_RATES, fpsValues.string());
         CDBG_HIGH("%s: supported fps rates: %s", __func__, fpsValues.string());
-        CameraParameters::setPreviewFrameRate(int(m_pCapability->fps_ranges_tbl[default_fps_index].max_fps));
+        setPreviewFrameRate(int(m_pCapability->fps_ranges_tbl[default_fps_index].max_fps));
     } else {
         ALOGE("%s: supported fps ranges cnt is 0 or exceeds max!!!", __func__);
     }
@@ -5975,6 +6398,7 @@ int32_t QCameraParameters::initDefaultParameters()
         set(KEY_QC_NO_DISPLAY_MODE, 1);
         m_bNoDisplayMode = true;
     }
+    publishFrameParams();
     return rc;
 }
 
@@ -6059,6 +6483,8 @@ int32_t QCameraParameters::init(cam_capability_t *capabilities,
         goto TRANS_INIT_ERROR2;
     }
     m_pParamBuf = (parm_buffer_t*) DATA_PTR(m_pParamHeap,0);
+    // fresh backend session, nothing committed yet
+    resetSentParams();
 
     // Check if it is dual camera mode
     if(m_relCamSyncInfo.sync_control == CAM_SYNC_RELATED_SENSORS_ON) {
@@ -6130,6 +6556,7 @@ void QCameraParameters::deinit()
     //clear all entries in the map
     String8 emptyStr;
     QCameraParameters::unflatten(emptyStr);
+    __atomic_add_fetch(&m_nParamGen, 1, __ATOMIC_RELEASE);
 
     if (NULL != m_pCamOpsTbl) {
         m_pCamOpsTbl->ops->unmap_buf(
@@ -7052,11 +7479,11 @@ void QCameraParameters::clearVisidonPara(void)
 {
     m_nVisidonMode = VISIDON_NOT_SUPPORT;
     g_cam_visidon_para.fb_enable = 0; // MODIFIED by zhfan, 2016-04-23,BUG-1785753
-    CameraParameters::set(QCameraParameters::KEY_VISIDON_MODE, "");
-    CameraParameters::set(QCameraParameters::KEY_VISIDON_FACE_BEAUTY_SKIN_TONE, 0);
-    CameraParameters::set(QCameraParameters::KEY_VISIDON_FACE_BEAUTY_SKIN_SMOOTHING, 0);
-    CameraParameters::set(QCameraParameters::KEY_VISIDON_FACE_BEAUTY_SKIN_COLOR, 0);
-    CameraParameters::set(QCameraParameters::KEY_VISIDON_EYE_BRIGHTENING, 0);
+    set(QCameraParameters::KEY_VISIDON_MODE, "");
+    set(QCameraParameters::KEY_VISIDON_FACE_BEAUTY_SKIN_TONE, 0);
+    set(QCameraParameters::KEY_VISIDON_FACE_BEAUTY_SKIN_SMOOTHING, 0);
+    set(QCameraParameters::KEY_VISIDON_FACE_BEAUTY_SKIN_COLOR, 0);
+    set(QCameraParameters::KEY_VISIDON_EYE_BRIGHTENING, 0);
 }
 
 int32_t QCameraParameters::setVisidonMode(const QCameraParameters& params)
@@ -7108,7 +7535,7 @@ int32_t QCameraParameters::setVisidonMode(const QCameraParameters& params)
 int32_t QCameraParameters::setVisidonFaceBeautyPara(const QCameraParameters& params)
 {
     m_nSkinSmoothingLevel = params.getInt(QCameraParameters::KEY_VISIDON_FACE_BEAUTY_SKIN_SMOOTHING);
-    CameraParameters::set(QCameraParameters::KEY_VISIDON_FACE_BEAUTY_SKIN_SMOOTHING, m_nSkinSmoothingLevel);
+    set(QCameraParameters::KEY_VISIDON_FACE_BEAUTY_SKIN_SMOOTHING, m_nSkinSmoothingLevel);
     g_cam_visidon_para.level = m_nSkinSmoothingLevel;
     if(getVisidonMode() == VISIDON_FACE_BEAUTY_MODE)
     {
@@ -11769,6 +12196,14 @@ int32_t QCameraParameters::initBatchUpdate(parm_buffer_t *p_table)
 {
     m_tempMap.clear();
 
+    // keep the entries of a deferred batch until endSetBatch
+    if ((m_nSetBatchDepth > 0) && (p_table == m_pParamBuf)) {
+        if (m_bSetBatchOpen) {
+            return NO_ERROR;
+        }
+        m_bSetBatchOpen = true;
+    }
+
     clear_metadata_buffer(p_table);
     return NO_ERROR;
 }
@@ -11787,34 +12222,187 @@ int32_t QCameraParameters::initBatchUpdate(parm_buffer_t *p_table)
 int32_t QCameraParameters::commitSetBatch()
 {
     int32_t rc = NO_ERROR;
-    int32_t i = 0;
 
     if (NULL == m_pParamBuf) {
         ALOGE("%s: Params not initialized", __func__);
         return NO_INIT;
     }
 
-    /* Loop to check if atleast one entry is valid */
-    for(i = 0; i < CAM_INTF_PARM_MAX; i++){
-        if(m_pParamBuf->is_valid[i])
-            break;
-    }
-
     if (NULL == m_pCamOpsTbl) {
         ALOGE("%s: Ops not initialized", __func__);
         return NO_INIT;
     }
 
-    if (i < CAM_INTF_PARM_MAX) {
+    if (m_nSetBatchDepth > 0) {
+        // backend commit is left to endSetBatch, the map is updated now
+        // so that getters in between see the new values
+        m_bSetBatchPending = true;
+        rc = commitParamChanges();
+        publishFrameParams();
+        return rc;
+    }
+
+    mm_camera_meta_valid_t valid;
+    uint32_t count = mm_camera_meta_get_valid(m_pParamBuf, &valid);
+    if (m_bParamDelta && (count > 0)) {
+        count -= dropUnchangedParams(&valid);
+    }
+    if (count > 0) {
         rc = m_pCamOpsTbl->ops->set_parms(m_pCamOpsTbl->camera_handle, m_pParamBuf);
+        if (m_bParamDelta) {
+            updateSentParams(&valid, rc == NO_ERROR);
+        }
     }
     if (rc == NO_ERROR) {
         // commit change from temp storage into param map
         rc = commitParamChanges();
+        publishFrameParams();
     }
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : dropUnchangedParams
+ *
+ * DESCRIPTION: invalidate the entries of the set batch that hold the value
+ *              last committed to the backend, so that only the delta is
+ *              sent. Nothing is dropped from a batch changing the scene
+ *              mode, the backend re-applies its own settings for it.
+ *
+ * PARAMETERS :
+ *   @valid   : valid index of the batch, dropped entries are cleared
+ *
+ * RETURN     : number of dropped entries
+ *==========================================================================*/
+uint32_t QCameraParameters::dropUnchangedParams(mm_camera_meta_valid_t *valid)
+{
+    uint32_t dropped = 0;
+    int32_t id = -1;
+
+    if (m_pParamBuf->is_valid[CAM_INTF_PARM_BESTSHOT_MODE]) {
+        return 0;
+    }
+
+    while ((id = mm_camera_meta_next_valid(valid, id)) >= 0) {
+        uint8_t slot = m_DeltaSlot[id];
+        if ((slot == 0) || !m_ParamSent[slot - 1].valid) {
+            continue;
+        }
+        size_t size = 0;
+        void *data = mm_camera_meta_entry(m_pParamBuf, (uint32_t)id, &size);
+        if ((data == NULL) || (size > PARAM_DELTA_MAX_SIZE) ||
+                memcmp(data, m_ParamSent[slot - 1].data, size)) {
+            continue;
+        }
+        m_pParamBuf->is_valid[id] = 0;
+        valid->bits[id / 64] &= ~((uint64_t)1 << (id % 64));
+        dropped++;
+    }
+
+    if (dropped > 0) {
+        CDBG("%s: %u unchanged entries not sent", __func__, dropped);
+    }
+    return dropped;
+}
+
+/*===========================================================================
+ * FUNCTION   : updateSentParams
+ *
+ * DESCRIPTION: remember the values of a committed set batch
+ *
+ * PARAMETERS :
+ *   @valid   : valid index of the batch
+ *   @sent    : if the backend accepted the batch
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::updateSentParams(const mm_camera_meta_valid_t *valid,
+        bool sent)
+{
+    int32_t id = -1;
+
+    // the backend state is unknown after a failure or a scene mode change
+    if (!sent || m_pParamBuf->is_valid[CAM_INTF_PARM_BESTSHOT_MODE]) {
+        resetSentParams();
+        return;
+    }
+
+    while ((id = mm_camera_meta_next_valid(valid, id)) >= 0) {
+        uint8_t slot = m_DeltaSlot[id];
+        if (slot == 0) {
+            continue;
+        }
+        size_t size = 0;
+        void *data = mm_camera_meta_entry(m_pParamBuf, (uint32_t)id, &size);
+        if ((data == NULL) || (size > PARAM_DELTA_MAX_SIZE)) {
+            continue;
+        }
+        memcpy(m_ParamSent[slot - 1].data, data, size);
+        m_ParamSent[slot - 1].valid = true;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : resetSentParams
+ *
+ * DESCRIPTION: forget the committed values, the next batch sends all its
+ *              entries
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::resetSentParams()
+{
+    memset(m_ParamSent, 0, sizeof(m_ParamSent));
+}
+
+/*===========================================================================
+ * FUNCTION   : beginSetBatch
+ *
+ * DESCRIPTION: start coalescing set batches. The batches committed until
+ *              the matching endSetBatch are merged and sent once. Calls
+ *              could be nested.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::beginSetBatch()
+{
+    m_nSetBatchDepth++;
+}
+
+/*===========================================================================
+ * FUNCTION   : endSetBatch
+ *
+ * DESCRIPTION: stop coalescing set batches and commit the merged batch to
+ *              backend if anything was committed since beginSetBatch
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraParameters::endSetBatch()
+{
+    if (m_nSetBatchDepth == 0) {
+        ALOGE("%s: No set batch started", __func__);
+        return INVALID_OPERATION;
+    }
+    if (--m_nSetBatchDepth > 0) {
+        return NO_ERROR;
+    }
+
+    m_bSetBatchOpen = false;
+    if (!m_bSetBatchPending) {
+        return NO_ERROR;
+    }
+    m_bSetBatchPending = false;
+    return commitSetBatch();
+}
+
 /*===========================================================================
  * FUNCTION   : commitGetBatch
  *
@@ -11829,25 +12417,23 @@ int32_t QCameraParameters::commitSetBatch()
 int32_t QCameraParameters::commitGetBatch()
 {
     int32_t rc = NO_ERROR;
-    int32_t i = 0;
 
     if (NULL == m_pParamBuf) {
         ALOGE("%s: Params not initialized", __func__);
         return NO_INIT;
     }
 
-    /* Loop to check if atleast one entry is valid */
-    for(i = 0; i < CAM_INTF_PARM_MAX; i++){
-        if(m_pParamBuf->is_valid[i])
-            break;
-    }
-
     if (NULL == m_pCamOpsTbl) {
         ALOGE("%s: Ops not initialized", __func__);
         return NO_INIT;
     }
 
-    if (i < CAM_INTF_PARM_MAX) {
+    if (m_nSetBatchDepth > 0) {
+        ALOGE("%s: Get batch inside a deferred set batch", __func__);
+        return INVALID_OPERATION;
+    }
+
+    if (mm_camera_meta_has_valid(m_pParamBuf)) {
         return m_pCamOpsTbl->ops->get_parms(m_pCamOpsTbl->camera_handle, m_pParamBuf);
     } else {
         return NO_ERROR;
@@ -11911,6 +12497,47 @@ int32_t QCameraParameters::commitParamChanges()
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : publishFrameParams
+ *
+ * DESCRIPTION: publish a new frame parameter snapshot if any of its values
+ *              changed. Called by the single parameter writer after the
+ *              parameter map is updated.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::publishFrameParams()
+{
+    const QCameraFrameParams *cur = m_pFrameParams;
+    QCameraFrameParams next;
+
+    memset(&next, 0, sizeof(next));
+    next.exposure_compensation = getInt(KEY_EXPOSURE_COMPENSATION);
+#ifdef TCT_TSHDR_FEATURE
+    next.ts_photo_hdr = getInt(KEY_TSPHOTOPROCESSMODE_HDR);
+    next.ts_video_hdr_checker = getInt(KEY_TSVIDEOPROCESSMODE_HDRCHECKER);
+#endif
+#ifdef TARGET_TS_MAKEUP
+    const char *makeup = get(KEY_TS_MAKEUP);
+    next.ts_makeup_on = (makeup != NULL) && (strcmp(makeup, "On") == 0);
+    next.ts_makeup_whiten = getInt(KEY_TS_MAKEUP_WHITEN);
+    next.ts_makeup_clean = getInt(KEY_TS_MAKEUP_CLEAN);
+#endif
+
+    next.generation = cur->generation;
+    if (!memcmp(&next, cur, sizeof(next))) {
+        return;
+    }
+
+    next.generation = cur->generation + 1;
+    QCameraFrameParams *slot =
+            &m_FrameParams[next.generation % FRAME_PARAMS_SLOTS];
+    memcpy(slot, &next, sizeof(next));
+    __atomic_store_n(&m_pFrameParams, slot, __ATOMIC_RELEASE);
+}
+
 /*===========================================================================
  * FUNCTION   : QCameraReprocScaleParam
  *
@@ -46,6 +46,43 @@ static const char ExifUndefinedPrefix[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 
 #define CAMERA_MIN_BATCH_COUNT           4
 
+// parameters compared against the last committed value before a set batch
+// is sent, and the largest entry kept for the compare
+#define PARAM_DELTA_ENTRIES              32
+#define PARAM_DELTA_MAX_SIZE             16
+
+/* Flattened parameter string handed out by get_parameters. The cached block
+ * is shared by all callers and never written once built; each get takes a
+ * reference that put_parameters drops, the block is freed with the last
+ * one. */
+typedef struct {
+    uint32_t refs;
+    uint32_t generation;    // parameter generation the string was built from
+    size_t len;
+    char str[1];
+} QCameraFlatParams;
+
+// slots of the frame parameter snapshot ring
+#define FRAME_PARAMS_SLOTS               8
+
+/* Typed copy of the parameters read on the frame path. A snapshot is never
+ * written after it is published; readers load it with getFrameParams() and
+ * copy what they need right away, the slot is only reused after
+ * FRAME_PARAMS_SLOTS - 1 newer snapshots. */
+typedef struct {
+    uint32_t generation;
+    int32_t exposure_compensation;
+#ifdef TCT_TSHDR_FEATURE
+    int32_t ts_photo_hdr;           // -1 when the key is not set
+    int32_t ts_video_hdr_checker;
+#endif
+#ifdef TARGET_TS_MAKEUP
+    bool ts_makeup_on;
+    int32_t ts_makeup_whiten;
+    int32_t ts_makeup_clean;
+#endif
+} QCameraFrameParams;
+
 class QCameraAdjustFPS
 {
 public:
@@ -112,6 +149,27 @@ public:
     QCameraParameters(const String8 &params);
     ~QCameraParameters();
 
+    // map writers hiding the CameraParameters ones, a write changing the
+    // map bumps the parameter generation
+    void set(const char *key, const char *value);
+    void set(const char *key, int value);
+    void setFloat(const char *key, float value);
+    void remove(const char *key);
+    void setPreviewSize(int width, int height);
+    void setVideoSize(int width, int height);
+    void setPictureSize(int width, int height);
+    void setPreviewFormat(const char *format);
+    void setPictureFormat(const char *format);
+    void setPreviewFrameRate(int fps);
+    uint32_t getParamGeneration() const
+            { return __atomic_load_n(&m_nParamGen, __ATOMIC_ACQUIRE); }
+
+    // flatten() cached per generation, returned strings are released
+    // with putFlatParams and must not be modified
+    char *getFlatParams();
+    char *getCachedFlatParams();
+    static void putFlatParams(char *str);
+
     // Supported PREVIEW/RECORDING SIZES IN HIGH FRAME RATE recording, sizes in pixels.
     // Example value: "800x480,432x320". Read only.
     static const char KEY_QC_SUPPORTED_HFR_SIZES[];
@@ -848,6 +906,15 @@ public:
     int32_t bundleRelatedCameras(bool sync, uint32_t sessionid);
     int32_t setInstantAEC(uint8_t enable, bool initCommit);
 
+    // coalesce the set batches committed in between into one backend
+    // commit, no get batch is allowed inside
+    void beginSetBatch();
+    int32_t endSetBatch();
+
+    // lock free, valid for the lifetime of this object
+    const QCameraFrameParams *getFrameParams() const
+            { return __atomic_load_n(&m_pFrameParams, __ATOMIC_ACQUIRE); }
+
 #ifdef TCT_VISIDON_FEATURE
     uint32_t getCurrentISO() const;
     uint32_t getZoomRatio() const;
@@ -1032,15 +1099,40 @@ private:
     String8 createZoomRatioValuesString(uint32_t *zoomRatios, size_t length);
     int32_t setDualLedCalibration();
 
+    // updateParameters handler, runs when one of its keys changed or
+    // always if it has none
+    #define PARAM_HANDLER_KEYS 4
+    typedef int32_t (QCameraParameters::*paramSetter)(const QCameraParameters&);
+    typedef struct {
+        paramSetter setter;
+        const char *keys[PARAM_HANDLER_KEYS];
+        bool on_restart;    // also runs when a restart is needed
+    } QCameraParamHandler;
+    static const QCameraParamHandler PARAM_HANDLERS[];
+    bool isParamChanged(const QCameraParameters& params, const char *key);
+    bool needParamHandler(const QCameraParameters& params,
+            const QCameraParamHandler &handler);
+
     // ops for batch set/get params with server
     int32_t initBatchUpdate(parm_buffer_t *p_table);
     int32_t commitSetBatch();
     int32_t commitGetBatch();
 
+    // last committed value of a delta tracked parameter
+    typedef struct {
+        bool valid;
+        uint8_t data[PARAM_DELTA_MAX_SIZE];
+    } QCameraParamSent;
+    static const cam_intf_parm_type_t DELTA_PARAMS[];
+    uint32_t dropUnchangedParams(mm_camera_meta_valid_t *valid);
+    void updateSentParams(const mm_camera_meta_valid_t *valid, bool sent);
+    void resetSentParams();
+
     // ops to tempororily update parameter entries and commit
     int32_t updateParamEntry(const char *key, const char *value);
     int32_t commitParamChanges();
     void updateViewAngles();
+    void publishFrameParams();
 
     // Map from strings to values
     static const cam_dimension_t THUMBNAIL_SIZES_MAP[];
@@ -1106,6 +1198,7 @@ private:
     cam_format_t mAppPreviewFormat;
     int32_t mPictureFormat;         // could be CAMERA_PICTURE_TYPE_JPEG or cam_format_t
     bool m_bNeedRestart;            // if preview needs restart after parameters updated
+    bool m_bParamDiff;              // skip handlers of unchanged keys
     bool m_bNoDisplayMode;
     bool m_bWNROn;
     bool m_bTNRPreviewOn;
@@ -1195,6 +1288,21 @@ private:
     uint8_t mAecFrameBound;
     // Number of preview frames, that HAL will hold without displaying, for instant AEC mode.
     uint8_t mAecSkipDisplayFrameBound;
+    // frame parameter snapshots, written by publishFrameParams only
+    QCameraFrameParams m_FrameParams[FRAME_PARAMS_SLOTS];
+    QCameraFrameParams *m_pFrameParams;
+    // map generation and the flatten() cache built from it
+    uint32_t m_nParamGen;
+    QCameraFlatParams *m_pFlatParams;
+    Mutex m_FlatParamsLock;               // cache swap vs lock free readers
+    // delta commit of set batches
+    bool m_bParamDelta;
+    uint8_t m_DeltaSlot[CAM_INTF_PARM_MAX];   // 1 + index in DELTA_PARAMS, 0 if not tracked
+    QCameraParamSent m_ParamSent[PARAM_DELTA_ENTRIES];
+    // deferred set batch
+    uint32_t m_nSetBatchDepth;
+    bool m_bSetBatchOpen;
+    bool m_bSetBatchPending;
 };
 
 }; // namespace qcamera
@@ -169,6 +169,7 @@ int32_t QCameraPostProcessor::init(jpeg_encode_callback_t jpeg_cb, void *user_da
 {
     mJpegCB = jpeg_cb;
     mJpegUserData = user_data;
+    m_dataProcTh.setJobCoalescing(true);
     m_dataProcTh.launch(dataProcessRoutine, this);
     m_saveProcTh.launch(dataSaveRoutine, this);
     m_parent->mParameters.setReprocCount();
@@ -1130,6 +1131,13 @@ int32_t QCameraPostProcessor::procVisidonMode(mm_camera_super_buf_t *procframe)
                                                 resolution,VISIDON_FACE_BEAUTY_SNAPSHOT);
                     break;
             }
+            // flushed with the super buffer before jpeg encoding
+            QCameraMemory *procMem =
+                    (QCameraMemory *)procframe->bufs[proc_buf_index]->mem_info;
+            if (NULL != procMem) {
+                procMem->markCpuWrite(procframe->bufs[proc_buf_index]->buf_idx,
+                        0, procframe->bufs[proc_buf_index]->frame_len);
+            }
         }
         if(m_visidonFrameQ.isEmpty())
         {
@@ -2406,7 +2414,7 @@ int32_t QCameraPostProcessor::encodeData(qcamera_jpeg_data_t *jpeg_job_data,
     **visidon face beauty shot has blue stripe,
     **clean cache before processing the data
     */
-    memObj->cleanInvalidateCache(main_frame->buf_idx);
+    QCameraMemory::flushSuperBuf(recvd_frame);
 
     // dump snapshot frame if enabled
     m_parent->dumpFrameToFile(main_stream, main_frame, QCAMERA_DUMP_FRM_SNAPSHOT);
@@ -3095,7 +3103,7 @@ void *QCameraPostProcessor::dataProcessRoutine(void *data)
     CDBG_HIGH("%s: E", __func__);
     do {
         do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            ret = cmdThread->waitCmd();
             if (ret != 0 && errno != EINVAL) {
                 ALOGE("%s: cam_sem_wait error (%s)",
                            __func__, strerror(errno));
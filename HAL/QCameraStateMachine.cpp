@@ -30,6 +30,7 @@
 #define LOG_TAG "QCameraStateMachine"
 
 #include <utils/Errors.h>
+#include <cutils/properties.h>
 #include "QCamera2HWI.h"
 #include "QCameraStateMachine.h"
 
@@ -124,6 +125,12 @@ QCameraStateMachine::QCameraStateMachine(QCamera2HardwareInterface *ctrl) :
     m_bDelayPreviewMsgs    = false;
     m_bPreviewNeedsRestart = false;
     m_DelayedMsgs          = 0;
+    m_publishedState       = QCAMERA_SM_STATE_PREVIEW_STOPPED;
+    m_publishedDelayedMsgs = 0;
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.api.fastquery", value, "1");
+    m_bFastQuery = atoi(value) > 0 ? true : false;
 }
 
 /*===========================================================================
@@ -319,6 +326,9 @@ int32_t QCameraStateMachine::stateMachine(qcamera_sm_evt_enum_t evt, void *paylo
         break;
     }
 
+    // cover transitions on internal events, API results publish
+    // before they are signaled
+    publishState();
     return rc;
 }
 
@@ -424,9 +434,6 @@ int32_t QCameraStateMachine::procEvtPreviewStoppedState(qcamera_sm_evt_enum_t ev
         break;
     case QCAMERA_SM_EVT_COMMIT_PARAMS:
         {
-            if (m_bPreviewNeedsRestart) {
-                m_parent->m_memoryPool.clear();
-            }
             if (rc == NO_ERROR) {
                 rc = m_parent->commitParameterChanges();
             }
@@ -439,10 +446,6 @@ int32_t QCameraStateMachine::procEvtPreviewStoppedState(qcamera_sm_evt_enum_t ev
         break;
     case QCAMERA_SM_EVT_COMMIT_STOP_PREVIEW:
         {
-            int needRestart = *((int*)payload);
-            if (m_bPreviewNeedsRestart || needRestart) {
-                m_parent->m_memoryPool.clear();
-            }
             if (rc == NO_ERROR) {
                 rc = m_parent->commitParameterChanges();
             }
@@ -839,8 +842,6 @@ int32_t QCameraStateMachine::procEvtPreviewReadyState(qcamera_sm_evt_enum_t evt,
                 CDBG("Restarting preview...");
                 // need restart preview for parameters to take effect
                 m_parent->unpreparePreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
                 // prepare preview again
@@ -865,8 +866,6 @@ int32_t QCameraStateMachine::procEvtPreviewReadyState(qcamera_sm_evt_enum_t evt,
                 CDBG("Stopping preview for restart...");
                 // need restart preview for parameters to take effect
                 m_parent->unpreparePreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
             } else {
@@ -1238,8 +1237,6 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
                 CDBG("Restarting preview...");
                 // stop preview
                 m_parent->stopPreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
                 // start preview again
@@ -1270,8 +1267,6 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
                 CDBG("Stopping preview for restart...");
                 // stop preview
                 m_parent->stopPreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
             } else {
@@ -1542,8 +1537,6 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
             if ((CAMERA_CMD_LONGSHOT_ON == cmd_payload->cmd) &&
                     (m_bPreviewNeedsRestart)) {
                 m_parent->stopPreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
 
                 if (!m_bPreviewDelayedRestart) {
                     // start preview again
@@ -3288,8 +3281,6 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
                 CDBG("Restarting preview...");
                 // stop preview
                 m_parent->stopPreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
                 // start preview again
@@ -3320,8 +3311,6 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
                 CDBG("Stopping preview for restart...");
                 // stop preview
                 m_parent->stopPreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
             } else {
@@ -3988,4 +3977,147 @@ String8 QCameraStateMachine::dump()
     return str;
 }
 
+/*===========================================================================
+ * FUNCTION   : publishState
+ *
+ * DESCRIPTION: publish the current state for the query functions. Called
+ *              from the cmd thread only, which is the single writer of the
+ *              state.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStateMachine::publishState()
+{
+    int32_t delayed = m_bDelayPreviewMsgs ? m_DelayedMsgs : 0;
+    __atomic_store_n(&m_publishedDelayedMsgs, delayed, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_publishedState, m_state, __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : queryPreviewEnabled
+ *
+ * DESCRIPTION: lock free preview_enabled, same answer per state as the
+ *              QCAMERA_SM_EVT_PREVIEW_ENABLED handlers.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : 1 -- preview enabled
+ *              0 -- preview not enabled
+ *              -1 -- has to be processed by the state machine
+ *==========================================================================*/
+int QCameraStateMachine::queryPreviewEnabled()
+{
+    if (!m_bFastQuery) {
+        return -1;
+    }
+
+    switch (__atomic_load_n(&m_publishedState, __ATOMIC_ACQUIRE)) {
+    case QCAMERA_SM_STATE_PREVIEW_READY:
+    case QCAMERA_SM_STATE_PREVIEWING:
+    case QCAMERA_SM_STATE_VIDEO_PIC_TAKING:
+    case QCAMERA_SM_STATE_PREVIEW_PIC_TAKING:
+        return 1;
+    case QCAMERA_SM_STATE_PREVIEW_STOPPED:
+    case QCAMERA_SM_STATE_PIC_TAKING:
+    case QCAMERA_SM_STATE_RECORDING:
+        return 0;
+    case QCAMERA_SM_STATE_PREPARE_SNAPSHOT:
+    default:
+        return -1;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : queryRecordingEnabled
+ *
+ * DESCRIPTION: lock free recording_enabled, same answer per state as the
+ *              QCAMERA_SM_EVT_RECORDING_ENABLED handlers.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : 1 -- recording enabled
+ *              0 -- recording not enabled
+ *              -1 -- has to be processed by the state machine
+ *==========================================================================*/
+int QCameraStateMachine::queryRecordingEnabled()
+{
+    if (!m_bFastQuery) {
+        return -1;
+    }
+
+    switch (__atomic_load_n(&m_publishedState, __ATOMIC_ACQUIRE)) {
+    case QCAMERA_SM_STATE_RECORDING:
+    case QCAMERA_SM_STATE_VIDEO_PIC_TAKING:
+        return 1;
+    case QCAMERA_SM_STATE_PREVIEW_STOPPED:
+    case QCAMERA_SM_STATE_PREVIEW_READY:
+    case QCAMERA_SM_STATE_PREVIEWING:
+    case QCAMERA_SM_STATE_PIC_TAKING:
+    case QCAMERA_SM_STATE_PREVIEW_PIC_TAKING:
+        return 0;
+    case QCAMERA_SM_STATE_PREPARE_SNAPSHOT:
+    default:
+        return -1;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : queryMsgTypeEnabled
+ *
+ * DESCRIPTION: lock free msg_type_enabled. Messages delayed during a ZSL
+ *              snapshot count as enabled in previewing state, as in the
+ *              QCAMERA_SM_EVT_MSG_TYPE_ENABLED handler.
+ *
+ * PARAMETERS :
+ *   @msg_type : msg type mask
+ *
+ * RETURN     : 0 -- not enabled
+ *              > 0 -- enabled
+ *              -1 -- has to be processed by the state machine
+ *==========================================================================*/
+int QCameraStateMachine::queryMsgTypeEnabled(int32_t msg_type)
+{
+    if (!m_bFastQuery) {
+        return -1;
+    }
+
+    qcamera_state_enum_t state =
+            __atomic_load_n(&m_publishedState, __ATOMIC_ACQUIRE);
+    if (state == QCAMERA_SM_STATE_PREPARE_SNAPSHOT) {
+        return -1;
+    }
+
+    int enabled = m_parent->msgTypeEnabled(msg_type);
+    if (state == QCAMERA_SM_STATE_PREVIEWING) {
+        enabled |= (msg_type &
+                __atomic_load_n(&m_publishedDelayedMsgs, __ATOMIC_RELAXED));
+    }
+    // a mask with the sign bit set can not be told apart from -1
+    return (enabled < 0) ? -1 : enabled;
+}
+
+/*===========================================================================
+ * FUNCTION   : queryParameters
+ *
+ * DESCRIPTION: lock free get_parameters, served from the flattened
+ *              parameter cache while it is current.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : flattened parameters, to be released with put_parameters
+ *              NULL if it has to be processed by the state machine
+ *==========================================================================*/
+char *QCameraStateMachine::queryParameters()
+{
+    if (!m_bFastQuery ||
+            (__atomic_load_n(&m_publishedState, __ATOMIC_ACQUIRE) ==
+            QCAMERA_SM_STATE_PREPARE_SNAPSHOT)) {
+        return NULL;
+    }
+
+    return m_parent->mParameters.getCachedFlatParams();
+}
+
 }; // namespace qcamera
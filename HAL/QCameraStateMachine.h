@@ -200,6 +200,15 @@ public:
     bool isRecording();
     void releaseThread();
 
+    // answers to read-only APIs from the published state, without going
+    // through the cmd thread. -1/NULL if the API has to be processed by
+    // the state machine.
+    int queryPreviewEnabled();
+    int queryRecordingEnabled();
+    int queryMsgTypeEnabled(int32_t msg_type);
+    char *queryParameters();
+    void publishState();
+
 private:
     typedef enum {
         QCAMERA_SM_STATE_PREVIEW_STOPPED,          // preview is stopped
@@ -252,6 +261,10 @@ private:
     bool m_bPreviewNeedsRestart;          // Preview needs restart
     bool m_bPreviewDelayedRestart;        // Preview delayed restart
     int32_t m_DelayedMsgs;
+    // state seen by the query functions, written by publishState only
+    qcamera_state_enum_t m_publishedState;
+    int32_t m_publishedDelayedMsgs;
+    bool m_bFastQuery;                    // serve read-only APIs lock free
 };
 
 }; // namespace qcamera
@@ -264,6 +264,35 @@ int32_t QCameraStream::clean_invalidate_buf(uint32_t index, void *user_data)
     return 0;
 }
 
+/*===========================================================================
+ * FUNCTION   : mark_cpu_write
+ *
+ * DESCRIPTION: static function entry to report a CPU write into a dequeued
+ *              stream buffer, so the next sync for device is not skipped
+ *
+ * PARAMETERS :
+ *   @index      : index of the stream buffer written
+ *   @offset     : offset of the written range
+ *   @len        : length of the written range
+ *   @user_data  : user data ptr of ops_tbl
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraStream::mark_cpu_write(uint32_t index, size_t offset,
+        size_t len, void *user_data)
+{
+    QCameraStream *stream = reinterpret_cast<QCameraStream *>(user_data);
+    if (!stream || !stream->mStreamBufs) {
+        ALOGE("%s: invalid stream pointer", __func__);
+        return NO_MEMORY;
+    }
+
+    stream->mStreamBufs->markCpuWrite(index, offset, len);
+    return NO_ERROR;
+}
+
 /*===========================================================================
  * FUNCTION   : set_config_ops
  *
@@ -333,7 +362,9 @@ QCameraStream::QCameraStream(QCameraAllocator &allocator,
         mDataCB(NULL),
         mSYNCDataCB(NULL),
         mUserData(NULL),
-        mDataQ(releaseFrameData, this),
+        mDataQ(releaseFrameData, this, QCAMERA_QUEUE_TYPE_RING_SPSC,
+                CAM_MAX_NUM_BUFS_PER_STREAM),
+        mUseProcLane(false),
         mStreamInfoBuf(NULL),
         mMiscBuf(NULL),
         mStreamBufs(NULL),
@@ -384,6 +415,7 @@ QCameraStream::QCameraStream(QCameraAllocator &allocator,
     }
     mMemVtbl.invalidate_buf = invalidate_buf;
     mMemVtbl.clean_invalidate_buf = clean_invalidate_buf;
+    mMemVtbl.mark_cpu_write = mark_cpu_write;
     mMemVtbl.set_config_ops = set_config_ops;
     memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
     memcpy(&mPaddingInfo, paddingInfo, sizeof(cam_padding_info_t));
@@ -877,7 +909,25 @@ int32_t QCameraStream::start()
 {
     int32_t rc = 0;
     mDataQ.init();
-    rc = mProcTh.launch(dataProcRoutine, this);
+    // preview and postview callbacks block on the display window and on
+    // frame processing, they keep their own thread so they can not stall
+    // the lanes sharing an executor worker
+    mUseProcLane = QCameraExecutor::isEnabled() &&
+            !isTypeOf(CAM_STREAM_TYPE_PREVIEW) &&
+            !isTypeOf(CAM_STREAM_TYPE_POSTVIEW);
+    if (mUseProcLane) {
+        char name[QCAMERA_EXECUTOR_LANE_NAME_SIZE];
+        snprintf(name, sizeof(name), "strm_%d_%x", getMyType(), mHandle);
+        rc = mProcLane.start(name, dataProcLaneRoutine, this);
+        if (rc != NO_ERROR) {
+            ALOGE("%s: executor lane failed, use stream thread", __func__);
+            mUseProcLane = false;
+        }
+    }
+    if (!mUseProcLane) {
+        mProcTh.setJobCoalescing(true);
+        rc = mProcTh.launch(dataProcRoutine, this);
+    }
     if (rc == NO_ERROR) {
         m_bActive = true;
     }
@@ -942,7 +992,12 @@ int32_t QCameraStream::stop()
     m_bActive = false;
     mAllocator.waitForBackgroundTask(mAllocTaskId);
     mAllocator.waitForBackgroundTask(mMapTaskId);
-    rc = mProcTh.exit();
+    if (mUseProcLane) {
+        rc = mProcLane.stop();
+        releaseProcResources();
+    } else {
+        rc = mProcTh.exit();
+    }
     return rc;
 }
 
@@ -1045,6 +1100,9 @@ int32_t QCameraStream::processDataNotify(mm_camera_super_buf_t *frame)
 {
     CDBG("%s:\n", __func__);
     if (mDataQ.enqueue((void *)frame)) {
+        if (mUseProcLane) {
+            return mProcLane.post();
+        }
         return mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
     } else {
         CDBG_HIGH("%s: Stream thread is not active, no ops here", __func__);
@@ -1117,10 +1175,84 @@ void QCameraStream::dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
         return;
     }
     *frame = *recvd_frame;
+    CAM_FRAME_TRACE("QCameraStream_dataNotify",
+            recvd_frame->bufs[0]->stream_type, recvd_frame->bufs[0]->frame_idx);
     stream->processDataNotify(frame);
     return;
 }
 
+/*===========================================================================
+ * FUNCTION   : processNextFrame
+ *
+ * DESCRIPTION: hand the next queued frame to dataCB
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStream::processNextFrame()
+{
+    mm_camera_super_buf_t *frame = (mm_camera_super_buf_t *)mDataQ.dequeue();
+    if (NULL != frame) {
+        if (mDataCB != NULL) {
+            CAM_FRAME_TRACE_SCOPE("QCameraStream_dataCB",
+                    frame->bufs[0]->stream_type, frame->bufs[0]->frame_idx);
+            mDataCB(frame, this, mUserData);
+        } else {
+            // no data cb routine, return buf here
+            bufDone(frame->bufs[0]->buf_idx);
+            free(frame);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseProcResources
+ *
+ * DESCRIPTION: flush pending frames and free data processing resources
+ *              once dataCB processing has stopped
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStream::releaseProcResources()
+{
+    /* flush data buf queue */
+    mDataQ.flush();
+    /*xiaoming.hu@tcl.com for DxO*/
+#ifdef TCT_TARGET_EIS_DXO_ENABLE
+    //CDBG_HIGH("WXT: dataProcRoutine Exit DxOEIS video size  width= %d, height=%d  ",mVideoWidth, mVideoHeight);
+
+    if (mIsVideoEisEnable && mCamId == 0 &&
+        ((1920 == mVideoWidth && 1080 == mVideoHeight) ||
+         (1280 == mVideoWidth && 720 == mVideoHeight) ||
+         (720 == mVideoWidth && 480 == mVideoHeight)))
+    {
+        deallocateDxOBuf();
+    }
+#endif
+#ifdef TCT_TSHDR_FEATURE // MODIFIED by xmhu, 2016-05-05,BUG-1865718
+    deallocateVideoBuf();
+#endif
+}
+
+/*===========================================================================
+ * FUNCTION   : dataProcLaneRoutine
+ *
+ * DESCRIPTION: executor lane job, same as DO_NEXT_JOB of dataProcRoutine
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStream::dataProcLaneRoutine(void *data)
+{
+    QCameraStream *pme = (QCameraStream *)data;
+    pme->processNextFrame();
+}
+
 /*===========================================================================
  * FUNCTION   : dataProcRoutine
  *
@@ -1142,7 +1274,7 @@ void *QCameraStream::dataProcRoutine(void *data)
     CDBG("%s: E", __func__);
     do {
         do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            ret = cmdThread->waitCmd();
             if (ret != 0 && errno != EINVAL) {
                 ALOGE("%s: cam_sem_wait error (%s)",
                       __func__, strerror(errno));
@@ -1154,41 +1286,13 @@ void *QCameraStream::dataProcRoutine(void *data)
         camera_cmd_type_t cmd = cmdThread->getCmd();
         switch (cmd) {
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
-            {
-                CDBG_HIGH("%s: Do next job", __func__);
-                mm_camera_super_buf_t *frame =
-                    (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
-                if (NULL != frame) {
-                    if (pme->mDataCB != NULL) {
-                        pme->mDataCB(frame, pme, pme->mUserData);
-                    } else {
-                        // no data cb routine, return buf here
-                        pme->bufDone(frame->bufs[0]->buf_idx);
-                        free(frame);
-                    }
-                }
-            }
+            CDBG_HIGH("%s: Do next job", __func__);
+            pme->processNextFrame();
             break;
         case CAMERA_CMD_TYPE_EXIT:
             CDBG_HIGH("%s: Exit", __func__);
-            /* flush data buf queue */
-            pme->mDataQ.flush();
-	     /*xiaoming.hu@tcl.com for DxO*/
-#ifdef TCT_TARGET_EIS_DXO_ENABLE
-            //CDBG_HIGH("WXT: dataProcRoutine Exit DxOEIS video size  width= %d, height=%d  ",pme->mVideoWidth, pme->mVideoHeight);
-
-            if (pme->mIsVideoEisEnable && pme->mCamId == 0 &&
-                ((1920 == pme->mVideoWidth && 1080 == pme->mVideoHeight) ||
-                 (1280 == pme->mVideoWidth && 720 == pme->mVideoHeight) ||
-                 (720 == pme->mVideoWidth && 480 == pme->mVideoHeight)))
-            {
-                pme->deallocateDxOBuf();
-            }
-#endif
+            pme->releaseProcResources();
             running = 0;
-#ifdef TCT_TSHDR_FEATURE // MODIFIED by xmhu, 2016-05-05,BUG-1865718
-            pme->deallocateVideoBuf();
-#endif
             break;
         default:
             break;
@@ -1775,7 +1879,17 @@ int32_t QCameraStream::mapBuffers()
     if (rc == NO_ERROR) {
         rc = bufferMaps.getCamBufMapList(bufMapList);
     }
-    if (rc == NO_ERROR) {
+    if ((rc == NO_ERROR) && (m_MemOpsTbl.bundled_map_async_ops != NULL)) {
+        // The socket is not held while the server maps, so the maps of
+        // other streams set up in the background go out meanwhile
+        mm_camera_map_batch_t batch;
+        memset(&batch, 0, sizeof(batch));
+        rc = m_MemOpsTbl.bundled_map_async_ops(&bufMapList, &batch,
+                m_MemOpsTbl.userdata);
+        if (rc == NO_ERROR) {
+            rc = m_MemOpsTbl.wait_ops(&batch, m_MemOpsTbl.userdata);
+        }
+    } else if (rc == NO_ERROR) {
         rc = mapBufs(bufMapList, NULL);
     }
 
@@ -2265,7 +2379,8 @@ int32_t QCameraStream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
 /*===========================================================================
  * FUNCTION   : invalidateBuf
  *
- * DESCRIPTION: invalidate a specific stream buffer
+ * DESCRIPTION: cache maintenance of a stream buffer queued to the kernel,
+ *              only CPU writes reported on the buffer need it
  *
  * PARAMETERS :
  *   @index   : index of the buffer to invalidate
@@ -2276,13 +2391,14 @@ int32_t QCameraStream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
  *==========================================================================*/
 int32_t QCameraStream::invalidateBuf(uint32_t index)
 {
-    return mStreamBufs->invalidateCache(index);
+    return mStreamBufs->syncForDevice(index);
 }
 
 /*===========================================================================
  * FUNCTION   : cleanInvalidateBuf
  *
- * DESCRIPTION: clean invalidate a specific stream buffer
+ * DESCRIPTION: cache maintenance of a stream buffer dequeued from the
+ *              kernel, before the CPU reads it
  *
  * PARAMETERS :
  *   @index   : index of the buffer to clean invalidate
@@ -2293,7 +2409,7 @@ int32_t QCameraStream::invalidateBuf(uint32_t index)
  *==========================================================================*/
 int32_t QCameraStream::cleanInvalidateBuf(uint32_t index)
 {
-    return mStreamBufs->cleanInvalidateCache(index);
+    return mStreamBufs->syncForCpu(index);
 }
 
 /*===========================================================================
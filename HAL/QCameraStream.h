@@ -32,6 +32,7 @@
 
 #include <hardware/camera.h>
 #include "QCameraCmdThread.h"
+#include "QCameraExecutor.h"
 #include "QCameraMem.h"
 #include "QCameraAllocator.h"
 
@@ -92,6 +93,7 @@ public:
     static void dataNotifySYNCCB(mm_camera_super_buf_t *recvd_frame,
             void *userdata);
     static void *dataProcRoutine(void *data);
+    static void dataProcLaneRoutine(void *data);
     static void *BufAllocRoutine(void *data);
     uint32_t getMyHandle() const {return mHandle;}
     bool isTypeOf(cam_stream_type_t type);
@@ -169,8 +171,10 @@ private:
     stream_cb_routine mSYNCDataCB;
     void *mUserData;
 
-    QCameraQueue     mDataQ;
+    QCameraQueue     mDataQ; // single producer: mm-camera stream cmd thread
     QCameraCmdThread mProcTh; // thread for dataCB
+    QCameraExecutorLane mProcLane; // shared executor lane for dataCB
+    bool mUseProcLane; // dataCB runs on mProcLane instead of mProcTh
 
     QCameraHeapMemory *mStreamInfoBuf;
     QCameraHeapMemory *mMiscBuf;
@@ -232,10 +236,15 @@ private:
 
     static int32_t invalidate_buf(uint32_t index, void *user_data);
     static int32_t clean_invalidate_buf(uint32_t index, void *user_data);
+    static int32_t mark_cpu_write(uint32_t index, size_t offset, size_t len,
+            void *user_data);
 
     static int32_t backgroundAllocate(void* data);
     static int32_t backgroundMap(void* data);
 
+    void processNextFrame();
+    void releaseProcResources();
+
 #ifdef TCT_TARGET_EIS_DXO_ENABLE
     int32_t getBufs(cam_frame_len_offset_t *offset,
                      uint8_t *num_bufs,
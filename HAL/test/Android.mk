@@ -60,3 +60,22 @@ LOCAL_CFLAGS += -DUSE_L_MR1
 endif
 
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    qcamera_params_bench.cpp
+
+LOCAL_SHARED_LIBRARIES:= \
+    libutils \
+    libcutils \
+    libhardware \
+    libcamera_client
+
+LOCAL_CFLAGS += -Wall -Wextra -Werror -Wno-unused-parameter
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+LOCAL_MODULE:= qcamera_params_bench
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,240 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Microbenchmark for the HAL1 parameter string: flatten, unflatten and the
+ * round trip a get_parameters/set_parameters pair costs, at key counts
+ * around what QCameraParameters holds (~300 keys, the supported-values
+ * lists being the long ones). "flatten + copy" is what get_parameters did
+ * on every call before the string was cached.
+ * With -c the camera HAL is opened in HAL1 mode and get_parameters /
+ * put_parameters are timed on the real QCameraParameters, with unchanged
+ * parameters (cached string) and after a set_parameters that changes one
+ * key (string rebuilt).
+ * Usage: qcamera_params_bench [-n iterations] [-k keys] [-c camera id]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <camera/CameraParameters.h>
+#include <hardware/camera.h>
+#include <hardware/camera_common.h>
+
+using namespace android;
+
+#define BENCH_LIST_EVERY 8  // one supported-values list every N keys
+
+static uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_fill(CameraParameters &params, uint32_t keys)
+{
+    char key[32];
+    char value[512];
+
+    for (uint32_t i = 0; i < keys; i++) {
+        snprintf(key, sizeof(key), "bench-key-%u", i);
+        if ((i % BENCH_LIST_EVERY) == 0) {
+            // like "preview-size-values", a list of WxH
+            size_t len = 0;
+            for (uint32_t j = 0; (j < 24) && (len + 16 < sizeof(value)); j++) {
+                len += (size_t)snprintf(value + len, sizeof(value) - len,
+                        "%s%ux%u", j ? "," : "", 4160 - j * 160, 3120 - j * 120);
+            }
+        } else {
+            snprintf(value, sizeof(value), "%u", i * 7);
+        }
+        params.set(key, value);
+    }
+}
+
+static void bench_report(const char *name, uint32_t keys, uint64_t elapsed,
+        uint32_t iterations)
+{
+    printf("%-16s keys %4u: %10.2f us\n", name, keys,
+            (double)elapsed / 1000.0 / (double)iterations);
+}
+
+static void bench_keys(uint32_t keys, uint32_t iterations)
+{
+    CameraParameters params;
+    bench_fill(params, keys);
+    String8 flat = params.flatten();
+    uint64_t start;
+
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        String8 str = params.flatten();
+    }
+    bench_report("flatten", keys, bench_now_ns() - start, iterations);
+
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        CameraParameters copy;
+        copy.unflatten(flat);
+    }
+    bench_report("unflatten", keys, bench_now_ns() - start, iterations);
+
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        CameraParameters copy(params.flatten());
+    }
+    bench_report("round trip", keys, bench_now_ns() - start, iterations);
+
+    // what get_parameters did on every call
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        String8 str = params.flatten();
+        char *out = (char *)malloc(str.length() + 1);
+        if (out != NULL) {
+            memcpy(out, str.string(), str.length() + 1);
+        }
+        free(out);
+    }
+    bench_report("flatten + copy", keys, bench_now_ns() - start, iterations);
+    printf("%-16s keys %4u: %10zu bytes\n", "string", keys, flat.length());
+}
+
+static int bench_hal(const char *camera_id, uint32_t iterations)
+{
+    camera_module_t *module = NULL;
+    hw_device_t *hw_dev = NULL;
+    camera_device_t *dev;
+    uint64_t start;
+    char *str;
+    int rc;
+
+    rc = hw_get_module(CAMERA_HARDWARE_MODULE_ID, (const hw_module_t **)&module);
+    if ((rc != 0) || (module == NULL)) {
+        printf("camera module not found: %d\n", rc);
+        return -1;
+    }
+    if (module->open_legacy != NULL) {
+        rc = module->open_legacy(&module->common, camera_id,
+                CAMERA_DEVICE_API_VERSION_1_0, &hw_dev);
+    } else {
+        rc = module->common.methods->open(&module->common, camera_id, &hw_dev);
+    }
+    if ((rc != 0) || (hw_dev == NULL)) {
+        printf("failed to open camera %s: %d\n", camera_id, rc);
+        return -1;
+    }
+    dev = (camera_device_t *)hw_dev;
+
+    // first get builds the string
+    str = dev->ops->get_parameters(dev);
+    if (str == NULL) {
+        printf("get_parameters failed\n");
+        dev->common.close(hw_dev);
+        return -1;
+    }
+    CameraParameters params;
+    params.unflatten(String8(str));
+    uint32_t keys = 1;
+    for (const char *c = str; *c != '\0'; c++) {
+        keys += (*c == ';') ? 1 : 0;
+    }
+    dev->ops->put_parameters(dev, str);
+
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        str = dev->ops->get_parameters(dev);
+        dev->ops->put_parameters(dev, str);
+    }
+    bench_report("hal get cached", keys, bench_now_ns() - start, iterations);
+
+    // one changed key per set, so every get rebuilds the string
+    uint64_t set_ns = 0;
+    uint64_t get_ns = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        params.set(CameraParameters::KEY_JPEG_QUALITY, (i & 1) ? 90 : 95);
+        String8 flat = params.flatten();
+        start = bench_now_ns();
+        dev->ops->set_parameters(dev, flat.string());
+        set_ns += bench_now_ns() - start;
+        start = bench_now_ns();
+        str = dev->ops->get_parameters(dev);
+        dev->ops->put_parameters(dev, str);
+        get_ns += bench_now_ns() - start;
+    }
+    bench_report("hal set", keys, set_ns, iterations);
+    bench_report("hal get rebuilt", keys, get_ns, iterations);
+
+    dev->ops->release(dev);
+    dev->common.close(hw_dev);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint32_t key_counts[] = { 50, 150, 300, 500 };
+    uint32_t iterations = 2000;
+    uint32_t keys = 0;
+    const char *camera_id = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:k:c:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = (uint32_t)atoi(optarg);
+            break;
+        case 'k':
+            keys = (uint32_t)atoi(optarg);
+            break;
+        case 'c':
+            camera_id = optarg;
+            break;
+        default:
+            printf("usage: %s [-n iterations] [-k keys] [-c camera id]\n",
+                    argv[0]);
+            return -1;
+        }
+    }
+    if (iterations == 0) {
+        iterations = 1;
+    }
+
+    if (camera_id != NULL) {
+        return bench_hal(camera_id, iterations);
+    }
+    if (keys > 0) {
+        bench_keys(keys, iterations);
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(key_counts) / sizeof(key_counts[0]); i++) {
+        bench_keys(key_counts[i], iterations);
+    }
+    return 0;
+}
@@ -2032,7 +2032,7 @@ int32_t QCamera3PicChannel::request(buffer_handle_t *buffer,
             free(src_frame);
             return rc;
         }
-        memcpy(meta_buf.buffer, metadata, sizeof(metadata_buffer_t));
+        mm_camera_meta_copy((metadata_buffer_t *)meta_buf.buffer, metadata);
         src_frame->metadata_buffer = meta_buf;
         src_frame->reproc_config = reproc_cfg;
 
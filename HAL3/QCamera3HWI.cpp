@@ -312,6 +312,8 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
       mParamHeap(NULL),
       mParameters(NULL),
       mPrevParameters(NULL),
+      mSettingsDiff(true),
+      mSettingsRecord(false),
       m_bIsVideo(false),
       m_bIs4KVideo(false),
       m_bEisSupportedSize(false),
@@ -342,8 +344,15 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
 
     pthread_cond_init(&mRequestCond, NULL);
     mPendingRequest = 0;
+    mMetadataSeq = 0;
+    clearPendingIndex();
     mCurrentRequestId = -1;
     pthread_mutex_init(&mMutex, NULL);
+    pthread_mutex_init(&mDeliveryLock, NULL);
+    pthread_mutex_init(&mPendingLock, NULL);
+    memset(mRequestLatency, 0, sizeof(mRequestLatency));
+    memset(mLockWait, 0, sizeof(mLockWait));
+    memset(mLockAcquired, 0, sizeof(mLockAcquired));
 
     for (size_t i = 0; i < CAMERA3_TEMPLATE_COUNT; i++)
         mDefaultMetadata[i] = NULL;
@@ -365,6 +374,14 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
     property_get("persist.camera.tnr.preview", prop, "0");
     m_bTnrEnabled = (uint8_t)atoi(prop);
 
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.hal3.settings.diff", prop, "1");
+    mSettingsDiff = (atoi(prop) != 0);
+
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.hal3.settings.rec", prop, "0");
+    mSettingsRecord = (atoi(prop) != 0);
+
     //Load and read GPU library.
     lib_surface_utils = NULL;
     LINK_get_surface_pixel_alignment = NULL;
@@ -466,10 +483,21 @@ QCamera3HardwareInterface::~QCamera3HardwareInterface()
     if (mCameraOpened)
         closeCamera();
 
+    clearPendingIndex();
     mPendingBuffersMap.mPendingBufferList.clear();
     mPendingRequestsList.clear();
     mPendingReprocessResultList.clear();
 
+    /* nothing is left to deliver to once the device is closed */
+    for (List<PendingCallback>::iterator i = mCallbackQueue.begin();
+            i != mCallbackQueue.end(); i++) {
+        delete [] i->result.output_buffers;
+        if (i->pooled) {
+            mResultPool.put((camera_metadata_t *)i->result.result);
+        }
+    }
+    mCallbackQueue.clear();
+
     for (size_t i = 0; i < CAMERA3_TEMPLATE_COUNT; i++)
         if (mDefaultMetadata[i])
             free_camera_metadata(mDefaultMetadata[i]);
@@ -478,6 +506,8 @@ QCamera3HardwareInterface::~QCamera3HardwareInterface()
 
     pthread_cond_destroy(&mBuffersCond);
 
+    pthread_mutex_destroy(&mPendingLock);
+    pthread_mutex_destroy(&mDeliveryLock);
     pthread_mutex_destroy(&mMutex);
     CDBG("%s: X", __func__);
 }
@@ -522,10 +552,10 @@ void QCamera3HardwareInterface::camEvtHandle(uint32_t /*camera_handle*/,
 
             case CAM_EVENT_TYPE_DAEMON_PULL_REQ:
                 CDBG("%s: HAL got request pull from Daemon", __func__);
-                pthread_mutex_lock(&obj->mMutex);
+                obj->lockWithStat(&obj->mPendingLock, LOCK_STAT_PENDING);
                 obj->mWokenUpByDaemon = true;
                 obj->unblockRequestIfNecessary();
-                pthread_mutex_unlock(&obj->mMutex);
+                pthread_mutex_unlock(&obj->mPendingLock);
                 break;
 
             default:
@@ -1005,7 +1035,7 @@ int QCamera3HardwareInterface::configureStreams(
         mMetadataChannel->stop();
     }
 
-    pthread_mutex_lock(&mMutex);
+    lockAll();
 
     /* Check whether we have video stream */
     m_bIs4KVideo = false;
@@ -1184,20 +1214,20 @@ int QCamera3HardwareInterface::configureStreams(
             processedStreamCnt > MAX_PROCESSED_STREAMS) {
         ALOGE("%s: Invalid stream configu: stall: %d, raw: %d, processed %d",
                 __func__, stallStreamCnt, rawStreamCnt, processedStreamCnt);
-        pthread_mutex_unlock(&mMutex);
+        unlockAll();
         return -EINVAL;
     }
     /* Check whether we have zsl stream or 4k video case */
     if (isZsl && m_bIsVideo) {
         ALOGE("%s: Currently invalid configuration ZSL&Video!", __func__);
-        pthread_mutex_unlock(&mMutex);
+        unlockAll();
         return -EINVAL;
     }
     /* Check if stream sizes are sane */
     if (numStreamsOnEncoder > 2) {
         ALOGE("%s: Number of streams on ISP encoder path exceeds limits of 2",
                 __func__);
-        pthread_mutex_unlock(&mMutex);
+        unlockAll();
         return -EINVAL;
     } else if (1 < numStreamsOnEncoder){
         bUseCommonFeatureMask = true;
@@ -1208,14 +1238,14 @@ int QCamera3HardwareInterface::configureStreams(
     if (m_bIs4KVideo && bJpegExceeds4K) {
         ALOGE("%s: HAL doesn't support Blob size greater than 4k in 4k recording",
                 __func__);
-        pthread_mutex_unlock(&mMutex);
+        unlockAll();
         return -EINVAL;
     }
 
     rc = validateStreamDimensions(streamList);
     if (rc != NO_ERROR) {
         ALOGE("%s: Invalid stream configuration requested!", __func__);
-        pthread_mutex_unlock(&mMutex);
+        unlockAll();
         return rc;
     }
 
@@ -1247,7 +1277,7 @@ int QCamera3HardwareInterface::configureStreams(
             if (!stream_info) {
                ALOGE("%s: Could not allocate stream info", __func__);
                rc = -ENOMEM;
-               pthread_mutex_unlock(&mMutex);
+               unlockAll();
                return rc;
             }
             stream_info->stream = newStream;
@@ -1259,7 +1289,7 @@ int QCamera3HardwareInterface::configureStreams(
                 || newStream->stream_type == CAMERA3_STREAM_BIDIRECTIONAL ) {
             if (inputStream != NULL) {
                 ALOGE("%s: Multiple input streams requested!", __func__);
-                pthread_mutex_unlock(&mMutex);
+                unlockAll();
                 return BAD_VALUE;
             }
             inputStream = newStream;
@@ -1292,7 +1322,7 @@ int QCamera3HardwareInterface::configureStreams(
     if (mMetadataChannel == NULL) {
         ALOGE("%s: failed to allocate metadata channel", __func__);
         rc = -ENOMEM;
-        pthread_mutex_unlock(&mMutex);
+        unlockAll();
         return rc;
     }
     rc = mMetadataChannel->initialize(IS_TYPE_NONE);
@@ -1300,7 +1330,7 @@ int QCamera3HardwareInterface::configureStreams(
         ALOGE("%s: metadata channel initialization failed", __func__);
         delete mMetadataChannel;
         mMetadataChannel = NULL;
-        pthread_mutex_unlock(&mMutex);
+        unlockAll();
         return rc;
     }
 
@@ -1319,7 +1349,7 @@ int QCamera3HardwareInterface::configureStreams(
                 this);
         if (!mAnalysisChannel) {
             ALOGE("%s: H/W Analysis channel cannot be created", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return -ENOMEM;
         }
     }
@@ -1336,7 +1366,7 @@ int QCamera3HardwareInterface::configureStreams(
                 this);
         if (!mSupportChannel) {
             ALOGE("%s: dummy channel cannot be created", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return -ENOMEM;
         }
     }
@@ -1475,7 +1505,7 @@ int QCamera3HardwareInterface::configureStreams(
                         jpegStream->width, jpegStream->height);
                 if (channel == NULL) {
                     ALOGE("%s: allocation of channel failed", __func__);
-                    pthread_mutex_unlock(&mMutex);
+                    unlockAll();
                     return -ENOMEM;
                 }
                 newStream->max_buffers = channel->getNumBuffers();
@@ -1494,7 +1524,7 @@ int QCamera3HardwareInterface::configureStreams(
                             mStreamConfigInfo.postprocess_mask[i]);
                     if (channel == NULL) {
                         ALOGE("%s: allocation of channel failed", __func__);
-                        pthread_mutex_unlock(&mMutex);
+                        unlockAll();
                         return -ENOMEM;
                     }
                     newStream->max_buffers = channel->getNumBuffers();
@@ -1511,7 +1541,7 @@ int QCamera3HardwareInterface::configureStreams(
                             (newStream->format == HAL_PIXEL_FORMAT_RAW16));
                     if (mRawChannel == NULL) {
                         ALOGE("%s: allocation of raw channel failed", __func__);
-                        pthread_mutex_unlock(&mMutex);
+                        unlockAll();
                         return -ENOMEM;
                     }
                     newStream->max_buffers = mRawChannel->getNumBuffers();
@@ -1529,7 +1559,7 @@ int QCamera3HardwareInterface::configureStreams(
                             (m_bIsVideo ? 1 : MAX_INFLIGHT_REQUESTS));
                     if (mPictureChannel == NULL) {
                         ALOGE("%s: allocation of channel failed", __func__);
-                        pthread_mutex_unlock(&mMutex);
+                        unlockAll();
                         return -ENOMEM;
                     }
                     newStream->priv = (QCamera3Channel*)mPictureChannel;
@@ -1580,7 +1610,7 @@ int QCamera3HardwareInterface::configureStreams(
                                   this, CAM_QCOM_FEATURE_NONE);
         if (!mRawDumpChannel) {
             ALOGE("%s: Raw Dump channel cannot be created", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return -ENOMEM;
         }
     }
@@ -1623,6 +1653,7 @@ int QCamera3HardwareInterface::configureStreams(
     mStreamConfigInfo.buffer_info.max_buffers = MAX_INFLIGHT_REQUESTS;
 
     /* Initialize mPendingRequestInfo and mPendnigBuffersMap */
+    clearPendingIndex();
     mPendingRequestsList.clear();
     mPendingFrameDropList.clear();
     // Initialize/Reset the pending buffers list
@@ -1631,13 +1662,15 @@ int QCamera3HardwareInterface::configureStreams(
     mPendingReprocessResultList.clear();
 
     mFirstRequest = true;
+    // New streams start from the defaults at the backend
+    mSettingsCache.invalidate();
     //Get min frame duration for this streams configuration
     deriveMinFrameDuration();
 
     /* Turn on video hint only if video stream is configured */
     updatePowerHint(bWasVideo, m_bIsVideo);
 
-    pthread_mutex_unlock(&mMutex);
+    unlockAll();
     return rc;
 }
 
@@ -1878,33 +1911,30 @@ int32_t QCamera3HardwareInterface::handlePendingReprocResults(uint32_t frame_num
     for (List<PendingReprocessResult>::iterator j = mPendingReprocessResultList.begin();
             j != mPendingReprocessResultList.end(); j++) {
         if (j->frame_number == frame_number) {
-            mCallbackOps->notify(mCallbackOps, &j->notify_msg);
+            queueNotify(&j->notify_msg);
 
             CDBG("%s: Delayed reprocess notify %d", __func__,
                     frame_number);
 
-            for (List<PendingRequestInfo>::iterator k = mPendingRequestsList.begin();
-                k != mPendingRequestsList.end(); k++) {
-
-                if (k->frame_number == j->frame_number) {
-                    CDBG("%s: Found reprocess frame number %d in pending reprocess List "
-                            "Take it out!!", __func__,
-                            k->frame_number);
-
-                    camera3_capture_result result;
-                    memset(&result, 0, sizeof(camera3_capture_result));
-                    result.frame_number = frame_number;
-                    result.num_output_buffers = 1;
-                    result.output_buffers =  &j->buffer;
-                    result.input_buffer = k->input_buffer;
-                    result.result = k->settings;
-                    result.partial_result = PARTIAL_RESULT_COUNT;
-                    mCallbackOps->process_capture_result(mCallbackOps, &result);
-
-                    mPendingRequestsList.erase(k);
-                    mPendingRequest--;
-                    break;
-                }
+            List<PendingRequestInfo>::iterator k = findPendingRequest(frame_number);
+            if (k != mPendingRequestsList.end()) {
+                CDBG("%s: Found reprocess frame number %d in pending reprocess List "
+                        "Take it out!!", __func__,
+                        k->frame_number);
+
+                camera3_capture_result result;
+                memset(&result, 0, sizeof(camera3_capture_result));
+                result.frame_number = frame_number;
+                result.num_output_buffers = 1;
+                result.output_buffers =  &j->buffer;
+                result.input_buffer = k->input_buffer;
+                result.result = k->settings;
+                result.partial_result = PARTIAL_RESULT_COUNT;
+                queueResult(&result, false);
+
+                recordRequestLatency(REQ_LAT_REPROCESS, k->request_time);
+                erasePendingRequest(k);
+                mPendingRequest--;
             }
             mPendingReprocessResultList.erase(j);
             break;
@@ -1916,7 +1946,7 @@ int32_t QCamera3HardwareInterface::handlePendingReprocResults(uint32_t frame_num
 /*===========================================================================
  * FUNCTION   : handleMetadataWithLock
  *
- * DESCRIPTION: Handles metadata buffer callback with mMutex lock held.
+ * DESCRIPTION: Handles metadata buffer callback with mPendingLock held.
  *
  * PARAMETERS : @metadata_buf: metadata buffer
  *
@@ -1975,41 +2005,35 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
           __func__, urgent_frame_number, capture_time);
 
         //Recieved an urgent Frame Number, handle it
-        //using partial results
-        for (List<PendingRequestInfo>::iterator i =
-            mPendingRequestsList.begin(); i != mPendingRequestsList.end(); i++) {
-            CDBG("%s: Iterator Frame = %d urgent frame = %d",
-                __func__, i->frame_number, urgent_frame_number);
-
-            if (i->frame_number < urgent_frame_number &&
-                i->partial_result_cnt == 0) {
+        //using partial results. The list is ordered by frame number.
+        for (List<PendingRequestInfo>::iterator i = mPendingRequestsList.begin();
+                i != mPendingRequestsList.end() &&
+                i->frame_number < urgent_frame_number; i++) {
+            if (i->partial_result_cnt == 0) {
                 ALOGE("%s: Error: HAL missed urgent metadata for frame number %d",
                     __func__, i->frame_number);
             }
+        }
 
-            if (i->frame_number == urgent_frame_number &&
-                     i->bUrgentReceived == 0) {
-
-                camera3_capture_result_t result;
-                memset(&result, 0, sizeof(camera3_capture_result_t));
-
-                i->partial_result_cnt++;
-                i->bUrgentReceived = 1;
-                // Extract 3A metadata
-                result.result =
-                    translateCbUrgentMetadataToResultMetadata(metadata);
-                // Populate metadata result
-                result.frame_number = urgent_frame_number;
-                result.num_output_buffers = 0;
-                result.output_buffers = NULL;
-                result.partial_result = i->partial_result_cnt;
-
-                mCallbackOps->process_capture_result(mCallbackOps, &result);
-                CDBG("%s: urgent frame_number = %u, capture_time = %lld",
-                     __func__, result.frame_number, capture_time);
-                free_camera_metadata((camera_metadata_t *)result.result);
-                break;
-            }
+        List<PendingRequestInfo>::iterator i = findPendingRequest(urgent_frame_number);
+        if (i != mPendingRequestsList.end() && i->bUrgentReceived == 0) {
+            camera3_capture_result_t result;
+            memset(&result, 0, sizeof(camera3_capture_result_t));
+
+            i->partial_result_cnt++;
+            i->bUrgentReceived = 1;
+            // Extract 3A metadata
+            result.result =
+                translateCbUrgentMetadataToResultMetadata(metadata);
+            // Populate metadata result
+            result.frame_number = urgent_frame_number;
+            result.num_output_buffers = 0;
+            result.output_buffers = NULL;
+            result.partial_result = i->partial_result_cnt;
+
+            queueResult(&result, true);
+            CDBG("%s: urgent frame_number = %u, capture_time = %lld",
+                 __func__, result.frame_number, capture_time);
         }
     }
 
@@ -2031,6 +2055,7 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
         CDBG("%s: frame_number in the list is %u", __func__, i->frame_number);
         i->partial_result_cnt++;
         result.partial_result = i->partial_result_cnt;
+        uint8_t pipeline_depth = (uint8_t)(mMetadataSeq - i->meta_seq);
 
         // Flush out all entries with less or equal frame numbers.
         mPendingRequest--;
@@ -2056,7 +2081,7 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
                            notify_msg.message.error.frame_number = i->frame_number;
                            notify_msg.message.error.error_code = CAMERA3_MSG_ERROR_BUFFER ;
                            notify_msg.message.error.error_stream = j->stream;
-                           mCallbackOps->notify(mCallbackOps, &notify_msg);
+                           queueNotify(&notify_msg);
                            CDBG("%s: End of reporting error frame#=%u, streamID=%u",
                                   __func__, i->frame_number, streamID);
                            PendingFrameDropInfo PendingFrameDrop;
@@ -2081,7 +2106,8 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
             notify_msg.message.shutter.frame_number = i->frame_number;
             notify_msg.message.shutter.timestamp = (uint64_t)capture_time -
                     (frame_number - i->frame_number) * NSEC_PER_33MSEC;
-            mCallbackOps->notify(mCallbackOps, &notify_msg);
+            queueNotify(&notify_msg);
+            recordRequestLatency(REQ_LAT_SHUTTER, i->request_time);
             i->timestamp = (nsecs_t)notify_msg.message.shutter.timestamp;
             CDBG("%s: Support notification !!!! notify frame_number = %u, capture_time = %llu",
                     __func__, i->frame_number, notify_msg.message.shutter.timestamp);
@@ -2094,7 +2120,7 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
             //[BUGFIX]-Add-BEGIN by TCTCD.long.chen,12/14/2015,Defect:1104979,
             //cts will be check pipeline_depth
             dummyMetadata.update(ANDROID_REQUEST_PIPELINE_DEPTH,
-                    &(i->pipeline_depth), 1);
+                    &pipeline_depth, 1);
             //[BUGFIX]-Add-END by TCTCD.long.chen
             result.result = dummyMetadata.release();
         } else {
@@ -2106,12 +2132,13 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
             notify_msg.type = CAMERA3_MSG_SHUTTER;
             notify_msg.message.shutter.frame_number = i->frame_number;
             notify_msg.message.shutter.timestamp = (uint64_t)capture_time;
-            mCallbackOps->notify(mCallbackOps, &notify_msg);
+            queueNotify(&notify_msg);
+            recordRequestLatency(REQ_LAT_SHUTTER, i->request_time);
 
             i->timestamp = capture_time;
 
             result.result = translateFromHalMetadata(metadata,
-                    i->timestamp, i->request_id, i->jpegMetadata, i->pipeline_depth,
+                    i->timestamp, i->request_id, i->jpegMetadata, pipeline_depth,
                     i->capture_intent, i->fwkCacMode);
 
             saveExifParams(metadata);
@@ -2174,17 +2201,15 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
                         }
                     }
 
-                    for (List<PendingBufferInfo>::iterator k =
-                      mPendingBuffersMap.mPendingBufferList.begin();
-                      k != mPendingBuffersMap.mPendingBufferList.end(); k++) {
-                      if (k->buffer == j->buffer->buffer) {
+                    List<PendingBufferInfo>::iterator k =
+                            findPendingBuffer(i->frame_number, j->buffer->buffer);
+                    if (k != mPendingBuffersMap.mPendingBufferList.end()) {
                         CDBG("%s: Found buffer %p in pending buffer List "
                               "for frame %u, Take it out!!", __func__,
                                k->buffer, k->frame_number);
                         mPendingBuffersMap.num_buffers--;
-                        k = mPendingBuffersMap.mPendingBufferList.erase(k);
-                        break;
-                      }
+                        recordRequestLatency(REQ_LAT_BUFFER, k->request_time);
+                        erasePendingBuffer(k);
                     }
 
                     result_buffers[result_buffers_idx++] = *(j->buffer);
@@ -2193,19 +2218,18 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
                 }
             }
             result.output_buffers = result_buffers;
-            mCallbackOps->process_capture_result(mCallbackOps, &result);
+            queueResult(&result, true);
             CDBG("%s: meta frame_number = %u, capture_time = %lld",
                     __func__, result.frame_number, i->timestamp);
-            free_camera_metadata((camera_metadata_t *)result.result);
             delete[] result_buffers;
         } else {
-            mCallbackOps->process_capture_result(mCallbackOps, &result);
+            queueResult(&result, true);
             CDBG("%s: meta frame_number = %u, capture_time = %lld",
                         __func__, result.frame_number, i->timestamp);
-            free_camera_metadata((camera_metadata_t *)result.result);
         }
         // erase the element from the list
-        i = mPendingRequestsList.erase(i);
+        recordRequestLatency(REQ_LAT_RESULT, i->request_time);
+        i = erasePendingRequest(i);
 
         if (!mPendingReprocessResultList.empty()) {
             handlePendingReprocResults(frame_number + 1);
@@ -2213,17 +2237,14 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
     }
 
 done_metadata:
-    for (List<PendingRequestInfo>::iterator i = mPendingRequestsList.begin();
-              i != mPendingRequestsList.end() ;i++) {
-        i->pipeline_depth++;
-    }
+    mMetadataSeq++;
     unblockRequestIfNecessary();
 }
 
 /*===========================================================================
  * FUNCTION   : handleBufferWithLock
  *
- * DESCRIPTION: Handles image buffer callback with mMutex lock held.
+ * DESCRIPTION: Handles image buffer callback with mPendingLock held.
  *
  * PARAMETERS : @buffer: image buffer for the callback
  *              @frame_number: frame number of the image buffer
@@ -2239,15 +2260,11 @@ void QCamera3HardwareInterface::handleBufferWithLock(
         // flush case
         //go through the pending buffers and mark them as returned.
         CDBG("%s: Handle buffer with lock called during flush", __func__);
-        for (List<PendingBufferInfo>::iterator i =
-                mPendingBuffersMap.mPendingBufferList.begin();
-                i != mPendingBuffersMap.mPendingBufferList.end(); i++) {
-            if (i->buffer == buffer->buffer) {
-                mPendingBuffersMap.num_buffers--;
-                CDBG("%s: Found Frame buffer, updated num_buffers %d, ",
-                        __func__, mPendingBuffersMap.num_buffers);
-                break;
-            }
+        if (findPendingBuffer(frame_number, buffer->buffer) !=
+                mPendingBuffersMap.mPendingBufferList.end()) {
+            mPendingBuffersMap.num_buffers--;
+            CDBG("%s: Found Frame buffer, updated num_buffers %d, ",
+                    __func__, mPendingBuffersMap.num_buffers);
         }
         if (mPendingBuffersMap.num_buffers == 0) {
             //signal the flush()
@@ -2261,18 +2278,13 @@ void QCamera3HardwareInterface::handleBufferWithLock(
     // If the frame number doesn't exist in the pending request list,
     // directly send the buffer to the frameworks, and update pending buffers map
     // Otherwise, book-keep the buffer.
-    List<PendingRequestInfo>::iterator i = mPendingRequestsList.begin();
-    while (i != mPendingRequestsList.end() && i->frame_number != frame_number){
-        i++;
-    }
+    List<PendingRequestInfo>::iterator i = findPendingRequest(frame_number);
     if (i == mPendingRequestsList.end()) {
         // Verify all pending requests frame_numbers are greater
         for (List<PendingRequestInfo>::iterator j = mPendingRequestsList.begin();
-                j != mPendingRequestsList.end(); j++) {
-            if (j->frame_number < frame_number) {
-                ALOGE("%s: Error: pending frame number %d is smaller than %d",
-                        __func__, j->frame_number, frame_number);
-            }
+                j != mPendingRequestsList.end() && j->frame_number < frame_number; j++) {
+            ALOGE("%s: Error: pending frame number %d is smaller than %d",
+                    __func__, j->frame_number, frame_number);
         }
         camera3_capture_result_t result;
         memset(&result, 0, sizeof(camera3_capture_result_t));
@@ -2296,22 +2308,20 @@ void QCamera3HardwareInterface::handleBufferWithLock(
         CDBG("%s: result frame_number = %d, buffer = %p",
                 __func__, frame_number, buffer->buffer);
 
-        for (List<PendingBufferInfo>::iterator k =
-                mPendingBuffersMap.mPendingBufferList.begin();
-                k != mPendingBuffersMap.mPendingBufferList.end(); k++ ) {
-            if (k->buffer == buffer->buffer) {
-                CDBG("%s: Found Frame buffer, take it out from list",
-                        __func__);
+        List<PendingBufferInfo>::iterator k =
+                findPendingBuffer(frame_number, buffer->buffer);
+        if (k != mPendingBuffersMap.mPendingBufferList.end()) {
+            CDBG("%s: Found Frame buffer, take it out from list",
+                    __func__);
 
-                mPendingBuffersMap.num_buffers--;
-                k = mPendingBuffersMap.mPendingBufferList.erase(k);
-                break;
-            }
+            mPendingBuffersMap.num_buffers--;
+            recordRequestLatency(REQ_LAT_BUFFER, k->request_time);
+            erasePendingBuffer(k);
         }
         CDBG("%s: mPendingBuffersMap.num_buffers = %d",
             __func__, mPendingBuffersMap.num_buffers);
 
-        mCallbackOps->process_capture_result(mCallbackOps, &result);
+        queueResult(&result, false);
     } else {
         if (i->input_buffer) {
             CameraMetadata settings;
@@ -2340,29 +2350,20 @@ void QCamera3HardwareInterface::handleBufferWithLock(
                 ALOGE("%s: input buffer fence wait failed %d", __func__, rc);
             }
 
-            for (List<PendingBufferInfo>::iterator k =
-                    mPendingBuffersMap.mPendingBufferList.begin();
-                    k != mPendingBuffersMap.mPendingBufferList.end(); k++ ) {
-                if (k->buffer == buffer->buffer) {
-                    CDBG("%s: Found Frame buffer, take it out from list",
-                            __func__);
+            List<PendingBufferInfo>::iterator k =
+                    findPendingBuffer(frame_number, buffer->buffer);
+            if (k != mPendingBuffersMap.mPendingBufferList.end()) {
+                CDBG("%s: Found Frame buffer, take it out from list",
+                        __func__);
 
-                    mPendingBuffersMap.num_buffers--;
-                    k = mPendingBuffersMap.mPendingBufferList.erase(k);
-                    break;
-                }
+                mPendingBuffersMap.num_buffers--;
+                erasePendingBuffer(k);
             }
             CDBG("%s: mPendingBuffersMap.num_buffers = %d",
                 __func__, mPendingBuffersMap.num_buffers);
 
-            bool notifyNow = true;
-            for (List<PendingRequestInfo>::iterator j = mPendingRequestsList.begin();
-                    j != mPendingRequestsList.end(); j++) {
-                if (j->frame_number < frame_number) {
-                    notifyNow = false;
-                    break;
-                }
-            }
+            // the list is ordered, only the oldest request can be older
+            bool notifyNow = (mPendingRequestsList.begin()->frame_number >= frame_number);
 
             if (notifyNow) {
                 camera3_capture_result result;
@@ -2374,10 +2375,11 @@ void QCamera3HardwareInterface::handleBufferWithLock(
                 result.output_buffers = buffer;
                 result.partial_result = PARTIAL_RESULT_COUNT;
 
-                mCallbackOps->notify(mCallbackOps, &notify_msg);
-                mCallbackOps->process_capture_result(mCallbackOps, &result);
+                queueNotify(&notify_msg);
+                queueResult(&result, false);
                 CDBG("%s: Notify reprocess now %d!", __func__, frame_number);
-                i = mPendingRequestsList.erase(i);
+                recordRequestLatency(REQ_LAT_REPROCESS, i->request_time);
+                i = erasePendingRequest(i);
                 mPendingRequest--;
             } else {
                 // Cache reprocess result for later
@@ -2412,7 +2414,7 @@ void QCamera3HardwareInterface::handleBufferWithLock(
  * FUNCTION   : unblockRequestIfNecessary
  *
  * DESCRIPTION: Unblock capture_request if max_buffer hasn't been reached. Note
- *              that mMutex is held when this function is called.
+ *              that mPendingLock is held when this function is called.
  *
  * PARAMETERS :
  *
@@ -2425,6 +2427,199 @@ void QCamera3HardwareInterface::unblockRequestIfNecessary()
    pthread_cond_signal(&mRequestCond);
 }
 
+/*===========================================================================
+ * FUNCTION   : addPendingRequest
+ *
+ * DESCRIPTION: append a request to the pending list and index it by frame
+ *              number. Called with mPendingLock held, requests come in frame
+ *              number order.
+ *
+ * PARAMETERS :
+ *   @request : pending request info
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3HardwareInterface::addPendingRequest(const PendingRequestInfo &request)
+{
+    PendingSlot &slot = mPendingSlots[request.frame_number % PENDING_SLOTS];
+
+    mPendingRequestsList.push_back(request);
+    if ((slot.has_request || slot.num_buffers) &&
+            (slot.frame_number != request.frame_number)) {
+        // slot still held by an old frame, e.g. a slow reprocess
+        mUnindexedRequests++;
+        return;
+    }
+    slot.frame_number = request.frame_number;
+    slot.has_request = true;
+    slot.request = --mPendingRequestsList.end();
+}
+
+/*===========================================================================
+ * FUNCTION   : findPendingRequest
+ *
+ * DESCRIPTION: look up a pending request by frame number
+ *
+ * PARAMETERS :
+ *   @frame_number : frame number of the request
+ *
+ * RETURN     : iterator of the request, mPendingRequestsList.end() if the
+ *              request is not pending
+ *==========================================================================*/
+List<QCamera3HardwareInterface::PendingRequestInfo>::iterator
+        QCamera3HardwareInterface::findPendingRequest(
+        uint32_t frame_number)
+{
+    PendingSlot &slot = mPendingSlots[frame_number % PENDING_SLOTS];
+
+    if (slot.has_request && (slot.frame_number == frame_number)) {
+        return slot.request;
+    }
+    if (mUnindexedRequests) {
+        for (List<PendingRequestInfo>::iterator i = mPendingRequestsList.begin();
+                i != mPendingRequestsList.end(); i++) {
+            if (i->frame_number == frame_number) {
+                return i;
+            }
+        }
+    }
+    return mPendingRequestsList.end();
+}
+
+/*===========================================================================
+ * FUNCTION   : erasePendingRequest
+ *
+ * DESCRIPTION: remove a request from the pending list and its index
+ *
+ * PARAMETERS :
+ *   @request : iterator of the request
+ *
+ * RETURN     : iterator following the removed request
+ *==========================================================================*/
+List<QCamera3HardwareInterface::PendingRequestInfo>::iterator
+        QCamera3HardwareInterface::erasePendingRequest(
+        List<PendingRequestInfo>::iterator request)
+{
+    PendingSlot &slot = mPendingSlots[request->frame_number % PENDING_SLOTS];
+
+    if (slot.has_request && (slot.frame_number == request->frame_number)) {
+        slot.has_request = false;
+    } else if (mUnindexedRequests) {
+        mUnindexedRequests--;
+    }
+    return mPendingRequestsList.erase(request);
+}
+
+/*===========================================================================
+ * FUNCTION   : addPendingBuffer
+ *
+ * DESCRIPTION: append a buffer to the pending buffers list and index it in
+ *              the slot of its frame number
+ *
+ * PARAMETERS :
+ *   @info    : pending buffer info
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3HardwareInterface::addPendingBuffer(const PendingBufferInfo &info)
+{
+    PendingSlot &slot = mPendingSlots[info.frame_number % PENDING_SLOTS];
+
+    mPendingBuffersMap.mPendingBufferList.push_back(info);
+    if (slot.has_request || slot.num_buffers) {
+        if ((slot.frame_number != info.frame_number) ||
+                (slot.num_buffers >= MAX_NUM_STREAMS)) {
+            // found by a list scan instead
+            return;
+        }
+    }
+    slot.frame_number = info.frame_number;
+    slot.buffers[slot.num_buffers++] = --mPendingBuffersMap.mPendingBufferList.end();
+}
+
+/*===========================================================================
+ * FUNCTION   : findPendingBuffer
+ *
+ * DESCRIPTION: look up a pending buffer
+ *
+ * PARAMETERS :
+ *   @frame_number : frame number the buffer was requested for
+ *   @buffer       : buffer handle
+ *
+ * RETURN     : iterator of the buffer, mPendingBufferList.end() if the
+ *              buffer is not pending
+ *==========================================================================*/
+List<QCamera3HardwareInterface::PendingBufferInfo>::iterator
+        QCamera3HardwareInterface::findPendingBuffer(
+        uint32_t frame_number, buffer_handle_t *buffer)
+{
+    PendingSlot &slot = mPendingSlots[frame_number % PENDING_SLOTS];
+
+    if (slot.frame_number == frame_number) {
+        for (uint32_t j = 0; j < slot.num_buffers; j++) {
+            if (slot.buffers[j]->buffer == buffer) {
+                return slot.buffers[j];
+            }
+        }
+    }
+    // not indexed, match on the handle only
+    for (List<PendingBufferInfo>::iterator k =
+            mPendingBuffersMap.mPendingBufferList.begin();
+            k != mPendingBuffersMap.mPendingBufferList.end(); k++) {
+        if (k->buffer == buffer) {
+            return k;
+        }
+    }
+    return mPendingBuffersMap.mPendingBufferList.end();
+}
+
+/*===========================================================================
+ * FUNCTION   : erasePendingBuffer
+ *
+ * DESCRIPTION: remove a buffer from the pending buffers list and its index.
+ *              num_buffers is left to the caller.
+ *
+ * PARAMETERS :
+ *   @info    : iterator of the buffer
+ *
+ * RETURN     : iterator following the removed buffer
+ *==========================================================================*/
+List<QCamera3HardwareInterface::PendingBufferInfo>::iterator
+        QCamera3HardwareInterface::erasePendingBuffer(
+        List<PendingBufferInfo>::iterator info)
+{
+    PendingSlot &slot = mPendingSlots[info->frame_number % PENDING_SLOTS];
+
+    if (slot.frame_number == info->frame_number) {
+        for (uint32_t j = 0; j < slot.num_buffers; j++) {
+            if (slot.buffers[j] == info) {
+                slot.buffers[j] = slot.buffers[--slot.num_buffers];
+                break;
+            }
+        }
+    }
+    return mPendingBuffersMap.mPendingBufferList.erase(info);
+}
+
+/*===========================================================================
+ * FUNCTION   : clearPendingIndex
+ *
+ * DESCRIPTION: reset the pending request index, called before the pending
+ *              lists are cleared
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3HardwareInterface::clearPendingIndex()
+{
+    for (size_t i = 0; i < PENDING_SLOTS; i++) {
+        mPendingSlots[i].has_request = false;
+        mPendingSlots[i].num_buffers = 0;
+    }
+    mUnindexedRequests = 0;
+}
+
 /*===========================================================================
  * FUNCTION   : processCaptureRequest
  *
@@ -2444,7 +2639,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
     int32_t request_id;
     CameraMetadata meta;
 
-    pthread_mutex_lock(&mMutex);
+    lockWithStat(&mMutex, LOCK_STAT_REQUEST);
 
     rc = validateCaptureRequest(request);
     if (rc != NO_ERROR) {
@@ -2694,8 +2889,10 @@ int QCamera3HardwareInterface::processCaptureRequest(
                 return rc;
             }
         }
+        lockWithStat(&mPendingLock, LOCK_STAT_PENDING);
         mWokenUpByDaemon = false;
         mPendingRequest = 0;
+        pthread_mutex_unlock(&mPendingLock);
         mFirstConfiguration = false;
     }
 
@@ -2768,6 +2965,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
        rc = setFrameParameters(request, streamID, blob_request, snapshotStreamId);
         if (rc < 0) {
             ALOGE("%s: fail to set frame parameters", __func__);
+            mSettingsCache.invalidate();
             pthread_mutex_unlock(&mMutex);
             return rc;
         }
@@ -2793,8 +2991,8 @@ int QCamera3HardwareInterface::processCaptureRequest(
 
     pendingRequest.input_buffer = request->input_buffer;
     pendingRequest.settings = request->settings;
-    pendingRequest.pipeline_depth = 0;
     pendingRequest.partial_result_cnt = 0;
+    pendingRequest.request_time = systemTime(CLOCK_MONOTONIC);
     extractJpegMetadata(pendingRequest.jpegMetadata, request);
 
     //extract capture intent
@@ -2811,6 +3009,8 @@ int QCamera3HardwareInterface::processCaptureRequest(
     }
     pendingRequest.fwkCacMode = mCacMode;
 
+    lockWithStat(&mPendingLock, LOCK_STAT_PENDING);
+    pendingRequest.meta_seq = mMetadataSeq;
     for (size_t i = 0; i < request->num_output_buffers; i++) {
         RequestedBufferInfo requestedBuf;
         requestedBuf.stream = request->output_buffers[i].stream;
@@ -2822,7 +3022,8 @@ int QCamera3HardwareInterface::processCaptureRequest(
         bufferInfo.frame_number = frameNumber;
         bufferInfo.buffer = request->output_buffers[i].buffer;
         bufferInfo.stream = request->output_buffers[i].stream;
-        mPendingBuffersMap.mPendingBufferList.push_back(bufferInfo);
+        bufferInfo.request_time = pendingRequest.request_time;
+        addPendingBuffer(bufferInfo);
         mPendingBuffersMap.num_buffers++;
         QCamera3Channel *channel = (QCamera3Channel *)bufferInfo.stream->priv;
         CDBG("%s: frame = %d, buffer = %p, streamTypeMask = %d, stream format = %d",
@@ -2832,9 +3033,12 @@ int QCamera3HardwareInterface::processCaptureRequest(
     CDBG("%s: mPendingBuffersMap.num_buffers = %d",
           __func__, mPendingBuffersMap.num_buffers);
 
-    mPendingRequestsList.push_back(pendingRequest);
+    addPendingRequest(pendingRequest);
+    pthread_mutex_unlock(&mPendingLock);
 
     if (mFlush) {
+        // The settings of this request never reach the backend
+        mSettingsCache.invalidate();
         pthread_mutex_unlock(&mMutex);
         return NO_ERROR;
     }
@@ -2863,6 +3067,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
                     request->input_buffer->stream->priv;
                 if(inputChannel == NULL ){
                     ALOGE("%s: failed to get input channel handle", __func__);
+                    mSettingsCache.invalidate();
                     pthread_mutex_unlock(&mMutex);
                     return NO_INIT;
                 }
@@ -2872,11 +3077,13 @@ int QCamera3HardwareInterface::processCaptureRequest(
                             request->input_buffer, &mRreprocMeta);
                     if (rc < 0) {
                         ALOGE("%s: Fail to request on picture channel", __func__);
+                        mSettingsCache.invalidate();
                         pthread_mutex_unlock(&mMutex);
                         return rc;
                     }
                 } else {
                     ALOGE("%s: fail to set reproc parameters", __func__);
+                    mSettingsCache.invalidate();
                     pthread_mutex_unlock(&mMutex);
                     return rc;
                 }
@@ -2903,6 +3110,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
         rc = mCameraHandle->ops->set_parms(mCameraHandle->camera_handle, mParameters);
         if (rc < 0) {
             ALOGE("%s: set_parms failed", __func__);
+            mSettingsCache.invalidate();
         }
     }
 
@@ -2919,17 +3127,18 @@ int QCamera3HardwareInterface::processCaptureRequest(
       // Make timeout as 5 sec for request to be honored
       ts.tv_sec += 5;
     }
-    //Block on conditional variable
-
+    //Block on conditional variable, flush() can come in while we wait
+    lockWithStat(&mPendingLock, LOCK_STAT_PENDING);
+    pthread_mutex_unlock(&mMutex);
     mPendingRequest++;
     while (mPendingRequest >= MIN_INFLIGHT_REQUESTS) {
         if (!isValidTimeout) {
             CDBG("%s: Blocking on conditional wait", __func__);
-            pthread_cond_wait(&mRequestCond, &mMutex);
+            pthread_cond_wait(&mRequestCond, &mPendingLock);
         }
         else {
             CDBG("%s: Blocking on timed conditional wait", __func__);
-            rc = pthread_cond_timedwait(&mRequestCond, &mMutex, &ts);
+            rc = pthread_cond_timedwait(&mRequestCond, &mPendingLock, &ts);
             if (rc == ETIMEDOUT) {
                 rc = -ENODEV;
                 ALOGE("%s: Unblocked on timeout!!!!", __func__);
@@ -2943,7 +3152,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
                 break;
         }
     }
-    pthread_mutex_unlock(&mMutex);
+    pthread_mutex_unlock(&mPendingLock);
 
     return rc;
 }
@@ -2960,7 +3169,8 @@ int QCamera3HardwareInterface::processCaptureRequest(
  *==========================================================================*/
 void QCamera3HardwareInterface::dump(int fd)
 {
-    pthread_mutex_lock(&mMutex);
+    lockWithStat(&mMutex, LOCK_STAT_REQUEST);
+    lockWithStat(&mPendingLock, LOCK_STAT_PENDING);
     dprintf(fd, "\n Camera HAL3 information Begin \n");
 
     dprintf(fd, "\nNumber of pending requests: %zu \n",
@@ -3002,12 +3212,67 @@ void QCamera3HardwareInterface::dump(int fd)
 
     dprintf(fd, "\n Camera HAL3 information End \n");
 
+    dprintf(fd, "\nRequest latency:\n");
+    mm_camera_latency_print(fd, "request -> shutter",
+            &mRequestLatency[REQ_LAT_SHUTTER]);
+    mm_camera_latency_print(fd, "request -> buffer",
+            &mRequestLatency[REQ_LAT_BUFFER]);
+    mm_camera_latency_print(fd, "request -> result",
+            &mRequestLatency[REQ_LAT_RESULT]);
+    mm_camera_latency_print(fd, "reprocess request -> result",
+            &mRequestLatency[REQ_LAT_REPROCESS]);
+    if (mCameraHandle != NULL) {
+        mCameraHandle->ops->dump_latency(mCameraHandle->camera_handle, fd);
+    }
+    dprintf(fd, "\n%s", QCameraCacheTracker::dump().string());
+    dprintf(fd, "%s", mResultPool.dump().string());
+    pthread_mutex_unlock(&mPendingLock);
+
+    dprintf(fd, "\nLock contention (contended/acquired):\n");
+    dprintf(fd, "request lock: %u/%u, delivery lock: %u/%u, pending lock: %u/%u\n",
+            mLockWait[LOCK_STAT_REQUEST].count, mLockAcquired[LOCK_STAT_REQUEST],
+            mLockWait[LOCK_STAT_DELIVERY].count, mLockAcquired[LOCK_STAT_DELIVERY],
+            mLockWait[LOCK_STAT_PENDING].count, mLockAcquired[LOCK_STAT_PENDING]);
+    mm_camera_latency_print(fd, "request lock wait",
+            &mLockWait[LOCK_STAT_REQUEST]);
+    mm_camera_latency_print(fd, "delivery lock wait",
+            &mLockWait[LOCK_STAT_DELIVERY]);
+    mm_camera_latency_print(fd, "pending lock wait",
+            &mLockWait[LOCK_STAT_PENDING]);
+
     /* use dumpsys media.camera as trigger to send update debug level event */
     mUpdateDebugLevel = true;
     pthread_mutex_unlock(&mMutex);
+
+    /* lock free, keep it out of mMutex */
+    if (g_mm_camera_trace_enabled) {
+        dprintf(fd, "\n Frame trace (Chrome JSON):\n");
+        mm_camera_trace_dump(fd);
+    }
     return;
 }
 
+/*===========================================================================
+ * FUNCTION   : recordRequestLatency
+ *
+ * DESCRIPTION: add a request latency sample, lock free
+ *
+ * PARAMETERS :
+ *   @stage        : REQ_LAT_* stage
+ *   @request_time : CLOCK_MONOTONIC time the request was received
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::recordRequestLatency(uint32_t stage,
+        nsecs_t request_time)
+{
+    nsecs_t now = systemTime(CLOCK_MONOTONIC);
+    if ((stage < REQ_LAT_MAX) && (request_time > 0) && (now >= request_time)) {
+        mm_camera_latency_record(&mRequestLatency[stage],
+                (uint64_t)(now - request_time));
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : flush
  *
@@ -3027,8 +3292,9 @@ int QCamera3HardwareInterface::flush()
     FlushMap flushMap;
 
     CDBG("%s: Unblocking Process Capture Request", __func__);
-    pthread_mutex_lock(&mMutex);
+    lockWithStat(&mMutex, LOCK_STAT_REQUEST);
     mFlush = true;
+    mSettingsCache.invalidate();
     pthread_mutex_unlock(&mMutex);
 
     memset(&result, 0, sizeof(camera3_capture_result_t));
@@ -3055,8 +3321,8 @@ int QCamera3HardwareInterface::flush()
         mMetadataChannel->stop();
     }
 
-    // Mutex Lock
-    pthread_mutex_lock(&mMutex);
+    // Mutex Lock, queued results go out before the flush errors
+    lockAll();
 
     // Unblock process_capture_request
     mPendingRequest = 0;
@@ -3086,7 +3352,7 @@ int QCamera3HardwareInterface::flush()
             }
 
             mPendingBuffersMap.num_buffers--;
-            k = mPendingBuffersMap.mPendingBufferList.erase(k);
+            k = erasePendingBuffer(k);
         } else {
             k++;
         }
@@ -3104,7 +3370,7 @@ int QCamera3HardwareInterface::flush()
         pStream_Buf = new camera3_stream_buffer_t[pending.size()];
         if (NULL == pStream_Buf) {
             ALOGE("%s: No memory for pending buffers array", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return NO_MEMORY;
         }
         memset(pStream_Buf, 0, sizeof(camera3_stream_buffer_t)*pending.size());
@@ -3154,7 +3420,7 @@ int QCamera3HardwareInterface::flush()
         }
 
         mPendingBuffersMap.num_buffers--;
-        k = mPendingBuffersMap.mPendingBufferList.erase(k);
+        k = erasePendingBuffer(k);
     }
 
     // Go through the pending requests info and send error request to framework
@@ -3176,7 +3442,7 @@ int QCamera3HardwareInterface::flush()
         pStream_Buf = new camera3_stream_buffer_t[pending.size()];
         if (NULL == pStream_Buf) {
             ALOGE("%s: No memory for pending buffers array", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return NO_MEMORY;
         }
         memset(pStream_Buf, 0, sizeof(camera3_stream_buffer_t)*pending.size());
@@ -3199,6 +3465,7 @@ int QCamera3HardwareInterface::flush()
     }
 
     /* Reset pending buffer list and requests list */
+    clearPendingIndex();
     mPendingRequestsList.clear();
     /* Reset pending frame Drop list and requests list */
     mPendingFrameDropList.clear();
@@ -3218,7 +3485,7 @@ int QCamera3HardwareInterface::flush()
         rc = mMetadataChannel->start();
         if (rc < 0) {
             ALOGE("%s: META channel start failed", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return rc;
         }
     }
@@ -3228,7 +3495,7 @@ int QCamera3HardwareInterface::flush()
         rc = channel->start();
         if (rc < 0) {
             ALOGE("%s: channel start failed", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return rc;
         }
     }
@@ -3239,7 +3506,7 @@ int QCamera3HardwareInterface::flush()
         rc = mSupportChannel->start();
         if (rc < 0) {
             ALOGE("%s: Support channel start failed", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return rc;
         }
     }
@@ -3247,12 +3514,12 @@ int QCamera3HardwareInterface::flush()
         rc = mRawDumpChannel->start();
         if (rc < 0) {
             ALOGE("%s: RAW dump channel start failed", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return rc;
         }
     }
 
-    pthread_mutex_unlock(&mMutex);
+    unlockAll();
 
     return 0;
 }
@@ -3280,7 +3547,7 @@ int QCamera3HardwareInterface::flushPerf()
     camera3_stream_buffer_t *pStream_Buf = NULL;
     FlushMap flushMap;
 
-    pthread_mutex_lock(&mMutex);
+    lockAll();
     mFlushPerf = true;
 
     /* send the flush event to the backend */
@@ -3288,14 +3555,14 @@ int QCamera3HardwareInterface::flushPerf()
     if (rc < 0) {
         ALOGE("%s: Error in flush: IOCTL failure", __func__);
         mFlushPerf = false;
-        pthread_mutex_unlock(&mMutex);
+        unlockAll();
         return -ENODEV;
     }
 
     if (mPendingBuffersMap.num_buffers == 0) {
         CDBG("%s: No pending buffers in the HAL, return flush");
         mFlushPerf = false;
-        pthread_mutex_unlock(&mMutex);
+        unlockAll();
         return rc;
     }
 
@@ -3313,14 +3580,14 @@ int QCamera3HardwareInterface::flushPerf()
     while (mPendingBuffersMap.num_buffers != 0) {
         CDBG("%s: Waiting on mBuffersCond", __func__);
         if (!timed_wait) {
-            rc = pthread_cond_wait(&mBuffersCond, &mMutex);
+            rc = pthread_cond_wait(&mBuffersCond, &mPendingLock);
             if (rc != 0) {
                  ALOGE("%s: pthread_cond_wait failed due to rc = %s", __func__,
                         strerror(rc));
                  break;
             }
         } else {
-            rc = pthread_cond_timedwait(&mBuffersCond, &mMutex, &timeout);
+            rc = pthread_cond_timedwait(&mBuffersCond, &mPendingLock, &timeout);
             if (rc != 0) {
                 ALOGE("%s: pthread_cond_timedwait failed due to rc = %s", __func__,
                             strerror(rc));
@@ -3330,7 +3597,7 @@ int QCamera3HardwareInterface::flushPerf()
     }
     if (rc != 0) {
         mFlushPerf = false;
-        pthread_mutex_unlock(&mMutex);
+        unlockAll();
         return -ENODEV;
     }
 
@@ -3358,7 +3625,7 @@ int QCamera3HardwareInterface::flushPerf()
                         flushMap.editValueFor(k->frame_number);
                 pending.add(*k);
             }
-            k = mPendingBuffersMap.mPendingBufferList.erase(k);
+            k = erasePendingBuffer(k);
         } else {
             k++;
         }
@@ -3377,7 +3644,7 @@ int QCamera3HardwareInterface::flushPerf()
         pStream_Buf = new camera3_stream_buffer_t[pending.size()];
         if (NULL == pStream_Buf) {
             ALOGE("%s: No memory for pending buffers array", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return NO_MEMORY;
         }
         memset(pStream_Buf, 0, sizeof(camera3_stream_buffer_t)*pending.size());
@@ -3425,7 +3692,7 @@ int QCamera3HardwareInterface::flushPerf()
                     flushMap.editValueFor(k->frame_number);
             pending.add(*k);
         }
-        k = mPendingBuffersMap.mPendingBufferList.erase(k);
+        k = erasePendingBuffer(k);
     }
 
     // Go through the pending requests info and send error request to framework
@@ -3448,7 +3715,7 @@ int QCamera3HardwareInterface::flushPerf()
         pStream_Buf = new camera3_stream_buffer_t[pending.size()];
         if (NULL == pStream_Buf) {
             ALOGE("%s: No memory for pending buffers array", __func__);
-            pthread_mutex_unlock(&mMutex);
+            unlockAll();
             return NO_MEMORY;
         }
         memset(pStream_Buf, 0, sizeof(camera3_stream_buffer_t)*pending.size());
@@ -3471,6 +3738,7 @@ int QCamera3HardwareInterface::flushPerf()
     }
 
     /* Reset pending buffer list and requests list */
+    clearPendingIndex();
     mPendingRequestsList.clear();
     /* Reset pending frame Drop list and requests list */
     mPendingFrameDropList.clear();
@@ -3486,7 +3754,7 @@ int QCamera3HardwareInterface::flushPerf()
     unblockRequestIfNecessary();
 
     mFlushPerf = false;
-    pthread_mutex_unlock(&mMutex);
+    unlockAll();
     return rc;
 }
 
@@ -3506,15 +3774,216 @@ int QCamera3HardwareInterface::flushPerf()
 void QCamera3HardwareInterface::captureResultCb(mm_camera_super_buf_t *metadata_buf,
                 camera3_stream_buffer_t *buffer, uint32_t frame_number)
 {
-    pthread_mutex_lock(&mMutex);
+    lockWithStat(&mPendingLock, LOCK_STAT_PENDING);
     if (metadata_buf)
         handleMetadataWithLock(metadata_buf);
     else
         handleBufferWithLock(buffer, frame_number);
-    pthread_mutex_unlock(&mMutex);
+    pthread_mutex_unlock(&mPendingLock);
+
+    deliverCallbacks();
     return;
 }
 
+/*===========================================================================
+ * FUNCTION   : queueNotify
+ *
+ * DESCRIPTION: queue a notify message for the framework, called with
+ *              mPendingLock held. Sent by deliverCallbacks.
+ *
+ * PARAMETERS :
+ *   @notify_msg : notify message, copied
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::queueNotify(const camera3_notify_msg_t *notify_msg)
+{
+    PendingCallback callback;
+    memset(&callback, 0, sizeof(PendingCallback));
+    callback.is_notify = true;
+    callback.notify_msg = *notify_msg;
+    mCallbackQueue.push_back(callback);
+}
+
+/*===========================================================================
+ * FUNCTION   : queueResult
+ *
+ * DESCRIPTION: queue a capture result for the framework, called with
+ *              mPendingLock held. Sent by deliverCallbacks.
+ *
+ * PARAMETERS :
+ *   @result : capture result, the output buffer array is copied
+ *   @pooled : result metadata comes from mResultPool and is returned to
+ *             it after delivery
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::queueResult(const camera3_capture_result_t *result,
+        bool pooled)
+{
+    PendingCallback callback;
+    memset(&callback, 0, sizeof(PendingCallback));
+    callback.is_notify = false;
+    callback.result = *result;
+    callback.pooled = pooled;
+    callback.result.output_buffers = NULL;
+    if (result->num_output_buffers > 0) {
+        camera3_stream_buffer_t *buffers =
+                new camera3_stream_buffer_t[result->num_output_buffers];
+        if (NULL == buffers) {
+            ALOGE("%s: No memory for result buffers of frame %d", __func__,
+                    result->frame_number);
+            callback.result.num_output_buffers = 0;
+        } else {
+            memcpy(buffers, result->output_buffers,
+                    sizeof(camera3_stream_buffer_t) * result->num_output_buffers);
+            callback.result.output_buffers = buffers;
+        }
+    }
+    mCallbackQueue.push_back(callback);
+}
+
+/*===========================================================================
+ * FUNCTION   : sendCallback
+ *
+ * DESCRIPTION: send one queued callback to the framework and release the
+ *              buffer array copy, called with mDeliveryLock held
+ *
+ * PARAMETERS :
+ *   @callback : queued notify message or capture result
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::sendCallback(const PendingCallback &callback)
+{
+    if (callback.is_notify) {
+        mCallbackOps->notify(mCallbackOps, &callback.notify_msg);
+    } else {
+        mCallbackOps->process_capture_result(mCallbackOps, &callback.result);
+        delete [] callback.result.output_buffers;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : deliverCallbacks
+ *
+ * DESCRIPTION: send the queued callbacks in order without holding
+ *              mPendingLock across the framework calls. If another thread
+ *              is already delivering it also sends what we queued: the
+ *              deliverer gives up mDeliveryLock before mPendingLock, so
+ *              a callback queued after its last look at the queue finds
+ *              mDeliveryLock free.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::deliverCallbacks()
+{
+    if (pthread_mutex_trylock(&mDeliveryLock) != 0) {
+        return;
+    }
+    mLockAcquired[LOCK_STAT_DELIVERY]++;
+
+    lockWithStat(&mPendingLock, LOCK_STAT_PENDING);
+    while (!mCallbackQueue.empty()) {
+        PendingCallback callback = *mCallbackQueue.begin();
+        mCallbackQueue.erase(mCallbackQueue.begin());
+        pthread_mutex_unlock(&mPendingLock);
+
+        sendCallback(callback);
+
+        lockWithStat(&mPendingLock, LOCK_STAT_PENDING);
+        if (callback.pooled) {
+            mResultPool.put((camera_metadata_t *)callback.result.result);
+        }
+    }
+    pthread_mutex_unlock(&mDeliveryLock);
+    pthread_mutex_unlock(&mPendingLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : deliverCallbacksLocked
+ *
+ * DESCRIPTION: send the queued callbacks with both mDeliveryLock and
+ *              mPendingLock held, used by the device ops that issue
+ *              framework callbacks themselves
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::deliverCallbacksLocked()
+{
+    while (!mCallbackQueue.empty()) {
+        PendingCallback callback = *mCallbackQueue.begin();
+        mCallbackQueue.erase(mCallbackQueue.begin());
+        sendCallback(callback);
+        if (callback.pooled) {
+            mResultPool.put((camera_metadata_t *)callback.result.result);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : lockWithStat
+ *
+ * DESCRIPTION: lock a mutex and record the wait if it was contended
+ *
+ * PARAMETERS :
+ *   @lock : mutex to lock
+ *   @stat : LOCK_STAT_* index of the mutex
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::lockWithStat(pthread_mutex_t *lock, uint32_t stat)
+{
+    if (pthread_mutex_trylock(lock) != 0) {
+        uint64_t start = mm_camera_latency_now_ns();
+        pthread_mutex_lock(lock);
+        mm_camera_latency_record(&mLockWait[stat],
+                mm_camera_latency_now_ns() - start);
+    }
+    mLockAcquired[stat]++;
+}
+
+/*===========================================================================
+ * FUNCTION   : lockAll
+ *
+ * DESCRIPTION: take the whole lock hierarchy for device ops that change the
+ *              pending state or call the framework themselves. Callbacks
+ *              already queued are sent first to keep them in order.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::lockAll()
+{
+    lockWithStat(&mMutex, LOCK_STAT_REQUEST);
+    lockWithStat(&mDeliveryLock, LOCK_STAT_DELIVERY);
+    lockWithStat(&mPendingLock, LOCK_STAT_PENDING);
+    deliverCallbacksLocked();
+}
+
+/*===========================================================================
+ * FUNCTION   : unlockAll
+ *
+ * DESCRIPTION: release the locks taken by lockAll, sending whatever the
+ *              result path queued while mDeliveryLock was held
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::unlockAll()
+{
+    deliverCallbacksLocked();
+    pthread_mutex_unlock(&mDeliveryLock);
+    pthread_mutex_unlock(&mPendingLock);
+    pthread_mutex_unlock(&mMutex);
+}
+
 /*===========================================================================
  * FUNCTION   : lookupFwkName
  *
@@ -3626,6 +4095,10 @@ QCamera3HardwareInterface::translateFromHalMetadata(
 {
     CameraMetadata camMetadata;
     camera_metadata_t *resultMetadata;
+    camera_metadata_t *pooled = mResultPool.get();
+
+    if (NULL != pooled)
+        camMetadata.acquire(pooled);
 
     if (jpegMetadata.entryCount())
         camMetadata.append(jpegMetadata);
@@ -4430,6 +4903,10 @@ QCamera3HardwareInterface::translateCbUrgentMetadataToResultMetadata
 {
     CameraMetadata camMetadata;
     camera_metadata_t *resultMetadata;
+    camera_metadata_t *pooled = mResultPool.get();
+
+    if (NULL != pooled)
+        camMetadata.acquire(pooled);
 
     IF_META_AVAILABLE(uint32_t, afState, CAM_INTF_META_AF_STATE, metadata) {
         uint8_t fwk_afState = (uint8_t) *afState;
@@ -5036,6 +5513,16 @@ int QCamera3HardwareInterface::initParameters()
     mParameters = (metadata_buffer_t *) DATA_PTR(mParamHeap,0);
 
     mPrevParameters = (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+
+    if (NO_ERROR != mSettingsCache.init()) {
+        mSettingsDiff = false;
+    }
+    if (mSettingsRecord) {
+        char path[64];
+        snprintf(path, sizeof(path), QCAMERA_DUMP_FRM_LOCATION"settings_%d.bin",
+                mCameraId);
+        mSettingsCache.startRecord(path);
+    }
     return rc;
 }
 
@@ -5061,6 +5548,8 @@ void QCamera3HardwareInterface::deinitParameters()
 
     free(mPrevParameters);
     mPrevParameters = NULL;
+
+    mSettingsCache.deinit();
 }
 
 /*===========================================================================
@@ -6775,6 +7264,31 @@ int QCamera3HardwareInterface::setFrameParameters(
     int32_t hal_version = CAM_HAL_V3;
 
     clear_metadata_buffer(mParameters);
+
+    if(request->settings != NULL){
+        /* Snapshot channels read the full settings from mParameters, so
+         * blob requests are always translated and sent in full */
+        int64_t minFrameDuration = getMinFrameDuration(request);
+        if (!blob_request && mSettingsCache.isCached(request->settings,
+                snapshotStreamId, minFrameDuration)) {
+            rc = mSettingsCache.apply(mParameters);
+            mSettingsCache.record(request->settings, NULL, snapshotStreamId,
+                    minFrameDuration);
+        } else {
+            rc = translateToHalMetadata(request, mParameters, snapshotStreamId);
+            if (NO_ERROR == rc) {
+                mSettingsCache.record(request->settings, mParameters,
+                        snapshotStreamId, minFrameDuration);
+            }
+            if (NO_ERROR == rc && mSettingsDiff) {
+                mSettingsCache.update(request->settings, mParameters,
+                        snapshotStreamId, minFrameDuration, blob_request != 0);
+            } else {
+                mSettingsCache.invalidate();
+            }
+        }
+    }
+
     if (ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters, CAM_INTF_PARM_HAL_VERSION, hal_version)) {
         ALOGE("%s: Failed to set hal version in the parameters", __func__);
         return BAD_VALUE;
@@ -6805,11 +7319,8 @@ int QCamera3HardwareInterface::setFrameParameters(
         mUpdateDebugLevel = false;
     }
 
-    if(request->settings != NULL){
-        rc = translateToHalMetadata(request, mParameters, snapshotStreamId);
-        if (blob_request)
-            memcpy(mPrevParameters, mParameters, sizeof(metadata_buffer_t));
-    }
+    if ((request->settings != NULL) && blob_request)
+        mm_camera_meta_copy(mPrevParameters, mParameters);
 
     return rc;
 }
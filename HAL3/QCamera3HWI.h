@@ -39,6 +39,8 @@
 #include "QCamera3HALHeader.h"
 #include "QCamera3Channel.h"
 #include "QCamera3CropRegionMapper.h"
+#include "QCamera3MetadataPool.h"
+#include "QCamera3SettingsCache.h"
 
 #include <hardware/power.h>
 
@@ -46,6 +48,7 @@ extern "C" {
 #include <mm_camera_interface.h>
 #include <mm_jpeg_interface.h>
 }
+#include "mm_camera_latency.h"
 #ifdef CDBG
 #undef CDBG
 #endif //#ifdef CDBG
@@ -218,6 +221,7 @@ private:
     void handleBufferWithLock(camera3_stream_buffer_t *buffer,
             uint32_t frame_number);
     void unblockRequestIfNecessary();
+    void recordRequestLatency(uint32_t stage, nsecs_t request_time);
     void dumpMetadataToFile(tuning_params_t &meta, uint32_t &dumpFrameCount,
             bool enabled, const char *type, uint32_t frameNumber);
     static void getLogLevel();
@@ -265,6 +269,12 @@ private:
     QCamera3HeapMemory *mParamHeap;
     metadata_buffer_t* mParameters;
     metadata_buffer_t* mPrevParameters;
+    // Last framework settings translated and the HAL entries they produced.
+    // Entries the backend already holds are not sent again.
+    bool mSettingsDiff;
+    // Record the request sequence for qcamera3_settings_bench
+    bool mSettingsRecord;
+    QCamera3SettingsCache mSettingsCache;
     bool m_bIsVideo;
     bool m_bIs4KVideo;
     bool m_bEisSupportedSize;
@@ -288,10 +298,12 @@ private:
         camera3_stream_buffer_t *input_buffer;
         const camera_metadata_t *settings;
         CameraMetadata jpegMetadata;
-        uint8_t pipeline_depth;
+        // mMetadataSeq when the request was received
+        uint32_t meta_seq;
         uint32_t partial_result_cnt;
         uint8_t capture_intent;
         uint8_t fwkCacMode;
+        nsecs_t request_time; // CLOCK_MONOTONIC at processCaptureRequest
     } PendingRequestInfo;
     typedef struct {
         uint32_t frame_number;
@@ -305,6 +317,8 @@ private:
         camera3_stream_t *stream;
         // Buffer handle
         buffer_handle_t *buffer;
+        // CLOCK_MONOTONIC at processCaptureRequest
+        nsecs_t request_time;
     } PendingBufferInfo;
 
     typedef struct {
@@ -326,18 +340,89 @@ private:
     List<PendingRequestInfo> mPendingRequestsList;
     List<PendingFrameDropInfo> mPendingFrameDropList;
     PendingBuffersMap mPendingBuffersMap;
+
+    // Ring index of the pending requests and buffers, slot is
+    // frame_number % PENDING_SLOTS. Entries that collide with a live frame
+    // are left out and found by a list scan.
+    enum { PENDING_SLOTS = 32 };
+    typedef struct {
+        uint32_t frame_number;
+        bool has_request;
+        List<PendingRequestInfo>::iterator request;
+        uint32_t num_buffers;
+        List<PendingBufferInfo>::iterator buffers[MAX_NUM_STREAMS];
+    } PendingSlot;
+    PendingSlot mPendingSlots[PENDING_SLOTS];
+    uint32_t mUnindexedRequests;
+    // metadata callbacks handled, gives the pipeline depth of a request
+    uint32_t mMetadataSeq;
+
+    void addPendingRequest(const PendingRequestInfo &request);
+    List<PendingRequestInfo>::iterator findPendingRequest(uint32_t frame_number);
+    List<PendingRequestInfo>::iterator erasePendingRequest(
+            List<PendingRequestInfo>::iterator request);
+    void addPendingBuffer(const PendingBufferInfo &info);
+    List<PendingBufferInfo>::iterator findPendingBuffer(uint32_t frame_number,
+            buffer_handle_t *buffer);
+    List<PendingBufferInfo>::iterator erasePendingBuffer(
+            List<PendingBufferInfo>::iterator info);
+    void clearPendingIndex();
     pthread_cond_t mRequestCond;
     int mPendingRequest;
     bool mWokenUpByDaemon;
     int32_t mCurrentRequestId;
     cam_stream_size_info_t mStreamConfigInfo;
 
-    //mutex for serialized access to camera3_device_ops_t functions
+    /* Lock hierarchy, always taken in this order:
+     *  mMutex        - request submission, serializes the camera3_device_ops_t
+     *                  functions. Never taken by the result callbacks.
+     *  mDeliveryLock - held by whoever sends the queued framework callbacks,
+     *                  so notify/process_capture_result stay in order.
+     *  mPendingLock  - pending requests/buffers and their index, mPendingRequest,
+     *                  mWokenUpByDaemon, mMetadataSeq, mResultPool and the
+     *                  callback queue. Critical sections are kept short.
+     * mFlushPerf is written with all three held and can be read under either
+     * mMutex or mPendingLock. The result path builds its callbacks under
+     * mPendingLock and hands them to the delivering thread through
+     * mCallbackQueue, it never blocks on the delivery of another thread. */
     pthread_mutex_t mMutex;
+    pthread_mutex_t mDeliveryLock;
+    pthread_mutex_t mPendingLock;
 
     //condition used to signal flush after buffers have returned
     pthread_cond_t mBuffersCond;
 
+    typedef struct {
+        bool is_notify;
+        camera3_notify_msg_t notify_msg;
+        // output_buffers is a copy owned by the queue entry
+        camera3_capture_result_t result;
+        // result metadata goes back to mResultPool once delivered
+        bool pooled;
+    } PendingCallback;
+    List<PendingCallback> mCallbackQueue;
+
+    void queueNotify(const camera3_notify_msg_t *notify_msg);
+    void queueResult(const camera3_capture_result_t *result, bool pooled);
+    void sendCallback(const PendingCallback &callback);
+    void deliverCallbacks();
+    void deliverCallbacksLocked();
+
+    // lock contention, waits are only recorded when the trylock fails
+    enum {
+        LOCK_STAT_REQUEST,  // mMutex
+        LOCK_STAT_DELIVERY, // mDeliveryLock
+        LOCK_STAT_PENDING,  // mPendingLock
+        LOCK_STAT_MAX
+    };
+    mm_camera_latency_hist_t mLockWait[LOCK_STAT_MAX];
+    // acquisitions, each counter is protected by its own lock
+    uint32_t mLockAcquired[LOCK_STAT_MAX];
+
+    void lockWithStat(pthread_mutex_t *lock, uint32_t stat);
+    void lockAll();
+    void unlockAll();
+
     List<stream_info_t*> mStreamInfo;
 
     int64_t mMinProcessedFrameDuration;
@@ -353,8 +438,19 @@ private:
     uint8_t mCacMode;
     metadata_buffer_t mRreprocMeta; //scratch meta buffer
 
+    // request latency histograms, recording is lock free
+    enum {
+        REQ_LAT_SHUTTER,    // request -> shutter notify
+        REQ_LAT_BUFFER,     // request -> output buffer returned
+        REQ_LAT_RESULT,     // request -> final result metadata
+        REQ_LAT_REPROCESS,  // reprocess request -> result
+        REQ_LAT_MAX
+    };
+    mm_camera_latency_hist_t mRequestLatency[REQ_LAT_MAX];
+
     /* sensor output size with current stream configuration */
     QCamera3CropRegionMapper mCropRegionMapper;
+    QCamera3MetadataPool mResultPool;
 
     static const QCameraMap<camera_metadata_enum_android_control_effect_mode_t,
             cam_effect_mode_type> EFFECT_MODES_MAP[];
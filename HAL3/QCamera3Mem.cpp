@@ -91,12 +91,15 @@ QCamera3Memory::~QCamera3Memory()
  *   @index   : index of the buffer
  *   @cmd     : cache ops command
  *   @vaddr   : ptr to the virtual address
+ *   @offset  : offset of the range to maintain
+ *   @len     : length of the range, 0 for the whole buffer
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *==========================================================================*/
-int QCamera3Memory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr)
+int QCamera3Memory::cacheOpsInternal(uint32_t index, unsigned int cmd,
+        void *vaddr, size_t offset, size_t len)
 {
     Mutex::Autolock lock(mLock);
 
@@ -117,10 +120,15 @@ int QCamera3Memory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vad
 
     memset(&cache_inv_data, 0, sizeof(cache_inv_data));
     memset(&custom_data, 0, sizeof(custom_data));
-    cache_inv_data.vaddr = vaddr;
+    if ((0 == len) || (offset + len > mMemInfo[index].size)) {
+        offset = 0;
+        len = mMemInfo[index].size;
+    }
+    cache_inv_data.vaddr = (uint8_t *)vaddr + offset;
     cache_inv_data.fd = mMemInfo[index].fd;
     cache_inv_data.handle = mMemInfo[index].handle;
-    cache_inv_data.length = (unsigned int)mMemInfo[index].size;
+    cache_inv_data.offset = (unsigned int)offset;
+    cache_inv_data.length = (unsigned int)len;
     custom_data.cmd = cmd;
     custom_data.arg = (unsigned long)&cache_inv_data;
 
@@ -135,6 +143,153 @@ int QCamera3Memory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vad
     return ret;
 }
 
+/*===========================================================================
+ * FUNCTION   : getSizeForCacheOps
+ *
+ * DESCRIPTION: size of a registered buffer for the cache tracker
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : size of the buffer, 0 if not registered
+ *==========================================================================*/
+size_t QCamera3Memory::getSizeForCacheOps(uint32_t index)
+{
+    Mutex::Autolock lock(mLock);
+
+    if ((MM_CAMERA_MAX_NUM_FRAMES <= index) || (0 == mMemInfo[index].handle)) {
+        return 0;
+    }
+    return mMemInfo[index].size;
+}
+
+/*===========================================================================
+ * FUNCTION   : cacheOpsTracked
+ *
+ * DESCRIPTION: issues the cache op planned by the cache tracker
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *   @plan    : op and range to maintain
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCamera3Memory::cacheOpsTracked(uint32_t index,
+        const qcamera_cache_plan_t &plan)
+{
+    unsigned int cmd;
+
+    switch (plan.op) {
+    case QCAMERA_CACHE_OP_CLEAN:
+        cmd = ION_IOC_CLEAN_CACHES;
+        break;
+    case QCAMERA_CACHE_OP_INV:
+        cmd = ION_IOC_INV_CACHES;
+        break;
+    case QCAMERA_CACHE_OP_CLEAN_INV:
+        cmd = ION_IOC_CLEAN_INV_CACHES;
+        break;
+    default:
+        return OK;
+    }
+
+    void *vaddr = getPtr(index);
+    if ((NULL == vaddr) || ((void *)BAD_INDEX == vaddr)) {
+        return cacheOps(index, cmd);
+    }
+    return cacheOpsInternal(index, cmd, vaddr, plan.offset, plan.len);
+}
+
+/*===========================================================================
+ * FUNCTION   : syncForDevice
+ *
+ * DESCRIPTION: cache maintenance before a buffer is queued to the hardware.
+ *              Nothing is done unless the CPU reported writes to it.
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCamera3Memory::syncForDevice(uint32_t index)
+{
+    size_t size = getSizeForCacheOps(index);
+    if (0 == size) {
+        ALOGE("%s: Buffer at %d not registered", __func__, index);
+        return BAD_INDEX;
+    }
+
+    return cacheOpsTracked(index, mCacheTracker.toDevice(index, size));
+}
+
+/*===========================================================================
+ * FUNCTION   : syncForCpu
+ *
+ * DESCRIPTION: cache maintenance after a buffer is dequeued from the
+ *              hardware
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCamera3Memory::syncForCpu(uint32_t index)
+{
+    size_t size = getSizeForCacheOps(index);
+    if (0 == size) {
+        ALOGE("%s: Buffer at %d not registered", __func__, index);
+        return BAD_INDEX;
+    }
+
+    return cacheOpsTracked(index, mCacheTracker.toCpu(index, size));
+}
+
+/*===========================================================================
+ * FUNCTION   : flushCpuWrites
+ *
+ * DESCRIPTION: writes back the range reported by markCpuWrite
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCamera3Memory::flushCpuWrites(uint32_t index)
+{
+    size_t size = getSizeForCacheOps(index);
+    if (0 == size) {
+        ALOGE("%s: Buffer at %d not registered", __func__, index);
+        return BAD_INDEX;
+    }
+
+    return cacheOpsTracked(index, mCacheTracker.flush(index, size));
+}
+
+/*===========================================================================
+ * FUNCTION   : markCpuWrite
+ *
+ * DESCRIPTION: reports a CPU write to a buffer, see QCameraCacheTracker
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *   @offset  : offset of the written range
+ *   @len     : length of the written range
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Memory::markCpuWrite(uint32_t index, size_t offset, size_t len)
+{
+    mCacheTracker.markCpuWrite(index, offset, len);
+}
+
 /*===========================================================================
  * FUNCTION   : getFd
  *
@@ -329,6 +484,7 @@ void QCamera3HeapMemory::dealloc()
 {
     for (uint32_t i = 0U; i < mBufferCount; i++)
         deallocOneBuffer(mMemInfo[i]);
+    mCacheTracker.resetAll();
 }
 
 /*===========================================================================
@@ -752,6 +908,7 @@ int32_t QCamera3GrallocMemory::unregisterBufferLocked(size_t idx)
     mMemInfo[idx].main_ion_fd = -1;
     mBufferHandle[idx] = NULL;
     mPrivateHandle[idx] = NULL;
+    mCacheTracker.reset((uint32_t)idx);
     mBufferCount--;
 
     return NO_ERROR;
@@ -856,6 +1013,8 @@ int32_t QCamera3GrallocMemory::markFrameNumber(uint32_t index, uint32_t frameNum
     }
 
     mCurrentFrameNumbers[index] = (int32_t)frameNumber;
+    // back from the framework, whose clients may have touched it
+    mCacheTracker.reset(index);
 
     return NO_ERROR;
 }
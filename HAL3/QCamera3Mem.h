@@ -31,6 +31,7 @@
 #define __QCAMERA3HWI_MEM_H__
 #include <hardware/camera3.h>
 #include <utils/Mutex.h>
+#include "QCameraCacheTracker.h"
 
 extern "C" {
 #include <sys/types.h>
@@ -48,16 +49,24 @@ class QCamera3Memory {
 public:
     int cleanCache(uint32_t index)
     {
+        mCacheTracker.onFullOp(index, QCAMERA_CACHE_OP_CLEAN);
         return cacheOps(index, ION_IOC_CLEAN_CACHES);
     }
     int invalidateCache(uint32_t index)
     {
+        mCacheTracker.onFullOp(index, QCAMERA_CACHE_OP_INV);
         return cacheOps(index, ION_IOC_INV_CACHES);
     }
     int cleanInvalidateCache(uint32_t index)
     {
+        mCacheTracker.onFullOp(index, QCAMERA_CACHE_OP_CLEAN_INV);
         return cacheOps(index, ION_IOC_CLEAN_INV_CACHES);
     }
+    // tracked cache maintenance, only issues what the transition needs
+    int syncForDevice(uint32_t index);
+    int syncForCpu(uint32_t index);
+    int flushCpuWrites(uint32_t index);
+    void markCpuWrite(uint32_t index, size_t offset, size_t len);
     int getFd(uint32_t index);
     ssize_t getSize(uint32_t index);
     uint32_t getCnt();
@@ -81,13 +90,17 @@ protected:
         size_t size;
     };
 
-    int cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr);
+    int cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr,
+            size_t offset = 0, size_t len = 0);
+    int cacheOpsTracked(uint32_t index, const qcamera_cache_plan_t &plan);
+    size_t getSizeForCacheOps(uint32_t index);
     virtual void *getPtrLocked(uint32_t index) = 0;
 
     uint32_t mBufferCount;
     struct QCamera3MemInfo mMemInfo[MM_CAMERA_MAX_NUM_FRAMES];
     void *mPtr[MM_CAMERA_MAX_NUM_FRAMES];
     Mutex mLock;
+    QCameraCacheTracker mCacheTracker;
 };
 
 // Internal heap memory is used for memories used internally
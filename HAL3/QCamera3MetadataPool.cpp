@@ -0,0 +1,214 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#define LOG_TAG "QCamera3MetadataPool"
+
+#include <string.h>
+#include <utils/Log.h>
+#include "QCamera3MetadataPool.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/* initial capacity, enough for a full result without tonemap curves */
+#define METADATA_POOL_ENTRIES   128
+#define METADATA_POOL_DATA      (16 * 1024)
+
+/*===========================================================================
+ * FUNCTION   : QCamera3MetadataPool
+ *
+ * DESCRIPTION: Constructor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3MetadataPool::QCamera3MetadataPool()
+        : mNumFree(0),
+          mEntryCapacity(METADATA_POOL_ENTRIES),
+          mDataCapacity(METADATA_POOL_DATA),
+          mGets(0),
+          mAllocs(0)
+{
+    pthread_mutex_init(&mLock, NULL);
+    memset(mFree, 0, sizeof(mFree));
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCamera3MetadataPool
+ *
+ * DESCRIPTION: destructor
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+QCamera3MetadataPool::~QCamera3MetadataPool()
+{
+    clear();
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : get
+ *
+ * DESCRIPTION: get an empty metadata buffer for a capture result
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : metadata buffer, NULL if out of memory. Hand it back with
+ *              put() once the framework returned from the result callback.
+ *==========================================================================*/
+camera_metadata_t *QCamera3MetadataPool::get()
+{
+    camera_metadata_t *meta = NULL;
+    size_t entryCapacity, dataCapacity;
+
+    pthread_mutex_lock(&mLock);
+    mGets++;
+    entryCapacity = mEntryCapacity;
+    dataCapacity = mDataCapacity;
+    while ((NULL == meta) && (mNumFree > 0)) {
+        meta = mFree[--mNumFree];
+        if ((get_camera_metadata_entry_capacity(meta) < entryCapacity) ||
+                (get_camera_metadata_data_capacity(meta) < dataCapacity)) {
+            /* sized before the pool grew */
+            free_camera_metadata(meta);
+            meta = NULL;
+        }
+    }
+    if (NULL == meta) {
+        mAllocs++;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    if (NULL != meta) {
+        /* reset to empty, keeping the capacity */
+        meta = place_camera_metadata(meta, get_camera_metadata_size(meta),
+                get_camera_metadata_entry_capacity(meta),
+                get_camera_metadata_data_capacity(meta));
+    } else {
+        meta = allocate_camera_metadata(entryCapacity, dataCapacity);
+        if (NULL == meta) {
+            ALOGE("%s: Failed to allocate metadata %zu/%zu", __func__,
+                    entryCapacity, dataCapacity);
+        }
+    }
+    return meta;
+}
+
+/*===========================================================================
+ * FUNCTION   : put
+ *
+ * DESCRIPTION: return a result buffer to the pool. Results that outgrew
+ *              the pool capacity raise it for the following buffers.
+ *
+ * PARAMETERS :
+ *   @meta    : buffer from get(), or any other heap allocated result
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3MetadataPool::put(camera_metadata_t *meta)
+{
+    size_t entries, data;
+
+    if (NULL == meta) {
+        return;
+    }
+
+    entries = get_camera_metadata_entry_count(meta);
+    data = get_camera_metadata_data_count(meta);
+
+    pthread_mutex_lock(&mLock);
+    if ((entries > mEntryCapacity) || (data > mDataCapacity)) {
+        /* the result was reallocated while it was built */
+        mAllocs++;
+        if (entries > mEntryCapacity) {
+            mEntryCapacity = entries;
+        }
+        if (data > mDataCapacity) {
+            mDataCapacity = data;
+        }
+    }
+    if ((mNumFree < MAX_POOLED) &&
+            (get_camera_metadata_entry_capacity(meta) >= mEntryCapacity) &&
+            (get_camera_metadata_data_capacity(meta) >= mDataCapacity)) {
+        mFree[mNumFree++] = meta;
+        meta = NULL;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    if (NULL != meta) {
+        free_camera_metadata(meta);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : clear
+ *
+ * DESCRIPTION: free all pooled buffers
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3MetadataPool::clear()
+{
+    pthread_mutex_lock(&mLock);
+    while (mNumFree > 0) {
+        free_camera_metadata(mFree[--mNumFree]);
+        mFree[mNumFree] = NULL;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: prints the pool counters
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : String8 with the counters
+ *==========================================================================*/
+String8 QCamera3MetadataPool::dump()
+{
+    String8 str;
+
+    pthread_mutex_lock(&mLock);
+    str.appendFormat("Result metadata: %llu results, %llu allocations, "
+            "capacity %zu entries / %zu bytes, %zu pooled\n",
+            (unsigned long long)mGets, (unsigned long long)mAllocs,
+            mEntryCapacity, mDataCapacity, mNumFree);
+    pthread_mutex_unlock(&mLock);
+    return str;
+}
+
+}; // namespace qcamera
@@ -0,0 +1,70 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __QCAMERA3METADATAPOOL_H__
+#define __QCAMERA3METADATAPOOL_H__
+
+#include <pthread.h>
+#include <utils/String8.h>
+#include <system/camera_metadata.h>
+
+using namespace android;
+
+namespace qcamera {
+
+/* Recycles the camera_metadata_t buffers of capture results. Buffers are
+ * sized to the largest result seen so far, so steady state results are
+ * built without heap allocations. */
+class QCamera3MetadataPool {
+public:
+    QCamera3MetadataPool();
+    virtual ~QCamera3MetadataPool();
+
+    camera_metadata_t *get();
+    void put(camera_metadata_t *meta);
+    void clear();
+    String8 dump();
+
+private:
+    enum { MAX_POOLED = 4 };
+
+    pthread_mutex_t mLock;
+    camera_metadata_t *mFree[MAX_POOLED];
+    size_t mNumFree;
+    /* capacity of new buffers, grows to the largest returned result */
+    size_t mEntryCapacity;
+    size_t mDataCapacity;
+
+    uint64_t mGets;
+    uint64_t mAllocs;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA3METADATAPOOL_H__ */
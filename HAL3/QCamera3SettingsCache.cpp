@@ -0,0 +1,390 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#define LOG_TAG "QCamera3SettingsCache"
+
+#include <stdlib.h>
+#include <string.h>
+#include <utils/Log.h>
+#include <utils/Errors.h>
+#include "QCamera3SettingsCache.h"
+
+using namespace android;
+
+namespace qcamera {
+
+#define ONE_SHOT_SETTINGS_SIZE \
+    (sizeof(ONE_SHOT_SETTINGS) / sizeof(ONE_SHOT_SETTINGS[0]))
+
+const cam_intf_parm_type_t QCamera3SettingsCache::ONE_SHOT_SETTINGS[] = {
+    CAM_INTF_META_AEC_PRECAPTURE_TRIGGER,
+    CAM_INTF_META_AF_TRIGGER,
+    CAM_INTF_META_CAPTURE_INTENT,
+};
+
+/*===========================================================================
+ * FUNCTION   : QCamera3SettingsCache
+ *
+ * DESCRIPTION: Constructor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3SettingsCache::QCamera3SettingsCache()
+        : mValid(false),
+          mSettings(NULL),
+          mTranslated(NULL),
+          mSnapshotStreamId(0),
+          mMinFrameDuration(0),
+          mRecordFile(NULL)
+{
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCamera3SettingsCache
+ *
+ * DESCRIPTION: Destructor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3SettingsCache::~QCamera3SettingsCache()
+{
+    deinit();
+}
+
+/*===========================================================================
+ * FUNCTION   : init
+ *
+ * DESCRIPTION: allocate the translated settings buffer
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : NO_ERROR  -- success
+ *              NO_MEMORY -- allocation failed, the cache stays unusable
+ *==========================================================================*/
+int32_t QCamera3SettingsCache::init()
+{
+    mValid = false;
+    if (NULL == mTranslated) {
+        mTranslated = (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+        if (NULL == mTranslated) {
+            ALOGE("%s: Failed to allocate translated settings", __func__);
+            return NO_MEMORY;
+        }
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : deinit
+ *
+ * DESCRIPTION: drop the cached settings and release the buffers
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3SettingsCache::deinit()
+{
+    invalidate();
+    stopRecord();
+    free(mTranslated);
+    mTranslated = NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : isCached
+ *
+ * DESCRIPTION: check whether the settings are the same as the last
+ *              translated ones
+ *
+ * PARAMETERS :
+ *   @settings         : framework settings of the request
+ *   @snapshotStreamId : snapshot stream id of the request
+ *   @minFrameDuration : min frame duration of the request streams
+ *
+ * RETURN     : true if the cached translation can be reused
+ *==========================================================================*/
+bool QCamera3SettingsCache::isCached(const camera_metadata_t *settings,
+        uint32_t snapshotStreamId, int64_t minFrameDuration)
+{
+    size_t count;
+
+    if (!mValid || (NULL == mSettings) || (NULL == settings)) {
+        return false;
+    }
+    /* the translation also depends on these */
+    if ((snapshotStreamId != mSnapshotStreamId) ||
+            (minFrameDuration != mMinFrameDuration)) {
+        return false;
+    }
+
+    count = get_camera_metadata_entry_count(settings);
+    if (count != get_camera_metadata_entry_count(mSettings)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        camera_metadata_ro_entry_t entry, cached;
+        if (get_camera_metadata_ro_entry(settings, i, &entry) ||
+                get_camera_metadata_ro_entry(mSettings, i, &cached)) {
+            return false;
+        }
+        if ((entry.tag != cached.tag) || (entry.type != cached.type) ||
+                (entry.count != cached.count)) {
+            return false;
+        }
+        if (memcmp(entry.data.u8, cached.data.u8,
+                entry.count * camera_metadata_type_size[entry.type])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : apply
+ *
+ * DESCRIPTION: add the cached one-shot controls for a request whose settings
+ *              are unchanged. Everything else is already held by the backend.
+ *
+ * PARAMETERS :
+ *   @hal_metadata : metadata buffer to fill
+ *
+ * RETURN     : success: NO_ERROR
+ *              failure: BAD_VALUE
+ *==========================================================================*/
+int32_t QCamera3SettingsCache::apply(metadata_buffer_t *hal_metadata)
+{
+    if (!mValid || (NULL == mTranslated)) {
+        return BAD_VALUE;
+    }
+
+    for (size_t i = 0; i < ONE_SHOT_SETTINGS_SIZE; i++) {
+        uint32_t id = ONE_SHOT_SETTINGS[i];
+        size_t size = 0;
+        void *src, *dst;
+
+        if (!mTranslated->is_valid[id]) {
+            continue;
+        }
+        src = mm_camera_meta_entry(mTranslated, id, &size);
+        dst = mm_camera_meta_entry(hal_metadata, id, NULL);
+        if ((NULL == src) || (NULL == dst)) {
+            return BAD_VALUE;
+        }
+        memcpy(dst, src, size);
+        hal_metadata->is_valid[id] = 1;
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : update
+ *
+ * DESCRIPTION: remember a fresh translation and drop the entries the backend
+ *              already holds with the same value
+ *
+ * PARAMETERS :
+ *   @settings         : framework settings that were translated
+ *   @hal_metadata     : translated settings, pruned in place
+ *   @snapshotStreamId : snapshot stream id of the request
+ *   @minFrameDuration : min frame duration of the request streams
+ *   @forwardAll       : keep every entry valid in @hal_metadata
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3SettingsCache::update(const camera_metadata_t *settings,
+        metadata_buffer_t *hal_metadata, uint32_t snapshotStreamId,
+        int64_t minFrameDuration, bool forwardAll)
+{
+    mm_camera_meta_valid_t valid, cached;
+    bool oneShot;
+    int32_t id = -1;
+
+    if (NULL == mTranslated) {
+        return;
+    }
+    if (!mValid) {
+        clear_metadata_buffer(mTranslated);
+    }
+    mm_camera_meta_get_valid(hal_metadata, &valid);
+    mm_camera_meta_get_valid(mTranslated, &cached);
+
+    while ((id = mm_camera_meta_next_valid(&valid, id)) >= 0) {
+        size_t size = 0;
+        void *src = mm_camera_meta_entry(hal_metadata, (uint32_t)id, &size);
+        void *dst = mm_camera_meta_entry(mTranslated, (uint32_t)id, NULL);
+        if ((NULL == src) || (NULL == dst)) {
+            continue;
+        }
+        if (mTranslated->is_valid[id] && !memcmp(src, dst, size)) {
+            oneShot = false;
+            for (size_t i = 0; i < ONE_SHOT_SETTINGS_SIZE; i++) {
+                if (ONE_SHOT_SETTINGS[i] == id) {
+                    oneShot = true;
+                    break;
+                }
+            }
+            if (!forwardAll && !oneShot) {
+                hal_metadata->is_valid[id] = 0;
+            }
+        } else {
+            memcpy(dst, src, size);
+            mTranslated->is_valid[id] = 1;
+        }
+    }
+
+    /* Entries the new settings did not produce keep their value at the
+     * backend, they are only dropped from the cache */
+    id = -1;
+    while ((id = mm_camera_meta_next_valid(&cached, id)) >= 0) {
+        if (!(valid.bits[id / 64] & (1ULL << (id % 64)))) {
+            mTranslated->is_valid[id] = 0;
+        }
+    }
+
+    if (NULL != mSettings) {
+        free_camera_metadata(mSettings);
+    }
+    mSettings = clone_camera_metadata(settings);
+    mSnapshotStreamId = snapshotStreamId;
+    mMinFrameDuration = minFrameDuration;
+    mValid = (NULL != mSettings);
+}
+
+/*===========================================================================
+ * FUNCTION   : invalidate
+ *
+ * DESCRIPTION: forget the cached settings, the next request is translated
+ *              and sent in full
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3SettingsCache::invalidate()
+{
+    mValid = false;
+    if (NULL != mSettings) {
+        free_camera_metadata(mSettings);
+        mSettings = NULL;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : startRecord
+ *
+ * DESCRIPTION: start recording the request sequence for offline replay
+ *
+ * PARAMETERS :
+ *   @path : file to write
+ *
+ * RETURN     : NO_ERROR  -- success
+ *              BAD_VALUE -- file could not be written
+ *==========================================================================*/
+int32_t QCamera3SettingsCache::startRecord(const char *path)
+{
+    qcamera3_settings_file_t header;
+
+    stopRecord();
+    mRecordFile = fopen(path, "wb");
+    if (NULL == mRecordFile) {
+        ALOGE("%s: Failed to open %s", __func__, path);
+        return BAD_VALUE;
+    }
+    header.magic = QCAMERA3_SETTINGS_RECORD_MAGIC;
+    header.meta_size = sizeof(metadata_buffer_t);
+    if (1 != fwrite(&header, sizeof(header), 1, mRecordFile)) {
+        ALOGE("%s: Failed to write %s", __func__, path);
+        stopRecord();
+        return BAD_VALUE;
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : record
+ *
+ * DESCRIPTION: append one request to the recording, if one is active
+ *
+ * PARAMETERS :
+ *   @settings         : framework settings of the request
+ *   @translated       : full translation of @settings, NULL if it was
+ *                       served from the cache
+ *   @snapshotStreamId : snapshot stream id of the request
+ *   @minFrameDuration : min frame duration of the request streams
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3SettingsCache::record(const camera_metadata_t *settings,
+        const metadata_buffer_t *translated, uint32_t snapshotStreamId,
+        int64_t minFrameDuration)
+{
+    qcamera3_settings_record_t rec;
+
+    if ((NULL == mRecordFile) || (NULL == settings)) {
+        return;
+    }
+    memset(&rec, 0, sizeof(rec));
+    rec.settings_size = (uint32_t)get_camera_metadata_size(settings);
+    rec.translated = (NULL != translated);
+    rec.snapshot_stream_id = snapshotStreamId;
+    rec.min_frame_duration = minFrameDuration;
+
+    if ((1 != fwrite(&rec, sizeof(rec), 1, mRecordFile)) ||
+            (1 != fwrite(settings, rec.settings_size, 1, mRecordFile)) ||
+            (translated && (1 != fwrite(translated,
+                    sizeof(metadata_buffer_t), 1, mRecordFile)))) {
+        ALOGE("%s: Failed to write record, stop recording", __func__);
+        stopRecord();
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : stopRecord
+ *
+ * DESCRIPTION: close the recording
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3SettingsCache::stopRecord()
+{
+    if (NULL != mRecordFile) {
+        fclose(mRecordFile);
+        mRecordFile = NULL;
+    }
+}
+
+}; // namespace qcamera
@@ -0,0 +1,100 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __QCAMERA3SETTINGSCACHE_H__
+#define __QCAMERA3SETTINGSCACHE_H__
+
+#include <stdio.h>
+#include <system/camera_metadata.h>
+
+extern "C" {
+#include <mm_camera_interface.h>
+}
+
+namespace qcamera {
+
+#define QCAMERA3_SETTINGS_RECORD_MAGIC 0x51335352 // "Q3SR"
+
+/* Layout of a recorded request sequence. The file starts with a
+ * qcamera3_settings_file_t, then one qcamera3_settings_record_t per
+ * request followed by its settings and, when translated, the
+ * metadata_buffer_t built from them before pruning. */
+typedef struct {
+    uint32_t magic;
+    uint32_t meta_size;          // sizeof(metadata_buffer_t) of the recorder
+} qcamera3_settings_file_t;
+
+typedef struct {
+    uint32_t settings_size;      // bytes of camera_metadata_t that follow
+    uint32_t translated;         // a metadata_buffer_t follows the settings
+    uint32_t snapshot_stream_id;
+    uint32_t reserved;
+    int64_t min_frame_duration;
+} qcamera3_settings_record_t;
+
+/* Last framework settings translated and the HAL entries they produced.
+ * A request with the same settings skips the translation, and entries the
+ * backend already holds with the same value are not sent again. */
+class QCamera3SettingsCache {
+public:
+    QCamera3SettingsCache();
+    virtual ~QCamera3SettingsCache();
+
+    int32_t init();
+    void deinit();
+
+    bool isCached(const camera_metadata_t *settings,
+            uint32_t snapshotStreamId, int64_t minFrameDuration);
+    int32_t apply(metadata_buffer_t *hal_metadata);
+    void update(const camera_metadata_t *settings,
+            metadata_buffer_t *hal_metadata, uint32_t snapshotStreamId,
+            int64_t minFrameDuration, bool forwardAll);
+    void invalidate();
+
+    int32_t startRecord(const char *path);
+    void record(const camera_metadata_t *settings,
+            const metadata_buffer_t *translated, uint32_t snapshotStreamId,
+            int64_t minFrameDuration);
+    void stopRecord();
+
+    // Controls that act once per request and are sent even when unchanged
+    static const cam_intf_parm_type_t ONE_SHOT_SETTINGS[];
+
+private:
+    bool mValid;
+    camera_metadata_t *mSettings;
+    metadata_buffer_t *mTranslated;
+    uint32_t mSnapshotStreamId;
+    int64_t mMinFrameDuration;
+    FILE *mRecordFile;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA3SETTINGSCACHE_H__ */
@@ -173,7 +173,8 @@ QCamera3Stream::QCamera3Stream(uint32_t camHandle,
         mNumBufs(0),
         mDataCB(NULL),
         mUserData(NULL),
-        mDataQ(releaseFrameData, this),
+        mDataQ(releaseFrameData, this, QCAMERA_QUEUE_TYPE_RING_SPSC,
+                CAM_MAX_NUM_BUFS_PER_STREAM),
         mStreamInfoBuf(NULL),
         mStreamBufs(NULL),
         mBufDefs(NULL),
@@ -184,6 +185,7 @@ QCamera3Stream::QCamera3Stream(uint32_t camHandle,
     mMemVtbl.put_bufs = put_bufs;
     mMemVtbl.invalidate_buf = invalidate_buf;
     mMemVtbl.clean_invalidate_buf = clean_invalidate_buf;
+    mMemVtbl.mark_cpu_write = NULL;
     mMemVtbl.set_config_ops = NULL;
     memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
     memcpy(&mPaddingInfo, paddingInfo, sizeof(cam_padding_info_t));
@@ -444,6 +446,8 @@ void QCamera3Stream::dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
         return;
     }
     *frame = *recvd_frame;
+    CAM_FRAME_TRACE("QCamera3Stream_dataNotify",
+            recvd_frame->bufs[0]->stream_type, recvd_frame->bufs[0]->frame_idx);
     stream->processDataNotify(frame);
     return;
 }
@@ -487,6 +491,9 @@ void *QCamera3Stream::dataProcRoutine(void *data)
                     (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
                 if (NULL != frame) {
                     if (pme->mDataCB != NULL) {
+                        CAM_FRAME_TRACE_SCOPE("QCamera3Stream_dataCB",
+                                frame->bufs[0]->stream_type,
+                                frame->bufs[0]->frame_idx);
                         pme->mDataCB(frame, pme, pme->mUserData);
                     } else {
                         // no data cb routine, return buf here
@@ -650,23 +657,37 @@ int32_t QCamera3Stream::getBufs(cam_frame_len_offset_t *offset,
         return NO_MEMORY;
     }
 
+    // Send the maps of all registered buffers back to back and wait for the
+    // server once, instead of a round trip per buffer
     uint32_t registeredBuffers = mStreamBufs->getCnt();
-    for (uint32_t i = 0; i < registeredBuffers; i++) {
-        ssize_t bufSize = mStreamBufs->getSize(i);
-        if (BAD_INDEX != bufSize) {
-            rc = ops_tbl->map_ops(i, -1, mStreamBufs->getFd(i),
-                    (size_t)bufSize, CAM_MAPPING_BUF_TYPE_STREAM_BUF, ops_tbl->userdata);
-            if (rc < 0) {
-                ALOGE("%s: map_stream_buf failed: %d", __func__, rc);
-                for (uint32_t j = 0; j < i; j++) {
-                    ops_tbl->unmap_ops(j, -1, CAM_MAPPING_BUF_TYPE_STREAM_BUF, ops_tbl->userdata);
-                }
-                return INVALID_OPERATION;
-            }
-        } else {
+    uint32_t mapped = 0;
+    mm_camera_map_batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    for (; mapped < registeredBuffers; mapped++) {
+        ssize_t bufSize = mStreamBufs->getSize(mapped);
+        if (BAD_INDEX == bufSize) {
             ALOGE("Failed to retrieve buffer size (bad index)");
-            return INVALID_OPERATION;
+            rc = INVALID_OPERATION;
+            break;
         }
+        rc = ops_tbl->map_async_ops(mapped, -1, mStreamBufs->getFd(mapped),
+                (size_t)bufSize, CAM_MAPPING_BUF_TYPE_STREAM_BUF, &batch,
+                ops_tbl->userdata);
+        if (rc < 0) {
+            ALOGE("%s: map_stream_buf failed: %d", __func__, rc);
+            break;
+        }
+    }
+    // Wait for what was sent even after a failure, before unmapping it
+    if (ops_tbl->wait_ops(&batch, ops_tbl->userdata) < 0) {
+        ALOGE("%s: map_stream_buf failed", __func__);
+        rc = INVALID_OPERATION;
+    }
+    if (rc < 0) {
+        for (uint32_t j = 0; j < mapped; j++) {
+            ops_tbl->unmap_ops(j, -1, CAM_MAPPING_BUF_TYPE_STREAM_BUF, ops_tbl->userdata);
+        }
+        return INVALID_OPERATION;
     }
 
     //regFlags array is allocated by us, but consumed and freed by mm-camera-interface
@@ -750,7 +771,8 @@ int32_t QCamera3Stream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
 /*===========================================================================
  * FUNCTION   : invalidateBuf
  *
- * DESCRIPTION: invalidate a specific stream buffer
+ * DESCRIPTION: cache maintenance of a stream buffer queued to the kernel,
+ *              only CPU writes reported on the buffer need it
  *
  * PARAMETERS :
  *   @index   : index of the buffer to invalidate
@@ -761,13 +783,14 @@ int32_t QCamera3Stream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
  *==========================================================================*/
 int32_t QCamera3Stream::invalidateBuf(uint32_t index)
 {
-    return mStreamBufs->invalidateCache(index);
+    return mStreamBufs->syncForDevice(index);
 }
 
 /*===========================================================================
  * FUNCTION   : cleanInvalidateBuf
  *
- * DESCRIPTION: clean and invalidate a specific stream buffer
+ * DESCRIPTION: cache maintenance of a stream buffer dequeued from the
+ *              kernel, before the CPU reads it
  *
  * PARAMETERS :
  *   @index   : index of the buffer to invalidate
@@ -778,7 +801,7 @@ int32_t QCamera3Stream::invalidateBuf(uint32_t index)
  *==========================================================================*/
 int32_t QCamera3Stream::cleanInvalidateBuf(uint32_t index)
 {
-    return mStreamBufs->cleanInvalidateCache(index);
+    return mStreamBufs->syncForCpu(index);
 }
 
 /*===========================================================================
@@ -101,7 +101,7 @@ private:
     hal3_stream_cb_routine mDataCB;
     void *mUserData;
 
-    QCameraQueue     mDataQ;
+    QCameraQueue     mDataQ; // single producer: mm-camera stream cmd thread
     QCameraCmdThread mProcTh; // thread for dataCB
 
     QCamera3HeapMemory *mStreamInfoBuf;
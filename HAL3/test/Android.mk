@@ -0,0 +1,26 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    qcamera3_settings_bench.cpp \
+    ../QCamera3SettingsCache.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/.. \
+    $(LOCAL_PATH)/../../stack/common
+
+LOCAL_SHARED_LIBRARIES:= \
+    liblog \
+    libutils \
+    libcutils \
+    libcamera_metadata \
+    libmmcamera_interface
+
+LOCAL_CFLAGS += -Wall -Wextra -Werror -Wno-unused-parameter
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+LOCAL_MODULE:= qcamera3_settings_bench
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_EXECUTABLE)
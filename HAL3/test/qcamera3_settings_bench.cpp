@@ -0,0 +1,403 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Replay bench for the HAL3 request settings cache. Requests are replayed
+ * through QCamera3SettingsCache the way setFrameParameters drives it, once
+ * with the cache and once with every request sent in full, and the backend
+ * state both leave behind is compared after each request.
+ * A sequence is recorded on target with persist.camera.hal3.settings.rec=1
+ * into /data/misc/camera/settings_<camera id>.bin. Without -f a synthetic
+ * preview sequence with periodic AF triggers is replayed.
+ * translateToHalMetadata is not run, a miss copies the recorded
+ * translation instead, so the numbers are the cache overhead and the
+ * entries saved, not the translation time saved.
+ * Usage: qcamera3_settings_bench [-f recording] [-l loops]
+ *                                [-n requests] [-t trigger period]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <utils/Log.h>
+#include <utils/Errors.h>
+#include "QCamera3SettingsCache.h"
+
+using namespace android;
+using namespace qcamera;
+
+typedef struct {
+    camera_metadata_t *settings;
+    metadata_buffer_t *translated; // NULL when the recorder hit the cache
+    uint32_t snapshot_stream_id;
+    int64_t min_frame_duration;
+} bench_request_t;
+
+typedef struct {
+    bench_request_t *reqs;
+    uint32_t count;
+    uint32_t capacity;
+} bench_sequence_t;
+
+static uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static bench_request_t *bench_add(bench_sequence_t *seq)
+{
+    if (seq->count == seq->capacity) {
+        uint32_t capacity = seq->capacity ? seq->capacity * 2 : 64;
+        bench_request_t *reqs = (bench_request_t *)realloc(seq->reqs,
+                capacity * sizeof(bench_request_t));
+        if (NULL == reqs) {
+            return NULL;
+        }
+        seq->reqs = reqs;
+        seq->capacity = capacity;
+    }
+    bench_request_t *req = &seq->reqs[seq->count++];
+    memset(req, 0, sizeof(*req));
+    return req;
+}
+
+static void bench_free(bench_sequence_t *seq)
+{
+    for (uint32_t i = 0; i < seq->count; i++) {
+        free(seq->reqs[i].settings);
+        free(seq->reqs[i].translated);
+    }
+    free(seq->reqs);
+    memset(seq, 0, sizeof(*seq));
+}
+
+static int bench_load(const char *path, bench_sequence_t *seq)
+{
+    qcamera3_settings_file_t header;
+    qcamera3_settings_record_t rec;
+    FILE *fp = fopen(path, "rb");
+
+    if (NULL == fp) {
+        printf("cannot open %s\n", path);
+        return -1;
+    }
+    if ((1 != fread(&header, sizeof(header), 1, fp)) ||
+            (QCAMERA3_SETTINGS_RECORD_MAGIC != header.magic) ||
+            (sizeof(metadata_buffer_t) != header.meta_size)) {
+        printf("%s is not a recording of this build\n", path);
+        fclose(fp);
+        return -1;
+    }
+    while (1 == fread(&rec, sizeof(rec), 1, fp)) {
+        bench_request_t *req = bench_add(seq);
+        if (NULL == req) {
+            break;
+        }
+        req->snapshot_stream_id = rec.snapshot_stream_id;
+        req->min_frame_duration = rec.min_frame_duration;
+        req->settings = (camera_metadata_t *)malloc(rec.settings_size);
+        if ((NULL == req->settings) ||
+                (1 != fread(req->settings, rec.settings_size, 1, fp))) {
+            seq->count--;
+            free(req->settings);
+            break;
+        }
+        if (rec.translated) {
+            req->translated =
+                    (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+            if ((NULL == req->translated) ||
+                    (1 != fread(req->translated, sizeof(metadata_buffer_t),
+                    1, fp))) {
+                seq->count--;
+                free(req->settings);
+                free(req->translated);
+                break;
+            }
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* A repeating preview request, with an AF trigger every @period requests
+ * followed by the return to idle. */
+static int bench_synthesize(bench_sequence_t *seq, uint32_t count,
+        uint32_t period)
+{
+    static const int32_t fpsRange[] = { 15, 30 };
+    static const int32_t cropRegion[] = { 0, 0, 4160, 3120 };
+    uint8_t controlMode = ANDROID_CONTROL_MODE_AUTO;
+    uint8_t aeMode = ANDROID_CONTROL_AE_MODE_ON;
+    uint8_t afMode = ANDROID_CONTROL_AF_MODE_CONTINUOUS_PICTURE;
+    uint8_t awbMode = ANDROID_CONTROL_AWB_MODE_AUTO;
+    uint8_t intent = ANDROID_CONTROL_CAPTURE_INTENT_PREVIEW;
+    uint8_t quality = 95;
+
+    for (uint32_t i = 0; i < count; i++) {
+        bench_request_t *req = bench_add(seq);
+        uint8_t afTrigger = ((0 != period) && (i % period == period - 1)) ?
+                ANDROID_CONTROL_AF_TRIGGER_START :
+                ANDROID_CONTROL_AF_TRIGGER_IDLE;
+        int32_t afTriggerId = (0 != period) ? (int32_t)((i + 1) / period) : 0;
+        cam_trigger_t trigger;
+        cam_fps_range_t fps;
+
+        if (NULL == req) {
+            return -1;
+        }
+        req->settings = allocate_camera_metadata(16, 64);
+        req->translated = (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+        if ((NULL == req->settings) || (NULL == req->translated)) {
+            return -1;
+        }
+        add_camera_metadata_entry(req->settings, ANDROID_CONTROL_MODE,
+                &controlMode, 1);
+        add_camera_metadata_entry(req->settings, ANDROID_CONTROL_AE_MODE,
+                &aeMode, 1);
+        add_camera_metadata_entry(req->settings, ANDROID_CONTROL_AE_TARGET_FPS_RANGE,
+                fpsRange, 2);
+        add_camera_metadata_entry(req->settings, ANDROID_CONTROL_AF_MODE,
+                &afMode, 1);
+        add_camera_metadata_entry(req->settings, ANDROID_CONTROL_AF_TRIGGER,
+                &afTrigger, 1);
+        add_camera_metadata_entry(req->settings, ANDROID_CONTROL_AF_TRIGGER_ID,
+                &afTriggerId, 1);
+        add_camera_metadata_entry(req->settings, ANDROID_CONTROL_AWB_MODE,
+                &awbMode, 1);
+        add_camera_metadata_entry(req->settings, ANDROID_CONTROL_CAPTURE_INTENT,
+                &intent, 1);
+        add_camera_metadata_entry(req->settings, ANDROID_SCALER_CROP_REGION,
+                cropRegion, 4);
+        add_camera_metadata_entry(req->settings, ANDROID_JPEG_QUALITY,
+                &quality, 1);
+
+        clear_metadata_buffer(req->translated);
+        memset(&trigger, 0, sizeof(trigger));
+        trigger.trigger = afTrigger;
+        trigger.trigger_id = afTriggerId;
+        fps.min_fps = (float)fpsRange[0];
+        fps.max_fps = (float)fpsRange[1];
+        fps.video_min_fps = fps.min_fps;
+        fps.video_max_fps = fps.max_fps;
+        ADD_SET_PARAM_ENTRY_TO_BATCH(req->translated, CAM_INTF_META_MODE,
+                (uint32_t)controlMode);
+        ADD_SET_PARAM_ENTRY_TO_BATCH(req->translated, CAM_INTF_META_AEC_MODE,
+                (uint32_t)CAM_AE_MODE_ON);
+        ADD_SET_PARAM_ENTRY_TO_BATCH(req->translated, CAM_INTF_PARM_FPS_RANGE,
+                fps);
+        ADD_SET_PARAM_ENTRY_TO_BATCH(req->translated, CAM_INTF_PARM_FOCUS_MODE,
+                (uint32_t)CAM_FOCUS_MODE_CONTINOUS_PICTURE);
+        ADD_SET_PARAM_ENTRY_TO_BATCH(req->translated, CAM_INTF_META_AF_TRIGGER,
+                trigger);
+        ADD_SET_PARAM_ENTRY_TO_BATCH(req->translated, CAM_INTF_PARM_WHITE_BALANCE,
+                (int32_t)CAM_WB_MODE_AUTO);
+        ADD_SET_PARAM_ENTRY_TO_BATCH(req->translated, CAM_INTF_META_CAPTURE_INTENT,
+                (uint32_t)intent);
+        ADD_SET_PARAM_ENTRY_TO_BATCH(req->translated, CAM_INTF_META_JPEG_QUALITY,
+                (uint32_t)quality);
+    }
+    return 0;
+}
+
+/* backend view of the parameters: each sent entry overwrites the last */
+static void bench_backend_set(metadata_buffer_t *backend,
+        metadata_buffer_t *sent)
+{
+    mm_camera_meta_valid_t valid;
+    int32_t id = -1;
+
+    mm_camera_meta_get_valid(sent, &valid);
+    while ((id = mm_camera_meta_next_valid(&valid, id)) >= 0) {
+        size_t size = 0;
+        void *src = mm_camera_meta_entry(sent, (uint32_t)id, &size);
+        void *dst = mm_camera_meta_entry(backend, (uint32_t)id, NULL);
+        if ((NULL != src) && (NULL != dst)) {
+            memcpy(dst, src, size);
+            backend->is_valid[id] = 1;
+        }
+    }
+}
+
+/* number of entries of @expect the backend holds with another value */
+static uint32_t bench_backend_diff(metadata_buffer_t *backend,
+        metadata_buffer_t *expect)
+{
+    mm_camera_meta_valid_t valid;
+    uint32_t diff = 0;
+    int32_t id = -1;
+
+    mm_camera_meta_get_valid(expect, &valid);
+    while ((id = mm_camera_meta_next_valid(&valid, id)) >= 0) {
+        size_t size = 0;
+        void *src = mm_camera_meta_entry(expect, (uint32_t)id, &size);
+        void *dst = mm_camera_meta_entry(backend, (uint32_t)id, NULL);
+        if ((NULL != src) && (NULL != dst) &&
+                (!backend->is_valid[id] || memcmp(src, dst, size))) {
+            diff++;
+        }
+    }
+    return diff;
+}
+
+/* Replays @seq once. The backend state is only tracked when @backend is
+ * given, so the timed runs measure the cache alone. */
+static uint64_t bench_replay(bench_sequence_t *seq, bool useCache,
+        metadata_buffer_t *params, metadata_buffer_t *backend,
+        uint64_t *sent, uint32_t *hits, uint32_t *mismatches)
+{
+    QCamera3SettingsCache cache;
+    metadata_buffer_t *last = NULL;
+    mm_camera_meta_valid_t valid;
+    uint64_t elapsed = 0;
+
+    if (useCache && (NULL != backend)) {
+        clear_metadata_buffer(backend);
+    }
+    if (NO_ERROR != cache.init()) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < seq->count; i++) {
+        bench_request_t *req = &seq->reqs[i];
+        if (NULL != req->translated) {
+            last = req->translated;
+        }
+        if (NULL == last) {
+            continue;
+        }
+
+        uint64_t start = bench_now_ns();
+        clear_metadata_buffer(params);
+        if (useCache && cache.isCached(req->settings,
+                req->snapshot_stream_id, req->min_frame_duration)) {
+            cache.apply(params);
+            (*hits)++;
+        } else {
+            // stand-in for translateToHalMetadata
+            mm_camera_meta_copy(params, last);
+            if (useCache) {
+                cache.update(req->settings, params, req->snapshot_stream_id,
+                        req->min_frame_duration, false);
+            }
+        }
+        elapsed += bench_now_ns() - start;
+
+        *sent += mm_camera_meta_get_valid(params, &valid);
+        if (NULL != backend) {
+            bench_backend_set(backend, params);
+            *mismatches += (0 != bench_backend_diff(backend, last));
+        }
+    }
+    cache.deinit();
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    uint32_t loops = 100;
+    uint32_t count = 3000;
+    uint32_t period = 30;
+    bench_sequence_t seq;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:l:n:t:")) != -1) {
+        switch (opt) {
+        case 'f':
+            path = optarg;
+            break;
+        case 'l':
+            loops = (uint32_t)atoi(optarg);
+            break;
+        case 'n':
+            count = (uint32_t)atoi(optarg);
+            break;
+        case 't':
+            period = (uint32_t)atoi(optarg);
+            break;
+        default:
+            printf("usage: %s [-f recording] [-l loops] [-n requests] "
+                    "[-t trigger period]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    memset(&seq, 0, sizeof(seq));
+    if ((NULL != path) ? bench_load(path, &seq) :
+            bench_synthesize(&seq, count, period)) {
+        bench_free(&seq);
+        return -1;
+    }
+    if ((0 == seq.count) || (0 == loops)) {
+        printf("nothing to replay\n");
+        bench_free(&seq);
+        return -1;
+    }
+
+    metadata_buffer_t *params =
+            (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+    metadata_buffer_t *backend =
+            (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+    if ((NULL == params) || (NULL == backend)) {
+        free(params);
+        free(backend);
+        bench_free(&seq);
+        return -1;
+    }
+
+    /* one checked pass: the cached run must leave the backend with the
+     * same values as sending every request in full */
+    uint64_t sent = 0;
+    uint32_t hits = 0, mismatches = 0;
+    bench_replay(&seq, true, params, backend, &sent, &hits, &mismatches);
+    printf("%u requests, %u cache hits, %u backend mismatches\n",
+            seq.count, hits, mismatches);
+
+    const bool modes[] = { false, true };
+    for (uint32_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        uint64_t elapsed = 0;
+        sent = 0;
+        hits = 0;
+        for (uint32_t l = 0; l < loops; l++) {
+            elapsed += bench_replay(&seq, modes[m], params, NULL,
+                    &sent, &hits, &mismatches);
+        }
+        printf("%-6s: %8.1f ns per request, %6.2f entries sent per request\n",
+                modes[m] ? "cached" : "full",
+                (double)elapsed / ((double)loops * seq.count),
+                (double)sent / ((double)loops * seq.count));
+    }
+
+    free(params);
+    free(backend);
+    bench_free(&seq);
+    return (0 == mismatches) ? 0 : -1;
+}
@@ -54,6 +54,11 @@ uint8_t gNumCameraSessions = 0;
 
 volatile uint32_t gKpiDebugLevel = 1;
 
+//Per camera buffer pools, kept across camera sessions.
+//Created on first use under gMemoryPoolLock and never freed.
+static QCameraMemoryPool *gMemoryPools[MM_CAMERA_MAX_NUM_SENSORS];
+static pthread_mutex_t gMemoryPoolLock = PTHREAD_MUTEX_INITIALIZER;
+
 /*===========================================================================
  * FUNCTION   : QCamera2Factory
  *
@@ -519,5 +524,33 @@ bool QCamera2Factory::isDualCamAvailable(int hal3Enabled)
     return rc;
 }
 
-}; // namespace qcamera
+/*===========================================================================
+ * FUNCTION   : getMemoryPool
+ *
+ * DESCRIPTION: returns the buffer pool of a camera. The pool outlives the
+ *              hardware interface so that the next session of the camera
+ *              can reuse the buffers of the previous one.
+ *
+ * PARAMETERS :
+ *   @cameraId : camera ID
+ *
+ * RETURN     : reference to the memory pool of the camera
+ *==========================================================================*/
+QCameraMemoryPool &QCamera2Factory::getMemoryPool(uint32_t cameraId)
+{
+    if (cameraId >= MM_CAMERA_MAX_NUM_SENSORS) {
+        ALOGE("%s: Invalid camera id %u", __func__, cameraId);
+        cameraId = 0;
+    }
+
+    pthread_mutex_lock(&gMemoryPoolLock);
+    if (NULL == gMemoryPools[cameraId]) {
+        gMemoryPools[cameraId] = new QCameraMemoryPool();
+    }
+    QCameraMemoryPool *pool = gMemoryPools[cameraId];
+    pthread_mutex_unlock(&gMemoryPoolLock);
 
+    return *pool;
+}
+
+}; // namespace qcamera
@@ -36,6 +36,8 @@
 
 namespace qcamera {
 
+class QCameraMemoryPool;
+
 typedef struct {
     uint32_t cameraId;
     uint32_t device_version;
@@ -53,6 +55,7 @@ public:
     static int open_legacy(const struct hw_module_t* module,
             const char* id, uint32_t halVersion, struct hw_device_t** device);
     bool isDualCamAvailable(int hal3Enabled);
+    static QCameraMemoryPool &getMemoryPool(uint32_t cameraId);
 
 private:
     int getNumberOfCameras();
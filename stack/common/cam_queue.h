@@ -67,6 +67,39 @@ static inline int32_t cam_queue_enq(cam_queue_t *queue, void *data)
     return 0;
 }
 
+/* enqueue a node owned by the caller, e.g. embedded in a preallocated
+ * slab entry. Such nodes must be taken out with cam_queue_deq_node(),
+ * which hands the node back instead of freeing it. */
+static inline void cam_queue_enq_node(cam_queue_t *queue, cam_node_t *node,
+    void *data)
+{
+    node->data = data;
+
+    pthread_mutex_lock(&queue->lock);
+    cam_list_add_tail_node(&node->list, &queue->head.list);
+    queue->size++;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static inline cam_node_t *cam_queue_deq_node(cam_queue_t *queue)
+{
+    cam_node_t *node = NULL;
+    struct cam_list *head = NULL;
+    struct cam_list *pos = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    head = &queue->head.list;
+    pos = head->next;
+    if (pos != head) {
+        node = member_of(pos, cam_node_t, list);
+        cam_list_del_node(&node->list);
+        queue->size--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return node;
+}
+
 static inline void *cam_queue_deq(cam_queue_t *queue)
 {
     cam_node_t *node = NULL;
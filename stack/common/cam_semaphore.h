@@ -30,6 +30,15 @@
 #ifndef __QCAMERA_SEMAPHORE_H__
 #define __QCAMERA_SEMAPHORE_H__
 
+#include <pthread.h>
+
+#if defined(__linux__) && !defined(CAM_SEM_USE_CONDVAR)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#define CAM_SEM_USE_FUTEX
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -37,8 +46,76 @@ extern "C" {
 /* Implement semaphore with mutex and conditional variable.
  * Reason being, POSIX semaphore on Android are not used or
  * well tested.
+ *
+ * On Linux the count is kept in a futex word instead: post and an
+ * uncontended wait are a single atomic op, wait spins briefly before
+ * sleeping and post only enters the kernel when someone sleeps.
+ * Define CAM_SEM_USE_CONDVAR to build the mutex/condvar variant.
  */
 
+#ifdef CAM_SEM_USE_FUTEX
+
+/* number of polls of the count before a waiter goes to sleep */
+#define CAM_SEM_SPIN_COUNT 100
+
+typedef struct {
+    int val;
+    int waiters;
+} cam_semaphore_t;
+
+static inline void cam_sem_init(cam_semaphore_t *s, int n)
+{
+    s->waiters = 0;
+    __atomic_store_n(&s->val, n, __ATOMIC_RELEASE);
+}
+
+static inline int cam_sem_trywait_fast(cam_semaphore_t *s)
+{
+    int val = __atomic_load_n(&s->val, __ATOMIC_SEQ_CST);
+    while (val > 0) {
+        if (__atomic_compare_exchange_n(&s->val, &val, val - 1, 1,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline void cam_sem_post(cam_semaphore_t *s)
+{
+    __atomic_fetch_add(&s->val, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST) > 0) {
+        syscall(SYS_futex, &s->val, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+static inline int cam_sem_wait(cam_semaphore_t *s)
+{
+    int i;
+    for (i = 0; i < CAM_SEM_SPIN_COUNT; i++) {
+        if (cam_sem_trywait_fast(s))
+            return 0;
+    }
+
+    /* waiters must be visible before the count is checked again, post
+     * bumps the count before it looks at waiters */
+    __atomic_fetch_add(&s->waiters, 1, __ATOMIC_SEQ_CST);
+    while (!cam_sem_trywait_fast(s)) {
+        /* sleeps only if the count is still 0, EINTR/EAGAIN just retry */
+        syscall(SYS_futex, &s->val, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+    }
+    __atomic_fetch_sub(&s->waiters, 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+static inline void cam_sem_destroy(cam_semaphore_t *s)
+{
+    s->val = 0;
+    s->waiters = 0;
+}
+
+#else /* CAM_SEM_USE_FUTEX */
+
 typedef struct {
     int val;
     pthread_mutex_t mutex;
@@ -78,6 +155,8 @@ static inline void cam_sem_destroy(cam_semaphore_t *s)
     s->val = 0;
 }
 
+#endif /* CAM_SEM_USE_FUTEX */
+
 #ifdef __cplusplus
 }
 #endif
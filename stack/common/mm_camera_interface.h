@@ -168,12 +168,17 @@ typedef enum {
 *    @num_retro_buf_requested : number of retro bufs requested
 *    @primary_only : specifies if only primary camera frame for a dual
 *     camera is requested
+*    @shutter_ts_ns : shutter press time, CLOCK_MONOTONIC
+*    @select_window_us : if non zero, the best scored frame within
+*     +/- window of the shutter is taken instead of the queue head
 **/
 typedef struct {
     mm_camera_req_buf_type_t type;
     uint32_t num_buf_requested;
     uint32_t num_retro_buf_requested;
     uint8_t primary_only;
+    uint64_t shutter_ts_ns;
+    uint32_t select_window_us;
 } mm_camera_req_buf_t;
 
 /** mm_camera_event_t: structure for event
@@ -205,6 +210,32 @@ typedef void (*mm_camera_event_notify_t)(uint32_t camera_handle,
 typedef void (*mm_camera_buf_notify_t) (mm_camera_super_buf_t *bufs,
                                         void *user_data);
 
+/** mm_camera_map_done_cb_t: function definition for completion
+*   of one asynchronous mapping/unmapping message
+*    @seq : sequence id returned when the message was sent
+*    @status : 0 if the server mapped/unmapped the buffers
+*    @user_data : user data pointer
+*   Called from the camera event thread, must not block on another
+*   mapping message.
+**/
+typedef void (*mm_camera_map_done_cb_t) (uint32_t seq,
+                                         int32_t status,
+                                         void *user_data);
+
+/** mm_camera_map_batch_t: barrier for a group of asynchronous
+*   mapping/unmapping messages. Zero it before the first send.
+*    @pending : messages sent and not completed yet
+*    @status : 0 while all completed messages succeeded, -1 otherwise
+*    @done_cb : optional callback for each completed message
+*    @user_data : user data pointer of done_cb
+**/
+typedef struct {
+    uint32_t pending;
+    int32_t status;
+    mm_camera_map_done_cb_t done_cb;
+    void *user_data;
+} mm_camera_map_batch_t;
+
 /** map_stream_buf_op_t: function definition for operation of
 *   mapping stream buffers via domain socket
 *    @frame_idx : buffer index within stream buffers
@@ -239,17 +270,48 @@ typedef int32_t (*unmap_stream_buf_op_t) (uint32_t frame_idx,
                                           cam_mapping_buf_type type,
                                           void *userdata);
 
+/** map_stream_buf_async_op_t: function definition for operation
+*   of mapping a stream buffer without waiting for the server.
+*   Same as map_stream_buf_op_t, the message is added to @batch.
+**/
+typedef int32_t (*map_stream_buf_async_op_t) (uint32_t frame_idx,
+                                              int32_t plane_idx,
+                                              int fd,
+                                              size_t size,
+                                              cam_mapping_buf_type type,
+                                              mm_camera_map_batch_t *batch,
+                                              void *userdata);
+
+typedef int32_t (*map_stream_bufs_async_op_t) (const cam_buf_map_type_list *buf_map_list,
+                                               mm_camera_map_batch_t *batch,
+                                               void *userdata);
+
+/** wait_stream_maps_op_t: function definition for waiting until
+*   all messages of a batch are completed by the server
+*    @batch : batch passed to the async mapping operations
+*    @userdata : user data pointer
+**/
+typedef int32_t (*wait_stream_maps_op_t) (mm_camera_map_batch_t *batch,
+                                          void *userdata);
+
 /** mm_camera_map_unmap_ops_tbl_t: virtual table
 *                      for mapping/unmapping stream buffers via
 *                      domain socket
 *    @map_ops : operation for mapping
 *    @unmap_ops : operation for unmapping
+*    @map_async_ops : operation for mapping without waiting
+*    @bundled_map_async_ops : operation for bundled mapping without
+*                             waiting
+*    @wait_ops : wait for the async mappings of a batch
 *    @userdata: user data pointer
 **/
 typedef struct {
     map_stream_buf_op_t map_ops;
     map_stream_bufs_op_t bundled_map_ops;
     unmap_stream_buf_op_t unmap_ops;
+    map_stream_buf_async_op_t map_async_ops;
+    map_stream_bufs_async_op_t bundled_map_async_ops;
+    wait_stream_maps_op_t wait_ops;
     void *userdata;
 } mm_camera_map_unmap_ops_tbl_t;
 
@@ -259,6 +321,8 @@ typedef struct {
 *                stream buffers
 *    @put_bufs : function definition for deallocating
 *                stream buffers
+*    @mark_cpu_write: optional, reports a CPU write into a
+*                stream buffer made after it was dequeued
 *    @user_data: user data pointer
 **/
 typedef struct {
@@ -275,6 +339,8 @@ typedef struct {
                        void *user_data);
   int32_t (*invalidate_buf)(uint32_t index, void *user_data);
   int32_t (*clean_invalidate_buf)(uint32_t index, void *user_data);
+  int32_t (*mark_cpu_write)(uint32_t index, size_t offset, size_t len,
+          void *user_data);
 } mm_camera_stream_mem_vtbl_t;
 
 /** mm_camera_stream_config_t: structure for stream
@@ -866,6 +932,26 @@ typedef struct {
     int32_t (*register_stream_buf_cb) (uint32_t camera_handle,
             uint32_t ch_id, uint32_t stream_id, mm_camera_buf_notify_t buf_cb,
             mm_camera_stream_cb_type cb_type, void *userdata);
+
+   /** dump_latency: print per stream type frame latency histograms
+     *    @camera_handle : camera handler
+     *    @fd : output fd
+     *    Return value: 0 -- success
+     *                -1 -- failure
+     **/
+    int32_t (*dump_latency) (uint32_t camera_handle, int fd);
+
+   /** set_buf_map_cache: keep stream buffer mappings at the server when
+     *                    the client unmaps them, so that mapping the same
+     *                    fd and size again after a stream restart costs no
+     *                    round trip. The client has to report freed buffers
+     *                    with mm_camera_invalidate_buf_mapping().
+     *    @camera_handle : camera handler
+     *    @enable : TRUE to enable, FALSE to disable
+     *    Return value: 0 -- success
+     *                -1 -- failure
+     **/
+    int32_t (*set_buf_map_cache) (uint32_t camera_handle, uint8_t enable);
 } mm_camera_ops_t;
 
 /** mm_camera_vtbl_t: virtual table for camera operations
@@ -927,4 +1013,37 @@ struct camera_info *get_cam_info(uint32_t camera_id, cam_sync_type_t *pCamType);
 
 uint8_t is_yuv_sensor(uint32_t camera_id);
 
+/* forget the server side mappings of a buffer before its fd is closed,
+ * required from clients that enabled set_buf_map_cache */
+void mm_camera_invalidate_buf_mapping(int32_t fd);
+
+/* sparse access to metadata_buffer_t, only the valid entries are touched */
+#define MM_CAMERA_META_VALID_WORDS ((CAM_INTF_PARM_MAX + 63) / 64)
+
+typedef struct {
+    uint64_t bits[MM_CAMERA_META_VALID_WORDS];
+    uint32_t count;
+} mm_camera_meta_valid_t;
+
+uint32_t mm_camera_meta_get_valid(const metadata_buffer_t *meta,
+        mm_camera_meta_valid_t *valid);
+
+uint8_t mm_camera_meta_has_valid(const metadata_buffer_t *meta);
+
+int32_t mm_camera_meta_next_valid(const mm_camera_meta_valid_t *valid,
+        int32_t id);
+
+void *mm_camera_meta_entry(metadata_buffer_t *meta, uint32_t id, size_t *size);
+
+size_t mm_camera_meta_copy(metadata_buffer_t *dst,
+        const metadata_buffer_t *src);
+
+size_t mm_camera_meta_encoded_size(const metadata_buffer_t *meta);
+
+size_t mm_camera_meta_encode(const metadata_buffer_t *meta, void *buf,
+        size_t len);
+
+int32_t mm_camera_meta_decode(const void *buf, size_t len,
+        metadata_buffer_t *meta);
+
 #endif /*__MM_CAMERA_INTERFACE_H__*/
@@ -0,0 +1,75 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __MM_CAMERA_LATENCY_H__
+#define __MM_CAMERA_LATENCY_H__
+
+#include <inttypes.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Log-linear latency histogram in microseconds: exact below 16us, then 8
+ * buckets per power of two, i.e. percentiles are within 12.5% and the max
+ * is exact. Recording is lock free and can be done from any thread. */
+
+#define MM_CAMERA_LATENCY_SUB_BITS 3
+#define MM_CAMERA_LATENCY_LINEAR (2 << MM_CAMERA_LATENCY_SUB_BITS)
+#define MM_CAMERA_LATENCY_BUCKETS \
+    (MM_CAMERA_LATENCY_LINEAR + (32 - MM_CAMERA_LATENCY_SUB_BITS - 1) * \
+    (1 << MM_CAMERA_LATENCY_SUB_BITS))
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[MM_CAMERA_LATENCY_BUCKETS];
+} mm_camera_latency_hist_t;
+
+static inline uint64_t mm_camera_latency_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void mm_camera_latency_record(mm_camera_latency_hist_t *hist, uint64_t ns);
+uint32_t mm_camera_latency_percentile(const mm_camera_latency_hist_t *hist,
+        uint32_t permille);
+void mm_camera_latency_reset(mm_camera_latency_hist_t *hist);
+void mm_camera_latency_print(int fd, const char *name,
+        const mm_camera_latency_hist_t *hist);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MM_CAMERA_LATENCY_H__ */
@@ -0,0 +1,77 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __MM_CAMERA_TRACE_H__
+#define __MM_CAMERA_TRACE_H__
+
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Frame trace: every thread records into its own ring, events carry the
+ * frame index and stream type so one frame can be followed across the
+ * interface, channel and HAL threads. Enabled with
+ * persist.camera.trace.frames=1, dumped as Chrome trace JSON through
+ * mm_camera_trace_dump() or, if persist.camera.trace.signal is set, to
+ * QCAMERA_DUMP_FRM_LOCATION on that signal. Event names must be string
+ * literals, only the pointer is stored. */
+
+typedef enum {
+    MM_CAMERA_TRACE_INSTANT,
+    MM_CAMERA_TRACE_BEGIN,
+    MM_CAMERA_TRACE_END,
+} mm_camera_trace_phase_t;
+
+extern volatile uint32_t g_mm_camera_trace_enabled;
+
+void mm_camera_trace_init(void);
+void mm_camera_trace_record(const char *name, uint32_t stream_type,
+        uint32_t frame_idx, mm_camera_trace_phase_t phase);
+int32_t mm_camera_trace_dump(int fd);
+
+#define MM_CAMERA_TRACE_EVENT(name, type, idx, phase) do { \
+    if (__builtin_expect(g_mm_camera_trace_enabled, 0)) { \
+        mm_camera_trace_record(name, (uint32_t)(type), (uint32_t)(idx), phase); \
+    } \
+} while (0)
+
+#define MM_CAMERA_TRACE_FRAME(name, type, idx) \
+    MM_CAMERA_TRACE_EVENT(name, type, idx, MM_CAMERA_TRACE_INSTANT)
+#define MM_CAMERA_TRACE_FRAME_BEGIN(name, type, idx) \
+    MM_CAMERA_TRACE_EVENT(name, type, idx, MM_CAMERA_TRACE_BEGIN)
+#define MM_CAMERA_TRACE_FRAME_END(name, type, idx) \
+    MM_CAMERA_TRACE_EVENT(name, type, idx, MM_CAMERA_TRACE_END)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MM_CAMERA_TRACE_H__ */
@@ -25,7 +25,17 @@ MM_CAM_FILES := \
         src/mm_camera_channel.c \
         src/mm_camera_stream.c \
         src/mm_camera_thread.c \
-        src/mm_camera_sock.c
+        src/mm_camera_sock.c \
+        src/mm_camera_trace.c \
+        src/mm_camera_latency.c \
+        src/mm_camera_map_cache.c \
+        src/mm_camera_meta.c
+
+# replay backend, see inc/mm_camera_sim.h
+ifeq ($(strip $(TARGET_USES_MM_CAMERA_SIM)),true)
+    MM_CAM_FILES += src/mm_camera_sim.c
+    LOCAL_CFLAGS += -DMM_CAMERA_SIM
+endif
 
 ifeq ($(strip $(TARGET_USES_ION)),true)
     LOCAL_CFLAGS += -DUSE_ION
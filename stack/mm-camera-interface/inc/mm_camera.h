@@ -33,6 +33,9 @@
 #include <cam_semaphore.h>
 
 #include "mm_camera_interface.h"
+#include "mm_camera_sim.h"
+#include "mm_camera_trace.h"
+#include "mm_camera_latency.h"
 #include <hardware/camera.h>
 #include <utils/Timers.h>
 
@@ -123,6 +126,33 @@ typedef struct {
 
 typedef void (*mm_camera_cmd_cb_t)(mm_camera_cmdcb_t * cmd_cb, void* user_data);
 
+/* cmd nodes carved from a pool per buffer a stream owns:
+ * one for the stream cmd thread, one for the channel cmd thread */
+#define MM_CAMERA_CMD_POOL_NODES_PER_BUF 2
+
+struct mm_camera_cmd_pool;
+
+/* cmd block allocated together with its cmd queue node, so posting a cmd
+ * costs a single allocation, or none when it comes from a pool */
+typedef struct {
+    cam_node_t qnode;                /* link in cmd queue or pool free list */
+    struct mm_camera_cmd_pool *pool; /* owner pool, NULL if from heap */
+    mm_camera_cmdcb_t cmd;
+} mm_camera_cmd_entry_t;
+
+typedef struct mm_camera_cmd_pool {
+    pthread_mutex_t lock;
+    mm_camera_cmd_entry_t *slab;     /* preallocated entries */
+    struct cam_list free_list;       /* free entries, linked via qnode */
+    uint32_t num_entries;
+    uint32_t in_use;
+    uint32_t high_water;             /* max entries in use at a time */
+    uint32_t alloc_avoided;          /* allocs served from slab */
+    uint32_t alloc_fallback;         /* allocs that fell back to heap */
+    uint8_t released;                /* owner gone, free on last put */
+    char name[THREAD_NAME_SIZE];
+} mm_camera_cmd_pool_t;
+
 typedef struct {
     uint8_t is_active;     /*indicates whether thread is active or not */
     cam_queue_t cmd_queue; /* cmd queue (queuing dataCB, asyncCB, or exitCMD) */
@@ -149,26 +179,48 @@ typedef struct {
     mm_camera_poll_notify_t notify_cb;
     uint32_t handler;
     void* user_data;
+    uint32_t events;  /* epoll events that trigger notify_cb */
+    int32_t slot;     /* slot in poll engine, -1 if not registered */
 } mm_camera_poll_entry_t;
 
+/* max fds registered on one poll engine, i.e. streams of all
+ * channels of a camera sharing its data poll engine */
+#define MM_CAMERA_POLL_ENGINE_MAX_SLOTS (MAX_STREAM_NUM_IN_BUNDLE * 8)
+/* max events dispatched per epoll wakeup */
+#define MM_CAMERA_POLL_ENGINE_MAX_EVENTS (MAX_STREAM_NUM_IN_BUNDLE + 1)
+
+typedef struct {
+    mm_camera_poll_entry_t *entry; /* NULL if slot is free */
+    uint32_t gen;                  /* bumped on reuse, filters stale events */
+} mm_camera_poll_slot_t;
+
+/* epoll loop servicing the entries of one or more poll threads */
+typedef struct {
+    int32_t epoll_fd;
+    int32_t event_fd;       /* control channel to wake up the loop */
+    pthread_t pid;
+    uint8_t exit;
+    uint32_t ref_cnt;       /* poll threads attached */
+    pthread_mutex_t mutex;  /* protects slots and dispatch state */
+    pthread_cond_t cond_v;  /* signalled when a dispatch round ends */
+    uint8_t dispatching;    /* loop is between epoll_wait returns */
+    uint32_t round;         /* completed dispatch rounds */
+    mm_camera_poll_slot_t slots[MM_CAMERA_POLL_ENGINE_MAX_SLOTS];
+    char threadName[THREAD_NAME_SIZE];
+} mm_camera_poll_engine_t;
+
 typedef struct {
     mm_camera_poll_thread_type_t poll_type;
     /* array to store poll fd and cb info
      * for MM_CAMERA_POLL_TYPE_EVT, only index 0 is valid;
      * for MM_CAMERA_POLL_TYPE_DATA, depends on valid stream fd */
     mm_camera_poll_entry_t poll_entries[MAX_STREAM_NUM_IN_BUNDLE];
-    int32_t pfds[2];
-    pthread_t pid;
+    /* DATA poll threads of the channels of one camera share an engine,
+     * EVT poll thread has its own */
+    mm_camera_poll_engine_t *engine;
+    uint8_t cam_idx;  /* camera of a DATA poll thread, set before launch */
     int32_t state;
-    int timeoutms;
-    uint32_t cmd;
-    struct pollfd poll_fds[MAX_STREAM_NUM_IN_BUNDLE + 1];
-    uint8_t num_fds;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond_v;
-    int32_t status;
     char threadName[THREAD_NAME_SIZE];
-    //void *my_obj;
 } mm_camera_poll_thread_t;
 
 /* mm_stream */
@@ -224,8 +276,23 @@ typedef struct {
     uint8_t in_kernel;
     /*indicate if this buffer is mapped to daemon*/
     uint8_t is_mapped;
+
+    /* CLOCK_MONOTONIC ns of the last DQBUF, superbuf match and first
+     * dispatch to the client, 0 if not reached yet */
+    uint64_t dq_ts;
+    uint64_t match_ts;
+    uint64_t cb_ts;
 } mm_stream_buf_status_t;
 
+/* per stream type frame latency stages, see mm_camera_dump_latency */
+typedef enum {
+    MM_STREAM_LAT_SENSOR_TO_DQ,   /* sensor timestamp -> DQBUF */
+    MM_STREAM_LAT_DQ_TO_MATCH,    /* DQBUF -> superbuf matched */
+    MM_STREAM_LAT_MATCH_TO_CB,    /* matched (or DQBUF) -> client callback */
+    MM_STREAM_LAT_CB_TO_DONE,     /* client callback -> buffer back in kernel */
+    MM_STREAM_LAT_MAX
+} mm_stream_latency_stage_t;
+
 typedef struct mm_stream {
     uint32_t my_hdl; /* local stream id */
     uint32_t server_stream_id; /* stream id from server */
@@ -244,6 +311,9 @@ typedef struct mm_stream {
     pthread_mutex_t cmd_lock; /* lock to protect cmd_thread */
     mm_camera_cmd_thread_t cmd_thread;
 
+    /* cmd nodes for buffers of this stream, sized at init_bufs */
+    mm_camera_cmd_pool_t *cmd_pool;
+
     /* dataCB registered on this stream obj */
     pthread_mutex_t cb_lock; /* cb lock to protect buf_cb */
     mm_stream_data_cb_t buf_cb[MM_CAMERA_STREAM_BUF_CB_MAX];
@@ -346,16 +416,59 @@ typedef struct {
 } mm_evt_paylod_reg_stream_buf_cb;
 
 
+struct mm_channel_superbuf_pool;
+
+/* superbuf, allocated together with its superbuf queue node */
 typedef struct {
     uint8_t num_of_bufs;
     mm_camera_buf_info_t super_buf[MAX_STREAM_NUM_IN_BUNDLE];
     uint8_t matched;
     uint8_t expected;
     uint32_t frame_idx;
+    cam_node_t qnode;       /* link in superbuf queue or pool free list */
+    struct cam_list ulist;  /* link in unmatched list, empty once matched */
+    uint8_t indexed;        /* held by the frame index ring */
+    struct mm_channel_superbuf_pool *pool; /* owner pool, NULL if from heap */
+    uint8_t scored;         /* ZSL selection scores below are valid */
+    uint8_t aec_settled;
+    uint8_t af_settled;
+    uint32_t sharpness;     /* mean luma gradient x 64 */
 } mm_channel_queue_node_t;
 
+typedef struct mm_channel_superbuf_pool {
+    pthread_mutex_t lock;
+    mm_channel_queue_node_t *slab;   /* preallocated superbufs */
+    struct cam_list free_list;       /* free superbufs, linked via qnode */
+    uint32_t num_entries;
+    uint32_t in_use;
+    uint32_t high_water;             /* max superbufs in use at a time */
+    uint32_t alloc_fallback;         /* allocs that fell back to heap */
+    uint8_t released;                /* owner gone, free on last put */
+} mm_channel_superbuf_pool_t;
+
+/* slots in the frame index ring of unmatched superbufs, power of 2 */
+#define MM_CHANNEL_SUPERBUF_INDEX_SIZE 64
+/* superbufs preallocated on top of water mark and unmatched frames,
+ * covers the ones being dispatched to the cb thread */
+#define MM_CHANNEL_SUPERBUF_POOL_EXTRA 4
+
+/* ZSL frame selection score: settled AEC and AF outweigh sharpness, which
+ * outweighs being a few frames away from the shutter */
+#define MM_CHANNEL_ZSL_SCORE_AEC (1 << 16)
+#define MM_CHANNEL_ZSL_SCORE_AF (1 << 15)
+#define MM_CHANNEL_ZSL_SCORE_PER_MS 8
+/* rows of the luma plane sampled for the sharpness estimate */
+#define MM_CHANNEL_ZSL_SHARPNESS_ROWS 32
+
 typedef struct {
     cam_queue_t que;
+    /* unmatched superbufs of que in ascending frame_idx order */
+    struct cam_list unmatched;
+    uint32_t unmatched_cnt;
+    /* unmatched superbufs by frame_idx & (INDEX_SIZE - 1) */
+    mm_channel_queue_node_t *index[MM_CHANNEL_SUPERBUF_INDEX_SIZE];
+    uint32_t unindexed_cnt;  /* unmatched superbufs lost to index collision */
+    mm_channel_superbuf_pool_t *pool;
     uint8_t num_streams;
     /* container for bundled stream handlers */
     uint32_t bundled_streams[MAX_STREAM_NUM_IN_BUNDLE];
@@ -380,28 +493,70 @@ typedef struct {
     void *user_data;
 } mm_channel_bundle_t;
 
+/* Frames of one camera waiting for their sync partners. Slots are indexed
+ * by frame_idx & (MM_FRAME_SYNC_RING_SIZE - 1), so add/remove are O(1). */
+#define MM_FRAME_SYNC_RING_SIZE 16
+/* Max number of independent frame sync pairs */
+#define MM_FRAME_SYNC_MAX_PAIRS 2
+/* Default sync window on sensor timestamps, 0 pairs by frame_idx */
+#define MM_FRAME_SYNC_WINDOW_US_DEFAULT "4000"
+
 /* Nodes used for frame sync */
 typedef struct {
-    /* Frame idx */
+    /* Frame idx, 0 if the slot is empty */
     uint32_t frame_idx;
-    /* Frame present for corresponding channel*/
-    uint32_t frame_valid[MAX_NUM_CAMERA_PER_BUNDLE];
-    /* Frame present in all channels*/
-    uint32_t matched;
+    /* Sync key: sensor timestamp in ns, or frame_idx in frame id mode */
+    uint64_t key;
+    /* Time the frame was added, for sync latency */
+    uint64_t add_ns;
 } mm_channel_sync_node_t;
 
-/* Frame sync information */
+/* Per camera frame sync ring */
+typedef struct {
+    mm_channel_sync_node_t node[MM_FRAME_SYNC_RING_SIZE];
+    /* Oldest frame_idx that may still be pending */
+    uint32_t head;
+    /* Newest frame_idx added + 1, 0 if nothing was added yet */
+    uint32_t tail;
+    /* Frames dropped without a partner */
+    uint32_t misses;
+} mm_channel_sync_cam_t;
+
+/* Set of frames, one per camera, that were synced together */
+typedef struct {
+    uint32_t frame_idx[MAX_NUM_CAMERA_PER_BUNDLE];
+} mm_channel_sync_set_t;
+
+/* Frame sync information for one pair of camera channels */
 typedef struct {
+    /* Protects everything below, taken after a channel queue lock */
+    pthread_mutex_t lock;
+    /* Signalled when in_use drops to 0 */
+    pthread_cond_t cond;
+    uint8_t initialized;
     /* Number of camera channels that need to be synced*/
     uint8_t num_cam;
-    /* position of the next node to be updated */
-    uint8_t pos;
-    /* circular node array used to store frame information */
-    mm_channel_sync_node_t node[MM_CAMERA_FRAME_SYNC_NODES];
+    /* Consumers currently dequeuing a synced set */
+    uint8_t in_use;
+    /* Max key distance between frames of a set, 0 for frame_idx match */
+    uint64_t window_ns;
     /* Channel corresponding to each camera */
     struct mm_channel *ch_obj[MAX_NUM_CAMERA_PER_BUNDLE];
     /* Cb corresponding to each camera */
     mm_camera_buf_notify_t cb[MAX_NUM_CAMERA_PER_BUNDLE];
+    /* Pending frames per camera */
+    mm_channel_sync_cam_t cam[MAX_NUM_CAMERA_PER_BUNDLE];
+    /* Synced sets waiting to be dispatched, oldest at matched_head */
+    mm_channel_sync_set_t matched[MM_CAMERA_FRAME_SYNC_NODES];
+    uint8_t matched_head;
+    uint8_t matched_cnt;
+    /* Statistics */
+    uint32_t synced;
+    uint32_t sets_dropped;
+    /* First frame of a set added -> set complete */
+    mm_camera_latency_hist_t sync_latency;
+    /* Key distance between the frames of a set */
+    mm_camera_latency_hist_t sync_skew;
 } mm_channel_frame_sync_info_t;
 
 /* Node information for multiple superbuf callbacks
@@ -444,6 +599,9 @@ typedef struct mm_channel {
     /* cb thread for sending data cb */
     mm_camera_cmd_thread_t cb_thread;
 
+    /* cmd nodes for super buf dispatch to cb_thread */
+    mm_camera_cmd_pool_t *cb_pool;
+
     /* data poll thread
     * currently one data poll thread per channel
     * could extended to support one data poll thread per stream in the channel */
@@ -477,6 +635,14 @@ typedef struct mm_channel {
 
     uint8_t capture_frame_id[MAX_CAPTURE_BATCH_NUM];
     cam_capture_frame_config_t frameConfig;
+
+    /* ZSL frame selection for the pending request, 0 window if off */
+    uint64_t select_shutter_ns;
+    uint64_t select_window_ns;
+
+    /* frame sync pair this channel is registered to, and its slot in it */
+    mm_channel_frame_sync_info_t *frame_sync;
+    uint8_t frame_sync_idx;
 } mm_channel_t;
 
 typedef struct {
@@ -505,6 +671,59 @@ typedef struct {
     int reg_count;
 } mm_camera_evt_obj_t;
 
+/* stream buffer mappings remembered per camera, see mm_camera_map_cache.c */
+#define MM_CAMERA_MAP_CACHE_SIZE 128
+
+typedef enum {
+    MM_CAMERA_MAP_FREE,
+    MM_CAMERA_MAP_ACTIVE,   /* mapped at the server and owned by the stream */
+    MM_CAMERA_MAP_PARKED,   /* unmapped by the client, kept at the server */
+    MM_CAMERA_MAP_STALE     /* parked but the buffer is freed, to be unmapped */
+} mm_camera_map_state_t;
+
+typedef struct {
+    mm_camera_map_state_t state;
+    uint32_t stream_hdl;
+    uint8_t buf_type;
+    uint32_t frame_idx;
+    int32_t plane_idx;
+    int32_t fd;
+    size_t size;
+} mm_camera_map_entry_t;
+
+typedef struct mm_camera_map_cache {
+    uint8_t enabled;
+    mm_camera_map_entry_t entries[MM_CAMERA_MAP_CACHE_SIZE];
+    struct mm_camera_map_cache *next; /* registered caches, for invalidation */
+
+    /* counters for the dump */
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t parked;
+    uint32_t flushed;
+} mm_camera_map_cache_t;
+
+/* mapping messages sent to the server and not answered yet. The server
+ * handles the domain socket in order and answers each message with one
+ * CAM_EVENT_TYPE_MAP_UNMAP_DONE, so completions match the oldest entry. */
+#define MM_CAMERA_MAP_INFLIGHT_MAX 16
+
+typedef struct {
+    uint32_t seq;
+    mm_camera_map_batch_t *batch; /* NULL if nobody waits for it */
+    mm_camera_map_done_cb_t cb;
+    void *user_data;
+} mm_camera_map_req_t;
+
+typedef struct {
+    mm_camera_map_req_t reqs[MM_CAMERA_MAP_INFLIGHT_MAX];
+    uint32_t head;
+    uint32_t count;
+    uint32_t max_inflight;
+    uint32_t seq;  /* last sequence id handed out */
+    uint32_t done; /* completions so far, to tell a slow server from a dead one */
+} mm_camera_map_queue_t;
+
 typedef struct mm_camera_obj {
     uint32_t my_hdl;
     int ref_count;
@@ -518,12 +737,18 @@ typedef struct mm_camera_obj {
     mm_camera_cmd_thread_t evt_thread;       /* thread for evt CB */
     mm_camera_vtbl_t vtbl;
 
-    pthread_mutex_t evt_lock;
+    pthread_mutex_t evt_lock; /* protects map_queue */
     pthread_cond_t evt_cond;
-    mm_camera_event_t evt_rcvd;
+    mm_camera_map_queue_t map_queue;
 
     pthread_mutex_t msg_lock; /* lock for sending msg through socket */
     uint32_t sessionid; /* Camera server session id */
+
+    /* frame latency per stream type, kept until camera close */
+    mm_camera_latency_hist_t stream_latency[CAM_STREAM_TYPE_MAX][MM_STREAM_LAT_MAX];
+
+    /* stream buffer mappings kept at the server across stream restarts */
+    mm_camera_map_cache_t map_cache;
 } mm_camera_obj_t;
 
 typedef struct {
@@ -568,6 +793,30 @@ extern int32_t mm_camera_util_bundled_sendmsg(mm_camera_obj_t *my_obj,
                                               int sendfds[CAM_MAX_NUM_BUFS_PER_STREAM],
                                               int numfds);
 
+/* send msg through domain socket without waiting for the server */
+extern int32_t mm_camera_util_sendmsg_async(mm_camera_obj_t *my_obj,
+                                            void *msg,
+                                            size_t buf_size,
+                                            int sendfd,
+                                            mm_camera_map_batch_t *batch,
+                                            mm_camera_map_done_cb_t cb,
+                                            void *user_data,
+                                            uint32_t *seq);
+
+extern int32_t mm_camera_util_bundled_sendmsg_async(mm_camera_obj_t *my_obj,
+                                                    void *msg,
+                                                    size_t buf_size,
+                                                    int sendfds[CAM_MAX_NUM_BUFS_PER_STREAM],
+                                                    int numfds,
+                                                    mm_camera_map_batch_t *batch,
+                                                    mm_camera_map_done_cb_t cb,
+                                                    void *user_data,
+                                                    uint32_t *seq);
+
+/* wait until the server answered all messages of a batch */
+extern int32_t mm_camera_util_wait_for_maps(mm_camera_obj_t *my_obj,
+                                            mm_camera_map_batch_t *batch);
+
 /* Check if hardware target is A family */
 uint8_t mm_camera_util_chip_is_a_family(void);
 
@@ -684,6 +933,31 @@ extern int32_t mm_camera_get_session_id(mm_camera_obj_t *my_obj,
                                         uint32_t* sessionid);
 extern int32_t mm_camera_sync_related_sensors(mm_camera_obj_t *my_obj,
                                    cam_sync_related_sensors_event_info_t *parms);
+extern int32_t mm_camera_dump_latency(mm_camera_obj_t *my_obj, int fd);
+extern int32_t mm_camera_set_buf_map_cache(mm_camera_obj_t *my_obj,
+                                          uint8_t enable);
+
+/* buffer mapping cache */
+extern void mm_camera_map_cache_init(mm_camera_map_cache_t *cache);
+extern void mm_camera_map_cache_deinit(mm_camera_map_cache_t *cache);
+extern void mm_camera_map_cache_enable(mm_camera_map_cache_t *cache,
+                                       uint8_t enable);
+extern uint32_t mm_camera_map_cache_prepare(mm_camera_map_cache_t *cache,
+                                            uint32_t stream_hdl,
+                                            cam_buf_map_type_list *maps,
+                                            cam_buf_unmap_type_list *unmaps);
+extern void mm_camera_map_cache_commit(mm_camera_map_cache_t *cache,
+                                       uint32_t stream_hdl,
+                                       const cam_buf_map_type_list *maps);
+extern uint8_t mm_camera_map_cache_park(mm_camera_map_cache_t *cache,
+                                        uint32_t stream_hdl,
+                                        uint8_t buf_type,
+                                        uint32_t frame_idx,
+                                        int32_t plane_idx);
+extern void mm_camera_map_cache_release_stream(mm_camera_map_cache_t *cache,
+                                               uint32_t stream_hdl,
+                                               cam_buf_unmap_type_list *unmaps);
+extern void mm_camera_map_cache_dump(mm_camera_map_cache_t *cache, int fd);
 
 /* mm_channel */
 extern int32_t mm_channel_fsm_fn(mm_channel_t *my_obj,
@@ -699,6 +973,19 @@ extern int32_t mm_channel_init(mm_channel_t *my_obj,
  * from the context of dataCB, but async stop is holding ch_lock */
 extern int32_t mm_channel_qbuf(mm_channel_t *my_obj,
                                mm_camera_buf_def_t *buf);
+extern mm_stream_t * mm_channel_util_get_stream_by_handler(mm_channel_t *ch_obj,
+                                                           uint32_t handler);
+extern int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t *queue);
+extern int32_t mm_channel_superbuf_queue_deinit(mm_channel_queue_t *queue);
+extern int32_t mm_channel_superbuf_comp_and_enqueue(mm_channel_t *ch_obj,
+                                                    mm_channel_queue_t *queue,
+                                                    mm_camera_buf_info_t *buf_info);
+extern int32_t mm_channel_superbuf_bufdone_overflow(mm_channel_t *my_obj,
+                                                    mm_channel_queue_t *queue);
+extern int32_t mm_channel_superbuf_flush(mm_channel_t *my_obj,
+                                         mm_channel_queue_t *queue,
+                                         cam_stream_type_t cam_type);
+extern void mm_frame_sync_dump(int fd);
 /* mm_stream */
 extern int32_t mm_stream_fsm_fn(mm_stream_t *my_obj,
                                 mm_stream_evt_type_t evt,
@@ -715,10 +1002,28 @@ extern int32_t mm_stream_map_buf(mm_stream_t *my_obj,
                                  size_t size);
 extern int32_t mm_stream_map_bufs(mm_stream_t *my_obj,
                                   const cam_buf_map_type_list *buf_map_list);
+extern int32_t mm_stream_map_buf_async(mm_stream_t *my_obj,
+                                       uint8_t buf_type,
+                                       uint32_t frame_idx,
+                                       int32_t plane_idx,
+                                       int fd,
+                                       size_t size,
+                                       mm_camera_map_batch_t *batch);
+extern int32_t mm_stream_map_bufs_async(mm_stream_t *my_obj,
+                                        const cam_buf_map_type_list *buf_map_list,
+                                        mm_camera_map_batch_t *batch);
+extern int32_t mm_stream_unmap_bufs(mm_stream_t *my_obj,
+                                    const cam_buf_unmap_type_list *buf_unmap_list);
 extern int32_t mm_stream_unmap_buf(mm_stream_t *my_obj,
                                    uint8_t buf_type,
                                    uint32_t frame_idx,
                                    int32_t plane_idx);
+extern void mm_stream_latency_matched(mm_stream_t *my_obj,
+                                      uint32_t buf_idx,
+                                      uint64_t now);
+extern void mm_stream_latency_dispatched(mm_stream_t *my_obj,
+                                         uint32_t buf_idx,
+                                         uint64_t now);
 
 
 /* utiltity fucntion declared in mm-camera-inteface2.c
@@ -751,6 +1056,13 @@ extern int32_t mm_camera_cmd_thread_launch(
                                 void* user_data);
 extern int32_t mm_camera_cmd_thread_name(const char* name);
 extern int32_t mm_camera_cmd_thread_release(mm_camera_cmd_thread_t * cmd_thread);
+extern int32_t mm_camera_cmd_thread_enq(mm_camera_cmd_thread_t *cmd_thread,
+                                        mm_camera_cmdcb_t *cmd);
+extern mm_camera_cmd_pool_t *mm_camera_cmd_pool_create(const char *name,
+                                                       uint32_t num_entries);
+extern void mm_camera_cmd_pool_release(mm_camera_cmd_pool_t *pool);
+extern mm_camera_cmdcb_t *mm_camera_cmd_alloc(mm_camera_cmd_pool_t *pool);
+extern void mm_camera_cmd_free(mm_camera_cmdcb_t *cmd);
 
 extern int32_t mm_camera_channel_advanced_capture(mm_camera_obj_t *my_obj,
         uint32_t ch_id, mm_camera_advanced_capture_t type,
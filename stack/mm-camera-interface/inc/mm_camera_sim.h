@@ -0,0 +1,93 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __MM_CAMERA_SIM_H__
+#define __MM_CAMERA_SIM_H__
+
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "cam_types.h"
+
+/* Replay backend for running mm-camera-interface without sensor, kernel
+ * driver or daemon. It is only built with MM_CAMERA_SIM defined and only
+ * takes over once enabled through persist.camera.sim.enable or
+ * mm_camera_sim_configure(); until then every call falls through to the
+ * real device. Frames are played back from <dir>/cam<idx>_<stream>.bin
+ * (e.g. cam0_preview.bin, cam0_metadata.bin), capabilities from
+ * <dir>/cam<idx>_caps.bin. A missing replay file leaves buffer contents
+ * untouched and only the timing is simulated. */
+
+#define MM_CAMERA_SIM_MAX_STREAMS 16
+
+typedef struct {
+    uint32_t server_stream_id;
+    cam_stream_type_t stream_type;
+    uint32_t frames;          /* frames written into a queued buffer */
+    uint32_t drops;           /* frame slots with no buffer queued */
+    uint32_t dequeued;        /* VIDIOC_DQBUF returned a frame */
+    uint32_t returned;        /* VIDIOC_QBUF of a previously dequeued frame */
+    uint64_t dq_lat_sum_ns;   /* frame ready -> DQBUF */
+    uint64_t dq_lat_max_ns;
+    uint64_t hold_sum_ns;     /* DQBUF -> QBUF, time spent above the kernel */
+    uint64_t hold_max_ns;
+} mm_camera_sim_stream_stats_t;
+
+#ifdef MM_CAMERA_SIM
+
+int32_t mm_camera_sim_configure(const char *replay_dir, uint32_t fps,
+        uint8_t num_cameras);
+uint8_t mm_camera_sim_enabled(void);
+uint8_t mm_camera_sim_get_num_of_cameras(void);
+uint8_t mm_camera_sim_owns_fd(int fd);
+int mm_camera_sim_open(const char *dev_name, int flags);
+int mm_camera_sim_close(int fd);
+int mm_camera_sim_ioctl(int fd, unsigned long request, void *arg);
+int mm_camera_sim_socket_create(int cam_id);
+int mm_camera_sim_sendmsg(int fd, void *msg, size_t buf_size,
+        int *sendfds, int numfds);
+int32_t mm_camera_sim_get_stats(uint8_t cam_idx,
+        mm_camera_sim_stream_stats_t *stats, uint32_t max_streams,
+        uint32_t *num_streams);
+
+#define mm_camera_dev_open(name, flags) mm_camera_sim_open(name, flags)
+#define mm_camera_dev_close(fd) mm_camera_sim_close(fd)
+#define mm_camera_dev_ioctl(fd, req, arg) mm_camera_sim_ioctl(fd, req, arg)
+
+#else
+
+#define mm_camera_dev_open(name, flags) open(name, flags)
+#define mm_camera_dev_close(fd) close(fd)
+#define mm_camera_dev_ioctl(fd, req, arg) ioctl(fd, req, arg)
+
+#endif /* MM_CAMERA_SIM */
+
+#endif /*__MM_CAMERA_SIM_H__*/
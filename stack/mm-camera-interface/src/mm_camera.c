@@ -136,6 +136,63 @@ static void mm_camera_dispatch_app_event(mm_camera_cmdcb_t *cmd_cb,
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_queue_complete
+ *
+ * DESCRIPTION: complete the oldest mapping message pending at the server.
+ *              Callbacks run before the message leaves the queue, so a
+ *              waiter on the batch returns only after them.
+ *
+ * PARAMETERS :
+ *   @my_obj   : camera object
+ *   @status   : 0 if the server mapped/unmapped the buffers
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_map_queue_complete(mm_camera_obj_t *my_obj,
+                                         int32_t status)
+{
+    mm_camera_map_queue_t *queue = &my_obj->map_queue;
+    mm_camera_map_req_t req;
+    mm_camera_map_done_cb_t batch_cb = NULL;
+    void *batch_data = NULL;
+
+    pthread_mutex_lock(&my_obj->evt_lock);
+    if (0 == queue->count) {
+        pthread_mutex_unlock(&my_obj->evt_lock);
+        CDBG_ERROR("%s: mapping done without a pending message", __func__);
+        return;
+    }
+    req = queue->reqs[queue->head];
+    if (NULL != req.batch) {
+        batch_cb = req.batch->done_cb;
+        batch_data = req.batch->user_data;
+    }
+    pthread_mutex_unlock(&my_obj->evt_lock);
+
+    if (NULL != req.cb) {
+        req.cb(req.seq, status, req.user_data);
+    }
+    if (NULL != batch_cb) {
+        batch_cb(req.seq, status, batch_data);
+    }
+
+    pthread_mutex_lock(&my_obj->evt_lock);
+    /* the batch could have been detached by a timed out waiter meanwhile */
+    req.batch = queue->reqs[queue->head].batch;
+    if (NULL != req.batch) {
+        if (0 != status) {
+            req.batch->status = -1;
+        }
+        req.batch->pending--;
+    }
+    queue->head = (queue->head + 1) % MM_CAMERA_MAP_INFLIGHT_MAX;
+    queue->count--;
+    queue->done++;
+    pthread_cond_broadcast(&my_obj->evt_cond);
+    pthread_mutex_unlock(&my_obj->evt_lock);
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_event_notify
  *
@@ -159,7 +216,7 @@ static void mm_camera_event_notify(void* user_data)
     if (NULL != my_obj) {
         /* read evt */
         memset(&ev, 0, sizeof(ev));
-        rc = ioctl(my_obj->ctrl_fd, VIDIOC_DQEVENT, &ev);
+        rc = mm_camera_dev_ioctl(my_obj->ctrl_fd, VIDIOC_DQEVENT, &ev);
 
         if (rc >= 0 && ev.id == MSM_CAMERA_MSM_NOTIFY) {
             msm_evt = (struct msm_v4l2_event_data *)ev.u.data;
@@ -169,11 +226,8 @@ static void mm_camera_event_notify(void* user_data)
                 mm_camera_enqueue_evt(my_obj, &evt);
                 break;
             case CAM_EVENT_TYPE_MAP_UNMAP_DONE:
-                pthread_mutex_lock(&my_obj->evt_lock);
-                my_obj->evt_rcvd.server_event_type = msm_evt->command;
-                my_obj->evt_rcvd.status = msm_evt->status;
-                pthread_cond_signal(&my_obj->evt_cond);
-                pthread_mutex_unlock(&my_obj->evt_lock);
+                mm_camera_map_queue_complete(my_obj,
+                        (MSM_CAMERA_STATUS_SUCCESS == msm_evt->status) ? 0 : -1);
                 break;
             case CAM_EVENT_TYPE_INT_TAKE_JPEG:
             case CAM_EVENT_TYPE_INT_TAKE_RAW:
@@ -222,14 +276,13 @@ int32_t mm_camera_enqueue_evt(mm_camera_obj_t *my_obj,
     int32_t rc = 0;
     mm_camera_cmdcb_t *node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_alloc(NULL);
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_EVT_CB;
         node->u.evt = *event;
 
         /* enqueue to evt cmd thread */
-        cam_queue_enq(&(my_obj->evt_thread.cmd_queue), node);
+        mm_camera_cmd_thread_enq(&(my_obj->evt_thread), node);
         /* wake up evt cmd thread */
         cam_sem_post(&(my_obj->evt_thread.cmd_sem));
     } else {
@@ -295,7 +348,7 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
 
     do{
         n_try--;
-        my_obj->ctrl_fd = open(dev_name, O_RDWR | O_NONBLOCK);
+        my_obj->ctrl_fd = mm_camera_dev_open(dev_name, O_RDWR | O_NONBLOCK);
         l_errno = errno;
         CDBG("%s:  ctrl_fd = %d, errno == %d", __func__, my_obj->ctrl_fd, l_errno);
         //[BUGFIX] by TCTCD.long.chen,12/30/2015,Defect: 1240689,
@@ -342,10 +395,18 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
         goto on_error;
     }
     pthread_mutex_init(&my_obj->msg_lock, NULL);
+    mm_camera_map_cache_init(&my_obj->map_cache);
 
     pthread_mutex_init(&my_obj->cb_lock, NULL);
     pthread_mutex_init(&my_obj->evt_lock, NULL);
     pthread_cond_init(&my_obj->evt_cond, NULL);
+    memset(&my_obj->map_queue, 0, sizeof(my_obj->map_queue));
+    property_get("persist.camera.map.inflight", prop, "4");
+    my_obj->map_queue.max_inflight = (uint32_t)atoi(prop);
+    if ((my_obj->map_queue.max_inflight < 1) ||
+            (my_obj->map_queue.max_inflight > MM_CAMERA_MAP_INFLIGHT_MAX)) {
+        my_obj->map_queue.max_inflight = MM_CAMERA_MAP_INFLIGHT_MAX;
+    }
 
     CDBG("%s : Launch evt Thread in Cam Open",__func__);
     snprintf(my_obj->evt_thread.threadName, THREAD_NAME_SIZE, "CAM_Dispatch");
@@ -379,7 +440,7 @@ on_error:
         rc = -1;
     } else {
         if (my_obj->ctrl_fd >= 0) {
-            close(my_obj->ctrl_fd);
+            mm_camera_dev_close(my_obj->ctrl_fd);
             my_obj->ctrl_fd = -1;
         }
         if (my_obj->ds_fd >= 0) {
@@ -420,13 +481,18 @@ int32_t mm_camera_close(mm_camera_obj_t *my_obj)
     mm_camera_cmd_thread_release(&my_obj->evt_thread);
 
     if(my_obj->ctrl_fd >= 0) {
-        close(my_obj->ctrl_fd);
+        mm_camera_dev_close(my_obj->ctrl_fd);
         my_obj->ctrl_fd = -1;
     }
     if(my_obj->ds_fd >= 0) {
         mm_camera_socket_close(my_obj->ds_fd);
         my_obj->ds_fd = -1;
     }
+    mm_camera_map_cache_deinit(&my_obj->map_cache);
+    /* the server is gone, fail whatever it did not answer */
+    while (my_obj->map_queue.count > 0) {
+        mm_camera_map_queue_complete(my_obj, -1);
+    }
     pthread_mutex_destroy(&my_obj->msg_lock);
 
     pthread_mutex_destroy(&my_obj->cb_lock);
@@ -455,7 +521,7 @@ int32_t mm_camera_close(mm_camera_obj_t *my_obj)
 int32_t mm_camera_close_fd(mm_camera_obj_t *my_obj)
 {
     if(my_obj->ctrl_fd >= 0) {
-        close(my_obj->ctrl_fd);
+        mm_camera_dev_close(my_obj->ctrl_fd);
         my_obj->ctrl_fd = -1;
     }
     if(my_obj->ds_fd >= 0) {
@@ -632,7 +698,7 @@ int32_t mm_camera_query_capability(mm_camera_obj_t *my_obj)
 
     /* get camera capabilities */
     memset(&cap, 0, sizeof(cap));
-    rc = ioctl(my_obj->ctrl_fd, VIDIOC_QUERYCAP, &cap);
+    rc = mm_camera_dev_ioctl(my_obj->ctrl_fd, VIDIOC_QUERYCAP, &cap);
     if (rc != 0) {
         CDBG_ERROR("%s: cannot get camera capabilities, rc = %d\n", __func__, rc);
     }
@@ -1727,7 +1793,7 @@ int32_t mm_camera_evt_sub(mm_camera_obj_t * my_obj,
     sub.id = MSM_CAMERA_MSM_NOTIFY;
     if(FALSE == reg_flag) {
         /* unsubscribe */
-        rc = ioctl(my_obj->ctrl_fd, VIDIOC_UNSUBSCRIBE_EVENT, &sub);
+        rc = mm_camera_dev_ioctl(my_obj->ctrl_fd, VIDIOC_UNSUBSCRIBE_EVENT, &sub);
         if (rc < 0) {
             CDBG_ERROR("%s: unsubscribe event rc = %d", __func__, rc);
             return rc;
@@ -1737,7 +1803,7 @@ int32_t mm_camera_evt_sub(mm_camera_obj_t * my_obj,
                                                my_obj->my_hdl,
                                                mm_camera_sync_call);
     } else {
-        rc = ioctl(my_obj->ctrl_fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
+        rc = mm_camera_dev_ioctl(my_obj->ctrl_fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
         if (rc < 0) {
             CDBG_ERROR("%s: subscribe event rc = %d", __func__, rc);
             return rc;
@@ -1754,39 +1820,217 @@ int32_t mm_camera_evt_sub(mm_camera_obj_t * my_obj,
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_util_wait_for_event
+ * FUNCTION   : mm_camera_util_queue_sendmsg
  *
- * DESCRIPTION: utility function to wait for certain events
+ * DESCRIPTION: utility function to send a mapping msg via domain socket and
+ *              queue it until the server answers with
+ *              CAM_EVENT_TYPE_MAP_UNMAP_DONE. Blocks only while
+ *              max_inflight messages are already pending.
  *
  * PARAMETERS :
  *   @my_obj       : camera object
- *   @evt_mask     : mask for events to be waited. Any of event in the mask would
- *                   trigger the wait to end
- *   @status       : status of the event
+ *   @msg          : message to be sent
+ *   @buf_size     : size of the message to be sent
+ *   @sendfds      : array of file descriptors to be sent
+ *   @numfds       : number of file descriptors to be sent
+ *   @bundled      : TRUE to send all fds of @sendfds in one message
+ *   @batch        : batch the message is added to, could be NULL
+ *   @cb           : called on completion, could be NULL
+ *   @user_data    : user data ptr of @cb
+ *   @seq          : output sequence id of the message, could be NULL
  *
- * RETURN     : none
+ * RETURN     : int32_t type of status
+ *              0  -- success, @cb will be called
+ *              -1 -- failure, nothing was queued
  *==========================================================================*/
-void mm_camera_util_wait_for_event(mm_camera_obj_t *my_obj,
-                                   uint32_t evt_mask,
-                                   uint32_t *status)
+static int32_t mm_camera_util_queue_sendmsg(mm_camera_obj_t *my_obj,
+                                             void *msg,
+                                             size_t buf_size,
+                                             int *sendfds,
+                                             int numfds,
+                                             uint8_t bundled,
+                                             mm_camera_map_batch_t *batch,
+                                             mm_camera_map_done_cb_t cb,
+                                             void *user_data,
+                                             uint32_t *seq)
 {
-    int rc = 0;
+    int32_t rc = -1;
+    int n;
+    uint32_t done, tail;
     struct timespec ts;
+    mm_camera_map_queue_t *queue = &my_obj->map_queue;
 
+    /* msg_lock keeps the queue in the order the messages hit the socket */
+    pthread_mutex_lock(&my_obj->msg_lock);
     pthread_mutex_lock(&my_obj->evt_lock);
-    while (!(my_obj->evt_rcvd.server_event_type & evt_mask)) {
+    while (queue->count >= queue->max_inflight) {
+        done = queue->done;
         clock_gettime(CLOCK_REALTIME, &ts);
         ts.tv_sec += WAIT_TIMEOUT;
-        rc = pthread_cond_timedwait(&my_obj->evt_cond, &my_obj->evt_lock, &ts);
-        if (rc == ETIMEDOUT) {
-            ALOGE("%s pthread_cond_timedwait success\n", __func__);
+        if ((pthread_cond_timedwait(&my_obj->evt_cond, &my_obj->evt_lock,
+                &ts) == ETIMEDOUT) && (done == queue->done)) {
             break;
         }
     }
-    *status = my_obj->evt_rcvd.status;
-    /* reset local storage for recieved event for next event */
-    memset(&my_obj->evt_rcvd, 0, sizeof(mm_camera_event_t));
+    if (queue->count >= queue->max_inflight) {
+        CDBG_ERROR("%s: server did not answer %d pending mapping messages",
+                __func__, queue->count);
+        pthread_mutex_unlock(&my_obj->evt_lock);
+        pthread_mutex_unlock(&my_obj->msg_lock);
+        return rc;
+    }
+
+    tail = (queue->head + queue->count) % MM_CAMERA_MAP_INFLIGHT_MAX;
+    queue->seq++;
+    queue->reqs[tail].seq = queue->seq;
+    queue->reqs[tail].batch = batch;
+    queue->reqs[tail].cb = cb;
+    queue->reqs[tail].user_data = user_data;
+    queue->count++;
+    if (NULL != batch) {
+        batch->pending++;
+    }
     pthread_mutex_unlock(&my_obj->evt_lock);
+
+    if (bundled) {
+        n = mm_camera_socket_bundle_sendmsg(my_obj->ds_fd, msg, buf_size,
+                sendfds, numfds);
+    } else {
+        n = mm_camera_socket_sendmsg(my_obj->ds_fd, msg, buf_size, sendfds[0]);
+    }
+
+    pthread_mutex_lock(&my_obj->evt_lock);
+    if (n > 0) {
+        if (NULL != seq) {
+            *seq = queue->reqs[tail].seq;
+        }
+        rc = 0;
+    } else {
+        /* never reached the server, take it back from the tail */
+        queue->count--;
+        if (NULL != batch) {
+            batch->pending--;
+        }
+    }
+    pthread_mutex_unlock(&my_obj->evt_lock);
+    pthread_mutex_unlock(&my_obj->msg_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_wait_for_maps
+ *
+ * DESCRIPTION: utility function to wait until the server answered all
+ *              mapping messages of a batch. Gives up once the server did not
+ *              answer any message for WAIT_TIMEOUT seconds.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @batch        : batch passed to the async send functions
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure of any message in the batch
+ *==========================================================================*/
+int32_t mm_camera_util_wait_for_maps(mm_camera_obj_t *my_obj,
+                                     mm_camera_map_batch_t *batch)
+{
+    int32_t rc;
+    uint32_t done, i, idx;
+    struct timespec ts;
+    mm_camera_map_queue_t *queue = &my_obj->map_queue;
+
+    pthread_mutex_lock(&my_obj->evt_lock);
+    while (batch->pending > 0) {
+        done = queue->done;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += WAIT_TIMEOUT;
+        if ((pthread_cond_timedwait(&my_obj->evt_cond, &my_obj->evt_lock,
+                &ts) == ETIMEDOUT) && (done == queue->done)) {
+            CDBG_ERROR("%s: timed out, %d mapping messages not answered",
+                    __func__, batch->pending);
+            /* late answers must not touch the batch of the caller anymore */
+            for (i = 0; i < queue->count; i++) {
+                idx = (queue->head + i) % MM_CAMERA_MAP_INFLIGHT_MAX;
+                if (queue->reqs[idx].batch == batch) {
+                    queue->reqs[idx].batch = NULL;
+                }
+            }
+            batch->pending = 0;
+            batch->status = -1;
+        }
+    }
+    rc = batch->status;
+    pthread_mutex_unlock(&my_obj->evt_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_bundled_sendmsg_async
+ *
+ * DESCRIPTION: utility function to send bundled msg via domain socket
+ *              without waiting for the server
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @msg          : message to be sent
+ *   @buf_size     : size of the message to be sent
+ *   @sendfds      : array of file descriptors to be sent
+ *   @numfds       : number of file descriptors to be sent
+ *   @batch        : batch the message is added to, could be NULL
+ *   @cb           : called on completion, could be NULL
+ *   @user_data    : user data ptr of @cb
+ *   @seq          : output sequence id of the message, could be NULL
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_util_bundled_sendmsg_async(mm_camera_obj_t *my_obj,
+                                             void *msg,
+                                             size_t buf_size,
+                                             int sendfds[CAM_MAX_NUM_BUFS_PER_STREAM],
+                                             int numfds,
+                                             mm_camera_map_batch_t *batch,
+                                             mm_camera_map_done_cb_t cb,
+                                             void *user_data,
+                                             uint32_t *seq)
+{
+    return mm_camera_util_queue_sendmsg(my_obj, msg, buf_size, sendfds,
+            numfds, TRUE, batch, cb, user_data, seq);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_sendmsg_async
+ *
+ * DESCRIPTION: utility function to send msg via domain socket without
+ *              waiting for the server
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @msg          : message to be sent
+ *   @buf_size     : size of the message to be sent
+ *   @sendfd       : >0 if any file descriptor need to be passed across process
+ *   @batch        : batch the message is added to, could be NULL
+ *   @cb           : called on completion, could be NULL
+ *   @user_data    : user data ptr of @cb
+ *   @seq          : output sequence id of the message, could be NULL
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_util_sendmsg_async(mm_camera_obj_t *my_obj,
+                                     void *msg,
+                                     size_t buf_size,
+                                     int sendfd,
+                                     mm_camera_map_batch_t *batch,
+                                     mm_camera_map_done_cb_t cb,
+                                     void *user_data,
+                                     uint32_t *seq)
+{
+    return mm_camera_util_queue_sendmsg(my_obj, msg, buf_size, &sendfd, 1,
+            FALSE, batch, cb, user_data, seq);
 }
 
 /*===========================================================================
@@ -1811,19 +2055,15 @@ int32_t mm_camera_util_bundled_sendmsg(mm_camera_obj_t *my_obj,
                                        int sendfds[CAM_MAX_NUM_BUFS_PER_STREAM],
                                        int numfds)
 {
-    int32_t rc = -1;
-    uint32_t status;
-
-    /* need to lock msg_lock, since sendmsg until response back is deemed as one operation*/
-    pthread_mutex_lock(&my_obj->msg_lock);
-    if(mm_camera_socket_bundle_sendmsg(my_obj->ds_fd, msg, buf_size, sendfds, numfds) > 0) {
-        /* wait for event that mapping/unmapping is done */
-        mm_camera_util_wait_for_event(my_obj, CAM_EVENT_TYPE_MAP_UNMAP_DONE, &status);
-        if (MSM_CAMERA_STATUS_SUCCESS == status) {
-            rc = 0;
-        }
+    int32_t rc;
+    mm_camera_map_batch_t batch;
+
+    memset(&batch, 0, sizeof(batch));
+    rc = mm_camera_util_bundled_sendmsg_async(my_obj, msg, buf_size,
+            sendfds, numfds, &batch, NULL, NULL, NULL);
+    if (0 == rc) {
+        rc = mm_camera_util_wait_for_maps(my_obj, &batch);
     }
-    pthread_mutex_unlock(&my_obj->msg_lock);
     return rc;
 }
 
@@ -1847,19 +2087,15 @@ int32_t mm_camera_util_sendmsg(mm_camera_obj_t *my_obj,
                                size_t buf_size,
                                int sendfd)
 {
-    int32_t rc = -1;
-    uint32_t status;
-
-    /* need to lock msg_lock, since sendmsg until reposonse back is deemed as one operation*/
-    pthread_mutex_lock(&my_obj->msg_lock);
-    if(mm_camera_socket_sendmsg(my_obj->ds_fd, msg, buf_size, sendfd) > 0) {
-        /* wait for event that mapping/unmapping is done */
-        mm_camera_util_wait_for_event(my_obj, CAM_EVENT_TYPE_MAP_UNMAP_DONE, &status);
-        if (MSM_CAMERA_STATUS_SUCCESS == status) {
-            rc = 0;
-        }
+    int32_t rc;
+    mm_camera_map_batch_t batch;
+
+    memset(&batch, 0, sizeof(batch));
+    rc = mm_camera_util_sendmsg_async(my_obj, msg, buf_size, sendfd,
+            &batch, NULL, NULL, NULL);
+    if (0 == rc) {
+        rc = mm_camera_util_wait_for_maps(my_obj, &batch);
     }
-    pthread_mutex_unlock(&my_obj->msg_lock);
     return rc;
 }
 
@@ -2003,7 +2239,7 @@ int32_t mm_camera_util_s_ctrl(int32_t fd,  uint32_t id, int32_t *value)
     if (value != NULL) {
         control.value = *value;
     }
-    rc = ioctl(fd, VIDIOC_S_CTRL, &control);
+    rc = mm_camera_dev_ioctl(fd, VIDIOC_S_CTRL, &control);
 
     CDBG("%s: fd=%d, S_CTRL, id=0x%x, value = %p, rc = %d\n",
          __func__, fd, id, value, rc);
@@ -2037,7 +2273,7 @@ int32_t mm_camera_util_g_ctrl( int32_t fd, uint32_t id, int32_t *value)
     if (value != NULL) {
         control.value = *value;
     }
-    rc = ioctl(fd, VIDIOC_G_CTRL, &control);
+    rc = mm_camera_dev_ioctl(fd, VIDIOC_G_CTRL, &control);
     CDBG("%s: fd=%d, G_CTRL, id=0x%x, rc = %d\n", __func__, fd, id, rc);
     if (value != NULL) {
         *value = control.value;
@@ -2149,6 +2385,69 @@ int32_t mm_camera_get_session_id(mm_camera_obj_t *my_obj,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_dump_latency
+ *
+ * DESCRIPTION: print the per stream type frame latency histograms, the
+ *              buffer mapping cache counters and the frame sync statistics
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @fd           : output fd
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ * NOTE       : cam_lock is expected to be held on entry and is released
+ *==========================================================================*/
+int32_t mm_camera_dump_latency(mm_camera_obj_t *my_obj, int fd)
+{
+    static const char *stream_names[CAM_STREAM_TYPE_MAX] = {
+        "default", "preview", "postview", "snapshot", "video",
+        "impl_defined", "metadata", "raw", "offline_proc", "parm",
+        "analysis", "callback"
+    };
+    static const char *stage_names[MM_STREAM_LAT_MAX] = {
+        "sensor -> dqbuf", "dqbuf -> superbuf match",
+        "match -> client cb", "client cb -> buf done"
+    };
+    char label[64];
+    uint32_t type, stage;
+
+    dprintf(fd, "\n Frame latency (camera 0x%x):\n", my_obj->my_hdl);
+    for (type = 0; type < CAM_STREAM_TYPE_MAX; type++) {
+        for (stage = 0; stage < MM_STREAM_LAT_MAX; stage++) {
+            snprintf(label, sizeof(label), "%s: %s", stream_names[type],
+                    stage_names[stage]);
+            mm_camera_latency_print(fd, label,
+                    &my_obj->stream_latency[type][stage]);
+        }
+    }
+    mm_camera_map_cache_dump(&my_obj->map_cache, fd);
+    pthread_mutex_unlock(&my_obj->cam_lock);
+    mm_frame_sync_dump(fd);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_set_buf_map_cache
+ *
+ * DESCRIPTION: enable or disable the stream buffer mapping cache
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @enable       : TRUE to keep mappings across stream restarts
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ * NOTE       : cam_lock is expected to be held on entry and is released
+ *==========================================================================*/
+int32_t mm_camera_set_buf_map_cache(mm_camera_obj_t *my_obj, uint8_t enable)
+{
+    mm_camera_map_cache_enable(&my_obj->map_cache, enable);
+    pthread_mutex_unlock(&my_obj->cam_lock);
+    return 0;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_sync_related_sensors
  *
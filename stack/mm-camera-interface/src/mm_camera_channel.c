@@ -29,12 +29,17 @@
 
 #include <pthread.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <cam_semaphore.h>
+#include <cutils/properties.h>
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #include "mm_camera_dbg.h"
 #include "mm_camera_interface.h"
@@ -43,9 +48,9 @@
 extern mm_camera_obj_t* mm_camera_util_get_camera_by_handler(uint32_t cam_handler);
 extern mm_channel_t * mm_camera_util_get_channel_by_handler(mm_camera_obj_t * cam_obj,
                                                             uint32_t handler);
-/* Static frame sync info used between different camera channels*/
-static mm_channel_frame_sync_info_t fs = { .num_cam =0, .pos = 0};
-/* Frame sync info access lock */
+/* Frame sync pairs used between different camera channels*/
+static mm_channel_frame_sync_info_t fs_pairs[MM_FRAME_SYNC_MAX_PAIRS];
+/* Pair registration lock, matching only takes the per pair lock */
 static pthread_mutex_t fs_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* internal function declare goes here */
@@ -133,21 +138,28 @@ int32_t mm_channel_superbuf_flush_matched(mm_channel_t* my_obj,
                                           mm_channel_queue_t * queue);
 
 /* Start of Frame Sync util methods */
-void mm_frame_sync_reset();
+void mm_frame_sync_reset(mm_channel_frame_sync_info_t *fs);
 int32_t mm_frame_sync_register_channel(mm_channel_t *ch_obj);
 int32_t mm_frame_sync_unregister_channel(mm_channel_t *ch_obj);
-int32_t mm_frame_sync_add(uint32_t frame_id, mm_channel_t *ch_obj);
-int32_t mm_frame_sync_remove(uint32_t frame_id);
-uint32_t mm_frame_sync_find_matched(uint8_t oldest);
-int8_t mm_frame_sync_find_frame_index(uint32_t frame_id);
-void mm_frame_sync_lock_queues();
-void mm_frame_sync_unlock_queues();
+int32_t mm_frame_sync_add(mm_channel_t *ch_obj,
+        mm_channel_queue_node_t *super_buf);
+int32_t mm_frame_sync_remove(mm_channel_t *ch_obj, uint32_t frame_id);
+mm_channel_frame_sync_info_t *mm_frame_sync_get_matched(mm_channel_t *ch_obj,
+        mm_channel_sync_set_t *set, mm_channel_t **sync_ch);
+void mm_frame_sync_put_matched(mm_channel_frame_sync_info_t *fs);
 void mm_channel_node_qbuf(mm_channel_t *ch_obj, mm_channel_queue_node_t *node);
 /* End of Frame Sync Util methods */
 void mm_channel_send_super_buf(mm_channel_node_info_t *info);
 mm_channel_queue_node_t* mm_channel_superbuf_dequeue_frame_internal(
         mm_channel_queue_t * queue, uint32_t frame_idx);
 uint8_t mm_channel_check_aec(mm_channel_queue_node_t *node);
+uint8_t mm_channel_check_af(mm_channel_queue_node_t *node);
+mm_channel_queue_node_t* mm_channel_superbuf_dequeue_best(
+        mm_channel_t *ch_obj, mm_channel_queue_t *queue);
+mm_channel_queue_node_t* mm_channel_superbuf_dequeue_internal(
+        mm_channel_queue_t * queue, uint8_t matched_only, mm_channel_t *ch_obj);
+static uint64_t mm_channel_superbuf_ts_ns(mm_channel_queue_node_t *node);
+void mm_channel_superbuf_free(mm_channel_queue_node_t *super_buf);
 
 /*===========================================================================
  * FUNCTION   : mm_channel_util_get_stream_by_handler
@@ -177,6 +189,43 @@ mm_stream_t * mm_channel_util_get_stream_by_handler(
     return s_obj;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_latency_mark
+ *
+ * DESCRIPTION: pass the buffers of a superbuf to a latency stage hook of
+ *              their owning stream
+ *
+ * PARAMETERS :
+ *   @my_obj   : channel object
+ *   @bufs     : superbuf buffers
+ *   @num_bufs : number of buffers
+ *   @mark     : stream latency hook
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_latency_mark(mm_channel_t *my_obj,
+        mm_camera_buf_def_t **bufs, uint32_t num_bufs,
+        void (*mark)(mm_stream_t *, uint32_t, uint64_t))
+{
+    uint64_t now = mm_camera_latency_now_ns();
+    mm_stream_t *s_obj;
+    uint32_t i;
+
+    for (i = 0; i < num_bufs; i++) {
+        if (NULL == bufs[i]) {
+            continue;
+        }
+        s_obj = mm_channel_util_get_stream_by_handler(my_obj,
+                bufs[i]->stream_id);
+        if ((NULL != s_obj) && (s_obj->ch_obj != my_obj)) {
+            s_obj = s_obj->linked_stream;
+        }
+        if (NULL != s_obj) {
+            mark(s_obj, bufs[i]->buf_idx, now);
+        }
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_dispatch_super_buf
  *
@@ -204,6 +253,8 @@ static void mm_channel_dispatch_super_buf(mm_camera_cmdcb_t *cmd_cb,
     }
 
     if (my_obj->bundle.super_buf_notify_cb) {
+        mm_channel_latency_mark(my_obj, cmd_cb->u.superbuf.bufs,
+                cmd_cb->u.superbuf.num_bufs, mm_stream_latency_dispatched);
         my_obj->bundle.super_buf_notify_cb(&cmd_cb->u.superbuf, my_obj->bundle.user_data);
     }
 }
@@ -246,6 +297,9 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
         ch_obj->pending_retro_cnt = cmd_cb->u.req_buf.num_retro_buf_requested;
         ch_obj->req_type = cmd_cb->u.req_buf.type;
         ch_obj->bWaitForPrepSnapshotDone = 0;
+        ch_obj->select_shutter_ns = cmd_cb->u.req_buf.shutter_ts_ns;
+        ch_obj->select_window_ns =
+                (uint64_t)cmd_cb->u.req_buf.select_window_us * 1000;
 
         CDBG_HIGH("%s: pending cnt (%d), retro count (%d)"
                 "req_type (%d) is_primary (%d)",
@@ -414,54 +468,64 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
       CDBG_HIGH("%s: [ZSL Retro] In loop pending cnt (%d), req type (%d)",
             __func__, ch_obj->pending_cnt, ch_obj->req_type);
         /* dequeue */
-        uint32_t match_frame = 0;
         mm_channel_node_info_t info;
         memset(&info, 0x0, sizeof(info));
         if (ch_obj->req_type == MM_CAMERA_REQ_FRAME_SYNC_BUF) {
-            // Lock the Queues
-            mm_frame_sync_lock_queues();
-            uint32_t match_frame = mm_frame_sync_find_matched(FALSE);
-            if (match_frame) {
+            mm_channel_sync_set_t set;
+            mm_channel_t *sync_ch[MAX_NUM_CAMERA_PER_BUNDLE];
+            mm_channel_frame_sync_info_t *fs =
+                    mm_frame_sync_get_matched(ch_obj, &set, sync_ch);
+            if (fs != NULL) {
                 uint8_t j = 0;
+                uint8_t num_cam = 0;
+                /* each channel is dequeued under its own queue lock only */
                 for (j = 0; j < MAX_NUM_CAMERA_PER_BUNDLE; j++) {
-                    if (fs.ch_obj[j]) {
+                    if (sync_ch[j]) {
                         mm_channel_queue_t *ch_queue =
-                                &fs.ch_obj[j]->bundle.superbuf_queue;
-                        if (ch_queue == NULL) {
-                            CDBG_HIGH("%s: Channel queue is NULL", __func__);
-                            break;
-                        }
+                                &sync_ch[j]->bundle.superbuf_queue;
+                        num_cam++;
+                        pthread_mutex_lock(&ch_queue->que.lock);
                         node = mm_channel_superbuf_dequeue_frame_internal(
-                                ch_queue, match_frame);
+                                ch_queue, set.frame_idx[j]);
+                        pthread_mutex_unlock(&ch_queue->que.lock);
                         if (node != NULL) {
-                            info.ch_obj[info.num_nodes] = fs.ch_obj[j];
+                            info.ch_obj[info.num_nodes] = sync_ch[j];
                             info.node[info.num_nodes] = node;
                             info.num_nodes++;
-                            CDBG_HIGH("%s: Added ch(%p) to node ,num nodes %d",
-                                    __func__, fs.ch_obj[j], info.num_nodes);
+                            CDBG_HIGH("%s: Added ch(%p) frame %d to node ,num nodes %d",
+                                    __func__, sync_ch[j], set.frame_idx[j],
+                                    info.num_nodes);
                         }
                     }
                 }
-                mm_frame_sync_remove(match_frame);
-                ALOGI("%s: match frame %d", __func__, match_frame);
-                if (info.num_nodes != fs.num_cam) {
+                if (info.num_nodes != num_cam) {
                     ALOGI("%s: num node %d != num cam (%d) Debug this",
-                            __func__, info.num_nodes, fs.num_cam);
+                            __func__, info.num_nodes, num_cam);
                     uint8_t j = 0;
                     // free super buffers from various nodes
                     for (j = 0; j < info.num_nodes; j++) {
                         if (info.node[j]) {
                             mm_channel_node_qbuf(info.ch_obj[j], info.node[j]);
-                            free(info.node[j]);
+                            mm_channel_superbuf_free(info.node[j]);
                         }
                     }
                     //we should not use it as matched dual camera frames
                     info.num_nodes = 0;
                 }
+                mm_frame_sync_put_matched(fs);
             }
-            mm_frame_sync_unlock_queues();
         } else {
-           node = mm_channel_superbuf_dequeue(&ch_obj->bundle.superbuf_queue, ch_obj);
+           if (ch_obj->select_window_ns && (ch_obj->pending_cnt > 0)) {
+               /* pick the first frame of the request around the shutter */
+               node = mm_channel_superbuf_dequeue_best(ch_obj,
+                       &ch_obj->bundle.superbuf_queue);
+               if (node != NULL) {
+                   ch_obj->select_window_ns = 0;
+               }
+           } else {
+               node = mm_channel_superbuf_dequeue(&ch_obj->bundle.superbuf_queue,
+                       ch_obj);
+           }
            if (node != NULL) {
                if (ch_obj->isConfigCapture &&
                         (node->frame_idx < ch_obj->capture_frame_id[ch_obj->cur_capture_idx])) {
@@ -469,7 +533,7 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
                    for (i = 0; i < node->num_of_bufs; i++) {
                        mm_channel_qbuf(ch_obj, node->super_buf[i].buf);
                    }
-                   free(node);
+                   mm_channel_superbuf_free(node);
                } else {
                    if (ch_obj->bundle.superbuf_queue.attr.instant_capture_enabled) {
                        // If instant capture enabled, wait until the AEC is settled
@@ -482,7 +546,7 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
                                mm_channel_qbuf(ch_obj, node->super_buf[i].buf);
                            }
                            ch_obj->bundle.superbuf_queue.frame_num_for_instant_capture++;
-                           free(node);
+                           mm_channel_superbuf_free(node);
                        } else {
                            info.num_nodes = 1;
                            info.ch_obj[0] = ch_obj;
@@ -586,9 +650,8 @@ void mm_channel_send_super_buf(mm_channel_node_info_t *info)
             CDBG("%s: Send superbuf to HAL, pending_cnt=%d",
                     __func__, ch_obj->pending_cnt);
             /* send cam_sem_post to wake up cb thread to dispatch super buffer */
-            cb_node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+            cb_node = mm_camera_cmd_alloc(ch_obj->cb_pool);
             if (NULL != cb_node) {
-                memset(cb_node, 0, sizeof(mm_camera_cmdcb_t));
                 cb_node->cmd_type = MM_CAMERA_CMD_TYPE_SUPER_BUF_DATA_CB;
                 cb_node->u.superbuf.num_bufs = node->num_of_bufs;
                 uint8_t i = 0;
@@ -605,7 +668,7 @@ void mm_channel_send_super_buf(mm_channel_node_info_t *info)
                     ch_obj->unLockAEC = 0;
                 }
                 /* enqueue to cb thread */
-                cam_queue_enq(&(ch_obj->cb_thread.cmd_queue), cb_node);
+                mm_camera_cmd_thread_enq(&(ch_obj->cb_thread), cb_node);
                 /* wake up cb thread */
                 cam_sem_post(&(ch_obj->cb_thread.cmd_sem));
                 CDBG_HIGH("%s: Sent super buf for node[%d] ", __func__, idx);
@@ -618,14 +681,14 @@ void mm_channel_send_super_buf(mm_channel_node_info_t *info)
                     mm_channel_qbuf(ch_obj, node->super_buf[i].buf);
                 }
             }
-            free(node);
+            mm_channel_superbuf_free(node);
         } else if ((ch_obj != NULL) && (node != NULL)) {
             /* buf done with the unused super buf */
             uint8_t i;
             for (i = 0; i < node->num_of_bufs; i++) {
                 mm_channel_qbuf(ch_obj, node->super_buf[i].buf);
             }
-            free(node);
+            mm_channel_superbuf_free(node);
         } else {
             CDBG_ERROR("%s: node is NULL, debug this", __func__);
         }
@@ -1167,6 +1230,8 @@ int32_t mm_channel_init(mm_channel_t *my_obj,
 
     CDBG("%s : Launch data poll thread in channel open", __func__);
     snprintf(my_obj->threadName, THREAD_NAME_SIZE, "CAM_dataPoll");
+    my_obj->poll_thread[0].cam_idx =
+            mm_camera_util_get_index_by_handler(my_obj->cam_obj->my_hdl);
     mm_camera_poll_thread_launch(&my_obj->poll_thread[0],
                                  MM_CAMERA_POLL_TYPE_DATA);
 
@@ -1522,6 +1587,11 @@ int32_t mm_channel_start(mm_channel_t *my_obj)
             }
         }
 
+        /* every super buf holds one buf of each bundled stream, so no
+         * more than the per stream buf max can be dispatched at once */
+        my_obj->cb_pool = mm_camera_cmd_pool_create("CAM_SuperBuf",
+                CAM_MAX_NUM_BUFS_PER_STREAM);
+
         /* launch cb thread for dispatching super buf through cb */
         snprintf(my_obj->cb_thread.threadName, THREAD_NAME_SIZE, "CAM_SuperBuf");
         mm_camera_cmd_thread_launch(&my_obj->cb_thread,
@@ -1638,6 +1708,8 @@ int32_t mm_channel_start(mm_channel_t *my_obj)
             /* first stop bundle thread */
             mm_camera_cmd_thread_release(&my_obj->cmd_thread);
             mm_camera_cmd_thread_release(&my_obj->cb_thread);
+            mm_camera_cmd_pool_release(my_obj->cb_pool);
+            my_obj->cb_pool = NULL;
 
             /* deinit superbuf queue */
             mm_channel_superbuf_queue_deinit(&my_obj->bundle.superbuf_queue);
@@ -1745,6 +1817,8 @@ int32_t mm_channel_stop(mm_channel_t *my_obj)
         /* first stop bundle thread */
         mm_camera_cmd_thread_release(&my_obj->cmd_thread);
         mm_camera_cmd_thread_release(&my_obj->cb_thread);
+        mm_camera_cmd_pool_release(my_obj->cb_pool);
+        my_obj->cb_pool = NULL;
 
         /* deinit superbuf queue */
         mm_channel_superbuf_queue_deinit(&my_obj->bundle.superbuf_queue);
@@ -1803,14 +1877,13 @@ int32_t mm_channel_request_super_buf(mm_channel_t *my_obj,
     /* set pending_cnt
      * will trigger dispatching super frames if pending_cnt > 0 */
     /* send cam_sem_post to wake up cmd thread to dispatch super buffer */
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_alloc(NULL);
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_REQ_DATA_CB;
         node->u.req_buf = *buf;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        mm_camera_cmd_thread_enq(&(my_obj->cmd_thread), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -1866,15 +1939,14 @@ int32_t mm_channel_flush_super_buf_queue(mm_channel_t *my_obj, uint32_t frame_id
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_alloc(NULL);
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_FLUSH_QUEUE;
         node->u.flush_cmd.frame_idx = frame_idx;
         node->u.flush_cmd.stream_type = stream_type;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        mm_camera_cmd_thread_enq(&(my_obj->cmd_thread), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -1908,14 +1980,13 @@ int32_t mm_channel_config_notify_mode(mm_channel_t *my_obj,
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_alloc(NULL);
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->u.notify_mode = notify_mode;
         node->cmd_type = MM_CAMERA_CMD_TYPE_CONFIG_NOTIFY;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        mm_camera_cmd_thread_enq(&(my_obj->cmd_thread), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -1944,13 +2015,12 @@ int32_t mm_channel_start_zsl_snapshot(mm_channel_t *my_obj)
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_alloc(NULL);
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_START_ZSL;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        mm_camera_cmd_thread_enq(&(my_obj->cmd_thread), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -1979,13 +2049,12 @@ int32_t mm_channel_stop_zsl_snapshot(mm_channel_t *my_obj)
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_alloc(NULL);
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_STOP_ZSL;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        mm_camera_cmd_thread_enq(&(my_obj->cmd_thread), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -2288,10 +2357,307 @@ int32_t mm_channel_unmap_stream_buf(mm_channel_t *my_obj,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_pool_destroy
+ *
+ * DESCRIPTION: free superbuf pool memory once no superbuf is in use
+ *
+ * PARAMETERS :
+ *   @pool    : ptr to pool
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_pool_destroy(mm_channel_superbuf_pool_t *pool)
+{
+    CDBG_HIGH("%s: %d superbufs, high water %d, heap fallbacks %d",
+            __func__, pool->num_entries, pool->high_water,
+            pool->alloc_fallback);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->slab);
+    free(pool);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_pool_create
+ *
+ * DESCRIPTION: create a pool of preallocated superbufs
+ *
+ * PARAMETERS :
+ *   @num_entries : number of preallocated superbufs
+ *
+ * RETURN     : ptr to pool, NULL on failure
+ *==========================================================================*/
+static mm_channel_superbuf_pool_t *mm_channel_superbuf_pool_create(
+        uint32_t num_entries)
+{
+    uint32_t i;
+    mm_channel_superbuf_pool_t *pool = NULL;
+
+    pool = (mm_channel_superbuf_pool_t *)malloc(sizeof(mm_channel_superbuf_pool_t));
+    if (NULL == pool) {
+        CDBG_ERROR("%s: No memory for superbuf pool", __func__);
+        return NULL;
+    }
+    memset(pool, 0, sizeof(mm_channel_superbuf_pool_t));
+
+    pool->slab = (mm_channel_queue_node_t *)
+            malloc(num_entries * sizeof(mm_channel_queue_node_t));
+    if (NULL == pool->slab) {
+        CDBG_ERROR("%s: No memory for %d superbufs", __func__, num_entries);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    cam_list_init(&pool->free_list);
+    for (i = 0; i < num_entries; i++) {
+        cam_list_add_tail_node(&pool->slab[i].qnode.list, &pool->free_list);
+    }
+    pool->num_entries = num_entries;
+    return pool;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_pool_release
+ *
+ * DESCRIPTION: release superbuf pool by its queue. Superbufs still on their
+ *              way to the cb thread stay valid, the last
+ *              mm_channel_superbuf_free frees them.
+ *
+ * PARAMETERS :
+ *   @pool    : ptr to pool
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_pool_release(mm_channel_superbuf_pool_t *pool)
+{
+    uint8_t destroy = FALSE;
+
+    if (NULL == pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->released = TRUE;
+    destroy = (0 == pool->in_use);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (destroy) {
+        mm_channel_superbuf_pool_destroy(pool);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_alloc
+ *
+ * DESCRIPTION: get a zeroed superbuf, from pool if one is free, otherwise
+ *              from heap
+ *
+ * PARAMETERS :
+ *   @pool    : ptr to pool, can be NULL
+ *
+ * RETURN     : ptr to superbuf, NULL if out of memory
+ *==========================================================================*/
+static mm_channel_queue_node_t *mm_channel_superbuf_alloc(
+        mm_channel_superbuf_pool_t *pool)
+{
+    mm_channel_queue_node_t *super_buf = NULL;
+    struct cam_list *pos = NULL;
+
+    if (NULL != pool) {
+        pthread_mutex_lock(&pool->lock);
+        pos = pool->free_list.next;
+        if (pos != &pool->free_list) {
+            cam_list_del_node(pos);
+            super_buf = member_of(pos, mm_channel_queue_node_t, qnode.list);
+            pool->in_use++;
+            if (pool->in_use > pool->high_water) {
+                pool->high_water = pool->in_use;
+            }
+        } else {
+            pool->alloc_fallback++;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (NULL == super_buf) {
+        super_buf = (mm_channel_queue_node_t *)malloc(sizeof(mm_channel_queue_node_t));
+        if (NULL == super_buf) {
+            return NULL;
+        }
+        pool = NULL;
+    }
+
+    memset(super_buf, 0, sizeof(mm_channel_queue_node_t));
+    super_buf->pool = pool;
+    super_buf->qnode.data = super_buf;
+    cam_list_init(&super_buf->ulist);
+    return super_buf;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_free
+ *
+ * DESCRIPTION: return superbuf obtained from mm_channel_superbuf_alloc. It
+ *              must not be in a superbuf queue anymore.
+ *
+ * PARAMETERS :
+ *   @super_buf : ptr to superbuf
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_channel_superbuf_free(mm_channel_queue_node_t *super_buf)
+{
+    mm_channel_superbuf_pool_t *pool = NULL;
+    uint8_t destroy = FALSE;
+
+    if (NULL == super_buf) {
+        return;
+    }
+
+    pool = super_buf->pool;
+    if (NULL == pool) {
+        free(super_buf);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    cam_list_add_tail_node(&super_buf->qnode.list, &pool->free_list);
+    pool->in_use--;
+    destroy = (pool->released && (0 == pool->in_use));
+    pthread_mutex_unlock(&pool->lock);
+
+    if (destroy) {
+        mm_channel_superbuf_pool_destroy(pool);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_track
+ *
+ * DESCRIPTION: add an unmatched superbuf to the unmatched list and the frame
+ *              index ring. Caller holds queue lock.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @super_buf : unmatched superbuf
+ *   @newer     : unmatched superbuf to insert before, NULL to append
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_track(mm_channel_queue_t *queue,
+        mm_channel_queue_node_t *super_buf, mm_channel_queue_node_t *newer)
+{
+    uint32_t slot = super_buf->frame_idx & (MM_CHANNEL_SUPERBUF_INDEX_SIZE - 1);
+
+    if (NULL != newer) {
+        cam_list_insert_before_node(&super_buf->ulist, &newer->ulist);
+    } else {
+        cam_list_add_tail_node(&super_buf->ulist, &queue->unmatched);
+    }
+    queue->unmatched_cnt++;
+
+    if (NULL == queue->index[slot]) {
+        queue->index[slot] = super_buf;
+        super_buf->indexed = TRUE;
+    } else {
+        /* frame ids INDEX_SIZE apart, lookups fall back to the list */
+        queue->unindexed_cnt++;
+        super_buf->indexed = FALSE;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_untrack
+ *
+ * DESCRIPTION: drop a superbuf from the unmatched list and the frame index
+ *              ring, if it is there. Caller holds queue lock.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @super_buf : superbuf
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_untrack(mm_channel_queue_t *queue,
+        mm_channel_queue_node_t *super_buf)
+{
+    uint32_t slot = super_buf->frame_idx & (MM_CHANNEL_SUPERBUF_INDEX_SIZE - 1);
+
+    if (super_buf->ulist.next == &super_buf->ulist) {
+        return;
+    }
+
+    cam_list_del_node(&super_buf->ulist);
+    queue->unmatched_cnt--;
+    if (super_buf->indexed) {
+        queue->index[slot] = NULL;
+        super_buf->indexed = FALSE;
+    } else {
+        queue->unindexed_cnt--;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_unlink
+ *
+ * DESCRIPTION: remove a superbuf from the superbuf queue. Caller holds
+ *              queue lock.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @super_buf : superbuf
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_unlink(mm_channel_queue_t *queue,
+        mm_channel_queue_node_t *super_buf)
+{
+    cam_list_del_node(&super_buf->qnode.list);
+    queue->que.size--;
+    mm_channel_superbuf_untrack(queue, super_buf);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_lookup
+ *
+ * DESCRIPTION: find the unmatched superbuf of a frame id. Caller holds
+ *              queue lock.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @frame_idx : frame id
+ *
+ * RETURN     : ptr to superbuf, NULL if none
+ *==========================================================================*/
+static mm_channel_queue_node_t *mm_channel_superbuf_lookup(
+        mm_channel_queue_t *queue, uint32_t frame_idx)
+{
+    mm_channel_queue_node_t *super_buf = NULL;
+    struct cam_list *head = &queue->unmatched;
+    struct cam_list *pos = NULL;
+
+    super_buf = queue->index[frame_idx & (MM_CHANNEL_SUPERBUF_INDEX_SIZE - 1)];
+    if ((NULL != super_buf) && (super_buf->frame_idx == frame_idx)) {
+        return super_buf;
+    }
+
+    if (0 != queue->unindexed_cnt) {
+        for (pos = head->next; pos != head; pos = pos->next) {
+            super_buf = member_of(pos, mm_channel_queue_node_t, ulist);
+            if (super_buf->frame_idx == frame_idx) {
+                return super_buf;
+            }
+        }
+    }
+    return NULL;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_superbuf_queue_init
  *
- * DESCRIPTION: initialize superbuf queue in the channel
+ * DESCRIPTION: initialize superbuf queue in the channel. Queue attr must be
+ *              set, it sizes the superbuf pool.
  *
  * PARAMETERS :
  *   @queue   : ptr to superbuf queue to be initialized
@@ -2302,6 +2668,13 @@ int32_t mm_channel_unmap_stream_buf(mm_channel_t *my_obj,
  *==========================================================================*/
 int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t * queue)
 {
+    cam_list_init(&queue->unmatched);
+    queue->unmatched_cnt = 0;
+    queue->unindexed_cnt = 0;
+    memset(queue->index, 0, sizeof(queue->index));
+    /* NULL pool is fine, superbufs then come from heap */
+    queue->pool = mm_channel_superbuf_pool_create(queue->attr.water_mark +
+            queue->attr.max_unmatched_frames + MM_CHANNEL_SUPERBUF_POOL_EXTRA);
     return cam_queue_init(&queue->que);
 }
 
@@ -2319,6 +2692,27 @@ int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t * queue)
  *==========================================================================*/
 int32_t mm_channel_superbuf_queue_deinit(mm_channel_queue_t * queue)
 {
+    struct cam_list *head = NULL;
+    struct cam_list *pos = NULL;
+    cam_node_t *node = NULL;
+    mm_channel_queue_node_t *super_buf = NULL;
+
+    /* superbufs are owned by the queue, cam_queue_flush would free()
+     * the embedded nodes */
+    pthread_mutex_lock(&queue->que.lock);
+    head = &queue->que.head.list;
+    pos = head->next;
+    while (pos != head) {
+        node = member_of(pos, cam_node_t, list);
+        pos = pos->next;
+        super_buf = (mm_channel_queue_node_t *)node->data;
+        mm_channel_superbuf_unlink(queue, super_buf);
+        mm_channel_superbuf_free(super_buf);
+    }
+    pthread_mutex_unlock(&queue->que.lock);
+
+    mm_channel_superbuf_pool_release(queue->pool);
+    queue->pool = NULL;
     return cam_queue_deinit(&queue->que);
 }
 
@@ -2379,6 +2773,270 @@ uint8_t mm_channel_check_aec(mm_channel_queue_node_t *node)
     return is_settled;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_check_af
+ *
+ * DESCRIPTION: check if AF is settled in the metadata of a superbuf
+ *
+ * PARAMETERS :
+ *   @node    : superbuf
+ *
+ * RETURN     : 1 if AF is focused or not reported, 0 otherwise
+ *==========================================================================*/
+uint8_t mm_channel_check_af(mm_channel_queue_node_t *node)
+{
+    uint8_t i = 0;
+    const metadata_buffer_t *metadata = NULL;
+    uint8_t is_settled = 1;
+
+    for (i = 0; i < node->num_of_bufs; i++) {
+        if (node->super_buf[i].buf->stream_type == CAM_STREAM_TYPE_METADATA) {
+            metadata = (const metadata_buffer_t *)node->super_buf[i].buf->buffer;
+            break;
+        }
+    }
+    if (NULL != metadata) {
+        IF_META_AVAILABLE(const uint32_t, af_state, CAM_INTF_META_AF_STATE, metadata) {
+            is_settled = (*af_state == CAM_AF_STATE_FOCUSED_LOCKED) ||
+                    (*af_state == CAM_AF_STATE_PASSIVE_FOCUSED) ||
+                    (*af_state == CAM_AF_STATE_INACTIVE);
+        }
+    }
+    CDBG("%s: is_settled %d", __func__ ,is_settled);
+    return is_settled;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_luma_gradient
+ *
+ * DESCRIPTION: sum of absolute horizontal and vertical differences along a
+ *              row of 8 bit luma
+ *
+ * PARAMETERS :
+ *   @row     : start of the row
+ *   @stride  : distance to the next row, which must be readable too
+ *   @len     : number of pixels
+ *
+ * RETURN     : gradient sum over 2 * (len - 1) differences
+ *==========================================================================*/
+static uint32_t mm_channel_luma_gradient(const uint8_t *row, int32_t stride,
+        uint32_t len)
+{
+    uint32_t sum = 0;
+    uint32_t x = 0;
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    while (x + 17 <= len) {
+        /* 16 bit lanes hold 64 iterations of 4 differences */
+        uint16x8_t acc16 = vdupq_n_u16(0);
+        uint32_t n;
+        for (n = 0; (n < 64) && (x + 17 <= len); n++, x += 16) {
+            uint8x16_t cur = vld1q_u8(row + x);
+            acc16 = vpadalq_u8(acc16, vabdq_u8(cur, vld1q_u8(row + x + 1)));
+            acc16 = vpadalq_u8(acc16, vabdq_u8(cur, vld1q_u8(row + x + stride)));
+        }
+        acc = vpadalq_u16(acc, acc16);
+    }
+    sum = vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) +
+            vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+#endif
+    for (; x + 1 < len; x++) {
+        sum += (uint32_t)abs(row[x] - row[x + 1]) +
+                (uint32_t)abs(row[x] - row[x + stride]);
+    }
+    return sum;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_sharpness
+ *
+ * DESCRIPTION: estimate sharpness of a superbuf as the mean luma gradient
+ *              over rows sampled from the central half of the main image.
+ *              Reads the buffer through the CPU mapping without a cache
+ *              invalidate, which is fine for an estimate.
+ *
+ * PARAMETERS :
+ *   @ch_obj  : channel object
+ *   @node    : superbuf
+ *
+ * RETURN     : mean gradient x 64, 0 if it can not be estimated
+ *==========================================================================*/
+static uint32_t mm_channel_superbuf_sharpness(mm_channel_t *ch_obj,
+        mm_channel_queue_node_t *node)
+{
+    mm_camera_buf_def_t *buf = NULL;
+    mm_stream_t *s_obj = NULL;
+    const cam_mp_len_offset_t *plane = NULL;
+    const uint8_t *base = NULL;
+    uint64_t sum = 0, cnt = 0;
+    int32_t width, height, x0, y, step;
+    uint32_t i;
+
+    for (i = 0; i < node->num_of_bufs; i++) {
+        mm_camera_buf_def_t *b = node->super_buf[i].buf;
+        if ((b != NULL) && ((b->stream_type == CAM_STREAM_TYPE_SNAPSHOT) ||
+                ((buf == NULL) && (b->stream_type == CAM_STREAM_TYPE_PREVIEW)))) {
+            buf = b;
+        }
+    }
+    if ((buf == NULL) || (buf->buffer == NULL)) {
+        return 0;
+    }
+    s_obj = mm_channel_util_get_stream_by_handler(ch_obj, buf->stream_id);
+    if ((s_obj == NULL) || (s_obj->stream_info == NULL)) {
+        return 0;
+    }
+    switch (s_obj->stream_info->fmt) {
+    case CAM_FORMAT_YUV_420_NV12:
+    case CAM_FORMAT_YUV_420_NV21:
+    case CAM_FORMAT_YUV_420_NV21_ADRENO:
+    case CAM_FORMAT_YUV_420_YV12:
+    case CAM_FORMAT_YUV_422_NV16:
+    case CAM_FORMAT_YUV_422_NV61:
+    case CAM_FORMAT_YUV_420_NV12_VENUS:
+    case CAM_FORMAT_YUV_420_NV21_VENUS:
+        break;
+    default:
+        return 0;
+    }
+
+    plane = &s_obj->stream_info->buf_planes.plane_info.mp[0];
+    width = plane->width;
+    height = plane->height;
+    if ((width < 32) || (height < 32) || (plane->stride < width)) {
+        return 0;
+    }
+    base = (const uint8_t *)buf->buffer + plane->offset;
+    x0 = width / 4;
+    step = (height / 2) / MM_CHANNEL_ZSL_SHARPNESS_ROWS;
+    if (step < 1) {
+        step = 1;
+    }
+    for (i = 0, y = height / 4; (i < MM_CHANNEL_ZSL_SHARPNESS_ROWS) &&
+            (y < height * 3 / 4); i++, y += step) {
+        sum += mm_channel_luma_gradient(base + y * plane->stride + x0,
+                plane->stride, (uint32_t)(width / 2));
+        cnt += 2 * (uint32_t)(width / 2 - 1);
+    }
+    return cnt ? (uint32_t)((sum * 64) / cnt) : 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_ts_ns
+ *
+ * DESCRIPTION: sensor timestamp of a superbuf. The metadata buffer is only
+ *              used as a last resort as it may be from another frame.
+ *
+ * PARAMETERS :
+ *   @node    : superbuf
+ *
+ * RETURN     : timestamp in ns, 0 if no buffer
+ *==========================================================================*/
+static uint64_t mm_channel_superbuf_ts_ns(mm_channel_queue_node_t *node)
+{
+    mm_camera_buf_def_t *buf = NULL;
+    uint8_t i;
+
+    for (i = 0; i < node->num_of_bufs; i++) {
+        if (node->super_buf[i].buf == NULL) {
+            continue;
+        }
+        if ((buf == NULL) || (buf->stream_type == CAM_STREAM_TYPE_METADATA)) {
+            buf = node->super_buf[i].buf;
+        }
+    }
+    if (buf == NULL) {
+        return 0;
+    }
+    return (uint64_t)buf->ts.tv_sec * 1000000000ULL + (uint64_t)buf->ts.tv_nsec;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_dequeue_best
+ *
+ * DESCRIPTION: dequeue the best scored matched superbuf within the selection
+ *              window around the shutter timestamp of the pending request.
+ *              Waits while frames inside the window can still arrive and
+ *              the queue is below its water mark. Falls back to the queue
+ *              head if no frame is inside the window.
+ *
+ * PARAMETERS :
+ *   @ch_obj  : channel object
+ *   @queue   : superbuf queue
+ *
+ * RETURN     : ptr to a node from superbuf queue, NULL to wait
+ *==========================================================================*/
+mm_channel_queue_node_t* mm_channel_superbuf_dequeue_best(
+        mm_channel_t *ch_obj, mm_channel_queue_t *queue)
+{
+    mm_channel_queue_node_t *super_buf = NULL;
+    mm_channel_queue_node_t *best = NULL;
+    struct cam_list *head = &queue->que.head.list;
+    struct cam_list *pos = NULL;
+    uint64_t shutter = ch_obj->select_shutter_ns;
+    uint64_t window = ch_obj->select_window_ns;
+    uint64_t ts, newest = 0, dt = 0, best_dt = 0;
+    int64_t score, best_score = 0;
+
+    pthread_mutex_lock(&queue->que.lock);
+    for (pos = head->next; pos != head; pos = pos->next) {
+        super_buf = (mm_channel_queue_node_t *)member_of(pos, cam_node_t, list)->data;
+        if ((super_buf == NULL) || !super_buf->matched) {
+            continue;
+        }
+        ts = mm_channel_superbuf_ts_ns(super_buf);
+        if (ts > newest) {
+            newest = ts;
+        }
+        dt = (ts > shutter) ? ts - shutter : shutter - ts;
+        if (dt > window) {
+            continue;
+        }
+        if (!super_buf->scored) {
+            super_buf->aec_settled = mm_channel_check_aec(super_buf);
+            super_buf->af_settled = mm_channel_check_af(super_buf);
+            super_buf->sharpness = mm_channel_superbuf_sharpness(ch_obj, super_buf);
+            super_buf->scored = 1;
+        }
+        score = (int64_t)super_buf->sharpness -
+                (int64_t)(dt / 1000000) * MM_CHANNEL_ZSL_SCORE_PER_MS;
+        if (super_buf->aec_settled) {
+            score += MM_CHANNEL_ZSL_SCORE_AEC;
+        }
+        if (super_buf->af_settled) {
+            score += MM_CHANNEL_ZSL_SCORE_AF;
+        }
+        if ((best == NULL) || (score > best_score)) {
+            best = super_buf;
+            best_score = score;
+            best_dt = dt;
+        }
+    }
+
+    if ((newest <= shutter + window) &&
+            (queue->match_cnt < queue->attr.water_mark)) {
+        /* frames inside the window are still to come */
+        pthread_mutex_unlock(&queue->que.lock);
+        return NULL;
+    }
+
+    if (best != NULL) {
+        CDBG_HIGH("%s: selected frame %d score %lld dt %lld us sharpness %d"
+                " aec %d af %d", __func__, best->frame_idx,
+                (long long)best_score, (long long)(best_dt / 1000),
+                best->sharpness, best->aec_settled, best->af_settled);
+        super_buf = mm_channel_superbuf_dequeue_frame_internal(queue,
+                best->frame_idx);
+    } else {
+        CDBG_HIGH("%s: no frame within %lld us of shutter, take queue head",
+                __func__, (long long)(window / 1000));
+        super_buf = mm_channel_superbuf_dequeue_internal(queue, TRUE, ch_obj);
+    }
+    pthread_mutex_unlock(&queue->que.lock);
+    return super_buf;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_handle_metadata
  *
@@ -2613,6 +3271,103 @@ end:
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_find
+ *
+ * DESCRIPTION: find the unmatched superbuf an incoming buffer belongs to.
+ *              A plain frame id match is looked up in the frame index ring
+ *              and an in-order frame is placed at the tail without walking
+ *              the queue. Only out-of-order frames and the nomatch / low
+ *              priority metadata pairing walk the unmatched list, which
+ *              never holds matched superbufs. Caller holds queue lock.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @buf_info  : new buffer from stream
+ *   @buf_s_idx : index of the buffer stream in the bundle
+ *   @older     : out, oldest unmatched superbuf ahead of the match or, if
+ *                none matched, older than the buffer
+ *   @newer     : out, unmatched superbuf to insert a new superbuf before
+ *   @unmatched_bundles : out, unmatched superbufs ahead of the match
+ *
+ * RETURN     : ptr to matching superbuf, NULL if none
+ *==========================================================================*/
+static mm_channel_queue_node_t *mm_channel_superbuf_find(
+        mm_channel_queue_t *queue,
+        mm_camera_buf_info_t *buf_info,
+        uint8_t buf_s_idx,
+        mm_channel_queue_node_t **older,
+        mm_channel_queue_node_t **newer,
+        uint32_t *unmatched_bundles)
+{
+    struct cam_list *head = &queue->unmatched;
+    struct cam_list *pos = NULL;
+    mm_channel_queue_node_t *super_buf = NULL;
+    mm_channel_queue_node_t *first = NULL;
+    mm_channel_queue_node_t *last = NULL;
+    uint8_t is_meta =
+            (buf_info->buf->stream_type == CAM_STREAM_TYPE_METADATA);
+
+    *older = NULL;
+    *newer = NULL;
+    *unmatched_bundles = 0;
+
+    if (head->next == head) {
+        return NULL;
+    }
+    first = member_of(head->next, mm_channel_queue_node_t, ulist);
+    last = member_of(head->prev, mm_channel_queue_node_t, ulist);
+
+    if (!((queue->nomatch_frame_id != 0) && is_meta) &&
+            !((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW) &&
+            !is_meta)) {
+        /* only the same frame id can match, list is in frame id order */
+        super_buf = mm_channel_superbuf_lookup(queue, buf_info->frame_idx);
+        if ((first != super_buf) &&
+                (first->frame_idx < buf_info->frame_idx)) {
+            *older = first;
+        }
+        if (NULL != super_buf) {
+            return super_buf;
+        }
+        if (last->frame_idx < buf_info->frame_idx) {
+            *unmatched_bundles = queue->unmatched_cnt;
+            return NULL;
+        }
+        *older = NULL;
+    }
+
+    for (pos = head->next; pos != head; pos = pos->next) {
+        super_buf = member_of(pos, mm_channel_queue_node_t, ulist);
+        if ( buf_info->frame_idx == super_buf->frame_idx
+                /*Pick metadata greater than available frameID*/
+                || ((queue->nomatch_frame_id != 0)
+                && (queue->nomatch_frame_id <= buf_info->frame_idx)
+                && (super_buf->super_buf[buf_s_idx].frame_idx == 0)
+                && is_meta)
+                /*Pick available metadata closest to frameID*/
+                || ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
+                && !is_meta
+                && (super_buf->super_buf[buf_s_idx].frame_idx == 0)
+                && (super_buf->frame_idx > buf_info->frame_idx))){
+            /*super buffer frame IDs matching OR In low priority bundling
+            metadata frameID greater than avialbale super buffer frameID  OR
+            metadata frame closest to incoming frameID will be bundled*/
+            return super_buf;
+        }
+        (*unmatched_bundles)++;
+        if ((NULL == *older) &&
+                (super_buf->frame_idx < buf_info->frame_idx)) {
+            *older = super_buf;
+        }
+        if ((NULL == *newer) &&
+                (super_buf->frame_idx > buf_info->frame_idx)) {
+            *newer = super_buf;
+        }
+    }
+    return NULL;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_superbuf_comp_and_enqueue
  *
@@ -2632,12 +3387,10 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                         mm_channel_queue_t *queue,
                         mm_camera_buf_info_t *buf_info)
 {
-    cam_node_t* node = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
     mm_channel_queue_node_t* super_buf = NULL;
-    uint8_t buf_s_idx, i, found_super_buf, unmatched_bundles;
-    struct cam_list *last_buf, *insert_before_buf, *last_buf_ptr;
+    mm_channel_queue_node_t *older = NULL, *newer = NULL, *next = NULL;
+    uint8_t buf_s_idx, i;
+    uint32_t unmatched_bundles;
 
     CDBG("%s: E", __func__);
 
@@ -2656,6 +3409,8 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
         mm_channel_qbuf(ch_obj, buf_info->buf);
         return 0;
     }
+    MM_CAMERA_TRACE_FRAME("mm_channel_superbuf_comp",
+            buf_info->buf->stream_type, buf_info->frame_idx);
 
     if (mm_channel_handle_metadata(ch_obj, queue, buf_info) < 0) {
         mm_channel_qbuf(ch_obj, buf_info->buf);
@@ -2680,60 +3435,11 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
 
     /* comp */
     pthread_mutex_lock(&queue->que.lock);
-    head = &queue->que.head.list;
-    /* get the last one in the queue which is possibly having no matching */
-    pos = head->next;
-
-    found_super_buf = 0;
-    unmatched_bundles = 0;
-    last_buf = NULL;
-    insert_before_buf = NULL;
-    last_buf_ptr = NULL;
-
-    while (pos != head) {
-        node = member_of(pos, cam_node_t, list);
-        super_buf = (mm_channel_queue_node_t*)node->data;
+    super_buf = mm_channel_superbuf_find(queue, buf_info, buf_s_idx,
+            &older, &newer, &unmatched_bundles);
 
-        if (NULL != super_buf) {
-            if (super_buf->matched) {
-                /* find a matched super buf, move to next one */
-                pos = pos->next;
-                continue;
-            } else if ( buf_info->frame_idx == super_buf->frame_idx
-                    /*Pick metadata greater than available frameID*/
-                    || ((queue->nomatch_frame_id != 0)
-                    && (queue->nomatch_frame_id <= buf_info->frame_idx)
-                    && (super_buf->super_buf[buf_s_idx].frame_idx == 0)
-                    && (buf_info->buf->stream_type == CAM_STREAM_TYPE_METADATA))
-                    /*Pick available metadata closest to frameID*/
-                    || ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
-                    && (buf_info->buf->stream_type != CAM_STREAM_TYPE_METADATA)
-                    && (super_buf->super_buf[buf_s_idx].frame_idx == 0)
-                    && (super_buf->frame_idx > buf_info->frame_idx))){
-                /*super buffer frame IDs matching OR In low priority bundling
-                metadata frameID greater than avialbale super buffer frameID  OR
-                metadata frame closest to incoming frameID will be bundled*/
-                found_super_buf = 1;
-                queue->nomatch_frame_id = 0;
-                break;
-            } else {
-                unmatched_bundles++;
-                if ( NULL == last_buf ) {
-                    if ( super_buf->frame_idx < buf_info->frame_idx ) {
-                        last_buf = pos;
-                    }
-                }
-                if ( NULL == insert_before_buf ) {
-                    if ( super_buf->frame_idx > buf_info->frame_idx ) {
-                        insert_before_buf = pos;
-                    }
-                }
-                pos = pos->next;
-            }
-        }
-    }
-
-    if ( found_super_buf ) {
+    if (NULL != super_buf) {
+        queue->nomatch_frame_id = 0;
         if(super_buf->super_buf[buf_s_idx].frame_idx != 0) {
             //This can cause frame drop. We are overwriting same memory.
             pthread_mutex_unlock(&queue->que.lock);
@@ -2775,33 +3481,32 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                     queue->attr.post_frame_skip, queue->expected_frame_id);
 
             queue->match_cnt++;
+            MM_CAMERA_TRACE_FRAME("mm_channel_superbuf_matched",
+                    buf_info->buf->stream_type, buf_info->frame_idx);
+            {
+                mm_camera_buf_def_t *bufs[MAX_STREAM_NUM_IN_BUNDLE];
+                for (i = 0; i < super_buf->num_of_bufs; i++) {
+                    bufs[i] = super_buf->super_buf[i].buf;
+                }
+                mm_channel_latency_mark(ch_obj, bufs, super_buf->num_of_bufs,
+                        mm_stream_latency_matched);
+            }
             if (ch_obj->bundle.superbuf_queue.attr.enable_frame_sync) {
-                pthread_mutex_lock(&fs_lock);
-                mm_frame_sync_add(buf_info->frame_idx, ch_obj);
-                pthread_mutex_unlock(&fs_lock);
+                mm_frame_sync_add(ch_obj, super_buf);
             }
             /* Any older unmatched buffer need to be released */
-            if ( last_buf ) {
-                while ( last_buf != pos ) {
-                    node = member_of(last_buf, cam_node_t, list);
-                    super_buf = (mm_channel_queue_node_t*)node->data;
-                    if (NULL != super_buf) {
-                        for (i=0; i<super_buf->num_of_bufs; i++) {
-                            if (super_buf->super_buf[i].frame_idx != 0) {
-                                mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
-                            }
-                        }
-                        queue->que.size--;
-                        last_buf = last_buf->next;
-                        cam_list_del_node(&node->list);
-                        free(node);
-                        free(super_buf);
-                    } else {
-                        CDBG_ERROR(" %s : Invalid superbuf in queue!", __func__);
-                        break;
+            while ((NULL != older) && (older != super_buf)) {
+                next = member_of(older->ulist.next, mm_channel_queue_node_t, ulist);
+                for (i=0; i<older->num_of_bufs; i++) {
+                    if (older->super_buf[i].frame_idx != 0) {
+                        mm_channel_qbuf(ch_obj, older->super_buf[i].buf);
                     }
                 }
+                mm_channel_superbuf_unlink(queue, older);
+                mm_channel_superbuf_free(older);
+                older = next;
             }
+            mm_channel_superbuf_untrack(queue, super_buf);
         }else {
             if (ch_obj->diverted_frame_id == buf_info->frame_idx) {
                 super_buf->expected = TRUE;
@@ -2810,85 +3515,76 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
         }
     } else {
         if ((queue->attr.max_unmatched_frames < unmatched_bundles)
-                && ( NULL == last_buf )) {
+                && ( NULL == older )) {
             /* incoming frame is older than the last bundled one */
             mm_channel_qbuf(ch_obj, buf_info->buf);
         } else {
-            last_buf_ptr = last_buf;
+            super_buf = older;
 
-            /* Loop to remove unmatched frames */
+            /* Loop to remove unmatched frames, oldest first */
             while ((queue->attr.max_unmatched_frames < unmatched_bundles)
-                    && (last_buf_ptr != NULL && last_buf_ptr != pos)) {
-                node = member_of(last_buf_ptr, cam_node_t, list);
-                super_buf = (mm_channel_queue_node_t*)node->data;
-                if (NULL != super_buf && super_buf->expected == FALSE
-                        && (&node->list != insert_before_buf)) {
+                    && (NULL != super_buf)) {
+                next = (super_buf->ulist.next == &queue->unmatched) ? NULL :
+                        member_of(super_buf->ulist.next, mm_channel_queue_node_t, ulist);
+                if ((super_buf->expected == FALSE) && (super_buf != newer)) {
                     for (i=0; i<super_buf->num_of_bufs; i++) {
                         if (super_buf->super_buf[i].frame_idx != 0) {
                             mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
                         }
                     }
-                    queue->que.size--;
-                    cam_list_del_node(&node->list);
-                    free(node);
-                    free(super_buf);
+                    if (super_buf == older) {
+                        older = NULL;
+                    }
+                    mm_channel_superbuf_unlink(queue, super_buf);
+                    mm_channel_superbuf_free(super_buf);
                     unmatched_bundles--;
                 }
-                last_buf_ptr = last_buf_ptr->next;
+                super_buf = next;
             }
 
-            if (queue->attr.max_unmatched_frames < unmatched_bundles) {
-                node = member_of(last_buf, cam_node_t, list);
-                super_buf = (mm_channel_queue_node_t*)node->data;
-                for (i=0; i<super_buf->num_of_bufs; i++) {
-                    if (super_buf->super_buf[i].frame_idx != 0) {
-                        mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
+            if ((queue->attr.max_unmatched_frames < unmatched_bundles)
+                    && (NULL != older)) {
+                for (i=0; i<older->num_of_bufs; i++) {
+                    if (older->super_buf[i].frame_idx != 0) {
+                        mm_channel_qbuf(ch_obj, older->super_buf[i].buf);
                     }
                 }
-                queue->que.size--;
-                cam_list_del_node(&node->list);
-                free(node);
-                free(super_buf);
+                mm_channel_superbuf_unlink(queue, older);
+                mm_channel_superbuf_free(older);
             }
 
             /* insert the new frame at the appropriate position. */
-
-            mm_channel_queue_node_t *new_buf = NULL;
-            cam_node_t* new_node = NULL;
-
-            new_buf = (mm_channel_queue_node_t*)malloc(sizeof(mm_channel_queue_node_t));
-            new_node = (cam_node_t*)malloc(sizeof(cam_node_t));
-            if (NULL != new_buf && NULL != new_node) {
-                memset(new_buf, 0, sizeof(mm_channel_queue_node_t));
-                memset(new_node, 0, sizeof(cam_node_t));
-                new_node->data = (void *)new_buf;
-                new_buf->num_of_bufs = queue->num_streams;
-                new_buf->super_buf[buf_s_idx] = *buf_info;
-                new_buf->frame_idx = buf_info->frame_idx;
+            super_buf = mm_channel_superbuf_alloc(queue->pool);
+            if (NULL != super_buf) {
+                super_buf->num_of_bufs = queue->num_streams;
+                super_buf->super_buf[buf_s_idx] = *buf_info;
+                super_buf->frame_idx = buf_info->frame_idx;
 
                 if (ch_obj->diverted_frame_id == buf_info->frame_idx) {
-                    new_buf->expected = TRUE;
+                    super_buf->expected = TRUE;
                     ch_obj->diverted_frame_id = 0;
                 }
 
                 /* enqueue */
-                if ( insert_before_buf ) {
-                    cam_list_insert_before_node(&new_node->list, insert_before_buf);
+                if (NULL != newer) {
+                    cam_list_insert_before_node(&super_buf->qnode.list,
+                            &newer->qnode.list);
                 } else {
-                    cam_list_add_tail_node(&new_node->list, &queue->que.head.list);
+                    cam_list_add_tail_node(&super_buf->qnode.list,
+                            &queue->que.head.list);
                 }
                 queue->que.size++;
 
                 if(queue->num_streams == 1) {
-                    new_buf->matched = 1;
-                    new_buf->expected = FALSE;
+                    super_buf->matched = 1;
+                    super_buf->expected = FALSE;
                     queue->expected_frame_id = buf_info->frame_idx + queue->attr.post_frame_skip;
                     queue->match_cnt++;
                     if (ch_obj->bundle.superbuf_queue.attr.enable_frame_sync) {
-                        pthread_mutex_lock(&fs_lock);
-                        mm_frame_sync_add(buf_info->frame_idx, ch_obj);
-                        pthread_mutex_unlock(&fs_lock);
+                        mm_frame_sync_add(ch_obj, super_buf);
                     }
+                } else {
+                    mm_channel_superbuf_track(queue, super_buf, newer);
                 }
 
                 if ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
@@ -2898,14 +3594,7 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                     queue->nomatch_frame_id = buf_info->frame_idx;
                 }
             } else {
-                /* No memory */
-                if (NULL != new_buf) {
-                    free(new_buf);
-                }
-                if (NULL != new_node) {
-                    free(new_node);
-                }
-                /* qbuf the new buf since we cannot enqueue */
+                /* No memory, qbuf the new buf since we cannot enqueue */
                 mm_channel_qbuf(ch_obj, buf_info->buf);
             }
         }
@@ -2952,17 +3641,13 @@ mm_channel_queue_node_t* mm_channel_superbuf_dequeue_internal(
         }
         if (NULL != super_buf) {
             /* remove from the queue */
-            cam_list_del_node(&node->list);
-            queue->que.size--;
+            mm_channel_superbuf_unlink(queue, super_buf);
             if (super_buf->matched == TRUE) {
                 queue->match_cnt--;
                 if (ch_obj->bundle.superbuf_queue.attr.enable_frame_sync) {
-                    pthread_mutex_lock(&fs_lock);
-                    mm_frame_sync_remove(super_buf->frame_idx);
-                    pthread_mutex_unlock(&fs_lock);
+                    mm_frame_sync_remove(ch_obj, super_buf->frame_idx);
                 }
             }
-            free(node);
         }
     }
 
@@ -3005,11 +3690,9 @@ mm_channel_queue_node_t* mm_channel_superbuf_dequeue_frame_internal(
         if (super_buf && super_buf->matched &&
                 (super_buf->frame_idx == frame_idx)) {
             /* remove from the queue */
-            cam_list_del_node(&node->list);
-            queue->que.size--;
+            mm_channel_superbuf_unlink(queue, super_buf);
             queue->match_cnt--;
             CDBG_HIGH("%s: Found match frame %d", __func__, frame_idx);
-            free(node);
             break;
         }
         else {
@@ -3081,7 +3764,7 @@ int32_t mm_channel_superbuf_bufdone_overflow(mm_channel_t* my_obj,
                     mm_channel_qbuf(my_obj, super_buf->super_buf[i].buf);
                 }
             }
-            free(super_buf);
+            mm_channel_superbuf_free(super_buf);
         }
     }
     pthread_mutex_unlock(&queue->que.lock);
@@ -3125,7 +3808,7 @@ int32_t mm_channel_superbuf_skip(mm_channel_t* my_obj,
                     mm_channel_qbuf(my_obj, super_buf->super_buf[i].buf);
                 }
             }
-            free(super_buf);
+            mm_channel_superbuf_free(super_buf);
         }
     }
     pthread_mutex_unlock(&queue->que.lock);
@@ -3167,7 +3850,7 @@ int32_t mm_channel_superbuf_flush(mm_channel_t* my_obj,
                 }
             }
         }
-        free(super_buf);
+        mm_channel_superbuf_free(super_buf);
         super_buf = mm_channel_superbuf_dequeue_internal(queue, FALSE, my_obj);
     }
     pthread_mutex_unlock(&queue->que.lock);
@@ -3195,14 +3878,13 @@ int32_t mm_channel_proc_general_cmd(mm_channel_t *my_obj,
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_alloc(NULL);
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->u.gen_cmd = *p_gen_cmd;
         node->cmd_type = MM_CAMERA_CMD_TYPE_GENERAL;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        mm_camera_cmd_thread_enq(&(my_obj->cmd_thread), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -3243,7 +3925,7 @@ int32_t mm_channel_superbuf_flush_matched(mm_channel_t* my_obj,
                 mm_channel_qbuf(my_obj, super_buf->super_buf[i].buf);
             }
         }
-        free(super_buf);
+        mm_channel_superbuf_free(super_buf);
         super_buf = mm_channel_superbuf_dequeue_internal(queue, TRUE, my_obj);
     }
     pthread_mutex_unlock(&queue->que.lock);
@@ -3255,19 +3937,31 @@ int32_t mm_channel_superbuf_flush_matched(mm_channel_t* my_obj,
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_reset
  *
- * DESCRIPTION: Reset Frame sync info
+ * DESCRIPTION: Reset pending frames and statistics of a frame sync pair.
+ *              Caller holds the pair lock.
+ *
+ * PARAMETERS :
+ *   @fs      : frame sync pair
  *
  * RETURN     : None
  *==========================================================================*/
-void mm_frame_sync_reset() {
-    memset(&fs, 0x0, sizeof(fs));
+void mm_frame_sync_reset(mm_channel_frame_sync_info_t *fs) {
+    memset(fs->cam, 0x0, sizeof(fs->cam));
+    memset(fs->matched, 0x0, sizeof(fs->matched));
+    fs->matched_head = 0;
+    fs->matched_cnt = 0;
+    fs->synced = 0;
+    fs->sets_dropped = 0;
+    mm_camera_latency_reset(&fs->sync_latency);
+    mm_camera_latency_reset(&fs->sync_skew);
     CDBG("%s: Reset Done", __func__);
 }
 
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_register_channel
  *
- * DESCRIPTION: Register Channel for frame sync
+ * DESCRIPTION: Register Channel for frame sync. The channel joins a pair
+ *              waiting for a channel of another camera, or starts a new one.
  *
  * PARAMETERS :
  *   @ch_obj  : channel object
@@ -3277,34 +3971,80 @@ void mm_frame_sync_reset() {
  *              -1 -- failure
  *==========================================================================*/
 int32_t mm_frame_sync_register_channel(mm_channel_t *ch_obj) {
-    // Lock frame sync info
+    mm_channel_frame_sync_info_t *fs = NULL;
+    mm_channel_queue_t *queue = NULL;
+    char prop[PROPERTY_VALUE_MAX];
+    int window_us = 0;
+    uint32_t misses = 0;
+    uint8_t i = 0, j = 0;
+
+    if (!ch_obj) {
+        CDBG_ERROR("%s: DBG_FS Error!! invalid channel", __func__);
+        return -1;
+    }
+    queue = &ch_obj->bundle.superbuf_queue;
+
+    // Lock frame sync registry
     pthread_mutex_lock(&fs_lock);
-    if ((fs.num_cam >= MAX_NUM_CAMERA_PER_BUNDLE) || (!ch_obj)) {
-        CDBG_ERROR("%s: DBG_FS Error!! num cam(%d) is out of range ",
-                __func__, fs.num_cam);
+    for (i = 0; (i < MM_FRAME_SYNC_MAX_PAIRS) && (fs == NULL); i++) {
+        if ((fs_pairs[i].num_cam == 0) ||
+                (fs_pairs[i].num_cam >= MAX_NUM_CAMERA_PER_BUNDLE)) {
+            continue;
+        }
+        for (j = 0; j < MAX_NUM_CAMERA_PER_BUNDLE; j++) {
+            if (fs_pairs[i].ch_obj[j] &&
+                    (fs_pairs[i].ch_obj[j]->cam_obj == ch_obj->cam_obj)) {
+                break;
+            }
+        }
+        if (j >= MAX_NUM_CAMERA_PER_BUNDLE) {
+            fs = &fs_pairs[i];
+        }
+    }
+    for (i = 0; (i < MM_FRAME_SYNC_MAX_PAIRS) && (fs == NULL); i++) {
+        if (fs_pairs[i].num_cam == 0) {
+            fs = &fs_pairs[i];
+        }
+    }
+    if (fs == NULL) {
+        CDBG_ERROR("%s: X, DBG_FS Cannot register channel!!", __func__);
         pthread_mutex_unlock(&fs_lock);
         return -1;
     }
-    if (fs.num_cam == 0) {
+    if (!fs->initialized) {
+        pthread_mutex_init(&fs->lock, NULL);
+        pthread_cond_init(&fs->cond, NULL);
+        fs->initialized = 1;
+    }
+
+    pthread_mutex_lock(&queue->que.lock);
+    pthread_mutex_lock(&fs->lock);
+    if (fs->num_cam == 0) {
         CDBG_HIGH("%s: First channel registering!!", __func__);
-        mm_frame_sync_reset();
+        mm_frame_sync_reset(fs);
+        property_get("persist.camera.fs.window_us", prop,
+                MM_FRAME_SYNC_WINDOW_US_DEFAULT);
+        window_us = atoi(prop);
+        fs->window_ns = (window_us > 0) ? (uint64_t)window_us * 1000 : 0;
     }
-    uint8_t i = 0;
     for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
-        if (fs.ch_obj[i] == NULL) {
-            fs.ch_obj[i] = ch_obj;
-            fs.cb[i] = ch_obj->bundle.super_buf_notify_cb;
-            fs.num_cam++;
+        if (fs->ch_obj[i] == NULL) {
+            fs->ch_obj[i] = ch_obj;
+            fs->cb[i] = ch_obj->bundle.super_buf_notify_cb;
+            misses = fs->cam[i].misses;
+            memset(&fs->cam[i], 0x0, sizeof(fs->cam[i]));
+            fs->cam[i].misses = misses;
+            fs->num_cam++;
+            ch_obj->frame_sync = fs;
+            ch_obj->frame_sync_idx = i;
             CDBG("%s: DBG_FS index %d", __func__, i);
             break;
         }
     }
-    if (i >= MAX_NUM_CAMERA_PER_BUNDLE) {
-        CDBG_HIGH("%s: X, DBG_FS Cannot register channel!!", __func__);
-        pthread_mutex_unlock(&fs_lock);
-        return -1;
-    }
-    CDBG_HIGH("%s: num_cam %d ", __func__, fs.num_cam);
+    CDBG_HIGH("%s: pair %d num_cam %d window %lld us", __func__,
+            (int)(fs - fs_pairs), fs->num_cam, (long long)fs->window_ns / 1000);
+    pthread_mutex_unlock(&fs->lock);
+    pthread_mutex_unlock(&queue->que.lock);
     pthread_mutex_unlock(&fs_lock);
     return 0;
 }
@@ -3312,7 +4052,8 @@ int32_t mm_frame_sync_register_channel(mm_channel_t *ch_obj) {
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_unregister_channel
  *
- * DESCRIPTION: un-register Channel for frame sync
+ * DESCRIPTION: un-register Channel for frame sync. Waits for consumers that
+ *              are still dequeuing a synced set from the pair.
  *
  * PARAMETERS :
  *   @ch_obj  : channel object
@@ -3322,245 +4063,378 @@ int32_t mm_frame_sync_register_channel(mm_channel_t *ch_obj) {
  *              -1 -- failure
  *==========================================================================*/
 int32_t mm_frame_sync_unregister_channel(mm_channel_t *ch_obj) {
-    uint8_t i = 0;
-    // Lock frame sync info
+    mm_channel_frame_sync_info_t *fs = NULL;
+    mm_channel_queue_t *queue = NULL;
+    uint32_t misses = 0;
+    uint8_t idx = 0;
+
+    // Lock frame sync registry
     pthread_mutex_lock(&fs_lock);
-    if (!fs.num_cam || !ch_obj) {
+    if (!ch_obj || !ch_obj->frame_sync) {
         CDBG_HIGH("%s: X, DBG_FS: channel not found  !!", __func__);
-        // Lock frame sync info
         pthread_mutex_unlock(&fs_lock);
         return -1;
     }
-    for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
-        if (fs.ch_obj[i] == ch_obj) {
-            CDBG("%s: found ch_obj at i (%d) ", __func__, i);
-            break;
-        }
-    }
-    if (i < MAX_NUM_CAMERA_PER_BUNDLE) {
-        CDBG("%s: remove channel info ", __func__);
-        fs.ch_obj[i] = NULL;
-        fs.cb[i] = NULL;
-        fs.num_cam--;
-    } else {
-        CDBG("%s: DBG_FS Channel not found ", __func__);
-    }
-    if (fs.num_cam == 0) {
-        mm_frame_sync_reset();
+    queue = &ch_obj->bundle.superbuf_queue;
+    fs = ch_obj->frame_sync;
+    idx = ch_obj->frame_sync_idx;
+
+    pthread_mutex_lock(&queue->que.lock);
+    pthread_mutex_lock(&fs->lock);
+    fs->ch_obj[idx] = NULL;
+    fs->cb[idx] = NULL;
+    fs->num_cam--;
+    /* synced sets refer to the removed channel, drop them */
+    misses = fs->cam[idx].misses;
+    memset(&fs->cam[idx], 0x0, sizeof(fs->cam[idx]));
+    fs->cam[idx].misses = misses;
+    fs->sets_dropped += fs->matched_cnt;
+    fs->matched_head = 0;
+    fs->matched_cnt = 0;
+    ch_obj->frame_sync = NULL;
+    pthread_mutex_unlock(&fs->lock);
+    pthread_mutex_unlock(&queue->que.lock);
+
+    pthread_mutex_lock(&fs->lock);
+    while (fs->in_use) {
+        pthread_cond_wait(&fs->cond, &fs->lock);
     }
-    CDBG_HIGH("%s: X, fs.num_cam %d", __func__, fs.num_cam);
+    CDBG_HIGH("%s: X, num_cam %d", __func__, fs->num_cam);
+    pthread_mutex_unlock(&fs->lock);
     pthread_mutex_unlock(&fs_lock);
     return 0;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_frame_sync_head
+ *
+ * DESCRIPTION: Get the oldest pending frame of a camera, skipping slots of
+ *              frames that were removed. Caller holds the pair lock.
+ *
+ * PARAMETERS :
+ *   @cam     : per camera frame sync ring
+ *
+ * RETURN     : oldest pending node, NULL if none
+ *==========================================================================*/
+static mm_channel_sync_node_t *mm_frame_sync_head(mm_channel_sync_cam_t *cam)
+{
+    mm_channel_sync_node_t *node = NULL;
+
+    while (cam->head < cam->tail) {
+        node = &cam->node[cam->head & (MM_FRAME_SYNC_RING_SIZE - 1)];
+        if (node->frame_idx == cam->head) {
+            return node;
+        }
+        cam->head++;
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_frame_sync_match
+ *
+ * DESCRIPTION: Sync the oldest pending frames of all cameras. Frames whose
+ *              keys are within the window form a set; a frame too old to be
+ *              synced with the newest head is dropped as a sync miss, so a
+ *              frame lost on one sensor does not stall the pair. Caller holds
+ *              the pair lock.
+ *
+ * PARAMETERS :
+ *   @fs      : frame sync pair
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static void mm_frame_sync_match(mm_channel_frame_sync_info_t *fs)
+{
+    mm_channel_sync_node_t *head[MAX_NUM_CAMERA_PER_BUNDLE];
+    mm_channel_sync_set_t *set = NULL;
+    uint64_t min_key, max_key, first_ns;
+    uint8_t i;
+
+    if (!fs->num_cam) {
+        return;
+    }
+    for (;;) {
+        min_key = UINT64_MAX;
+        max_key = 0;
+        first_ns = UINT64_MAX;
+        for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
+            head[i] = NULL;
+            if (!fs->ch_obj[i]) {
+                continue;
+            }
+            head[i] = mm_frame_sync_head(&fs->cam[i]);
+            if (!head[i]) {
+                return;
+            }
+            if (head[i]->key < min_key) {
+                min_key = head[i]->key;
+            }
+            if (head[i]->key > max_key) {
+                max_key = head[i]->key;
+            }
+            if (head[i]->add_ns < first_ns) {
+                first_ns = head[i]->add_ns;
+            }
+        }
+
+        if (max_key - min_key <= fs->window_ns) {
+            if (fs->matched_cnt >= MM_CAMERA_FRAME_SYNC_NODES) {
+                /* consumer is behind, the oldest set is overflowed anyway */
+                fs->matched_head = (uint8_t)((fs->matched_head + 1) %
+                        MM_CAMERA_FRAME_SYNC_NODES);
+                fs->matched_cnt--;
+                fs->sets_dropped++;
+            }
+            set = &fs->matched[(fs->matched_head + fs->matched_cnt) %
+                    MM_CAMERA_FRAME_SYNC_NODES];
+            fs->matched_cnt++;
+            for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
+                set->frame_idx[i] = 0;
+                if (head[i]) {
+                    set->frame_idx[i] = head[i]->frame_idx;
+                    head[i]->frame_idx = 0;
+                    fs->cam[i].head++;
+                }
+            }
+            fs->synced++;
+            mm_camera_latency_record(&fs->sync_latency,
+                    mm_camera_latency_now_ns() - first_ns);
+            if (fs->window_ns) {
+                mm_camera_latency_record(&fs->sync_skew, max_key - min_key);
+            }
+            CDBG("%s: synced frames %d/%d", __func__,
+                    set->frame_idx[0], set->frame_idx[1]);
+            continue;
+        }
+
+        for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
+            if (head[i] && (max_key - head[i]->key > fs->window_ns)) {
+                CDBG("%s: sync miss ch %d frame %d", __func__, i,
+                        head[i]->frame_idx);
+                head[i]->frame_idx = 0;
+                fs->cam[i].head++;
+                fs->cam[i].misses++;
+            }
+        }
+    }
+}
 
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_add
  *
- * DESCRIPTION: Add frame info into frame sync nodes
+ * DESCRIPTION: Add a matched superbuf of a channel to its frame sync pair.
+ *              Caller holds the channel queue lock.
  *
  * PARAMETERS :
- *   @frame_id  : frame id to be added
- *   @ch_obj  : channel object
+ *   @ch_obj    : channel object
+ *   @super_buf : matched superbuf
  *
  * RETURN     : int32_t type of status
  *              0  -- success
  *              -1 -- failure
  *==========================================================================*/
-int32_t mm_frame_sync_add(uint32_t frame_id, mm_channel_t *ch_obj) {
+int32_t mm_frame_sync_add(mm_channel_t *ch_obj,
+        mm_channel_queue_node_t *super_buf) {
+    mm_channel_frame_sync_info_t *fs = ch_obj->frame_sync;
+    mm_channel_sync_cam_t *cam = NULL;
+    mm_channel_sync_node_t *node = NULL;
+    uint32_t frame_id = super_buf->frame_idx;
+    uint64_t key = frame_id;
 
     CDBG("%s: E, frame id %d ch_obj %p", __func__, frame_id, ch_obj);
-    if (!frame_id || !ch_obj) {
+    if (!frame_id || !fs) {
         CDBG_HIGH("%s: X, DBG_FS Error, cannot add sync frame !!", __func__);
         return -1;
     }
 
-    int8_t ch_idx = -1;
-    uint8_t i = 0;
-    for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
-        if (fs.ch_obj[i] == ch_obj) {
-            ch_idx = i;
-            CDBG("%s: ch id %d ", __func__, ch_idx);
-            break;
-        }
+    pthread_mutex_lock(&fs->lock);
+    if (fs->window_ns) {
+        key = mm_channel_superbuf_ts_ns(super_buf);
     }
-    if (ch_idx < 0) {
-        CDBG_HIGH("%s: X, DBG_FS ch not found!!", __func__);
-        return -1;
+
+    cam = &fs->cam[ch_obj->frame_sync_idx];
+    if (cam->tail == 0) {
+        cam->head = cam->tail = frame_id;
     }
-    int8_t index = mm_frame_sync_find_frame_index(frame_id);
-    if ((index >= 0) && (index < MM_CAMERA_FRAME_SYNC_NODES)) {
-        fs.node[index].frame_valid[ch_idx] = 1;
-    } else if (index < 0) {
-        if (fs.pos >= MM_CAMERA_FRAME_SYNC_NODES) {
-            fs.pos = 0;
-        }
-        index = fs.pos;
-        memset(&fs.node[index], 0x00, sizeof(mm_channel_sync_node_t));
-        fs.pos++;
-        fs.node[index].frame_idx = frame_id;
-        fs.node[index].frame_valid[ch_idx] = 1;
-        if (fs.num_cam == 1) {
-            CDBG("%s: Single camera frame %d , matched ", __func__, frame_id);
-            fs.node[index].matched = 1;
-        }
-    }
-    uint8_t frames_valid = 0;
-    if (!fs.node[index].matched) {
-        for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
-            if (fs.node[index].frame_valid[i]) {
-                frames_valid++;
-            }
-        }
-        if (frames_valid == fs.num_cam) {
-            fs.node[index].matched = 1;
-            CDBG("%s: dual camera frame %d , matched ",
-                    __func__, frame_id);
+    if (frame_id < cam->head) {
+        /* its partners were synced or dropped already */
+        cam->misses++;
+        pthread_mutex_unlock(&fs->lock);
+        return 0;
+    }
+    while (frame_id - cam->head >= MM_FRAME_SYNC_RING_SIZE) {
+        node = &cam->node[cam->head & (MM_FRAME_SYNC_RING_SIZE - 1)];
+        if (node->frame_idx == cam->head) {
+            node->frame_idx = 0;
+            cam->misses++;
         }
+        cam->head++;
+    }
+    node = &cam->node[frame_id & (MM_FRAME_SYNC_RING_SIZE - 1)];
+    node->frame_idx = frame_id;
+    node->key = key;
+    node->add_ns = mm_camera_latency_now_ns();
+    if (frame_id >= cam->tail) {
+        cam->tail = frame_id + 1;
     }
+
+    mm_frame_sync_match(fs);
+    pthread_mutex_unlock(&fs->lock);
     return 0;
 }
 
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_remove
  *
- * DESCRIPTION: Remove frame info from frame sync nodes
+ * DESCRIPTION: Remove a frame of a channel from its frame sync pair, also
+ *              from synced sets not yet dispatched. Caller holds the channel
+ *              queue lock.
  *
  * PARAMETERS :
+ *   @ch_obj    : channel object
  *   @frame_id  : frame id to be removed
  *
  * RETURN     : int32_t type of status
  *              0  -- success
  *              -1 -- failure
  *==========================================================================*/
-int32_t mm_frame_sync_remove(uint32_t frame_id) {
-    int8_t index = -1;
+int32_t mm_frame_sync_remove(mm_channel_t *ch_obj, uint32_t frame_id) {
+    mm_channel_frame_sync_info_t *fs = ch_obj->frame_sync;
+    mm_channel_sync_node_t *node = NULL;
+    uint8_t idx, i;
 
     CDBG("%s: E, frame_id %d", __func__, frame_id);
-    if (!frame_id) {
+    if (!frame_id || !fs) {
         CDBG("%s: X, DBG_FS frame id invalid", __func__);
         return -1;
     }
 
-    index = mm_frame_sync_find_frame_index(frame_id);
-    if ((index >= 0) && (index < MM_CAMERA_FRAME_SYNC_NODES)) {
-        CDBG("%s: Removing sync frame %d", __func__, frame_id);
-        memset(&fs.node[index], 0x00, sizeof(mm_channel_sync_node_t));
+    pthread_mutex_lock(&fs->lock);
+    idx = ch_obj->frame_sync_idx;
+    node = &fs->cam[idx].node[frame_id & (MM_FRAME_SYNC_RING_SIZE - 1)];
+    if (node->frame_idx == frame_id) {
+        node->frame_idx = 0;
     }
+    for (i = 0; i < fs->matched_cnt; i++) {
+        mm_channel_sync_set_t *set = &fs->matched[(fs->matched_head + i) %
+                MM_CAMERA_FRAME_SYNC_NODES];
+        if (set->frame_idx[idx] == frame_id) {
+            CDBG("%s: Removing sync frame %d", __func__, frame_id);
+            set->frame_idx[idx] = 0;
+        }
+    }
+    pthread_mutex_unlock(&fs->lock);
     CDBG("%s: X ", __func__);
     return 0;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_frame_sync_find_matched
+ * FUNCTION   : mm_frame_sync_get_matched
  *
- * DESCRIPTION: Find  a matched sync frame from the node array
+ * DESCRIPTION: Take the oldest complete synced set of the pair a channel is
+ *              registered to. The pair stays referenced until
+ *              mm_frame_sync_put_matched, so its channels cannot unregister
+ *              while their frames are dequeued.
  *
  * PARAMETERS :
- *   @oldest  : If enabled, find oldest matched frame.,
- *                  If not enabled, get the first matched frame found
+ *   @ch_obj  : channel object
+ *   @set     : filled with the frame id of each camera
+ *   @sync_ch : filled with the channel of each camera
  *
- * RETURN     : unt32_t type of status
- *              0  -- If no matched frames found
- *              frame index: inf matched frame found
+ * RETURN     : frame sync pair, NULL if no synced set is available
  *==========================================================================*/
-uint32_t mm_frame_sync_find_matched(uint8_t oldest) {
-    CDBG_HIGH("%s: E, oldest %d ", __func__, oldest);
-    uint8_t i = 0;
-    uint32_t frame_idx = 0;
-    uint32_t curr_frame_idx = 0;
-    for (i = 0; i < MM_CAMERA_FRAME_SYNC_NODES; i++) {
-        if (fs.node[i].matched) {
-            curr_frame_idx = fs.node[i].frame_idx;
-            if (!frame_idx) {
-                frame_idx = curr_frame_idx;
-            }
-            if (!oldest) {
+mm_channel_frame_sync_info_t *mm_frame_sync_get_matched(mm_channel_t *ch_obj,
+        mm_channel_sync_set_t *set, mm_channel_t **sync_ch) {
+    mm_channel_queue_t *queue = &ch_obj->bundle.superbuf_queue;
+    mm_channel_frame_sync_info_t *fs = NULL;
+    uint8_t i, found = 0;
+
+    pthread_mutex_lock(&queue->que.lock);
+    fs = ch_obj->frame_sync;
+    if (fs == NULL) {
+        pthread_mutex_unlock(&queue->que.lock);
+        return NULL;
+    }
+    pthread_mutex_lock(&fs->lock);
+    while (!found && fs->matched_cnt) {
+        *set = fs->matched[fs->matched_head];
+        fs->matched_head = (uint8_t)((fs->matched_head + 1) %
+                MM_CAMERA_FRAME_SYNC_NODES);
+        fs->matched_cnt--;
+        found = 1;
+        for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
+            if (fs->ch_obj[i] && !set->frame_idx[i]) {
+                /* a frame of the set was overflowed or flushed */
+                fs->sets_dropped++;
+                found = 0;
                 break;
-            } else if (frame_idx > curr_frame_idx) {
-                frame_idx = curr_frame_idx;
             }
         }
     }
-    CDBG_HIGH("%s: X, oldest %d frame idx %d", __func__, oldest, frame_idx);
-    return frame_idx;
-}
-
-/*===========================================================================
- * FUNCTION   : mm_frame_sync_find_frame_index
- *
- * DESCRIPTION: Find sync frame index if present
- *
- * PARAMETERS :
- *   @frame_id  : frame id to be searched
- *
- * RETURN     : int8_t type of status
- *              -1  -- If desired frame not found
- *              index: node array index if frame is found
- *==========================================================================*/
-int8_t mm_frame_sync_find_frame_index(uint32_t frame_id) {
-
-    CDBG("%s: E, frame_id %d", __func__, frame_id);
-    int8_t index = -1, i = 0;
-    for (i = 0; i < MM_CAMERA_FRAME_SYNC_NODES; i++) {
-        if (fs.node[i].frame_idx == frame_id) {
-            index = i;
-            break;
+    if (found) {
+        for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
+            sync_ch[i] = fs->ch_obj[i];
         }
+        fs->in_use++;
     }
-    CDBG("%s: X index :%d", __func__, index);
-    return index;
+    pthread_mutex_unlock(&fs->lock);
+    pthread_mutex_unlock(&queue->que.lock);
+    return found ? fs : NULL;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_frame_sync_lock_queues
+ * FUNCTION   : mm_frame_sync_put_matched
  *
- * DESCRIPTION: Lock all channel queues present in node info
+ * DESCRIPTION: Release a pair referenced by mm_frame_sync_get_matched
+ *
+ * PARAMETERS :
+ *   @fs      : frame sync pair
  *
  * RETURN     : None
  *==========================================================================*/
-void mm_frame_sync_lock_queues() {
-    uint8_t j = 0;
-    ALOGI("%s: E ", __func__);
-    for (j = 0; j < MAX_NUM_CAMERA_PER_BUNDLE; j++) {
-        if (fs.ch_obj[j]) {
-            mm_channel_queue_t *ch_queue =
-                    &fs.ch_obj[j]->bundle.superbuf_queue;
-            if (ch_queue) {
-                pthread_mutex_lock(&ch_queue->que.lock);
-                ALOGI("%s: Done locking fs.ch_obj[%d] ", __func__, j);
-            }
-        }
+void mm_frame_sync_put_matched(mm_channel_frame_sync_info_t *fs) {
+    pthread_mutex_lock(&fs->lock);
+    if (--fs->in_use == 0) {
+        pthread_cond_broadcast(&fs->cond);
     }
-    ALOGI("%s: Locking fs ", __func__);
-    pthread_mutex_lock(&fs_lock);
-    ALOGI("%s: X ", __func__);
+    pthread_mutex_unlock(&fs->lock);
 }
 
 /*===========================================================================
- * FUNCTION   : mm_frame_sync_unlock_queues
+ * FUNCTION   : mm_frame_sync_dump
+ *
+ * DESCRIPTION: print frame sync statistics of all pairs
  *
- * DESCRIPTION: Unlock all channel queues
+ * PARAMETERS :
+ *   @fd      : output fd
  *
  * RETURN     : None
  *==========================================================================*/
-void mm_frame_sync_unlock_queues() {
-    // Unlock all queues
-    uint8_t j = 0;
-    ALOGI("%s: E ", __func__);
-    pthread_mutex_unlock(&fs_lock);
-    ALOGI("%s: Done unlocking fs ", __func__);
-    for (j = 0; j < MAX_NUM_CAMERA_PER_BUNDLE; j++) {
-        if (fs.ch_obj[j]) {
-            mm_channel_queue_t *ch_queue =
-                    &fs.ch_obj[j]->bundle.superbuf_queue;
-            if (ch_queue) {
-                pthread_mutex_unlock(&ch_queue->que.lock);
-                ALOGI("%s: Done unlocking fs.ch_obj[%d] ", __func__, j);
-            }
+void mm_frame_sync_dump(int fd) {
+    mm_channel_frame_sync_info_t *fs = NULL;
+    uint8_t i, j;
+
+    pthread_mutex_lock(&fs_lock);
+    for (i = 0; i < MM_FRAME_SYNC_MAX_PAIRS; i++) {
+        fs = &fs_pairs[i];
+        if (!fs->initialized) {
+            continue;
+        }
+        pthread_mutex_lock(&fs->lock);
+        dprintf(fd, "\n Frame sync pair %d: num_cam %d window %llu us"
+                " synced %u dropped sets %u\n", i, fs->num_cam,
+                (unsigned long long)(fs->window_ns / 1000),
+                fs->synced, fs->sets_dropped);
+        for (j = 0; j < MAX_NUM_CAMERA_PER_BUNDLE; j++) {
+            dprintf(fd, "  camera %d: sync misses %u\n", j,
+                    fs->cam[j].misses);
         }
+        mm_camera_latency_print(fd, "sync latency", &fs->sync_latency);
+        mm_camera_latency_print(fd, "sync skew", &fs->sync_skew);
+        pthread_mutex_unlock(&fs->lock);
     }
-    ALOGI("%s: X ", __func__);
+    pthread_mutex_unlock(&fs_lock);
 }
 
 /*===========================================================================
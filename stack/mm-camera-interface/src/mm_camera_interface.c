@@ -1489,6 +1489,69 @@ static int32_t mm_camera_intf_get_session_id(uint32_t camera_handle,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_intf_dump_latency
+ *
+ * DESCRIPTION: print the frame latency histograms of a camera
+ *
+ * PARAMETERS :
+ *   @camera_handle: camera handle
+ *   @fd           : output fd
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_intf_dump_latency(uint32_t camera_handle, int fd)
+{
+    int32_t rc = -1;
+    mm_camera_obj_t * my_obj = NULL;
+
+    pthread_mutex_lock(&g_intf_lock);
+    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+
+    if(my_obj) {
+        pthread_mutex_lock(&my_obj->cam_lock);
+        pthread_mutex_unlock(&g_intf_lock);
+        rc = mm_camera_dump_latency(my_obj, fd);
+    } else {
+        pthread_mutex_unlock(&g_intf_lock);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_intf_set_buf_map_cache
+ *
+ * DESCRIPTION: enable or disable the stream buffer mapping cache of a camera
+ *
+ * PARAMETERS :
+ *   @camera_handle: camera handle
+ *   @enable       : TRUE to keep mappings across stream restarts
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_intf_set_buf_map_cache(uint32_t camera_handle,
+        uint8_t enable)
+{
+    int32_t rc = -1;
+    mm_camera_obj_t * my_obj = NULL;
+
+    pthread_mutex_lock(&g_intf_lock);
+    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+
+    if(my_obj) {
+        pthread_mutex_lock(&my_obj->cam_lock);
+        pthread_mutex_unlock(&g_intf_lock);
+        rc = mm_camera_set_buf_map_cache(my_obj, enable);
+    } else {
+        pthread_mutex_unlock(&g_intf_lock);
+    }
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_intf_sync_related_sensors
  *
@@ -1777,6 +1840,8 @@ uint8_t get_num_of_cameras()
 
     CDBG("%s : E", __func__);
 
+    mm_camera_trace_init();
+
     property_get("vold.decrypt", prop, "0");
     int decrypt = atoi(prop);
     if (decrypt == 1)
@@ -1785,6 +1850,28 @@ uint8_t get_num_of_cameras()
     /* lock the mutex */
     pthread_mutex_lock(&g_intf_lock);
 
+#ifdef MM_CAMERA_SIM
+    if (mm_camera_sim_enabled()) {
+        int8_t i;
+        num_cameras = (int8_t)mm_camera_sim_get_num_of_cameras();
+        for (i = 0; i < num_cameras; i++) {
+            snprintf(g_cam_ctrl.video_dev_name[i], MM_CAMERA_DEV_NAME_LEN,
+                    "video%d", i);
+            g_cam_ctrl.info[i].facing =
+                    (i % 2) ? CAMERA_FACING_FRONT : CAMERA_FACING_BACK;
+            g_cam_ctrl.info[i].orientation = (i % 2) ? 270 : 90;
+            g_cam_ctrl.cam_type[i] = CAM_TYPE_MAIN;
+            g_cam_ctrl.is_yuv[i] = 0;
+        }
+        g_cam_ctrl.num_cam = (uint8_t)num_cameras;
+        sort_camera_info(g_cam_ctrl.num_cam);
+        pthread_mutex_unlock(&g_intf_lock);
+        ALOGI("%s: num_cameras=%d (replay backend)\n", __func__,
+                (int)g_cam_ctrl.num_cam);
+        return (uint8_t)g_cam_ctrl.num_cam;
+    }
+#endif
+
     while (1) {
         uint32_t num_entities = 1U;
         char dev_name[32];
@@ -2044,7 +2131,9 @@ static mm_camera_ops_t mm_camera_ops = {
     .get_session_id = mm_camera_intf_get_session_id,
     .sync_related_sensors = mm_camera_intf_sync_related_sensors,
     .flush = mm_camera_intf_flush,
-    .register_stream_buf_cb = mm_camera_intf_register_stream_buf_cb
+    .register_stream_buf_cb = mm_camera_intf_register_stream_buf_cb,
+    .dump_latency = mm_camera_intf_dump_latency,
+    .set_buf_map_cache = mm_camera_intf_set_buf_map_cache
 };
 
 /*===========================================================================
@@ -0,0 +1,191 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mm_camera_latency.h"
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_latency_bucket
+ *
+ * DESCRIPTION: bucket index of a latency value
+ *
+ * PARAMETERS :
+ *   @us      : latency in microseconds
+ *
+ * RETURN     : bucket index
+ *==========================================================================*/
+static uint32_t mm_camera_latency_bucket(uint32_t us)
+{
+    uint32_t shift;
+
+    if (us < MM_CAMERA_LATENCY_LINEAR) {
+        return us;
+    }
+    shift = (uint32_t)(31 - __builtin_clz(us)) - MM_CAMERA_LATENCY_SUB_BITS;
+    return MM_CAMERA_LATENCY_LINEAR +
+            ((shift - 1) << MM_CAMERA_LATENCY_SUB_BITS) +
+            ((us >> shift) - (1 << MM_CAMERA_LATENCY_SUB_BITS));
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_latency_bucket_max
+ *
+ * DESCRIPTION: highest value counted in a bucket
+ *
+ * PARAMETERS :
+ *   @idx     : bucket index
+ *
+ * RETURN     : latency in microseconds
+ *==========================================================================*/
+static uint32_t mm_camera_latency_bucket_max(uint32_t idx)
+{
+    uint32_t shift, mant;
+
+    if (idx < MM_CAMERA_LATENCY_LINEAR) {
+        return idx;
+    }
+    idx -= MM_CAMERA_LATENCY_LINEAR;
+    shift = (idx >> MM_CAMERA_LATENCY_SUB_BITS) + 1;
+    mant = (idx & ((1 << MM_CAMERA_LATENCY_SUB_BITS) - 1)) +
+            (1 << MM_CAMERA_LATENCY_SUB_BITS);
+    return (uint32_t)((((uint64_t)mant + 1) << shift) - 1);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_latency_record
+ *
+ * DESCRIPTION: add one sample
+ *
+ * PARAMETERS :
+ *   @hist    : histogram
+ *   @ns      : latency in nanoseconds
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_latency_record(mm_camera_latency_hist_t *hist, uint64_t ns)
+{
+    uint64_t us64 = ns / 1000;
+    uint32_t us = (us64 > UINT32_MAX) ? UINT32_MAX : (uint32_t)us64;
+    uint32_t max = __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&hist->buckets[mm_camera_latency_bucket(us)], 1,
+            __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum_us, us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+    while ((us > max) && !__atomic_compare_exchange_n(&hist->max_us, &max, us,
+            1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_latency_percentile
+ *
+ * DESCRIPTION: value at or below which the given share of samples fall
+ *
+ * PARAMETERS :
+ *   @hist     : histogram
+ *   @permille : requested share, e.g. 990 for p99
+ *
+ * RETURN     : latency in microseconds, 0 if no samples
+ *==========================================================================*/
+uint32_t mm_camera_latency_percentile(const mm_camera_latency_hist_t *hist,
+        uint32_t permille)
+{
+    uint64_t total = 0;
+    uint64_t rank, seen = 0;
+    uint32_t max = __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED);
+    uint32_t i, val;
+
+    /* buckets rather than count, so a concurrent record can not leave the
+     * rank unreachable */
+    for (i = 0; i < MM_CAMERA_LATENCY_BUCKETS; i++) {
+        total += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+    }
+    if (0 == total) {
+        return 0;
+    }
+    rank = (total * permille + 999) / 1000;
+    if (0 == rank) {
+        rank = 1;
+    }
+    for (i = 0; i < MM_CAMERA_LATENCY_BUCKETS; i++) {
+        seen += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            break;
+        }
+    }
+    val = mm_camera_latency_bucket_max(i);
+    return (val > max) ? max : val;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_latency_reset
+ *
+ * DESCRIPTION: clear all samples
+ *
+ * PARAMETERS :
+ *   @hist    : histogram
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_latency_reset(mm_camera_latency_hist_t *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_latency_print
+ *
+ * DESCRIPTION: write one summary line, nothing if there are no samples
+ *
+ * PARAMETERS :
+ *   @fd      : output fd
+ *   @name    : line label
+ *   @hist    : histogram
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_latency_print(int fd, const char *name,
+        const mm_camera_latency_hist_t *hist)
+{
+    uint32_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+    uint64_t sum = __atomic_load_n(&hist->sum_us, __ATOMIC_RELAXED);
+
+    if (0 == count) {
+        return;
+    }
+    dprintf(fd, "  %-28s n %7u avg %8" PRIu64 " p50 %8u p90 %8u p99 %8u"
+            " max %8u us\n", name, count, sum / count,
+            mm_camera_latency_percentile(hist, 500),
+            mm_camera_latency_percentile(hist, 900),
+            mm_camera_latency_percentile(hist, 990),
+            __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED));
+}
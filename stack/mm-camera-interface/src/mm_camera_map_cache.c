@@ -0,0 +1,442 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+#include "mm_camera.h"
+
+/* Stream buffer mappings kept at the server after the client unmapped them.
+ *
+ * Stopping a stream unmaps every buffer and starting it again maps them
+ * back, each a blocking round trip to the server. Most of these buffers
+ * survive the restart (memory pool, same preview window), so an unmap is
+ * only recorded (PARKED) and the following map of the same fd and size
+ * into the same slot is answered locally. The client must report freed
+ * buffers through mm_camera_invalidate_buf_mapping() before it closes the
+ * fd, as the fd number can be reused by the next allocation. Freed and
+ * replaced buffers are unmapped in bulk ahead of the next map of the
+ * stream, and whatever is left when the stream is released. */
+
+static pthread_mutex_t g_map_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static mm_camera_map_cache_t *g_map_caches = NULL;
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_cache_find
+ *
+ * DESCRIPTION: look up the entry of a mapping slot
+ *
+ * PARAMETERS :
+ *   @cache      : mapping cache
+ *   @stream_hdl : stream handle
+ *   @buf_type   : mapping buffer type
+ *   @frame_idx  : buffer index
+ *   @plane_idx  : plane index, -1 for all planes
+ *
+ * RETURN     : entry or NULL if the slot is not tracked
+ * NOTE       : g_map_cache_lock is expected to be held
+ *==========================================================================*/
+static mm_camera_map_entry_t *mm_camera_map_cache_find(
+        mm_camera_map_cache_t *cache, uint32_t stream_hdl, uint8_t buf_type,
+        uint32_t frame_idx, int32_t plane_idx)
+{
+    uint32_t i;
+    mm_camera_map_entry_t *entry;
+
+    for (i = 0; i < MM_CAMERA_MAP_CACHE_SIZE; i++) {
+        entry = &cache->entries[i];
+        if ((MM_CAMERA_MAP_FREE != entry->state) &&
+                (entry->stream_hdl == stream_hdl) &&
+                (entry->buf_type == buf_type) &&
+                (entry->frame_idx == frame_idx) &&
+                (entry->plane_idx == plane_idx)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_cache_add_unmap
+ *
+ * DESCRIPTION: move a server side mapping into an unmap list and forget it
+ *
+ * PARAMETERS :
+ *   @entry      : parked or stale entry
+ *   @unmaps     : unmap list to fill
+ *
+ * RETURN     : TRUE if added, FALSE if the list is full
+ * NOTE       : g_map_cache_lock is expected to be held
+ *==========================================================================*/
+static uint8_t mm_camera_map_cache_add_unmap(mm_camera_map_entry_t *entry,
+        cam_buf_unmap_type_list *unmaps)
+{
+    cam_buf_unmap_type *unmap;
+
+    if (unmaps->length >= CAM_MAX_NUM_BUFS_PER_STREAM) {
+        return FALSE;
+    }
+    unmap = &unmaps->buf_unmaps[unmaps->length++];
+    memset(unmap, 0, sizeof(*unmap));
+    unmap->type = (cam_mapping_buf_type)entry->buf_type;
+    unmap->frame_idx = entry->frame_idx;
+    unmap->plane_idx = entry->plane_idx;
+    entry->state = MM_CAMERA_MAP_FREE;
+    return TRUE;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_cache_init
+ *
+ * DESCRIPTION: initialize the mapping cache of a camera and register it for
+ *              invalidation. The cache starts disabled.
+ *
+ * PARAMETERS :
+ *   @cache      : mapping cache
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_map_cache_init(mm_camera_map_cache_t *cache)
+{
+    pthread_mutex_lock(&g_map_cache_lock);
+    memset(cache, 0, sizeof(*cache));
+    cache->next = g_map_caches;
+    g_map_caches = cache;
+    pthread_mutex_unlock(&g_map_cache_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_cache_deinit
+ *
+ * DESCRIPTION: unregister the mapping cache of a camera. The server drops
+ *              all mappings of a closed session, nothing is sent.
+ *
+ * PARAMETERS :
+ *   @cache      : mapping cache
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_map_cache_deinit(mm_camera_map_cache_t *cache)
+{
+    mm_camera_map_cache_t **node;
+
+    pthread_mutex_lock(&g_map_cache_lock);
+    for (node = &g_map_caches; NULL != *node; node = &(*node)->next) {
+        if (*node == cache) {
+            *node = cache->next;
+            break;
+        }
+    }
+    CDBG_HIGH("%s: %u hits, %u misses, %u unmaps deferred, %u flushed",
+            __func__, cache->hits, cache->misses, cache->parked,
+            cache->flushed);
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_unlock(&g_map_cache_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_cache_enable
+ *
+ * DESCRIPTION: enable or disable parking of unmapped buffers. Entries parked
+ *              already are flushed as usual.
+ *
+ * PARAMETERS :
+ *   @cache      : mapping cache
+ *   @enable     : TRUE if the client reports freed buffers
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_map_cache_enable(mm_camera_map_cache_t *cache, uint8_t enable)
+{
+    pthread_mutex_lock(&g_map_cache_lock);
+    cache->enabled = enable;
+    pthread_mutex_unlock(&g_map_cache_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_cache_prepare
+ *
+ * DESCRIPTION: filter a map request against the parked mappings of a stream.
+ *              Buffers still mapped into the same slot with the same fd and
+ *              size are removed from the list. Mappings that have to go
+ *              first (slot taken by another buffer, buffer freed) are put
+ *              into the unmap list.
+ *
+ * PARAMETERS :
+ *   @cache      : mapping cache
+ *   @stream_hdl : stream handle
+ *   @maps       : map list, compacted in place
+ *   @unmaps     : unmap list to send before the maps
+ *
+ * RETURN     : number of buffers that need no mapping
+ *==========================================================================*/
+uint32_t mm_camera_map_cache_prepare(mm_camera_map_cache_t *cache,
+        uint32_t stream_hdl, cam_buf_map_type_list *maps,
+        cam_buf_unmap_type_list *unmaps)
+{
+    uint32_t i, n = 0, hits = 0;
+    cam_buf_map_type *map;
+    mm_camera_map_entry_t *entry;
+
+    unmaps->length = 0;
+    pthread_mutex_lock(&g_map_cache_lock);
+    for (i = 0; i < maps->length; i++) {
+        map = &maps->buf_maps[i];
+        entry = mm_camera_map_cache_find(cache, stream_hdl, (uint8_t)map->type,
+                map->frame_idx, map->plane_idx);
+        if ((NULL != entry) && (MM_CAMERA_MAP_PARKED == entry->state) &&
+                (entry->fd == map->fd) && (entry->size == map->size)) {
+            entry->state = MM_CAMERA_MAP_ACTIVE;
+            hits++;
+            continue;
+        }
+        if ((NULL != entry) && (MM_CAMERA_MAP_ACTIVE != entry->state)) {
+            if (!mm_camera_map_cache_add_unmap(entry, unmaps)) {
+                /* no room to replace it, leave the slot to the server */
+                entry->state = MM_CAMERA_MAP_FREE;
+            }
+        }
+        if (cache->enabled && (CAM_MAPPING_BUF_TYPE_STREAM_BUF == map->type)) {
+            cache->misses++;
+        }
+        if (n != i) {
+            maps->buf_maps[n] = *map;
+        }
+        n++;
+    }
+    maps->length = n;
+
+    /* freed buffers of the stream go along if an unmap is sent anyway */
+    for (i = 0; (0 < unmaps->length) && (i < MM_CAMERA_MAP_CACHE_SIZE); i++) {
+        entry = &cache->entries[i];
+        if ((MM_CAMERA_MAP_STALE == entry->state) &&
+                (entry->stream_hdl == stream_hdl) &&
+                !mm_camera_map_cache_add_unmap(entry, unmaps)) {
+            break;
+        }
+    }
+
+    cache->hits += hits;
+    cache->flushed += unmaps->length;
+    pthread_mutex_unlock(&g_map_cache_lock);
+    return hits;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_cache_commit
+ *
+ * DESCRIPTION: remember buffers the server mapped successfully
+ *
+ * PARAMETERS :
+ *   @cache      : mapping cache
+ *   @stream_hdl : stream handle
+ *   @maps       : map list sent to the server
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_map_cache_commit(mm_camera_map_cache_t *cache,
+        uint32_t stream_hdl, const cam_buf_map_type_list *maps)
+{
+    uint32_t i, slot = 0;
+    const cam_buf_map_type *map;
+    mm_camera_map_entry_t *entry;
+
+    pthread_mutex_lock(&g_map_cache_lock);
+    if (!cache->enabled) {
+        pthread_mutex_unlock(&g_map_cache_lock);
+        return;
+    }
+    for (i = 0; i < maps->length; i++) {
+        map = &maps->buf_maps[i];
+        if (CAM_MAPPING_BUF_TYPE_STREAM_BUF != map->type) {
+            continue;
+        }
+        entry = mm_camera_map_cache_find(cache, stream_hdl, (uint8_t)map->type,
+                map->frame_idx, map->plane_idx);
+        while ((NULL == entry) && (slot < MM_CAMERA_MAP_CACHE_SIZE)) {
+            if (MM_CAMERA_MAP_FREE == cache->entries[slot].state) {
+                entry = &cache->entries[slot];
+            }
+            slot++;
+        }
+        if (NULL == entry) {
+            /* full, the buffer is unmapped the usual way */
+            break;
+        }
+        entry->state = MM_CAMERA_MAP_ACTIVE;
+        entry->stream_hdl = stream_hdl;
+        entry->buf_type = (uint8_t)map->type;
+        entry->frame_idx = map->frame_idx;
+        entry->plane_idx = map->plane_idx;
+        entry->fd = map->fd;
+        entry->size = map->size;
+    }
+    pthread_mutex_unlock(&g_map_cache_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_cache_park
+ *
+ * DESCRIPTION: handle an unmap request of the client
+ *
+ * PARAMETERS :
+ *   @cache      : mapping cache
+ *   @stream_hdl : stream handle
+ *   @buf_type   : mapping buffer type
+ *   @frame_idx  : buffer index
+ *   @plane_idx  : plane index, -1 for all planes
+ *
+ * RETURN     : TRUE if the mapping is kept and nothing has to be sent
+ *==========================================================================*/
+uint8_t mm_camera_map_cache_park(mm_camera_map_cache_t *cache,
+        uint32_t stream_hdl, uint8_t buf_type, uint32_t frame_idx,
+        int32_t plane_idx)
+{
+    uint8_t parked = FALSE;
+    mm_camera_map_entry_t *entry;
+
+    pthread_mutex_lock(&g_map_cache_lock);
+    entry = mm_camera_map_cache_find(cache, stream_hdl, buf_type, frame_idx,
+            plane_idx);
+    if (NULL != entry) {
+        if (cache->enabled && (MM_CAMERA_MAP_ACTIVE == entry->state)) {
+            entry->state = MM_CAMERA_MAP_PARKED;
+            cache->parked++;
+            parked = TRUE;
+        } else {
+            entry->state = MM_CAMERA_MAP_FREE;
+        }
+    }
+    pthread_mutex_unlock(&g_map_cache_lock);
+    return parked;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_cache_release_stream
+ *
+ * DESCRIPTION: collect the mappings a stream still holds at the server
+ *
+ * PARAMETERS :
+ *   @cache      : mapping cache
+ *   @stream_hdl : stream handle
+ *   @unmaps     : unmap list to fill. Called again until it comes back
+ *                 empty if the stream holds more than one list.
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_map_cache_release_stream(mm_camera_map_cache_t *cache,
+        uint32_t stream_hdl, cam_buf_unmap_type_list *unmaps)
+{
+    uint32_t i;
+    mm_camera_map_entry_t *entry;
+
+    unmaps->length = 0;
+    pthread_mutex_lock(&g_map_cache_lock);
+    for (i = 0; i < MM_CAMERA_MAP_CACHE_SIZE; i++) {
+        entry = &cache->entries[i];
+        if ((MM_CAMERA_MAP_FREE == entry->state) ||
+                (entry->stream_hdl != stream_hdl)) {
+            continue;
+        }
+        if (MM_CAMERA_MAP_ACTIVE == entry->state) {
+            /* still owned by the client, it sends the unmap itself */
+            entry->state = MM_CAMERA_MAP_FREE;
+        } else if (!mm_camera_map_cache_add_unmap(entry, unmaps)) {
+            break;
+        }
+    }
+    cache->flushed += unmaps->length;
+    pthread_mutex_unlock(&g_map_cache_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_map_cache_dump
+ *
+ * DESCRIPTION: print the mapping cache counters
+ *
+ * PARAMETERS :
+ *   @cache      : mapping cache
+ *   @fd         : output fd
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_map_cache_dump(mm_camera_map_cache_t *cache, int fd)
+{
+    uint32_t i, parked = 0;
+
+    pthread_mutex_lock(&g_map_cache_lock);
+    for (i = 0; i < MM_CAMERA_MAP_CACHE_SIZE; i++) {
+        if (MM_CAMERA_MAP_ACTIVE < cache->entries[i].state) {
+            parked++;
+        }
+    }
+    dprintf(fd, "\n Buffer mapping cache: %s, %u hits, %u misses,"
+            " %u unmaps deferred, %u flushed, %u held\n",
+            cache->enabled ? "on" : "off", cache->hits, cache->misses,
+            cache->parked, cache->flushed, parked);
+    pthread_mutex_unlock(&g_map_cache_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_invalidate_buf_mapping
+ *
+ * DESCRIPTION: forget every mapping of a buffer that is about to be freed.
+ *              Parked mappings are unmapped with the next map or release of
+ *              their stream.
+ *
+ * PARAMETERS :
+ *   @fd         : fd of the buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_invalidate_buf_mapping(int32_t fd)
+{
+    uint32_t i;
+    mm_camera_map_cache_t *cache;
+    mm_camera_map_entry_t *entry;
+
+    pthread_mutex_lock(&g_map_cache_lock);
+    for (cache = g_map_caches; NULL != cache; cache = cache->next) {
+        for (i = 0; i < MM_CAMERA_MAP_CACHE_SIZE; i++) {
+            entry = &cache->entries[i];
+            if (entry->fd != fd) {
+                continue;
+            }
+            if (MM_CAMERA_MAP_PARKED == entry->state) {
+                entry->state = MM_CAMERA_MAP_STALE;
+            } else if (MM_CAMERA_MAP_ACTIVE == entry->state) {
+                entry->state = MM_CAMERA_MAP_FREE;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_map_cache_lock);
+}
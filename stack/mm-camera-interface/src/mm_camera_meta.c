@@ -0,0 +1,630 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+#include "mm_camera.h"
+
+/* Sparse access to metadata_buffer_t.
+ *
+ * The buffer is a flat struct with room for every parameter the server knows,
+ * a few hundred kilobytes, while a request or a result carries a few dozen
+ * of them. The entries below give offset and size of every parameter, so a
+ * copy or a serialized form only touches the valid ones. The layout itself
+ * is shared with the server and stays as it is.
+ *
+ * The compact form is a mm_camera_meta_blob_hdr_t followed by, for every
+ * valid entry, a mm_camera_meta_blob_entry_t and the entry data. The debug
+ * blocks after the data table are encoded with the ids of meta_extras. */
+
+#define MM_CAMERA_META_MAGIC   0x4154454d /* "META" */
+#define MM_CAMERA_META_VERSION 1
+
+typedef struct {
+    uint32_t offset; /* from the start of metadata_buffer_t */
+    uint32_t size;   /* 0 if the id has no storage */
+} mm_camera_meta_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+} mm_camera_meta_blob_hdr_t;
+
+typedef struct {
+    uint16_t id;
+    uint16_t reserved;
+    uint32_t size;
+} mm_camera_meta_blob_entry_t;
+
+#define MM_CAMERA_META_ENTRY(ID) \
+    [ID] = { (uint32_t)(offsetof(metadata_buffer_t, data) + \
+                 offsetof(metadata_data_t, member_variable_##ID)), \
+             (uint32_t)sizeof(((metadata_data_t *)0)->member_variable_##ID) }
+
+/* generated from the INCLUDE() list of metadata_data_t in cam_intf.h,
+ * keep both in sync */
+static const mm_camera_meta_entry_t meta_entries[CAM_INTF_PARM_MAX] = {
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_HISTOGRAM),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_FACE_DETECTION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AUTOFOCUS_DATA),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_UPDATE_DEBUG_LEVEL),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_CROP_DATA),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_PREP_SNAPSHOT_DONE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_GOOD_FRAME_IDX_RANGE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_ASD_HDR_SCENE_DATA),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_ASD_SCENE_TYPE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_CURRENT_SCENE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AWB_INFO),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_FOCUS_POSITION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_CHROMATIX_LITE_ISP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_CHROMATIX_LITE_PP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_CHROMATIX_LITE_AE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_CHROMATIX_LITE_AWB),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_CHROMATIX_LITE_AF),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_CHROMATIX_LITE_ASD),
+    MM_CAMERA_META_ENTRY(CAM_INTF_BUF_DIVERT_INFO),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_FRAME_NUMBER_VALID),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_URGENT_FRAME_NUMBER_VALID),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_FRAME_DROPPED),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_FRAME_NUMBER),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_URGENT_FRAME_NUMBER),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_COLOR_CORRECT_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_COLOR_CORRECT_TRANSFORM),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_COLOR_CORRECT_GAINS),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_PRED_COLOR_CORRECT_TRANSFORM),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_PRED_COLOR_CORRECT_GAINS),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AEC_ROI),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AEC_STATE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_FOCUS_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_MANUAL_FOCUS_POS),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AF_ROI),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AF_STATE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_WHITE_BALANCE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AWB_REGIONS),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AWB_STATE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_BLACK_LEVEL_LOCK),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_EDGE_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_FLASH_POWER),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_FLASH_FIRING_TIME),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_FLASH_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_FLASH_STATE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_HOTPIXEL_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_LENS_APERTURE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_LENS_FILTERDENSITY),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_LENS_FOCAL_LENGTH),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_LENS_FOCUS_DISTANCE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_LENS_FOCUS_RANGE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_LENS_STATE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_LENS_OPT_STAB_MODE),
+    /* CAM_INTF_META_LENS_FOCUS_STATE has storage but no id */
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_NOISE_REDUCTION_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_NOISE_REDUCTION_STRENGTH),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SCALER_CROP_REGION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SCENE_FLICKER),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SENSOR_EXPOSURE_TIME),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SENSOR_FRAME_DURATION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SENSOR_SENSITIVITY),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SENSOR_TIMESTAMP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SENSOR_ROLLING_SHUTTER_SKEW),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SHADING_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_STATS_FACEDETECT_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_STATS_HISTOGRAM_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_STATS_SHARPNESS_MAP_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_STATS_SHARPNESS_MAP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_TONEMAP_CURVES),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_LENS_SHADING_MAP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AEC_INFO),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SENSOR_INFO),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_EXIF_DEBUG_AE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_EXIF_DEBUG_AWB),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_EXIF_DEBUG_AF),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_EXIF_DEBUG_ASD),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_EXIF_DEBUG_STATS),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_ASD_SCENE_CAPTURE_TYPE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_EFFECT),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_PRIVATE_DATA),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_HAL_VERSION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_ANTIBANDING),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_EXPOSURE_COMPENSATION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_EV_STEP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_AEC_LOCK),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_FPS_RANGE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_AWB_LOCK),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_BESTSHOT_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_DIS_ENABLE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_LED_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_LED_MODE_OVERRIDE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_RELATED_SENSORS_CALIBRATION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AF_FOCAL_LENGTH_RATIO),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SNAP_CROP_INFO_SENSOR),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SNAP_CROP_INFO_CAMIF),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SNAP_CROP_INFO_ISP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SNAP_CROP_INFO_CPP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_DCRF),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_TEST_DUALLED_VALUE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_QUERY_FLASH4SNAP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_EXPOSURE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_SHARPNESS),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_CONTRAST),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_SATURATION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_BRIGHTNESS),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_ISO),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_EXPOSURE_TIME),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_ZOOM),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_ROLLOFF),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_AEC_ALGO_TYPE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_FOCUS_ALGO_TYPE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_AEC_ROI),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_AF_ROI),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_SCE_FACTOR),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_FD),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_MCE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_HFR),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_REDEYE_REDUCTION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_WAVELET_DENOISE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_TEMPORAL_DENOISE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_HISTOGRAM),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_ASD_ENABLE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_RECORDING_HINT),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_HDR),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_FRAMESKIP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_ZSL_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_HDR_NEED_1X),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_LOCK_CAF),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_VIDEO_HDR),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_SENSOR_HDR),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_VT),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_SET_AUTOFOCUSTUNING),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_SET_VFE_COMMAND),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_SET_PP_COMMAND),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_MAX_DIMENSION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_RAW_DIMENSION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_TINTLESS),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_WB_MANUAL),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_CDS_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_EZTUNE_CMD),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_INT_EVT),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_RDI_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_BURST_NUM),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_RETRO_BURST_NUM),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_BURST_LED_ON_PERIOD),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_LONGSHOT_ENABLE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_TONE_MAP_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_DUAL_LED_CALIBRATION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_STREAM_INFO),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AEC_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AEC_PRECAPTURE_TRIGGER),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_AF_TRIGGER),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_CAPTURE_INTENT),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_DEMOSAIC),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SHARPNESS_STRENGTH),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_GEOMETRIC_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_GEOMETRIC_STRENGTH),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_LENS_SHADING_MAP_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_SHADING_STRENGTH),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_TONEMAP_MODE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_STREAM_ID),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_STATS_DEBUG_MASK),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_STATS_AF_PAAF),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_FOCUS_BRACKETING),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_FLASH_BRACKETING),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_JPEG_GPS_COORDINATES),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_JPEG_GPS_PROC_METHODS),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_JPEG_GPS_TIMESTAMP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_JPEG_ORIENTATION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_JPEG_QUALITY),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_JPEG_THUMB_QUALITY),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_JPEG_THUMB_SIZE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_TEST_PATTERN_DATA),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_PROFILE_TONE_CURVE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_OTP_WB_GRGB),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_IMG_HYST_INFO),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_CAC_INFO),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_CAC),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_NEUTRAL_COL_POINT),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_ROTATION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_HW_DATA_OVERWRITE),
+    MM_CAMERA_META_ENTRY(CAM_INTF_META_IMGLIB),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_CAPTURE_FRAME_CONFIG),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_CUSTOM),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_FLIP),
+    MM_CAMERA_META_ENTRY(CAM_INTF_AF_STATE_TRANSITION),
+    MM_CAMERA_META_ENTRY(CAM_INTF_PARM_INSTANT_AEC),
+};
+
+/* blocks with their own valid flag after the data table */
+#define MM_CAMERA_META_EXTRA(FLAG, DATA) \
+    { offsetof(metadata_buffer_t, FLAG), offsetof(metadata_buffer_t, DATA), \
+      sizeof(((metadata_buffer_t *)0)->DATA) }
+
+static const struct {
+    uint32_t flag_offset;
+    uint32_t offset;
+    uint32_t size;
+} meta_extras[] = {
+    MM_CAMERA_META_EXTRA(is_tuning_params_valid, tuning_params),
+    MM_CAMERA_META_EXTRA(is_mobicat_aec_params_valid, mobicat_aec_params),
+    MM_CAMERA_META_EXTRA(is_statsdebug_ae_params_valid, statsdebug_ae_data),
+    MM_CAMERA_META_EXTRA(is_statsdebug_awb_params_valid, statsdebug_awb_data),
+    MM_CAMERA_META_EXTRA(is_statsdebug_af_params_valid, statsdebug_af_data),
+    MM_CAMERA_META_EXTRA(is_statsdebug_asd_params_valid, statsdebug_asd_data),
+    MM_CAMERA_META_EXTRA(is_statsdebug_stats_params_valid,
+            statsdebug_stats_buffer_data),
+};
+
+#define MM_CAMERA_META_NUM_EXTRAS (sizeof(meta_extras) / sizeof(meta_extras[0]))
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_meta_get_valid
+ *
+ * DESCRIPTION: build the valid index of a metadata buffer. The flags are
+ *              read a word at a time, so a sparse buffer costs
+ *              CAM_INTF_PARM_MAX / 8 loads.
+ *
+ * PARAMETERS :
+ *   @meta    : metadata buffer
+ *   @valid   : output valid index
+ *
+ * RETURN     : number of valid entries
+ *==========================================================================*/
+uint32_t mm_camera_meta_get_valid(const metadata_buffer_t *meta,
+        mm_camera_meta_valid_t *valid)
+{
+    uint32_t base, i;
+    uint64_t word;
+
+    memset(valid, 0, sizeof(*valid));
+    for (base = 0; base < CAM_INTF_PARM_MAX; base += sizeof(word)) {
+        if (base + sizeof(word) <= CAM_INTF_PARM_MAX) {
+            memcpy(&word, &meta->is_valid[base], sizeof(word));
+            if (0 == word) {
+                continue;
+            }
+        }
+        for (i = base; (i < base + sizeof(word)) && (i < CAM_INTF_PARM_MAX);
+                i++) {
+            if (meta->is_valid[i]) {
+                valid->bits[i / 64] |= (uint64_t)1 << (i % 64);
+                valid->count++;
+            }
+        }
+    }
+    return valid->count;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_meta_has_valid
+ *
+ * DESCRIPTION: check if any entry of a metadata buffer is valid
+ *
+ * PARAMETERS :
+ *   @meta    : metadata buffer
+ *
+ * RETURN     : TRUE if at least one entry is valid
+ *==========================================================================*/
+uint8_t mm_camera_meta_has_valid(const metadata_buffer_t *meta)
+{
+    uint32_t base;
+    uint64_t word;
+
+    for (base = 0; base + sizeof(word) <= CAM_INTF_PARM_MAX;
+            base += sizeof(word)) {
+        memcpy(&word, &meta->is_valid[base], sizeof(word));
+        if (0 != word) {
+            return TRUE;
+        }
+    }
+    for (; base < CAM_INTF_PARM_MAX; base++) {
+        if (meta->is_valid[base]) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_meta_next_valid
+ *
+ * DESCRIPTION: iterate a valid index
+ *
+ * PARAMETERS :
+ *   @valid   : valid index
+ *   @id      : previous id, -1 to start
+ *
+ * RETURN     : next valid id after @id, -1 at the end
+ *==========================================================================*/
+int32_t mm_camera_meta_next_valid(const mm_camera_meta_valid_t *valid,
+        int32_t id)
+{
+    uint32_t next = (uint32_t)(id + 1);
+    uint32_t w;
+    uint64_t bits;
+
+    while (next < CAM_INTF_PARM_MAX) {
+        w = next / 64;
+        bits = valid->bits[w] >> (next % 64);
+        if (0 != bits) {
+            return (int32_t)(next + (uint32_t)__builtin_ctzll(bits));
+        }
+        next = (w + 1) * 64;
+    }
+    return -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_meta_entry
+ *
+ * DESCRIPTION: get the storage of a parameter by id
+ *
+ * PARAMETERS :
+ *   @meta    : metadata buffer
+ *   @id      : parameter id
+ *   @size    : output size of the storage, could be NULL
+ *
+ * RETURN     : pointer to the storage, NULL if the id has none
+ *==========================================================================*/
+void *mm_camera_meta_entry(metadata_buffer_t *meta, uint32_t id, size_t *size)
+{
+    if ((id >= CAM_INTF_PARM_MAX) || (0 == meta_entries[id].size)) {
+        return NULL;
+    }
+    if (NULL != size) {
+        *size = meta_entries[id].size;
+    }
+    return (uint8_t *)meta + meta_entries[id].offset;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_meta_copy
+ *
+ * DESCRIPTION: copy the valid entries of a metadata buffer. Entries not
+ *              valid in @src are left invalid in @dst.
+ *
+ * PARAMETERS :
+ *   @dst     : destination metadata buffer
+ *   @src     : source metadata buffer
+ *
+ * RETURN     : number of bytes copied
+ *==========================================================================*/
+size_t mm_camera_meta_copy(metadata_buffer_t *dst,
+        const metadata_buffer_t *src)
+{
+    mm_camera_meta_valid_t valid;
+    const mm_camera_meta_entry_t *entry;
+    size_t copied = 0;
+    uint32_t i;
+    int32_t id = -1;
+
+    if (dst == src) {
+        return 0;
+    }
+    mm_camera_meta_get_valid(src, &valid);
+    clear_metadata_buffer(dst);
+    while ((id = mm_camera_meta_next_valid(&valid, id)) >= 0) {
+        entry = &meta_entries[id];
+        dst->is_valid[id] = 1;
+        if (entry->size > 0) {
+            memcpy((uint8_t *)dst + entry->offset,
+                    (const uint8_t *)src + entry->offset, entry->size);
+            copied += entry->size;
+        }
+    }
+    for (i = 0; i < MM_CAMERA_META_NUM_EXTRAS; i++) {
+        if (*((const uint8_t *)src + meta_extras[i].flag_offset)) {
+            *((uint8_t *)dst + meta_extras[i].flag_offset) = 1;
+            memcpy((uint8_t *)dst + meta_extras[i].offset,
+                    (const uint8_t *)src + meta_extras[i].offset,
+                    meta_extras[i].size);
+            copied += meta_extras[i].size;
+        }
+    }
+    return copied;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_meta_encoded_size
+ *
+ * DESCRIPTION: size of the compact form of a metadata buffer
+ *
+ * PARAMETERS :
+ *   @meta    : metadata buffer
+ *
+ * RETURN     : number of bytes mm_camera_meta_encode needs
+ *==========================================================================*/
+size_t mm_camera_meta_encoded_size(const metadata_buffer_t *meta)
+{
+    mm_camera_meta_valid_t valid;
+    size_t len = sizeof(mm_camera_meta_blob_hdr_t);
+    uint32_t i;
+    int32_t id = -1;
+
+    mm_camera_meta_get_valid(meta, &valid);
+    while ((id = mm_camera_meta_next_valid(&valid, id)) >= 0) {
+        len += sizeof(mm_camera_meta_blob_entry_t) + meta_entries[id].size;
+    }
+    for (i = 0; i < MM_CAMERA_META_NUM_EXTRAS; i++) {
+        if (*((const uint8_t *)meta + meta_extras[i].flag_offset)) {
+            len += sizeof(mm_camera_meta_blob_entry_t) + meta_extras[i].size;
+        }
+    }
+    return len;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_meta_put
+ *
+ * DESCRIPTION: append one entry to a compact form
+ *
+ * PARAMETERS :
+ *   @out     : compact form
+ *   @pos     : write position, advanced past the entry
+ *   @id      : id of the entry
+ *   @data    : entry data
+ *   @size    : size of the entry data
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_meta_put(uint8_t *out, size_t *pos, uint32_t id,
+        const void *data, uint32_t size)
+{
+    mm_camera_meta_blob_entry_t blob;
+
+    blob.id = (uint16_t)id;
+    blob.reserved = 0;
+    blob.size = size;
+    memcpy(out + *pos, &blob, sizeof(blob));
+    *pos += sizeof(blob);
+    memcpy(out + *pos, data, size);
+    *pos += size;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_meta_encode
+ *
+ * DESCRIPTION: serialize the valid entries of a metadata buffer
+ *
+ * PARAMETERS :
+ *   @meta    : metadata buffer
+ *   @buf     : output buffer
+ *   @len     : size of @buf
+ *
+ * RETURN     : number of bytes written, 0 if @buf is too small
+ *==========================================================================*/
+size_t mm_camera_meta_encode(const metadata_buffer_t *meta, void *buf,
+        size_t len)
+{
+    mm_camera_meta_valid_t valid;
+    mm_camera_meta_blob_hdr_t hdr;
+    const uint8_t *src = (const uint8_t *)meta;
+    uint8_t *out = (uint8_t *)buf;
+    size_t pos = sizeof(hdr);
+    uint32_t i;
+    int32_t id = -1;
+
+    if (len < mm_camera_meta_encoded_size(meta)) {
+        CDBG_ERROR("%s: buffer of %zu bytes too small", __func__, len);
+        return 0;
+    }
+
+    hdr.magic = MM_CAMERA_META_MAGIC;
+    hdr.version = MM_CAMERA_META_VERSION;
+    hdr.count = 0;
+    mm_camera_meta_get_valid(meta, &valid);
+    while ((id = mm_camera_meta_next_valid(&valid, id)) >= 0) {
+        mm_camera_meta_put(out, &pos, (uint32_t)id,
+                src + meta_entries[id].offset, meta_entries[id].size);
+        hdr.count++;
+    }
+    for (i = 0; i < MM_CAMERA_META_NUM_EXTRAS; i++) {
+        if (src[meta_extras[i].flag_offset]) {
+            mm_camera_meta_put(out, &pos, CAM_INTF_PARM_MAX + i,
+                    src + meta_extras[i].offset, meta_extras[i].size);
+            hdr.count++;
+        }
+    }
+    memcpy(out, &hdr, sizeof(hdr));
+    return pos;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_meta_decode
+ *
+ * DESCRIPTION: rebuild a metadata buffer from its compact form. Entries not
+ *              in the compact form are left invalid.
+ *
+ * PARAMETERS :
+ *   @buf     : compact form
+ *   @len     : size of @buf
+ *   @meta    : output metadata buffer
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- malformed or unknown compact form
+ *==========================================================================*/
+int32_t mm_camera_meta_decode(const void *buf, size_t len,
+        metadata_buffer_t *meta)
+{
+    const uint8_t *in = (const uint8_t *)buf;
+    mm_camera_meta_blob_hdr_t hdr;
+    mm_camera_meta_blob_entry_t blob;
+    size_t pos = sizeof(hdr);
+    uint32_t i, extra;
+
+    if (len < sizeof(hdr)) {
+        return -1;
+    }
+    memcpy(&hdr, in, sizeof(hdr));
+    if ((MM_CAMERA_META_MAGIC != hdr.magic) ||
+            (MM_CAMERA_META_VERSION != hdr.version)) {
+        CDBG_ERROR("%s: unknown blob 0x%x version %d",
+                __func__, hdr.magic, hdr.version);
+        return -1;
+    }
+
+    clear_metadata_buffer(meta);
+    for (i = 0; i < hdr.count; i++) {
+        if (len - pos < sizeof(blob)) {
+            return -1;
+        }
+        memcpy(&blob, in + pos, sizeof(blob));
+        pos += sizeof(blob);
+        if (len - pos < blob.size) {
+            return -1;
+        }
+        if (blob.id < CAM_INTF_PARM_MAX) {
+            if (blob.size != meta_entries[blob.id].size) {
+                CDBG_ERROR("%s: size %d of id %d does not match %d",
+                        __func__, blob.size, blob.id,
+                        meta_entries[blob.id].size);
+                return -1;
+            }
+            memcpy((uint8_t *)meta + meta_entries[blob.id].offset,
+                    in + pos, blob.size);
+            meta->is_valid[blob.id] = 1;
+        } else {
+            extra = (uint32_t)(blob.id - CAM_INTF_PARM_MAX);
+            if ((extra >= MM_CAMERA_META_NUM_EXTRAS) ||
+                    (blob.size != meta_extras[extra].size)) {
+                return -1;
+            }
+            memcpy((uint8_t *)meta + meta_extras[extra].offset,
+                    in + pos, blob.size);
+            *((uint8_t *)meta + meta_extras[extra].flag_offset) = 1;
+        }
+        pos += blob.size;
+    }
+    return 0;
+}
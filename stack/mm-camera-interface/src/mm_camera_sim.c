@@ -0,0 +1,1278 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <cutils/properties.h>
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+#include "mm_camera.h"
+#include "mm_camera_sim.h"
+
+#define MM_CAMERA_SIM_MAX_FDS 64
+#define MM_CAMERA_SIM_EVT_QUEUE_SIZE 16
+#define MM_CAMERA_SIM_DEFAULT_FPS 30
+#define MM_CAMERA_SIM_DEFAULT_DIR QCAMERA_DUMP_FRM_LOCATION"sim"
+#define MM_CAMERA_SIM_PATH_LEN 128
+
+typedef enum {
+    MM_CAMERA_SIM_FD_CTRL,
+    MM_CAMERA_SIM_FD_STREAM,
+    MM_CAMERA_SIM_FD_SOCK,
+} mm_camera_sim_fd_type_t;
+
+typedef struct {
+    void *vaddr;
+    size_t size;
+} mm_camera_sim_map_t;
+
+typedef struct {
+    mm_camera_sim_map_t planes[VIDEO_MAX_PLANES];
+    uint32_t sequence;
+    uint64_t ready_ns;
+    uint64_t dq_ns;
+} mm_camera_sim_buf_t;
+
+/* fixed size FIFO of buffer indexes */
+typedef struct {
+    uint8_t idx[MM_CAMERA_MAX_NUM_FRAMES];
+    uint32_t head;
+    uint32_t count;
+} mm_camera_sim_fifo_t;
+
+struct mm_camera_sim_cam;
+
+typedef struct {
+    int fd;
+    uint32_t server_stream_id;
+    struct mm_camera_sim_cam *cam;
+    mm_camera_sim_map_t info;
+    mm_camera_sim_buf_t bufs[MM_CAMERA_MAX_NUM_FRAMES];
+    uint32_t num_bufs;
+    mm_camera_sim_fifo_t free_q;  /* queued by QBUF, waiting for a frame */
+    mm_camera_sim_fifo_t done_q;  /* filled, waiting for DQBUF */
+    int replay_fd;
+    uint32_t frame_id;
+    uint8_t streaming;
+    pthread_t pid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    mm_camera_sim_stream_stats_t stats;
+} mm_camera_sim_stream_t;
+
+typedef struct mm_camera_sim_cam {
+    uint8_t cam_idx;
+    int ctrl_fd;
+    mm_camera_sim_map_t caps;
+    mm_camera_sim_stream_t *streams[MM_CAMERA_SIM_MAX_STREAMS];
+    uint32_t next_stream_id;
+    /* pending MSM_CAMERA_MSM_NOTIFY events for the ctrl fd */
+    pthread_mutex_t evt_lock;
+    uint32_t evt_cmd[MM_CAMERA_SIM_EVT_QUEUE_SIZE];
+    uint32_t evt_status[MM_CAMERA_SIM_EVT_QUEUE_SIZE];
+    uint32_t evt_head;
+    uint32_t evt_count;
+} mm_camera_sim_cam_t;
+
+typedef struct {
+    int fd;
+    mm_camera_sim_fd_type_t type;
+    void *obj;
+} mm_camera_sim_fd_t;
+
+typedef struct {
+    uint8_t probed;
+    uint8_t enabled;
+    uint8_t num_cameras;
+    uint32_t fps;
+    char dir[MM_CAMERA_SIM_PATH_LEN];
+    mm_camera_sim_fd_t fds[MM_CAMERA_SIM_MAX_FDS];
+    mm_camera_sim_cam_t cams[MM_CAMERA_MAX_NUM_SENSORS];
+} mm_camera_sim_t;
+
+static pthread_mutex_t g_sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static mm_camera_sim_t g_sim;
+
+static const char *g_sim_stream_names[CAM_STREAM_TYPE_MAX] = {
+    "default", "preview", "postview", "snapshot", "video", "impl_defined",
+    "metadata", "raw", "offline_proc", "parm", "analysis", "callback"
+};
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_now_ns
+ *
+ * DESCRIPTION: monotonic clock in nanoseconds
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : current time
+ *==========================================================================*/
+static uint64_t mm_camera_sim_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_fifo_push / mm_camera_sim_fifo_pop
+ *
+ * DESCRIPTION: buffer index FIFO helpers, caller holds the stream lock
+ *
+ * PARAMETERS :
+ *   @fifo    : FIFO
+ *   @idx     : buffer index to push
+ *
+ * RETURN     : push: 0 on success, -1 if full
+ *              pop : buffer index, -1 if empty
+ *==========================================================================*/
+static int32_t mm_camera_sim_fifo_push(mm_camera_sim_fifo_t *fifo, uint8_t idx)
+{
+    if (MM_CAMERA_MAX_NUM_FRAMES <= fifo->count) {
+        return -1;
+    }
+    fifo->idx[(fifo->head + fifo->count) % MM_CAMERA_MAX_NUM_FRAMES] = idx;
+    fifo->count++;
+    return 0;
+}
+
+static int32_t mm_camera_sim_fifo_pop(mm_camera_sim_fifo_t *fifo)
+{
+    int32_t idx;
+    if (0 == fifo->count) {
+        return -1;
+    }
+    idx = fifo->idx[fifo->head];
+    fifo->head = (fifo->head + 1) % MM_CAMERA_MAX_NUM_FRAMES;
+    fifo->count--;
+    return idx;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_probe
+ *
+ * DESCRIPTION: read the sim properties once. Caller holds g_sim_lock.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_probe(void)
+{
+    char prop[PROPERTY_VALUE_MAX];
+    int val;
+    uint8_t i;
+
+    if (g_sim.probed) {
+        return;
+    }
+    for (i = 0; i < MM_CAMERA_SIM_MAX_FDS; i++) {
+        g_sim.fds[i].fd = -1;
+    }
+    for (i = 0; i < MM_CAMERA_MAX_NUM_SENSORS; i++) {
+        g_sim.cams[i].cam_idx = i;
+        g_sim.cams[i].ctrl_fd = -1;
+        pthread_mutex_init(&g_sim.cams[i].evt_lock, NULL);
+    }
+
+    property_get("persist.camera.sim.enable", prop, "0");
+    g_sim.enabled = (atoi(prop) > 0) ? 1 : 0;
+    property_get("persist.camera.sim.fps", prop, "30");
+    val = atoi(prop);
+    g_sim.fps = (val > 0) ? (uint32_t)val : MM_CAMERA_SIM_DEFAULT_FPS;
+    property_get("persist.camera.sim.num_cameras", prop, "1");
+    val = atoi(prop);
+    if (val <= 0) {
+        val = 1;
+    } else if (val > MM_CAMERA_MAX_NUM_SENSORS) {
+        val = MM_CAMERA_MAX_NUM_SENSORS;
+    }
+    g_sim.num_cameras = (uint8_t)val;
+    property_get("persist.camera.sim.dir", prop, MM_CAMERA_SIM_DEFAULT_DIR);
+    strlcpy(g_sim.dir, prop, sizeof(g_sim.dir));
+    g_sim.probed = 1;
+
+    if (g_sim.enabled) {
+        CDBG_HIGH("%s: replay backend on, %d cameras at %u fps from %s",
+                __func__, g_sim.num_cameras, g_sim.fps, g_sim.dir);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_configure
+ *
+ * DESCRIPTION: enable the replay backend programmatically, overriding the
+ *              persist.camera.sim.* properties. Must be called before the
+ *              first camera is opened.
+ *
+ * PARAMETERS :
+ *   @replay_dir  : directory holding the replay files, NULL keeps default
+ *   @fps         : frame rate of every stream, 0 keeps default
+ *   @num_cameras : number of cameras to expose, 0 keeps default
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_sim_configure(const char *replay_dir, uint32_t fps,
+        uint8_t num_cameras)
+{
+    pthread_mutex_lock(&g_sim_lock);
+    mm_camera_sim_probe();
+    if (NULL != replay_dir) {
+        strlcpy(g_sim.dir, replay_dir, sizeof(g_sim.dir));
+    }
+    if (0 < fps) {
+        g_sim.fps = fps;
+    }
+    if (0 < num_cameras) {
+        g_sim.num_cameras = (num_cameras > MM_CAMERA_MAX_NUM_SENSORS) ?
+                MM_CAMERA_MAX_NUM_SENSORS : num_cameras;
+    }
+    g_sim.enabled = 1;
+    pthread_mutex_unlock(&g_sim_lock);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_enabled
+ *
+ * DESCRIPTION: whether the replay backend replaces the camera devices
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : 1 if enabled, 0 otherwise
+ *==========================================================================*/
+uint8_t mm_camera_sim_enabled(void)
+{
+    uint8_t enabled;
+    pthread_mutex_lock(&g_sim_lock);
+    mm_camera_sim_probe();
+    enabled = g_sim.enabled;
+    pthread_mutex_unlock(&g_sim_lock);
+    return enabled;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_get_num_of_cameras
+ *
+ * DESCRIPTION: number of simulated cameras, exposed as /dev/video0..N-1
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : number of cameras
+ *==========================================================================*/
+uint8_t mm_camera_sim_get_num_of_cameras(void)
+{
+    uint8_t num;
+    pthread_mutex_lock(&g_sim_lock);
+    mm_camera_sim_probe();
+    num = g_sim.num_cameras;
+    pthread_mutex_unlock(&g_sim_lock);
+    return num;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_lookup
+ *
+ * DESCRIPTION: find the sim object behind a fd
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor
+ *   @type    : expected fd type
+ *
+ * RETURN     : object ptr, NULL if the fd does not belong to the sim
+ *==========================================================================*/
+static void *mm_camera_sim_lookup(int fd, mm_camera_sim_fd_type_t type)
+{
+    void *obj = NULL;
+    uint32_t i;
+
+    pthread_mutex_lock(&g_sim_lock);
+    for (i = 0; i < MM_CAMERA_SIM_MAX_FDS; i++) {
+        if ((fd == g_sim.fds[i].fd) && (type == g_sim.fds[i].type)) {
+            obj = g_sim.fds[i].obj;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_sim_lock);
+    return obj;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_owns_fd
+ *
+ * DESCRIPTION: whether a fd was handed out by the replay backend
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor
+ *
+ * RETURN     : 1 if owned, 0 otherwise
+ *==========================================================================*/
+uint8_t mm_camera_sim_owns_fd(int fd)
+{
+    uint8_t owned = 0;
+    uint32_t i;
+
+    if (0 > fd) {
+        return 0;
+    }
+    pthread_mutex_lock(&g_sim_lock);
+    if (g_sim.enabled) {
+        for (i = 0; i < MM_CAMERA_SIM_MAX_FDS; i++) {
+            if (fd == g_sim.fds[i].fd) {
+                owned = 1;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_sim_lock);
+    return owned;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_add_fd
+ *
+ * DESCRIPTION: create an eventfd standing in for a device node or socket
+ *              and register it. Caller holds g_sim_lock.
+ *
+ * PARAMETERS :
+ *   @type    : fd type
+ *   @obj     : object behind the fd
+ *
+ * RETURN     : fd, -1 on failure
+ *==========================================================================*/
+static int mm_camera_sim_add_fd(mm_camera_sim_fd_type_t type, void *obj)
+{
+    uint32_t i;
+    int fd;
+
+    for (i = 0; i < MM_CAMERA_SIM_MAX_FDS; i++) {
+        if (0 > g_sim.fds[i].fd) {
+            break;
+        }
+    }
+    if (MM_CAMERA_SIM_MAX_FDS == i) {
+        CDBG_ERROR("%s: out of sim fds", __func__);
+        errno = EMFILE;
+        return -1;
+    }
+    /* one count per pending frame or event, so readiness follows the
+     * queue depth the same way the v4l2 poll does */
+    fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE | EFD_CLOEXEC);
+    if (0 > fd) {
+        CDBG_ERROR("%s: eventfd failed, errno = %d", __func__, errno);
+        return -1;
+    }
+    g_sim.fds[i].fd = fd;
+    g_sim.fds[i].type = type;
+    g_sim.fds[i].obj = obj;
+    return fd;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_remove_fd
+ *
+ * DESCRIPTION: unregister a sim fd. Caller holds g_sim_lock.
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_remove_fd(int fd)
+{
+    uint32_t i;
+    for (i = 0; i < MM_CAMERA_SIM_MAX_FDS; i++) {
+        if (fd == g_sim.fds[i].fd) {
+            g_sim.fds[i].fd = -1;
+            g_sim.fds[i].obj = NULL;
+            break;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_map / mm_camera_sim_unmap
+ *
+ * DESCRIPTION: map a buffer shared by the HAL into the backend, the way
+ *              the daemon does on a mapping message
+ *
+ * PARAMETERS :
+ *   @map     : mapping record
+ *   @fd      : buffer fd
+ *   @size    : buffer size
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_sim_map(mm_camera_sim_map_t *map, int fd, size_t size)
+{
+    void *vaddr;
+
+    if ((0 > fd) || (0 == size)) {
+        return -1;
+    }
+    if (NULL != map->vaddr) {
+        munmap(map->vaddr, map->size);
+        map->vaddr = NULL;
+    }
+    vaddr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == vaddr) {
+        CDBG_ERROR("%s: mmap fd %d size %zu failed, errno = %d",
+                __func__, fd, size, errno);
+        return -1;
+    }
+    map->vaddr = vaddr;
+    map->size = size;
+    return 0;
+}
+
+static void mm_camera_sim_unmap(mm_camera_sim_map_t *map)
+{
+    if (NULL != map->vaddr) {
+        munmap(map->vaddr, map->size);
+    }
+    map->vaddr = NULL;
+    map->size = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_find_stream
+ *
+ * DESCRIPTION: find a stream by server stream id. Caller holds g_sim_lock.
+ *
+ * PARAMETERS :
+ *   @cam       : sim camera
+ *   @stream_id : server stream id
+ *
+ * RETURN     : stream ptr, NULL if not found
+ *==========================================================================*/
+static mm_camera_sim_stream_t *mm_camera_sim_find_stream(
+        mm_camera_sim_cam_t *cam, uint32_t stream_id)
+{
+    uint32_t i;
+    for (i = 0; i < MM_CAMERA_SIM_MAX_STREAMS; i++) {
+        if ((NULL != cam->streams[i]) &&
+                (stream_id == cam->streams[i]->server_stream_id)) {
+            return cam->streams[i];
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_post_evt
+ *
+ * DESCRIPTION: queue a MSM_CAMERA_MSM_NOTIFY event on the ctrl fd
+ *
+ * PARAMETERS :
+ *   @cam     : sim camera
+ *   @command : event command
+ *   @status  : event status
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_post_evt(mm_camera_sim_cam_t *cam,
+        uint32_t command, uint32_t status)
+{
+    uint32_t pos;
+
+    pthread_mutex_lock(&cam->evt_lock);
+    if (MM_CAMERA_SIM_EVT_QUEUE_SIZE <= cam->evt_count) {
+        pthread_mutex_unlock(&cam->evt_lock);
+        CDBG_ERROR("%s: event queue full, dropping cmd %u", __func__, command);
+        return;
+    }
+    pos = (cam->evt_head + cam->evt_count) % MM_CAMERA_SIM_EVT_QUEUE_SIZE;
+    cam->evt_cmd[pos] = command;
+    cam->evt_status[pos] = status;
+    cam->evt_count++;
+    pthread_mutex_unlock(&cam->evt_lock);
+    eventfd_write(cam->ctrl_fd, 1);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_replay_open
+ *
+ * DESCRIPTION: open the replay file of a stream, if there is one
+ *
+ * PARAMETERS :
+ *   @stream  : sim stream
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_replay_open(mm_camera_sim_stream_t *stream)
+{
+    char path[MM_CAMERA_SIM_PATH_LEN + 32];
+    cam_stream_info_t *info = (cam_stream_info_t *)stream->info.vaddr;
+    cam_stream_type_t type = CAM_STREAM_TYPE_DEFAULT;
+
+    if ((NULL != info) && (info->stream_type < CAM_STREAM_TYPE_MAX)) {
+        type = info->stream_type;
+    }
+    stream->stats.stream_type = type;
+    snprintf(path, sizeof(path), "%s/cam%d_%s.bin", g_sim.dir,
+            stream->cam->cam_idx, g_sim_stream_names[type]);
+    stream->replay_fd = open(path, O_RDONLY | O_CLOEXEC);
+    CDBG_HIGH("%s: stream %u replays %s (fd %d)", __func__,
+            stream->server_stream_id, path, stream->replay_fd);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_replay_read
+ *
+ * DESCRIPTION: fill a plane from the replay file, wrapping at EOF
+ *
+ * PARAMETERS :
+ *   @stream  : sim stream
+ *   @dst     : destination
+ *   @len     : bytes to fill
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_replay_read(mm_camera_sim_stream_t *stream,
+        uint8_t *dst, size_t len)
+{
+    size_t filled = 0;
+    uint8_t rewound = 0;
+
+    while (filled < len) {
+        ssize_t n = read(stream->replay_fd, dst + filled, len - filled);
+        if (0 < n) {
+            filled += (size_t)n;
+            rewound = 0;
+        } else if ((0 == n) && !rewound) {
+            lseek(stream->replay_fd, 0, SEEK_SET);
+            rewound = 1;
+        } else if ((0 > n) && (EINTR == errno)) {
+            continue;
+        } else {
+            break;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_produce
+ *
+ * DESCRIPTION: one frame slot: fill the oldest queued buffer and make it
+ *              available to DQBUF. With no buffer queued the slot is
+ *              dropped, same as the ISP does.
+ *
+ * PARAMETERS :
+ *   @stream  : sim stream
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_produce(mm_camera_sim_stream_t *stream)
+{
+    int32_t idx;
+    uint32_t i;
+    mm_camera_sim_buf_t *buf;
+
+    pthread_mutex_lock(&stream->lock);
+    stream->frame_id++;
+    idx = mm_camera_sim_fifo_pop(&stream->free_q);
+    if (0 > idx) {
+        stream->stats.drops++;
+        pthread_mutex_unlock(&stream->lock);
+        return;
+    }
+    pthread_mutex_unlock(&stream->lock);
+
+    /* buffer is owned by the backend until it is on the done queue */
+    buf = &stream->bufs[idx];
+    if (0 <= stream->replay_fd) {
+        for (i = 0; i < VIDEO_MAX_PLANES; i++) {
+            if (NULL != buf->planes[i].vaddr) {
+                mm_camera_sim_replay_read(stream,
+                        (uint8_t *)buf->planes[i].vaddr, buf->planes[i].size);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    buf->sequence = stream->frame_id;
+    buf->ready_ns = mm_camera_sim_now_ns();
+    mm_camera_sim_fifo_push(&stream->done_q, (uint8_t)idx);
+    stream->stats.frames++;
+    pthread_mutex_unlock(&stream->lock);
+    eventfd_write(stream->fd, 1);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_stream_routine
+ *
+ * DESCRIPTION: frame clock of a streaming sim stream
+ *
+ * PARAMETERS :
+ *   @data    : sim stream
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void *mm_camera_sim_stream_routine(void *data)
+{
+    mm_camera_sim_stream_t *stream = (mm_camera_sim_stream_t *)data;
+    uint64_t period_ns = 1000000000ULL / g_sim.fps;
+    uint64_t next_ns = mm_camera_sim_now_ns();
+    struct timespec ts;
+
+    pthread_setname_np(pthread_self(), "CAM_SimStrm");
+    pthread_mutex_lock(&stream->lock);
+    while (stream->streaming) {
+        next_ns += period_ns;
+        ts.tv_sec = (time_t)(next_ns / 1000000000ULL);
+        ts.tv_nsec = (long)(next_ns % 1000000000ULL);
+        while (stream->streaming &&
+                (ETIMEDOUT != pthread_cond_timedwait(&stream->cond,
+                        &stream->lock, &ts))) {
+        }
+        if (!stream->streaming) {
+            break;
+        }
+        pthread_mutex_unlock(&stream->lock);
+        mm_camera_sim_produce(stream);
+        pthread_mutex_lock(&stream->lock);
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_stream_off
+ *
+ * DESCRIPTION: stop the frame clock and take back every buffer, as
+ *              VIDIOC_STREAMOFF does
+ *
+ * PARAMETERS :
+ *   @stream  : sim stream
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_stream_off(mm_camera_sim_stream_t *stream)
+{
+    eventfd_t cnt;
+
+    pthread_mutex_lock(&stream->lock);
+    if (!stream->streaming) {
+        pthread_mutex_unlock(&stream->lock);
+        return;
+    }
+    stream->streaming = 0;
+    pthread_cond_signal(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->pid, NULL);
+
+    pthread_mutex_lock(&stream->lock);
+    memset(&stream->free_q, 0, sizeof(stream->free_q));
+    memset(&stream->done_q, 0, sizeof(stream->done_q));
+    while (0 == eventfd_read(stream->fd, &cnt)) {
+    }
+    pthread_mutex_unlock(&stream->lock);
+    if (0 <= stream->replay_fd) {
+        close(stream->replay_fd);
+        stream->replay_fd = -1;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_stream_ioctl
+ *
+ * DESCRIPTION: v4l2 contract of a stream node
+ *
+ * PARAMETERS :
+ *   @stream  : sim stream
+ *   @request : ioctl request
+ *   @arg     : ioctl argument
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_camera_sim_stream_ioctl(mm_camera_sim_stream_t *stream,
+        unsigned long request, void *arg)
+{
+    int rc = 0;
+    int32_t idx;
+    uint32_t i;
+    uint64_t now;
+    eventfd_t cnt;
+    mm_camera_sim_buf_t *buf;
+    struct v4l2_buffer *vb;
+
+    switch (request) {
+    case VIDIOC_DQBUF:
+        vb = (struct v4l2_buffer *)arg;
+        if (0 != eventfd_read(stream->fd, &cnt)) {
+            errno = EAGAIN;
+            return -1;
+        }
+        pthread_mutex_lock(&stream->lock);
+        idx = mm_camera_sim_fifo_pop(&stream->done_q);
+        if (0 > idx) {
+            pthread_mutex_unlock(&stream->lock);
+            errno = EAGAIN;
+            return -1;
+        }
+        buf = &stream->bufs[idx];
+        now = mm_camera_sim_now_ns();
+        buf->dq_ns = now;
+        stream->stats.dequeued++;
+        stream->stats.dq_lat_sum_ns += now - buf->ready_ns;
+        if (stream->stats.dq_lat_max_ns < now - buf->ready_ns) {
+            stream->stats.dq_lat_max_ns = now - buf->ready_ns;
+        }
+        vb->index = (__u32)idx;
+        vb->sequence = buf->sequence;
+        vb->timestamp.tv_sec = (long)(buf->ready_ns / 1000000000ULL);
+        vb->timestamp.tv_usec = (long)((buf->ready_ns % 1000000000ULL) / 1000);
+        vb->reserved = 0;
+        for (i = 0; (i < vb->length) && (i < VIDEO_MAX_PLANES); i++) {
+            vb->m.planes[i].bytesused = (__u32)buf->planes[i].size;
+        }
+        pthread_mutex_unlock(&stream->lock);
+        break;
+    case VIDIOC_QBUF:
+        vb = (struct v4l2_buffer *)arg;
+        pthread_mutex_lock(&stream->lock);
+        if (vb->index >= stream->num_bufs) {
+            pthread_mutex_unlock(&stream->lock);
+            errno = EINVAL;
+            return -1;
+        }
+        buf = &stream->bufs[vb->index];
+        if (0 != buf->dq_ns) {
+            now = mm_camera_sim_now_ns();
+            stream->stats.returned++;
+            stream->stats.hold_sum_ns += now - buf->dq_ns;
+            if (stream->stats.hold_max_ns < now - buf->dq_ns) {
+                stream->stats.hold_max_ns = now - buf->dq_ns;
+            }
+            buf->dq_ns = 0;
+        }
+        rc = mm_camera_sim_fifo_push(&stream->free_q, (uint8_t)vb->index);
+        pthread_mutex_unlock(&stream->lock);
+        if (0 > rc) {
+            errno = EINVAL;
+        }
+        break;
+    case VIDIOC_REQBUFS:
+        {
+            struct v4l2_requestbuffers *req = (struct v4l2_requestbuffers *)arg;
+            if (req->count > MM_CAMERA_MAX_NUM_FRAMES) {
+                errno = EINVAL;
+                return -1;
+            }
+            pthread_mutex_lock(&stream->lock);
+            stream->num_bufs = req->count;
+            memset(&stream->free_q, 0, sizeof(stream->free_q));
+            memset(&stream->done_q, 0, sizeof(stream->done_q));
+            pthread_mutex_unlock(&stream->lock);
+        }
+        break;
+    case VIDIOC_S_PARM:
+        ((struct v4l2_streamparm *)arg)->parm.capture.extendedmode =
+                stream->server_stream_id;
+        break;
+    case VIDIOC_STREAMON:
+        pthread_mutex_lock(&stream->lock);
+        if (stream->streaming) {
+            pthread_mutex_unlock(&stream->lock);
+            break;
+        }
+        mm_camera_sim_replay_open(stream);
+        stream->streaming = 1;
+        if (0 != pthread_create(&stream->pid, NULL,
+                mm_camera_sim_stream_routine, stream)) {
+            stream->streaming = 0;
+            errno = ENOMEM;
+            rc = -1;
+        }
+        pthread_mutex_unlock(&stream->lock);
+        break;
+    case VIDIOC_STREAMOFF:
+        mm_camera_sim_stream_off(stream);
+        break;
+    default:
+        /* S_FMT, S_CTRL/G_CTRL stream parms: the stream info buffer already
+         * carries everything the backend needs */
+        break;
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_ctrl_ioctl
+ *
+ * DESCRIPTION: v4l2 contract of the camera control node
+ *
+ * PARAMETERS :
+ *   @cam     : sim camera
+ *   @request : ioctl request
+ *   @arg     : ioctl argument
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_camera_sim_ctrl_ioctl(mm_camera_sim_cam_t *cam,
+        unsigned long request, void *arg)
+{
+    char path[MM_CAMERA_SIM_PATH_LEN + 32];
+    eventfd_t cnt;
+    int fd;
+
+    switch (request) {
+    case VIDIOC_DQEVENT:
+        {
+            struct v4l2_event *ev = (struct v4l2_event *)arg;
+            struct msm_v4l2_event_data *msm_evt =
+                    (struct msm_v4l2_event_data *)ev->u.data;
+            if (0 != eventfd_read(cam->ctrl_fd, &cnt)) {
+                errno = ENOENT;
+                return -1;
+            }
+            pthread_mutex_lock(&cam->evt_lock);
+            if (0 == cam->evt_count) {
+                pthread_mutex_unlock(&cam->evt_lock);
+                errno = ENOENT;
+                return -1;
+            }
+            ev->type = MSM_CAMERA_V4L2_EVENT_TYPE;
+            ev->id = MSM_CAMERA_MSM_NOTIFY;
+            msm_evt->command = cam->evt_cmd[cam->evt_head];
+            msm_evt->status = cam->evt_status[cam->evt_head];
+            cam->evt_head = (cam->evt_head + 1) % MM_CAMERA_SIM_EVT_QUEUE_SIZE;
+            cam->evt_count--;
+            pthread_mutex_unlock(&cam->evt_lock);
+        }
+        break;
+    case VIDIOC_QUERYCAP:
+        /* the daemon fills the mapped capability buffer on QUERYCAP */
+        if (NULL == cam->caps.vaddr) {
+            break;
+        }
+        snprintf(path, sizeof(path), "%s/cam%d_caps.bin", g_sim.dir,
+                cam->cam_idx);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (0 > fd) {
+            CDBG_ERROR("%s: no capability replay %s", __func__, path);
+            break;
+        }
+        if (0 > read(fd, cam->caps.vaddr, cam->caps.size)) {
+            CDBG_ERROR("%s: reading %s failed, errno = %d",
+                    __func__, path, errno);
+        }
+        close(fd);
+        break;
+    case VIDIOC_G_CTRL:
+        {
+            struct v4l2_control *ctrl = (struct v4l2_control *)arg;
+            if (MSM_CAMERA_PRIV_G_SESSION_ID == ctrl->id) {
+                ctrl->value = cam->cam_idx + 1;
+            }
+        }
+        break;
+    default:
+        /* event subscription, S_CTRL of parm/3A commands: parameters live in
+         * the shared parm buffer and have no effect on the replay */
+        break;
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_open
+ *
+ * DESCRIPTION: open a camera video node. The first open of a node is the
+ *              control fd, later ones are stream fds, same as the msm
+ *              video node.
+ *
+ * PARAMETERS :
+ *   @dev_name : device node path, /dev/video<idx>
+ *   @flags    : open flags
+ *
+ * RETURN     : fd, -1 with errno set on failure
+ *==========================================================================*/
+int mm_camera_sim_open(const char *dev_name, int flags)
+{
+    int cam_idx = -1;
+    int fd = -1;
+    uint32_t i;
+    mm_camera_sim_cam_t *cam;
+    mm_camera_sim_stream_t *stream;
+    pthread_condattr_t attr;
+
+    pthread_mutex_lock(&g_sim_lock);
+    mm_camera_sim_probe();
+    if (!g_sim.enabled) {
+        pthread_mutex_unlock(&g_sim_lock);
+        return open(dev_name, flags);
+    }
+    if ((1 != sscanf(dev_name, "/dev/video%d", &cam_idx)) ||
+            (0 > cam_idx) || (cam_idx >= g_sim.num_cameras)) {
+        pthread_mutex_unlock(&g_sim_lock);
+        errno = ENODEV;
+        return -1;
+    }
+
+    cam = &g_sim.cams[cam_idx];
+    if (0 > cam->ctrl_fd) {
+        fd = mm_camera_sim_add_fd(MM_CAMERA_SIM_FD_CTRL, cam);
+        if (0 <= fd) {
+            cam->ctrl_fd = fd;
+            cam->evt_head = 0;
+            cam->evt_count = 0;
+        }
+        pthread_mutex_unlock(&g_sim_lock);
+        return fd;
+    }
+
+    for (i = 0; i < MM_CAMERA_SIM_MAX_STREAMS; i++) {
+        if (NULL == cam->streams[i]) {
+            break;
+        }
+    }
+    if (MM_CAMERA_SIM_MAX_STREAMS == i) {
+        pthread_mutex_unlock(&g_sim_lock);
+        errno = EBUSY;
+        return -1;
+    }
+    stream = (mm_camera_sim_stream_t *)calloc(1, sizeof(*stream));
+    if (NULL == stream) {
+        pthread_mutex_unlock(&g_sim_lock);
+        errno = ENOMEM;
+        return -1;
+    }
+    fd = mm_camera_sim_add_fd(MM_CAMERA_SIM_FD_STREAM, stream);
+    if (0 > fd) {
+        pthread_mutex_unlock(&g_sim_lock);
+        free(stream);
+        return -1;
+    }
+    stream->fd = fd;
+    stream->cam = cam;
+    stream->server_stream_id = ++cam->next_stream_id;
+    stream->stats.server_stream_id = stream->server_stream_id;
+    stream->replay_fd = -1;
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&stream->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    cam->streams[i] = stream;
+    pthread_mutex_unlock(&g_sim_lock);
+    return fd;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_close
+ *
+ * DESCRIPTION: close a fd obtained from mm_camera_sim_open or
+ *              mm_camera_sim_socket_create
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor
+ *
+ * RETURN     : 0 on success, -1 on failure
+ *==========================================================================*/
+int mm_camera_sim_close(int fd)
+{
+    uint32_t i, j;
+    mm_camera_sim_stream_t *stream = NULL;
+    mm_camera_sim_cam_t *cam = NULL;
+
+    pthread_mutex_lock(&g_sim_lock);
+    for (i = 0; i < MM_CAMERA_SIM_MAX_FDS; i++) {
+        if (fd == g_sim.fds[i].fd) {
+            break;
+        }
+    }
+    if ((0 > fd) || (MM_CAMERA_SIM_MAX_FDS == i)) {
+        pthread_mutex_unlock(&g_sim_lock);
+        return close(fd);
+    }
+    if (MM_CAMERA_SIM_FD_STREAM == g_sim.fds[i].type) {
+        stream = (mm_camera_sim_stream_t *)g_sim.fds[i].obj;
+        for (j = 0; j < MM_CAMERA_SIM_MAX_STREAMS; j++) {
+            if (stream == stream->cam->streams[j]) {
+                stream->cam->streams[j] = NULL;
+            }
+        }
+    } else if (MM_CAMERA_SIM_FD_CTRL == g_sim.fds[i].type) {
+        cam = (mm_camera_sim_cam_t *)g_sim.fds[i].obj;
+        cam->ctrl_fd = -1;
+        cam->next_stream_id = 0;
+        mm_camera_sim_unmap(&cam->caps);
+    }
+    mm_camera_sim_remove_fd(fd);
+    pthread_mutex_unlock(&g_sim_lock);
+
+    if (NULL != stream) {
+        mm_camera_sim_stream_off(stream);
+        mm_camera_sim_unmap(&stream->info);
+        for (i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
+            for (j = 0; j < VIDEO_MAX_PLANES; j++) {
+                mm_camera_sim_unmap(&stream->bufs[i].planes[j]);
+            }
+        }
+        pthread_cond_destroy(&stream->cond);
+        pthread_mutex_destroy(&stream->lock);
+        free(stream);
+    }
+    return close(fd);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_ioctl
+ *
+ * DESCRIPTION: ioctl entry point, sim fds are handled by the backend and
+ *              anything else goes to the kernel
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor
+ *   @request : ioctl request
+ *   @arg     : ioctl argument
+ *
+ * RETURN     : ioctl return value
+ *==========================================================================*/
+int mm_camera_sim_ioctl(int fd, unsigned long request, void *arg)
+{
+    void *obj;
+
+    obj = mm_camera_sim_lookup(fd, MM_CAMERA_SIM_FD_STREAM);
+    if (NULL != obj) {
+        return mm_camera_sim_stream_ioctl((mm_camera_sim_stream_t *)obj,
+                request, arg);
+    }
+    obj = mm_camera_sim_lookup(fd, MM_CAMERA_SIM_FD_CTRL);
+    if (NULL != obj) {
+        return mm_camera_sim_ctrl_ioctl((mm_camera_sim_cam_t *)obj,
+                request, arg);
+    }
+    return ioctl(fd, request, arg);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_socket_create
+ *
+ * DESCRIPTION: stand-in for the daemon domain socket of a camera
+ *
+ * PARAMETERS :
+ *   @cam_id  : camera index
+ *
+ * RETURN     : fd, -1 on failure
+ *==========================================================================*/
+int mm_camera_sim_socket_create(int cam_id)
+{
+    int fd = -1;
+
+    pthread_mutex_lock(&g_sim_lock);
+    if ((0 <= cam_id) && (cam_id < g_sim.num_cameras)) {
+        fd = mm_camera_sim_add_fd(MM_CAMERA_SIM_FD_SOCK, &g_sim.cams[cam_id]);
+    } else {
+        errno = ENODEV;
+    }
+    pthread_mutex_unlock(&g_sim_lock);
+    return fd;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_do_map
+ *
+ * DESCRIPTION: apply one map/unmap request. Buffers the replay does not
+ *              use are only acknowledged. Caller holds g_sim_lock.
+ *
+ * PARAMETERS :
+ *   @cam       : sim camera
+ *   @type      : mapping buffer type
+ *   @stream_id : server stream id
+ *   @frame_idx : buffer index
+ *   @plane_idx : plane index, -1 if all planes share the fd
+ *   @fd        : buffer fd, -1 to unmap
+ *   @size      : buffer size
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_sim_do_map(mm_camera_sim_cam_t *cam,
+        cam_mapping_buf_type type, uint32_t stream_id, uint32_t frame_idx,
+        int32_t plane_idx, int fd, size_t size)
+{
+    mm_camera_sim_stream_t *stream;
+    mm_camera_sim_map_t *map = NULL;
+
+    switch (type) {
+    case CAM_MAPPING_BUF_TYPE_CAPABILITY:
+        map = &cam->caps;
+        break;
+    case CAM_MAPPING_BUF_TYPE_STREAM_INFO:
+    case CAM_MAPPING_BUF_TYPE_STREAM_BUF:
+        stream = mm_camera_sim_find_stream(cam, stream_id);
+        if (NULL == stream) {
+            CDBG_ERROR("%s: unknown stream %u", __func__, stream_id);
+            return -1;
+        }
+        if (CAM_MAPPING_BUF_TYPE_STREAM_INFO == type) {
+            map = &stream->info;
+        } else if ((frame_idx < MM_CAMERA_MAX_NUM_FRAMES) &&
+                (plane_idx < VIDEO_MAX_PLANES)) {
+            map = &stream->bufs[frame_idx].planes[(0 > plane_idx) ? 0 : plane_idx];
+        }
+        break;
+    default:
+        return 0;
+    }
+    if (NULL == map) {
+        return -1;
+    }
+    if (0 > fd) {
+        mm_camera_sim_unmap(map);
+        return 0;
+    }
+    return mm_camera_sim_map(map, fd, size);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_sendmsg
+ *
+ * DESCRIPTION: handle a mapping packet sent to the daemon socket and
+ *              answer with CAM_EVENT_TYPE_MAP_UNMAP_DONE on the ctrl fd
+ *
+ * PARAMETERS :
+ *   @fd       : sim socket fd
+ *   @msg      : cam_sock_packet_t
+ *   @buf_size : size of the message
+ *   @sendfds  : fds attached to the message
+ *   @numfds   : number of fds
+ *
+ * RETURN     : number of bytes sent, -1 on failure
+ *==========================================================================*/
+int mm_camera_sim_sendmsg(int fd, void *msg, size_t buf_size,
+        int *sendfds, int numfds)
+{
+    cam_sock_packet_t *packet = (cam_sock_packet_t *)msg;
+    mm_camera_sim_cam_t *cam;
+    int32_t rc = 0;
+    uint32_t i;
+
+    cam = (mm_camera_sim_cam_t *)mm_camera_sim_lookup(fd, MM_CAMERA_SIM_FD_SOCK);
+    if ((NULL == cam) || (NULL == packet) || (buf_size < sizeof(*packet))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_sim_lock);
+    switch (packet->msg_type) {
+    case CAM_MAPPING_TYPE_FD_MAPPING:
+        {
+            cam_buf_map_type *m = &packet->payload.buf_map;
+            rc = mm_camera_sim_do_map(cam, m->type, m->stream_id, m->frame_idx,
+                    m->plane_idx, (0 < numfds) ? sendfds[0] : -1, m->size);
+        }
+        break;
+    case CAM_MAPPING_TYPE_FD_BUNDLED_MAPPING:
+        for (i = 0; (i < packet->payload.buf_map_list.length) &&
+                (i < (uint32_t)numfds); i++) {
+            cam_buf_map_type *m = &packet->payload.buf_map_list.buf_maps[i];
+            rc |= mm_camera_sim_do_map(cam, m->type, m->stream_id,
+                    m->frame_idx, m->plane_idx, sendfds[i], m->size);
+        }
+        break;
+    case CAM_MAPPING_TYPE_FD_UNMAPPING:
+        {
+            cam_buf_unmap_type *u = &packet->payload.buf_unmap;
+            rc = mm_camera_sim_do_map(cam, u->type, u->stream_id,
+                    u->frame_idx, u->plane_idx, -1, 0);
+        }
+        break;
+    case CAM_MAPPING_TYPE_FD_BUNDLED_UNMAPPING:
+        for (i = 0; (i < packet->payload.buf_unmap_list.length) &&
+                (i < CAM_MAX_NUM_BUFS_PER_STREAM); i++) {
+            cam_buf_unmap_type *u = &packet->payload.buf_unmap_list.buf_unmaps[i];
+            rc |= mm_camera_sim_do_map(cam, u->type, u->stream_id,
+                    u->frame_idx, u->plane_idx, -1, 0);
+        }
+        break;
+    default:
+        rc = -1;
+        break;
+    }
+    pthread_mutex_unlock(&g_sim_lock);
+
+    mm_camera_sim_post_evt(cam, CAM_EVENT_TYPE_MAP_UNMAP_DONE,
+            (0 == rc) ? MSM_CAMERA_STATUS_SUCCESS : MSM_CAMERA_STATUS_FAIL);
+    return (int)buf_size;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_get_stats
+ *
+ * DESCRIPTION: snapshot the per stream counters of a simulated camera
+ *
+ * PARAMETERS :
+ *   @cam_idx     : camera index
+ *   @stats       : output array
+ *   @max_streams : size of the output array
+ *   @num_streams : number of entries filled
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_sim_get_stats(uint8_t cam_idx,
+        mm_camera_sim_stream_stats_t *stats, uint32_t max_streams,
+        uint32_t *num_streams)
+{
+    uint32_t i, n = 0;
+    mm_camera_sim_stream_t *stream;
+
+    if ((NULL == stats) || (NULL == num_streams) ||
+            (cam_idx >= MM_CAMERA_MAX_NUM_SENSORS)) {
+        return -1;
+    }
+    pthread_mutex_lock(&g_sim_lock);
+    for (i = 0; (i < MM_CAMERA_SIM_MAX_STREAMS) && (n < max_streams); i++) {
+        stream = g_sim.cams[cam_idx].streams[i];
+        if (NULL != stream) {
+            pthread_mutex_lock(&stream->lock);
+            stats[n++] = stream->stats;
+            pthread_mutex_unlock(&stream->lock);
+        }
+    }
+    pthread_mutex_unlock(&g_sim_lock);
+    *num_streams = n;
+    return 0;
+}
@@ -35,6 +35,7 @@
 
 #include "mm_camera_dbg.h"
 #include "mm_camera_sock.h"
+#include "mm_camera_sim.h"
 
 /*===========================================================================
  * FUNCTION   : mm_camera_socket_create
@@ -64,6 +65,11 @@ int mm_camera_socket_create(int cam_id, mm_camera_sock_type_t sock_type)
         CDBG_ERROR("%s: unknown socket type =%d", __func__, sock_type);
         return -1;
     }
+#ifdef MM_CAMERA_SIM
+    if (mm_camera_sim_enabled()) {
+        return mm_camera_sim_socket_create(cam_id);
+    }
+#endif
     socket_fd = socket(AF_UNIX, sktype, 0);
     if (socket_fd < 0) {
         CDBG_ERROR("%s: error create socket fd =%d", __func__, socket_fd);
@@ -97,7 +103,7 @@ int mm_camera_socket_create(int cam_id, mm_camera_sock_type_t sock_type)
 void mm_camera_socket_close(int fd)
 {
     if (fd >= 0) {
-      close(fd);
+      mm_camera_dev_close(fd);
     }
 }
 
@@ -126,6 +132,12 @@ int mm_camera_socket_sendmsg(
       CDBG("%s: msg is NULL", __func__);
       return -1;
     }
+#ifdef MM_CAMERA_SIM
+    if (mm_camera_sim_owns_fd(fd)) {
+      return mm_camera_sim_sendmsg(fd, msg, buf_size, &sendfd,
+          (sendfd >= 0) ? 1 : 0);
+    }
+#endif
     memset(&msgh, 0, sizeof(msgh));
     msgh.msg_name = NULL;
     msgh.msg_namelen = 0;
@@ -189,6 +201,11 @@ int mm_camera_socket_bundle_sendmsg(
       CDBG("%s: msg is NULL", __func__);
       return -1;
     }
+#ifdef MM_CAMERA_SIM
+    if (mm_camera_sim_owns_fd(fd)) {
+      return mm_camera_sim_sendmsg(fd, msg, buf_size, sendfds, numfds);
+    }
+#endif
     memset(&msgh, 0, sizeof(msgh));
     msgh.msg_name = NULL;
     msgh.msg_namelen = 0;
@@ -50,7 +50,20 @@
 cam_visidon_para_t g_cam_visidon_para;
 #endif
 
+/* mapping message waiting for the answer of the server */
+typedef struct {
+    mm_channel_t *ch_obj;
+    uint32_t stream_hdl;
+    uint8_t buf_type;
+    uint32_t first_idx;  /* buffers to mark mapped on completion */
+    uint32_t num_bufs;
+    cam_buf_map_type_list maps; /* mappings to remember in the cache */
+} mm_stream_map_ctx_t;
+
 /* internal function decalre */
+static int32_t mm_stream_unmap_bufs_async(mm_stream_t * my_obj,
+        const cam_buf_unmap_type_list *buf_unmap_list,
+        mm_camera_map_batch_t *batch);
 int32_t mm_stream_qbuf(mm_stream_t *my_obj,
                        mm_camera_buf_def_t *buf);
 int32_t mm_stream_set_ext_mode(mm_stream_t * my_obj);
@@ -231,13 +244,14 @@ void VisidonFaceBeauty(unsigned char *pData, cam_visidon_resolution_t resolution
  * PARAMETERS :
  *   @ch_obj  : channel object
  *   @buf_info: ptr to struct storing buffer information
+ *   @pool    : cmd node pool of the stream owning the buffer
  *
  * RETURN     : int32_t type of status
  *              0  -- success
  *              0> -- failure
  *==========================================================================*/
 int32_t mm_stream_notify_channel(struct mm_channel* ch_obj,
-        mm_camera_buf_info_t *buf_info)
+        mm_camera_buf_info_t *buf_info, mm_camera_cmd_pool_t *pool)
 {
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
@@ -249,14 +263,13 @@ int32_t mm_stream_notify_channel(struct mm_channel* ch_obj,
 
     /* send cam_sem_post to wake up channel cmd thread to enqueue
      * to super buffer */
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_alloc(pool);
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
         node->u.buf = *buf_info;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(ch_obj->cmd_thread.cmd_queue), node);
+        mm_camera_cmd_thread_enq(&(ch_obj->cmd_thread), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(ch_obj->cmd_thread.cmd_sem));
@@ -289,7 +302,8 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
 
     /* enqueue to super buf thread */
     if (my_obj->is_bundled) {
-        rc = mm_stream_notify_channel(my_obj->ch_obj, buf_info);
+        rc = mm_stream_notify_channel(my_obj->ch_obj, buf_info,
+                my_obj->cmd_pool);
         if (rc < 0) {
             CDBG_ERROR("%s: Unable to notify channel", __func__);
         }
@@ -300,7 +314,8 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
         /* need to add into super buf for linking, add ref count */
         my_obj->buf_status[buf_info->buf->buf_idx].buf_refcnt++;
 
-        rc = mm_stream_notify_channel(my_obj->linked_obj, buf_info);
+        rc = mm_stream_notify_channel(my_obj->linked_obj, buf_info,
+                my_obj->cmd_pool);
         if (rc < 0) {
             CDBG_ERROR("%s: Unable to notify channel", __func__);
         }
@@ -312,14 +327,13 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
         mm_camera_cmdcb_t* node = NULL;
 
         /* send cam_sem_post to wake up cmd thread to dispatch dataCB */
-        node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+        node = mm_camera_cmd_alloc(my_obj->cmd_pool);
         if (NULL != node) {
-            memset(node, 0, sizeof(mm_camera_cmdcb_t));
             node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
             node->u.buf = *buf_info;
 
             /* enqueue to cmd thread */
-            cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+            mm_camera_cmd_thread_enq(&(my_obj->cmd_thread), node);
 
             /* wake up cmd thread */
             cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -373,6 +387,154 @@ static void mm_stream_dispatch_sync_data(mm_stream_t * my_obj,
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_stream_latency_record
+ *
+ * DESCRIPTION: add a latency sample for the type of this stream
+ *
+ * PARAMETERS :
+ *   @my_obj  : stream object
+ *   @stage   : latency stage
+ *   @ns      : latency in nanoseconds
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_latency_record(mm_stream_t *my_obj,
+        mm_stream_latency_stage_t stage, uint64_t ns)
+{
+    cam_stream_type_t type = my_obj->stream_info->stream_type;
+
+    if ((CAM_STREAM_TYPE_MAX > type) && (NULL != my_obj->ch_obj)) {
+        mm_camera_latency_record(
+                &my_obj->ch_obj->cam_obj->stream_latency[type][stage], ns);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_latency_dequeued
+ *
+ * DESCRIPTION: start latency tracking of a dequeued buffer. Called with
+ *              buf_lock held.
+ *
+ * PARAMETERS :
+ *   @my_obj    : stream object
+ *   @buf_idx   : buffer index
+ *   @sensor_ts : sensor timestamp of the frame
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_latency_dequeued(mm_stream_t *my_obj, uint32_t buf_idx,
+        const struct timespec *sensor_ts)
+{
+    mm_stream_buf_status_t *status = &my_obj->buf_status[buf_idx];
+    uint64_t now = mm_camera_latency_now_ns();
+    uint64_t sensor = (uint64_t)sensor_ts->tv_sec * 1000000000ULL +
+            (uint64_t)sensor_ts->tv_nsec;
+
+    __atomic_store_n(&status->dq_ts, now, __ATOMIC_RELAXED);
+    __atomic_store_n(&status->match_ts, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&status->cb_ts, 0, __ATOMIC_RELAXED);
+    if ((0 != sensor) && (sensor <= now)) {
+        mm_stream_latency_record(my_obj, MM_STREAM_LAT_SENSOR_TO_DQ,
+                now - sensor);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_latency_matched
+ *
+ * DESCRIPTION: buffer became part of a matched superbuf
+ *
+ * PARAMETERS :
+ *   @my_obj  : stream object owning the buffer
+ *   @buf_idx : buffer index
+ *   @now     : match time, CLOCK_MONOTONIC ns
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_stream_latency_matched(mm_stream_t *my_obj, uint32_t buf_idx,
+        uint64_t now)
+{
+    mm_stream_buf_status_t *status;
+    uint64_t dq;
+
+    if (CAM_MAX_NUM_BUFS_PER_STREAM <= buf_idx) {
+        return;
+    }
+    status = &my_obj->buf_status[buf_idx];
+    dq = __atomic_load_n(&status->dq_ts, __ATOMIC_RELAXED);
+    __atomic_store_n(&status->match_ts, now, __ATOMIC_RELAXED);
+    if ((0 != dq) && (dq <= now)) {
+        mm_stream_latency_record(my_obj, MM_STREAM_LAT_DQ_TO_MATCH, now - dq);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_latency_dispatched
+ *
+ * DESCRIPTION: buffer is handed to a client callback. Only the first of
+ *              the stream and superbuf callbacks is counted.
+ *
+ * PARAMETERS :
+ *   @my_obj  : stream object owning the buffer
+ *   @buf_idx : buffer index
+ *   @now     : dispatch time, CLOCK_MONOTONIC ns
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_stream_latency_dispatched(mm_stream_t *my_obj, uint32_t buf_idx,
+        uint64_t now)
+{
+    mm_stream_buf_status_t *status;
+    uint64_t expected = 0;
+    uint64_t base;
+
+    if (CAM_MAX_NUM_BUFS_PER_STREAM <= buf_idx) {
+        return;
+    }
+    status = &my_obj->buf_status[buf_idx];
+    if (!__atomic_compare_exchange_n(&status->cb_ts, &expected, now, 0,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
+    base = __atomic_load_n(&status->match_ts, __ATOMIC_RELAXED);
+    if (0 == base) {
+        base = __atomic_load_n(&status->dq_ts, __ATOMIC_RELAXED);
+    }
+    if ((0 != base) && (base <= now)) {
+        mm_stream_latency_record(my_obj, MM_STREAM_LAT_MATCH_TO_CB,
+                now - base);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_latency_returned
+ *
+ * DESCRIPTION: last client reference of a buffer dropped and the buffer
+ *              was queued back. Called with buf_lock held.
+ *
+ * PARAMETERS :
+ *   @my_obj  : stream object
+ *   @buf_idx : buffer index
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_latency_returned(mm_stream_t *my_obj, uint32_t buf_idx)
+{
+    mm_stream_buf_status_t *status = &my_obj->buf_status[buf_idx];
+    uint64_t cb = __atomic_load_n(&status->cb_ts, __ATOMIC_RELAXED);
+    uint64_t now;
+
+    if (0 == cb) {
+        return;
+    }
+    now = mm_camera_latency_now_ns();
+    if (cb <= now) {
+        mm_stream_latency_record(my_obj, MM_STREAM_LAT_CB_TO_DONE, now - cb);
+    }
+    __atomic_store_n(&status->cb_ts, 0, __ATOMIC_RELAXED);
+}
+
 /*===========================================================================
  * FUNCTION   : mm_stream_data_notify
  *
@@ -503,6 +665,8 @@ static void mm_stream_dispatch_app_data(mm_camera_cmdcb_t *cmd_cb,
                 pthread_mutex_unlock(&my_obj->buf_lock);
 
                 /* callback */
+                mm_stream_latency_dispatched(my_obj, buf_info->buf->buf_idx,
+                        mm_camera_latency_now_ns());
                 my_obj->buf_cb[i].cb(&super_buf,
                                      my_obj->buf_cb[i].user_data);
             }
@@ -628,7 +792,7 @@ int32_t mm_stream_fsm_inited(mm_stream_t *my_obj,
         snprintf(dev_name, sizeof(dev_name), "/dev/%s",
                  dev_name_value);
 
-        my_obj->fd = open(dev_name, O_RDWR | O_NONBLOCK);
+        my_obj->fd = mm_camera_dev_open(dev_name, O_RDWR | O_NONBLOCK);
         if (my_obj->fd < 0) {
             CDBG_ERROR("%s: open dev returned %d\n", __func__, my_obj->fd);
             rc = -1;
@@ -641,7 +805,7 @@ int32_t mm_stream_fsm_inited(mm_stream_t *my_obj,
         } else {
             /* failed setting ext_mode
              * close fd */
-            close(my_obj->fd);
+            mm_camera_dev_close(my_obj->fd);
             my_obj->fd = -1;
             break;
         }
@@ -1081,6 +1245,95 @@ static int32_t mm_stream_bundled_map_buf_ops(
                               buf_map_list);
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_stream_map_buf_async_ops
+ *
+ * DESCRIPTION: ops for mapping stream buffer via domain socket to server
+ *              without waiting for the server. The upper layer waits for a
+ *              whole batch through mm_stream_wait_maps_ops.
+ *
+ * PARAMETERS :
+ *   @frame_idx    : index of buffer within the stream buffers, only valid if
+ *                   buf_type is CAM_MAPPING_BUF_TYPE_STREAM_BUF or
+ *                   CAM_MAPPING_BUF_TYPE_OFFLINE_INPUT_BUF
+ *   @plane_idx    : plane index. If all planes share the same fd,
+ *                   plane_idx = -1; otherwise, plean_idx is the
+ *                   index to plane (0..num_of_planes)
+ *   @fd           : file descriptor of the buffer
+ *   @size         : size of the buffer
+ *   @batch        : batch to wait on for the answer of the server
+ *   @userdata     : user data ptr (stream object)
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_stream_map_buf_async_ops(uint32_t frame_idx,
+                                           int32_t plane_idx,
+                                           int fd,
+                                           size_t size,
+                                           cam_mapping_buf_type type,
+                                           mm_camera_map_batch_t *batch,
+                                           void *userdata)
+{
+    mm_stream_t *my_obj = (mm_stream_t *)userdata;
+    return mm_stream_map_buf_async(my_obj,
+                                   type,
+                                   frame_idx, plane_idx, fd, size,
+                                   batch);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_bundled_map_buf_async_ops
+ *
+ * DESCRIPTION: ops for mapping bundled stream buffers via domain socket to
+ *              server without waiting for the server
+ *
+ * PARAMETERS :
+ *   @buf_map_list : list of buffer mapping information
+ *   @batch        : batch to wait on for the answer of the server
+ *   @userdata     : user data ptr (stream object)
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_stream_bundled_map_buf_async_ops(
+        const cam_buf_map_type_list *buf_map_list,
+        mm_camera_map_batch_t *batch,
+        void *userdata)
+{
+    mm_stream_t *my_obj = (mm_stream_t *)userdata;
+    return mm_stream_map_bufs_async(my_obj,
+                                    buf_map_list,
+                                    batch);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_wait_maps_ops
+ *
+ * DESCRIPTION: ops for waiting until the server answered all async mapping
+ *              messages of a batch
+ *
+ * PARAMETERS :
+ *   @batch        : batch passed to the async mapping ops
+ *   @userdata     : user data ptr (stream object)
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure of any mapping in the batch
+ *==========================================================================*/
+static int32_t mm_stream_wait_maps_ops(mm_camera_map_batch_t *batch,
+                                       void *userdata)
+{
+    mm_stream_t *my_obj = (mm_stream_t *)userdata;
+    if (NULL == my_obj || NULL == my_obj->ch_obj || NULL == my_obj->ch_obj->cam_obj) {
+        CDBG_ERROR("%s: NULL obj of stream/channel/camera", __func__);
+        return -1;
+    }
+    return mm_camera_util_wait_for_maps(my_obj->ch_obj->cam_obj, batch);
+}
+
 /*===========================================================================
  * FUNCTION   : mm_stream_unmap_buf_ops
  *
@@ -1161,6 +1414,9 @@ int32_t mm_stream_config(mm_stream_t *my_obj,
     my_obj->map_ops.map_ops = mm_stream_map_buf_ops;
     my_obj->map_ops.bundled_map_ops = mm_stream_bundled_map_buf_ops;
     my_obj->map_ops.unmap_ops = mm_stream_unmap_buf_ops;
+    my_obj->map_ops.map_async_ops = mm_stream_map_buf_async_ops;
+    my_obj->map_ops.bundled_map_async_ops = mm_stream_bundled_map_buf_async_ops;
+    my_obj->map_ops.wait_ops = mm_stream_wait_maps_ops;
     my_obj->map_ops.userdata = my_obj;
 
     if(my_obj->mem_vtbl.set_config_ops != NULL) {
@@ -1187,6 +1443,17 @@ int32_t mm_stream_release(mm_stream_t *my_obj)
     CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d",
          __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
 
+    /* give back the mappings kept across restarts of this stream */
+    if ((NULL != my_obj->ch_obj) && (NULL != my_obj->ch_obj->cam_obj)) {
+        cam_buf_unmap_type_list unmaps;
+        do {
+            mm_camera_map_cache_release_stream(
+                    &my_obj->ch_obj->cam_obj->map_cache, my_obj->my_hdl,
+                    &unmaps);
+            mm_stream_unmap_bufs(my_obj, &unmaps);
+        } while (unmaps.length >= CAM_MAX_NUM_BUFS_PER_STREAM);
+    }
+
     pthread_mutex_lock(&my_obj->buf_lock);
     memset(my_obj->buf_status, 0, sizeof(my_obj->buf_status));
     pthread_mutex_unlock(&my_obj->buf_lock);
@@ -1194,7 +1461,7 @@ int32_t mm_stream_release(mm_stream_t *my_obj)
     /* close fd */
     if(my_obj->fd >= 0)
     {
-        close(my_obj->fd);
+        mm_camera_dev_close(my_obj->fd);
     }
 
     /* destroy mutex */
@@ -1244,7 +1511,7 @@ int32_t mm_stream_streamon(mm_stream_t *my_obj)
 
     pthread_mutex_unlock(&my_obj->buf_lock);
 
-    rc = ioctl(my_obj->fd, VIDIOC_STREAMON, &buf_type);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_STREAMON, &buf_type);
     if (rc < 0) {
         CDBG_ERROR("%s: ioctl VIDIOC_STREAMON failed: rc=%d\n",
                    __func__, rc);
@@ -1288,7 +1555,7 @@ int32_t mm_stream_streamoff(mm_stream_t *my_obj)
     }
 
     /* step2: stream off */
-    rc = ioctl(my_obj->fd, VIDIOC_STREAMOFF, &buf_type);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_STREAMOFF, &buf_type);
     if (rc < 0) {
         CDBG_ERROR("%s: STREAMOFF failed: %s\n",
                 __func__, strerror(errno));
@@ -1523,7 +1790,7 @@ int32_t mm_stream_read_msm_frame(mm_stream_t * my_obj,
     vb.m.planes = &planes[0];
     vb.length = num_planes;
 
-    rc = ioctl(my_obj->fd, VIDIOC_DQBUF, &vb);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_DQBUF, &vb);
     if (0 > rc) {
         CDBG_ERROR("%s: VIDIOC_DQBUF ioctl call failed on stream type %d (rc=%d): %s",
             __func__, my_obj->stream_info->stream_type, rc, strerror(errno));
@@ -1548,6 +1815,9 @@ int32_t mm_stream_read_msm_frame(mm_stream_t * my_obj,
         buf_info->buf->frame_idx = vb.sequence;
         buf_info->buf->ts.tv_sec  = vb.timestamp.tv_sec;
         buf_info->buf->ts.tv_nsec = vb.timestamp.tv_usec * 1000;
+        MM_CAMERA_TRACE_FRAME("mm_stream_dqbuf",
+                my_obj->stream_info->stream_type, vb.sequence);
+        mm_stream_latency_dequeued(my_obj, idx, &buf_info->buf->ts);
 
         CDBG_HIGH("%s: VIDIOC_DQBUF buf_index %d, frame_idx %d, stream type %d, rc %d,"
                 "queued: %d, buf_type = %d",
@@ -1612,6 +1882,12 @@ int32_t mm_stream_read_msm_frame(mm_stream_t * my_obj,
 		        }
 
 					VisidonFaceBeauty((unsigned char*)buf_info->buf->buffer, resolution, VISIDON_FACE_BEAUTY_PREVIEW);
+					/* the beauty pass rewrote the frame after the dqbuf sync,
+					 * report it so the qbuf clean is not skipped */
+					if (NULL != my_obj->mem_vtbl.mark_cpu_write) {
+					    my_obj->mem_vtbl.mark_cpu_write(buf_info->buf->buf_idx, 0,
+					            buf_info->buf->frame_len, my_obj->mem_vtbl.user_data);
+					}
 			}
 			CDBG("zhenhuan.fan enable = %d, level = %d",g_cam_visidon_para.fb_enable,g_cam_visidon_para.level);
 		}
@@ -1728,7 +2004,7 @@ int32_t mm_stream_set_ext_mode(mm_stream_t * my_obj)
     memset(&s_parm, 0, sizeof(s_parm));
     s_parm.type =  V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
 
-    rc = ioctl(my_obj->fd, VIDIOC_S_PARM, &s_parm);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_S_PARM, &s_parm);
     CDBG("%s:stream fd=%d, rc=%d, extended_mode=%d\n",
          __func__, my_obj->fd, rc, s_parm.parm.capture.extendedmode);
     if (rc == 0) {
@@ -1821,7 +2097,7 @@ int32_t mm_stream_qbuf(mm_stream_t *my_obj, mm_camera_buf_def_t *buf)
         }
     }
 
-    rc = ioctl(my_obj->fd, VIDIOC_QBUF, &buffer);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_QBUF, &buffer);
     if (0 > rc) {
         CDBG_ERROR("%s: VIDIOC_QBUF ioctl call failed on stream type %d (rc=%d): %s",
             __func__, my_obj->stream_info->stream_type, rc, strerror(errno));
@@ -1880,7 +2156,7 @@ int32_t mm_stream_request_buf(mm_stream_t * my_obj)
     bufreq.count = buf_num;
     bufreq.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
     bufreq.memory = V4L2_MEMORY_USERPTR;
-    rc = ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
     if (rc < 0) {
       CDBG_ERROR("%s: fd=%d, ioctl VIDIOC_REQBUFS failed: rc=%d\n",
            __func__, my_obj->fd, rc);
@@ -1918,9 +2194,155 @@ int8_t mm_stream_need_wait_for_mapping(mm_stream_t * my_obj)
 }
 
 /*===========================================================================
- * FUNCTION   : mm_stream_map_buf
+ * FUNCTION   : mm_stream_mark_mapped
  *
- * DESCRIPTION: mapping stream buffer via domain socket to server
+ * DESCRIPTION: mark stream buffers as mapped at the server and wake up a
+ *              stream on waiting for them
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @buf_type     : mapping type of the buffers
+ *   @first_idx    : index of the first buffer
+ *   @num_bufs     : number of buffers
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_mark_mapped(mm_stream_t *my_obj,
+                                  uint8_t buf_type,
+                                  uint32_t first_idx,
+                                  uint32_t num_bufs)
+{
+    uint32_t i;
+
+    if ((buf_type == CAM_MAPPING_BUF_TYPE_STREAM_BUF)
+            || ((buf_type
+            == CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF)
+            && (my_obj->stream_info != NULL)
+            && (my_obj->stream_info->streaming_mode
+            == CAM_STREAMING_MODE_BATCH))) {
+        pthread_mutex_lock(&my_obj->buf_lock);
+        for (i = first_idx; (i < first_idx + num_bufs) &&
+                (i < CAM_MAX_NUM_BUFS_PER_STREAM); i++) {
+            my_obj->buf_status[i].is_mapped = 1;
+        }
+        if (mm_stream_need_wait_for_mapping(my_obj) == 0) {
+            CDBG ("%s: Buffer mapping Done: Signal strm fd = %d",
+                    __func__, my_obj->fd);
+            pthread_cond_signal(&my_obj->buf_cond);
+        }
+        pthread_mutex_unlock(&my_obj->buf_lock);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_map_done
+ *
+ * DESCRIPTION: completion of a mapping message. Remembers the mappings in
+ *              the mapping cache and marks the buffers mapped, so a stream
+ *              on waiting for them can start.
+ *
+ * PARAMETERS :
+ *   @seq       : sequence id of the message
+ *   @status    : 0 if the server mapped the buffers
+ *   @user_data : user data ptr (mm_stream_map_ctx_t)
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_map_done(uint32_t seq, int32_t status, void *user_data)
+{
+    mm_stream_map_ctx_t *ctx = (mm_stream_map_ctx_t *)user_data;
+    mm_stream_t *my_obj;
+
+    if (0 == status) {
+        mm_camera_map_cache_commit(&ctx->ch_obj->cam_obj->map_cache,
+                ctx->stream_hdl, &ctx->maps);
+    } else {
+        CDBG_ERROR("%s: mapping %d failed for stream 0x%x",
+                __func__, seq, ctx->stream_hdl);
+    }
+
+    /* the stream is gone if its owner gave up waiting and released it */
+    my_obj = mm_channel_util_get_stream_by_handler(ctx->ch_obj,
+            ctx->stream_hdl);
+    if (NULL != my_obj) {
+        mm_stream_mark_mapped(my_obj, ctx->buf_type, ctx->first_idx,
+                ctx->num_bufs);
+    }
+    free(ctx);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_send_maps
+ *
+ * DESCRIPTION: send a mapping packet to the server without waiting for it
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @packet       : FD_MAPPING or FD_BUNDLED_MAPPING packet
+ *   @sendfds      : file descriptors of the buffers in @maps
+ *   @numfds       : number of file descriptors
+ *   @maps         : mappings sent, for the mapping cache
+ *   @buf_type     : mapping type of the buffers
+ *   @first_idx    : index of the first buffer to mark mapped on completion
+ *   @num_bufs     : number of buffers to mark mapped on completion
+ *   @batch        : batch to wait on for the answer of the server
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_stream_send_maps(mm_stream_t *my_obj,
+                                   cam_sock_packet_t *packet,
+                                   int *sendfds,
+                                   uint32_t numfds,
+                                   const cam_buf_map_type_list *maps,
+                                   uint8_t buf_type,
+                                   uint32_t first_idx,
+                                   uint32_t num_bufs,
+                                   mm_camera_map_batch_t *batch)
+{
+    int32_t rc = -1;
+    mm_camera_obj_t *cam_obj = my_obj->ch_obj->cam_obj;
+    mm_stream_map_ctx_t *ctx;
+
+    ctx = (mm_stream_map_ctx_t *)malloc(sizeof(mm_stream_map_ctx_t));
+    if (NULL != ctx) {
+        ctx->ch_obj = my_obj->ch_obj;
+        ctx->stream_hdl = my_obj->my_hdl;
+        ctx->buf_type = buf_type;
+        ctx->first_idx = first_idx;
+        ctx->num_bufs = num_bufs;
+        ctx->maps = *maps;
+
+        if (CAM_MAPPING_TYPE_FD_BUNDLED_MAPPING == packet->msg_type) {
+            rc = mm_camera_util_bundled_sendmsg_async(cam_obj, packet,
+                    sizeof(cam_sock_packet_t), sendfds, (int)numfds, batch,
+                    mm_stream_map_done, ctx, NULL);
+        } else {
+            rc = mm_camera_util_sendmsg_async(cam_obj, packet,
+                    sizeof(cam_sock_packet_t), sendfds[0], batch,
+                    mm_stream_map_done, ctx, NULL);
+        }
+        if (0 != rc) {
+            free(ctx);
+        }
+    } else {
+        CDBG_ERROR("%s: no memory for mapping of stream 0x%x",
+                __func__, my_obj->my_hdl);
+    }
+
+    if (0 != rc) {
+        /* do not keep a stream on waiting for a mapping never to come */
+        mm_stream_mark_mapped(my_obj, buf_type, first_idx, num_bufs);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_map_buf_async
+ *
+ * DESCRIPTION: mapping stream buffer via domain socket to server without
+ *              waiting for the server to answer
  *
  * PARAMETERS :
  *   @my_obj       : stream object
@@ -1936,26 +2358,29 @@ int8_t mm_stream_need_wait_for_mapping(mm_stream_t * my_obj)
  *                   index to plane (0..num_of_planes)
  *   @fd           : file descriptor of the buffer
  *   @size         : size of the buffer
+ *   @batch        : batch to wait on for the answer of the server
  *
  * RETURN     : int32_t type of status
  *              0  -- success
  *              -1 -- failure
  *==========================================================================*/
-int32_t mm_stream_map_buf(mm_stream_t * my_obj,
-                          uint8_t buf_type,
-                          uint32_t frame_idx,
-                          int32_t plane_idx,
-                          int32_t fd,
-                          size_t size)
+int32_t mm_stream_map_buf_async(mm_stream_t * my_obj,
+                                uint8_t buf_type,
+                                uint32_t frame_idx,
+                                int32_t plane_idx,
+                                int32_t fd,
+                                size_t size,
+                                mm_camera_map_batch_t *batch)
 {
     int32_t rc = 0;
-    int8_t i;
     if (NULL == my_obj || NULL == my_obj->ch_obj || NULL == my_obj->ch_obj->cam_obj) {
         CDBG_ERROR("%s: NULL obj of stream/channel/camera", __func__);
         return -1;
     }
 
     cam_sock_packet_t packet;
+    cam_buf_map_type_list maps;
+    cam_buf_unmap_type_list unmaps;
     memset(&packet, 0, sizeof(cam_sock_packet_t));
     packet.msg_type = CAM_MAPPING_TYPE_FD_MAPPING;
     packet.payload.buf_map.type = buf_type;
@@ -1964,43 +2389,85 @@ int32_t mm_stream_map_buf(mm_stream_t * my_obj,
     packet.payload.buf_map.stream_id = my_obj->server_stream_id;
     packet.payload.buf_map.frame_idx = frame_idx;
     packet.payload.buf_map.plane_idx = plane_idx;
-    rc = mm_camera_util_sendmsg(my_obj->ch_obj->cam_obj,
-            &packet, sizeof(cam_sock_packet_t), fd);
 
-    if ((buf_type == CAM_MAPPING_BUF_TYPE_STREAM_BUF)
-            || ((buf_type
-            == CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF)
-            && (my_obj->stream_info != NULL)
-            && (my_obj->stream_info->streaming_mode
-            == CAM_STREAMING_MODE_BATCH))) {
-        pthread_mutex_lock(&my_obj->buf_lock);
-        my_obj->buf_status[frame_idx].is_mapped = 1;
-        if (mm_stream_need_wait_for_mapping(my_obj) == 0) {
-            CDBG ("%s: Buffer mapping Done: Signal strm fd = %d",
-                    __func__, my_obj->fd);
-            pthread_cond_signal(&my_obj->buf_cond);
-        }
-        pthread_mutex_unlock(&my_obj->buf_lock);
+    maps.length = 1;
+    maps.buf_maps[0] = packet.payload.buf_map;
+    mm_camera_map_cache_prepare(&my_obj->ch_obj->cam_obj->map_cache,
+            my_obj->my_hdl, &maps, &unmaps);
+    if (unmaps.length > 0) {
+        mm_stream_unmap_bufs_async(my_obj, &unmaps, NULL);
+    }
+    if (maps.length > 0) {
+        rc = mm_stream_send_maps(my_obj, &packet, &fd, 1, &maps,
+                buf_type, frame_idx, 1, batch);
+    } else {
+        mm_stream_mark_mapped(my_obj, buf_type, frame_idx, 1);
     }
     return rc;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_stream_map_bufs
+ * FUNCTION   : mm_stream_map_buf
  *
- * DESCRIPTION: mapping stream buffers via domain socket to server
+ * DESCRIPTION: mapping stream buffer via domain socket to server
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @buf_type     : type of buffer to be mapped. could be following values:
+ *                   CAM_MAPPING_BUF_TYPE_STREAM_BUF
+ *                   CAM_MAPPING_BUF_TYPE_STREAM_INFO
+ *                   CAM_MAPPING_BUF_TYPE_OFFLINE_INPUT_BUF
+ *   @frame_idx    : index of buffer within the stream buffers, only valid if
+ *                   buf_type is CAM_MAPPING_BUF_TYPE_STREAM_BUF or
+ *                   CAM_MAPPING_BUF_TYPE_OFFLINE_INPUT_BUF
+ *   @plane_idx    : plane index. If all planes share the same fd,
+ *                   plane_idx = -1; otherwise, plean_idx is the
+ *                   index to plane (0..num_of_planes)
+ *   @fd           : file descriptor of the buffer
+ *   @size         : size of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_stream_map_buf(mm_stream_t * my_obj,
+                          uint8_t buf_type,
+                          uint32_t frame_idx,
+                          int32_t plane_idx,
+                          int32_t fd,
+                          size_t size)
+{
+    int32_t rc;
+    mm_camera_map_batch_t batch;
+
+    memset(&batch, 0, sizeof(batch));
+    rc = mm_stream_map_buf_async(my_obj, buf_type, frame_idx, plane_idx,
+            fd, size, &batch);
+    if (0 == rc) {
+        rc = mm_camera_util_wait_for_maps(my_obj->ch_obj->cam_obj, &batch);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_map_bufs_async
+ *
+ * DESCRIPTION: mapping stream buffers via domain socket to server without
+ *              waiting for the server to answer
  *
  * PARAMETERS :
  *   @my_obj       : stream object
  *   @buf_map_list : list of buffer objects to map
+ *   @batch        : batch to wait on for the answer of the server
  *
  * RETURN     : int32_t type of status
  *              0  -- success
  *              -1 -- failure
  *==========================================================================*/
 
-int32_t mm_stream_map_bufs(mm_stream_t * my_obj,
-                           const cam_buf_map_type_list *buf_map_list)
+int32_t mm_stream_map_bufs_async(mm_stream_t * my_obj,
+                                 const cam_buf_map_type_list *buf_map_list,
+                                 mm_camera_map_batch_t *batch)
 {
     if (NULL == my_obj || NULL == my_obj->ch_obj || NULL == my_obj->ch_obj->cam_obj) {
         CDBG_ERROR("%s: NULL obj of stream/channel/camera", __func__);
@@ -2008,6 +2475,7 @@ int32_t mm_stream_map_bufs(mm_stream_t * my_obj,
     }
 
     cam_sock_packet_t packet;
+    cam_buf_unmap_type_list unmaps;
     memset(&packet, 0, sizeof(cam_sock_packet_t));
     packet.msg_type = CAM_MAPPING_TYPE_FD_BUNDLED_MAPPING;
 
@@ -2021,41 +2489,137 @@ int32_t mm_stream_map_bufs(mm_stream_t * my_obj,
       return 0;
     }
 
+    /* drop buffers the server still has from before a restart */
+    mm_camera_map_cache_prepare(&my_obj->ch_obj->cam_obj->map_cache,
+            my_obj->my_hdl, &packet.payload.buf_map_list, &unmaps);
+    if (unmaps.length > 0) {
+        mm_stream_unmap_bufs_async(my_obj, &unmaps, NULL);
+    }
+    uint32_t numsend = packet.payload.buf_map_list.length;
+
     uint32_t i;
-    for (i = 0; i < numbufs; i++) {
+    for (i = 0; i < numsend; i++) {
         packet.payload.buf_map_list.buf_maps[i].stream_id = my_obj->server_stream_id;
         sendfds[i] = packet.payload.buf_map_list.buf_maps[i].fd;
     }
 
-    for (i = numbufs; i < CAM_MAX_NUM_BUFS_PER_STREAM; i++) {
+    for (i = numsend; i < CAM_MAX_NUM_BUFS_PER_STREAM; i++) {
         packet.payload.buf_map_list.buf_maps[i].fd = -1;
         sendfds[i] = -1;
     }
 
-    int32_t ret = mm_camera_util_bundled_sendmsg(my_obj->ch_obj->cam_obj,
-            &packet, sizeof(cam_sock_packet_t), sendfds, numbufs);
-    if ((numbufs > 0) && ((buf_map_list->buf_maps[0].type
-            == CAM_MAPPING_BUF_TYPE_STREAM_BUF)
-            || ((buf_map_list->buf_maps[0].type ==
-            CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF)
-            && (my_obj->stream_info != NULL)
-            && (my_obj->stream_info->streaming_mode
-            == CAM_STREAMING_MODE_BATCH)))) {
-        pthread_mutex_lock(&my_obj->buf_lock);
-        for (i = 0; i < numbufs; i++) {
-           my_obj->buf_status[i].is_mapped = 1;
-        }
-
-        if (mm_stream_need_wait_for_mapping(my_obj) == 0) {
-            CDBG ("%s: Buffer mapping Done: Signal strm fd = %d",
-                    __func__, my_obj->fd);
-            pthread_cond_signal(&my_obj->buf_cond);
-        }
-        pthread_mutex_unlock(&my_obj->buf_lock);
+    int32_t ret = 0;
+    if (numsend > 0) {
+        ret = mm_stream_send_maps(my_obj, &packet, sendfds, numsend,
+                &packet.payload.buf_map_list,
+                (uint8_t)buf_map_list->buf_maps[0].type, 0, numbufs, batch);
+    } else {
+        mm_stream_mark_mapped(my_obj,
+                (uint8_t)buf_map_list->buf_maps[0].type, 0, numbufs);
     }
     return ret;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_stream_map_bufs
+ *
+ * DESCRIPTION: mapping stream buffers via domain socket to server
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @buf_map_list : list of buffer objects to map
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_stream_map_bufs(mm_stream_t * my_obj,
+                           const cam_buf_map_type_list *buf_map_list)
+{
+    int32_t rc;
+    mm_camera_map_batch_t batch;
+
+    memset(&batch, 0, sizeof(batch));
+    rc = mm_stream_map_bufs_async(my_obj, buf_map_list, &batch);
+    if (0 == rc) {
+        rc = mm_camera_util_wait_for_maps(my_obj->ch_obj->cam_obj, &batch);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_unmap_bufs_async
+ *
+ * DESCRIPTION: unmapping a list of stream buffers via domain socket to server
+ *              in one message. Used for mappings kept by the mapping cache,
+ *              the buffer status of the stream is not touched.
+ *
+ * PARAMETERS :
+ *   @my_obj         : stream object
+ *   @buf_unmap_list : list of buffers to unmap
+ *   @batch          : batch to wait on, NULL if nobody waits
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_stream_unmap_bufs_async(mm_stream_t * my_obj,
+        const cam_buf_unmap_type_list *buf_unmap_list,
+        mm_camera_map_batch_t *batch)
+{
+    uint32_t i;
+    cam_sock_packet_t packet;
+
+    if (NULL == my_obj || NULL == my_obj->ch_obj || NULL == my_obj->ch_obj->cam_obj) {
+        CDBG_ERROR("%s: NULL obj of stream/channel/camera", __func__);
+        return -1;
+    }
+    if (buf_unmap_list->length < 1) {
+        return 0;
+    }
+
+    memset(&packet, 0, sizeof(cam_sock_packet_t));
+    packet.msg_type = CAM_MAPPING_TYPE_FD_BUNDLED_UNMAPPING;
+    memcpy(&packet.payload.buf_unmap_list, buf_unmap_list,
+           sizeof(packet.payload.buf_unmap_list));
+    for (i = 0; i < packet.payload.buf_unmap_list.length; i++) {
+        packet.payload.buf_unmap_list.buf_unmaps[i].stream_id =
+                my_obj->server_stream_id;
+    }
+    return mm_camera_util_sendmsg_async(my_obj->ch_obj->cam_obj,
+            &packet,
+            sizeof(cam_sock_packet_t),
+            -1, batch, NULL, NULL, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_unmap_bufs
+ *
+ * DESCRIPTION: unmapping a list of stream buffers via domain socket to server
+ *              in one message and wait for the server
+ *
+ * PARAMETERS :
+ *   @my_obj         : stream object
+ *   @buf_unmap_list : list of buffers to unmap
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_stream_unmap_bufs(mm_stream_t * my_obj,
+                             const cam_buf_unmap_type_list *buf_unmap_list)
+{
+    int32_t rc;
+    mm_camera_map_batch_t batch;
+
+    memset(&batch, 0, sizeof(batch));
+    rc = mm_stream_unmap_bufs_async(my_obj, buf_unmap_list, &batch);
+    if (0 == rc) {
+        rc = mm_camera_util_wait_for_maps(my_obj->ch_obj->cam_obj, &batch);
+    }
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_stream_unmap_buf
  *
@@ -2087,17 +2651,21 @@ int32_t mm_stream_unmap_buf(mm_stream_t * my_obj,
         CDBG_ERROR("%s: NULL obj of stream/channel/camera", __func__);
         return -1;
     }
-    cam_sock_packet_t packet;
-    memset(&packet, 0, sizeof(cam_sock_packet_t));
-    packet.msg_type = CAM_MAPPING_TYPE_FD_UNMAPPING;
-    packet.payload.buf_unmap.type = buf_type;
-    packet.payload.buf_unmap.stream_id = my_obj->server_stream_id;
-    packet.payload.buf_unmap.frame_idx = frame_idx;
-    packet.payload.buf_unmap.plane_idx = plane_idx;
-    int32_t ret = mm_camera_util_sendmsg(my_obj->ch_obj->cam_obj,
-            &packet,
-            sizeof(cam_sock_packet_t),
-            -1);
+    int32_t ret = 0;
+    if (!mm_camera_map_cache_park(&my_obj->ch_obj->cam_obj->map_cache,
+            my_obj->my_hdl, buf_type, frame_idx, plane_idx)) {
+        cam_sock_packet_t packet;
+        memset(&packet, 0, sizeof(cam_sock_packet_t));
+        packet.msg_type = CAM_MAPPING_TYPE_FD_UNMAPPING;
+        packet.payload.buf_unmap.type = buf_type;
+        packet.payload.buf_unmap.stream_id = my_obj->server_stream_id;
+        packet.payload.buf_unmap.frame_idx = frame_idx;
+        packet.payload.buf_unmap.plane_idx = plane_idx;
+        ret = mm_camera_util_sendmsg(my_obj->ch_obj->cam_obj,
+                &packet,
+                sizeof(cam_sock_packet_t),
+                -1);
+    }
     pthread_mutex_lock(&my_obj->buf_lock);
     my_obj->buf_status[frame_idx].is_mapped = 0;
     pthread_mutex_unlock(&my_obj->buf_lock);
@@ -2175,6 +2743,11 @@ int32_t mm_stream_init_bufs(mm_stream_t * my_obj)
     /* update in stream info about number of stream buffers */
     my_obj->stream_info->num_bufs = my_obj->buf_num;
 
+    /* a buf is in at most one stream and one channel cmd at a time,
+     * so cmd nodes for this stream never have to come from heap */
+    my_obj->cmd_pool = mm_camera_cmd_pool_create("CAM_StrmAppData",
+            (uint32_t)my_obj->buf_num * MM_CAMERA_CMD_POOL_NODES_PER_BUF);
+
     return rc;
 }
 
@@ -2208,6 +2781,9 @@ int32_t mm_stream_deinit_bufs(mm_stream_t * my_obj)
     ops_tbl.map_ops = mm_stream_map_buf_ops;
     ops_tbl.bundled_map_ops = mm_stream_bundled_map_buf_ops;
     ops_tbl.unmap_ops = mm_stream_unmap_buf_ops;
+    ops_tbl.map_async_ops = mm_stream_map_buf_async_ops;
+    ops_tbl.bundled_map_async_ops = mm_stream_bundled_map_buf_async_ops;
+    ops_tbl.wait_ops = mm_stream_wait_maps_ops;
     ops_tbl.userdata = my_obj;
 
     rc = my_obj->mem_vtbl.put_bufs(&ops_tbl,
@@ -2221,6 +2797,10 @@ int32_t mm_stream_deinit_bufs(mm_stream_t * my_obj)
     free(my_obj->buf);
     my_obj->buf = NULL;
 
+    /* nodes still queued to a channel are freed with their last put */
+    mm_camera_cmd_pool_release(my_obj->cmd_pool);
+    my_obj->cmd_pool = NULL;
+
     return rc;
 }
 
@@ -2296,7 +2876,7 @@ int32_t mm_stream_unreg_buf(mm_stream_t * my_obj)
     bufreq.count = 0;
     bufreq.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
     bufreq.memory = V4L2_MEMORY_USERPTR;
-    rc = ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
     if (rc < 0) {
         CDBG_ERROR("%s: fd=%d, VIDIOC_REQBUFS failed, rc=%d\n",
               __func__, my_obj->fd, rc);
@@ -4402,7 +4982,7 @@ int32_t mm_stream_set_fmt(mm_stream_t *my_obj)
     }
 
     memcpy(fmt.fmt.raw_data, &msm_fmt, sizeof(msm_fmt));
-    rc = ioctl(my_obj->fd, VIDIOC_S_FMT, &fmt);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_S_FMT, &fmt);
     return rc;
 }
 
@@ -4444,6 +5024,7 @@ int32_t mm_stream_buf_done(mm_stream_t * my_obj,
                            __func__, frame->buf_idx, rc);
             } else {
                 my_obj->buf_status[frame->buf_idx].in_kernel = 1;
+                mm_stream_latency_returned(my_obj, frame->buf_idx);
             }
         }else{
             CDBG("<DEBUG> : Still ref count pending count :%d",
@@ -35,328 +35,271 @@
 #include <sys/stat.h>
 #include <sys/prctl.h>
 #include <fcntl.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <cam_semaphore.h>
 
 #include "mm_camera_dbg.h"
 #include "mm_camera_interface.h"
 #include "mm_camera.h"
 
-typedef enum {
-    /* poll entries updated */
-    MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED,
-    /* poll entries updated asynchronous */
-    MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC,
-    /* commit updates */
-    MM_CAMERA_PIPE_CMD_COMMIT,
-    /* exit */
-    MM_CAMERA_PIPE_CMD_EXIT,
-    /* max count */
-    MM_CAMERA_PIPE_CMD_MAX
-} mm_camera_pipe_cmd_type_t;
-
 typedef enum {
     MM_CAMERA_POLL_TASK_STATE_STOPPED,
     MM_CAMERA_POLL_TASK_STATE_POLL,     /* polling pid in polling state. */
     MM_CAMERA_POLL_TASK_STATE_MAX
 } mm_camera_poll_task_state_type_t;
 
-typedef struct {
-    uint32_t cmd;
-    mm_camera_event_t event;
-} mm_camera_sig_evt_t;
+/* epoll data of the control eventfd, slot events carry gen << 32 | slot */
+#define MM_CAMERA_POLL_CTRL_EVENT UINT64_MAX
 
+/* data poll engines, one per camera shared by its channels. Frame
+ * callbacks of one camera can not hold up DQBUF of another. */
+static mm_camera_poll_engine_t *g_data_poll_engine[MM_CAMERA_MAX_NUM_SENSORS];
+static pthread_mutex_t g_poll_engine_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig_async
+ * FUNCTION   : mm_camera_poll_engine_wakeup
  *
- * DESCRIPTION: Asynchoronous call to send a command through pipe.
+ * DESCRIPTION: wake up poll engine through its eventfd
  *
  * PARAMETERS :
- *   @poll_cb      : ptr to poll thread object
- *   @cmd          : command to be sent
+ *   @engine  : ptr to poll engine
  *
- * RETURN     : int32_t type of status
- *              0  -- success
- *              -1 -- failure
- *==========================================================================*/
-static int32_t mm_camera_poll_sig_async(mm_camera_poll_thread_t *poll_cb,
-                                  uint32_t cmd)
-{
-    /* send through pipe */
-    /* get the mutex */
-    mm_camera_sig_evt_t cmd_evt;
-
-    CDBG("%s: E cmd = %d", __func__,cmd);
-    memset(&cmd_evt, 0, sizeof(cmd_evt));
-    cmd_evt.cmd = cmd;
-    pthread_mutex_lock(&poll_cb->mutex);
-    /* reset the statue to false */
-    poll_cb->status = FALSE;
-
-    /* send cmd to worker */
-    ssize_t len = write(poll_cb->pfds[1], &cmd_evt, sizeof(cmd_evt));
-    if (len < 1) {
-        CDBG_ERROR("%s: len = %lld, errno = %d", __func__,
-                (long long int)len, errno);
-        /* Avoid waiting for the signal */
-        pthread_mutex_unlock(&poll_cb->mutex);
-        return 0;
-    }
-    CDBG("%s: begin IN mutex write done, len = %lld", __func__,
-            (long long int)len);
-    pthread_mutex_unlock(&poll_cb->mutex);
-    CDBG("%s: X", __func__);
-    return 0;
-}
-
-
-
-
-/*===========================================================================
- * FUNCTION   : mm_camera_poll_sig
- *
- * DESCRIPTION: synchorinzed call to send a command through pipe.
- *
- * PARAMETERS :
- *   @poll_cb      : ptr to poll thread object
- *   @cmd          : command to be sent
- *
- * RETURN     : int32_t type of status
- *              0  -- success
- *              -1 -- failure
+ * RETURN     : none
  *==========================================================================*/
-static int32_t mm_camera_poll_sig(mm_camera_poll_thread_t *poll_cb,
-                                  uint32_t cmd)
+static void mm_camera_poll_engine_wakeup(mm_camera_poll_engine_t *engine)
 {
-    /* send through pipe */
-    /* get the mutex */
-    mm_camera_sig_evt_t cmd_evt;
-
-    CDBG("%s: E cmd = %d", __func__,cmd);
-    memset(&cmd_evt, 0, sizeof(cmd_evt));
-    cmd_evt.cmd = cmd;
-    pthread_mutex_lock(&poll_cb->mutex);
-    /* reset the statue to false */
-    poll_cb->status = FALSE;
-    /* send cmd to worker */
-
-    ssize_t len = write(poll_cb->pfds[1], &cmd_evt, sizeof(cmd_evt));
-    if(len < 1) {
+    uint64_t val = 1;
+    ssize_t len = write(engine->event_fd, &val, sizeof(val));
+    if (len != sizeof(val)) {
         CDBG_ERROR("%s: len = %lld, errno = %d", __func__,
                 (long long int)len, errno);
-        /* Avoid waiting for the signal */
-        pthread_mutex_unlock(&poll_cb->mutex);
-        return 0;
-    }
-    CDBG("%s: begin IN mutex write done, len = %lld", __func__,
-            (long long int)len);
-    /* wait till worker task gives positive signal */
-    if (FALSE == poll_cb->status) {
-        CDBG("%s: wait", __func__);
-        pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
-    }
-    /* done */
-    pthread_mutex_unlock(&poll_cb->mutex);
-    CDBG("%s: X", __func__);
-    return 0;
+    }
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig
+ * FUNCTION   : mm_camera_poll_engine_quiesce
  *
- * DESCRIPTION: signal the status of done
+ * DESCRIPTION: wait until a dispatch round in progress is over, so no
+ *              notify_cb of a removed entry can still be running. Called
+ *              with engine mutex held. No op from the engine thread.
  *
  * PARAMETERS :
- *   @poll_cb : ptr to poll thread object
+ *   @engine  : ptr to poll engine
  *
  * RETURN     : none
  *==========================================================================*/
-static void mm_camera_poll_sig_done(mm_camera_poll_thread_t *poll_cb)
+static void mm_camera_poll_engine_quiesce(mm_camera_poll_engine_t *engine)
 {
-    pthread_mutex_lock(&poll_cb->mutex);
-    poll_cb->status = TRUE;
-    pthread_cond_signal(&poll_cb->cond_v);
-    CDBG("%s: done, in mutex", __func__);
-    pthread_mutex_unlock(&poll_cb->mutex);
+    uint32_t round = engine->round;
+
+    if (pthread_equal(pthread_self(), engine->pid)) {
+        return;
+    }
+    while (engine->dispatching && (round == engine->round)) {
+        pthread_cond_wait(&engine->cond_v, &engine->mutex);
+    }
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_set_state
+ * FUNCTION   : mm_camera_poll_engine_del_entry
  *
- * DESCRIPTION: set a polling state
+ * DESCRIPTION: remove entry fd from epoll set and free its slot. Called
+ *              with engine mutex held.
  *
  * PARAMETERS :
- *   @poll_cb : ptr to poll thread object
- *   @state   : polling state (stopped/polling)
+ *   @engine  : ptr to poll engine
+ *   @entry   : ptr to poll entry
  *
  * RETURN     : none
  *==========================================================================*/
-static void mm_camera_poll_set_state(mm_camera_poll_thread_t *poll_cb,
-                                     mm_camera_poll_task_state_type_t state)
+static void mm_camera_poll_engine_del_entry(mm_camera_poll_engine_t *engine,
+                                            mm_camera_poll_entry_t *entry)
 {
-    poll_cb->state = state;
+    if ((entry->slot < 0) ||
+            (entry->slot >= MM_CAMERA_POLL_ENGINE_MAX_SLOTS)) {
+        return;
+    }
+    if (epoll_ctl(engine->epoll_fd, EPOLL_CTL_DEL, entry->fd, NULL) < 0) {
+        CDBG_ERROR("%s: epoll del fd %d failed, errno = %d",
+                __func__, entry->fd, errno);
+    }
+    engine->slots[entry->slot].entry = NULL;
+    entry->slot = -1;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_proc_pipe
+ * FUNCTION   : mm_camera_poll_engine_fn
  *
- * DESCRIPTION: polling thread routine to process pipe
+ * DESCRIPTION: poll engine thread routine. Registration changes are done
+ *              by callers directly on the epoll set, stale events are
+ *              dropped by checking the slot generation.
  *
  * PARAMETERS :
- *   @poll_cb : ptr to poll thread object
+ *   @data    : ptr to poll engine
  *
  * RETURN     : none
  *==========================================================================*/
-static void mm_camera_poll_proc_pipe(mm_camera_poll_thread_t *poll_cb)
+static void *mm_camera_poll_engine_fn(void *data)
 {
-    ssize_t read_len;
-    int i;
-    mm_camera_sig_evt_t cmd_evt;
-    read_len = read(poll_cb->pfds[0], &cmd_evt, sizeof(cmd_evt));
-    CDBG("%s: read_fd = %d, read_len = %d, expect_len = %d cmd = %d",
-         __func__, poll_cb->pfds[0], (int)read_len, (int)sizeof(cmd_evt), cmd_evt.cmd);
-    switch (cmd_evt.cmd) {
-    case MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED:
-    case MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC:
-        /* we always have index 0 for pipe read */
-        poll_cb->num_fds = 0;
-        poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->pfds[0];
-        poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-        poll_cb->num_fds++;
-
-        if (MM_CAMERA_POLL_TYPE_EVT == poll_cb->poll_type &&
-                poll_cb->num_fds < MAX_STREAM_NUM_IN_BUNDLE) {
-            if (poll_cb->poll_entries[0].fd >= 0) {
-                /* fd is valid, we update poll_fds */
-                poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->poll_entries[0].fd;
-                poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-                poll_cb->num_fds++;
+    mm_camera_poll_engine_t *engine = (mm_camera_poll_engine_t *)data;
+    struct epoll_event events[MM_CAMERA_POLL_ENGINE_MAX_EVENTS];
+    uint8_t exit = FALSE;
+    int i, num;
+
+    mm_camera_cmd_thread_name(engine->threadName);
+    do {
+        num = epoll_wait(engine->epoll_fd, events,
+                MM_CAMERA_POLL_ENGINE_MAX_EVENTS, -1);
+        if (num < 0) {
+            if (EINTR == errno) {
+                continue;
             }
-        } else if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type &&
-                poll_cb->num_fds <= MAX_STREAM_NUM_IN_BUNDLE) {
-            for(i = 0; i < MAX_STREAM_NUM_IN_BUNDLE; i++) {
-                if(poll_cb->poll_entries[i].fd >= 0) {
-                    /* fd is valid, we update poll_fds to this fd */
-                    poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->poll_entries[i].fd;
-                    poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-                    poll_cb->num_fds++;
-                } else {
-                    /* fd is invalid, we set the entry to -1 to prevent polling.
-                     * According to spec, polling will not poll on entry with fd=-1.
-                     * If this is not the case, we need to skip these invalid fds
-                     * when updating this array.
-                     * We still keep fd=-1 in this array because this makes easier to
-                     * map cb associated with this fd once incoming data avail by directly
-                     * using the index-1(0 is reserved for pipe read, so need to reduce index by 1) */
-                    poll_cb->poll_fds[poll_cb->num_fds].fd = -1;
-                    poll_cb->poll_fds[poll_cb->num_fds].events = 0;
-                    poll_cb->num_fds++;
+            CDBG_ERROR("%s: epoll_wait failed, errno = %d", __func__, errno);
+            break;
+        }
+
+        pthread_mutex_lock(&engine->mutex);
+        engine->dispatching = TRUE;
+        for (i = 0; i < num; i++) {
+            uint64_t key = events[i].data.u64;
+            mm_camera_poll_entry_t *entry;
+            mm_camera_poll_notify_t notify_cb;
+            void *user_data;
+            uint32_t slot;
+
+            if (MM_CAMERA_POLL_CTRL_EVENT == key) {
+                uint64_t val;
+                if (read(engine->event_fd, &val, sizeof(val)) < 0) {
+                    CDBG_ERROR("%s: eventfd read errno = %d", __func__, errno);
                 }
+                continue;
             }
+
+            slot = (uint32_t)(key & 0xFFFFFFFF);
+            if ((slot >= MM_CAMERA_POLL_ENGINE_MAX_SLOTS) ||
+                    (NULL == engine->slots[slot].entry) ||
+                    (engine->slots[slot].gen != (uint32_t)(key >> 32))) {
+                /* fd was removed after epoll_wait returned */
+                continue;
+            }
+            entry = engine->slots[slot].entry;
+            /* entries may ask for several bits of which only one is
+             * raised, e.g. EPOLLPRI|EPOLLIN on the sim EVT fd */
+            if (!(events[i].events & entry->events)) {
+                continue;
+            }
+            notify_cb = entry->notify_cb;
+            user_data = entry->user_data;
+
+            pthread_mutex_unlock(&engine->mutex);
+            if (NULL != notify_cb) {
+                notify_cb(user_data);
+            }
+            pthread_mutex_lock(&engine->mutex);
         }
-        if (cmd_evt.cmd != MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC)
-            mm_camera_poll_sig_done(poll_cb);
-        break;
-
-    case MM_CAMERA_PIPE_CMD_COMMIT:
-        mm_camera_poll_sig_done(poll_cb);
-        break;
-    case MM_CAMERA_PIPE_CMD_EXIT:
-    default:
-        mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_STOPPED);
-        mm_camera_poll_sig_done(poll_cb);
-        break;
-    }
+        engine->dispatching = FALSE;
+        engine->round++;
+        exit = engine->exit;
+        pthread_cond_broadcast(&engine->cond_v);
+        pthread_mutex_unlock(&engine->mutex);
+    } while (!exit);
+    return NULL;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_fn
+ * FUNCTION   : mm_camera_poll_engine_create
  *
- * DESCRIPTION: polling thread routine
+ * DESCRIPTION: create epoll set and eventfd, launch poll engine thread
  *
  * PARAMETERS :
- *   @poll_cb : ptr to poll thread object
+ *   @name    : thread name
  *
- * RETURN     : none
+ * RETURN     : ptr to poll engine, NULL on failure
  *==========================================================================*/
-static void *mm_camera_poll_fn(mm_camera_poll_thread_t *poll_cb)
+static mm_camera_poll_engine_t *mm_camera_poll_engine_create(const char *name)
 {
-    int rc = 0, i;
+    struct epoll_event ev;
+    mm_camera_poll_engine_t *engine =
+            (mm_camera_poll_engine_t *)malloc(sizeof(mm_camera_poll_engine_t));
+    if (NULL == engine) {
+        CDBG_ERROR("%s: No memory for poll engine", __func__);
+        return NULL;
+    }
+    memset(engine, 0, sizeof(mm_camera_poll_engine_t));
+    strlcpy(engine->threadName, name, sizeof(engine->threadName));
 
-    if (NULL == poll_cb) {
-        CDBG_ERROR("%s: poll_cb is NULL!\n", __func__);
+    engine->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (engine->epoll_fd < 0) {
+        CDBG_ERROR("%s: epoll_create1 failed, errno = %d", __func__, errno);
+        free(engine);
         return NULL;
     }
-    CDBG("%s: poll type = %d, num_fd = %d poll_cb = %p\n",
-         __func__, poll_cb->poll_type, poll_cb->num_fds,poll_cb);
-    do {
-         for(i = 0; i < poll_cb->num_fds; i++) {
-            poll_cb->poll_fds[i].events = POLLIN|POLLRDNORM|POLLPRI;
-         }
-
-         rc = poll(poll_cb->poll_fds, poll_cb->num_fds, poll_cb->timeoutms);
-         if(rc > 0) {
-            if ((poll_cb->poll_fds[0].revents & POLLIN) &&
-                (poll_cb->poll_fds[0].revents & POLLRDNORM)) {
-                /* if we have data on pipe, we only process pipe in this iteration */
-                CDBG("%s: cmd received on pipe\n", __func__);
-                mm_camera_poll_proc_pipe(poll_cb);
-            } else {
-                for(i=1; i<poll_cb->num_fds; i++) {
-                    /* Checking for ctrl events */
-                    if ((poll_cb->poll_type == MM_CAMERA_POLL_TYPE_EVT) &&
-                        (poll_cb->poll_fds[i].revents & POLLPRI)) {
-                        CDBG("%s: mm_camera_evt_notify\n", __func__);
-                        if (NULL != poll_cb->poll_entries[i-1].notify_cb) {
-                            poll_cb->poll_entries[i-1].notify_cb(poll_cb->poll_entries[i-1].user_data);
-                        }
-                    }
-
-                    if ((MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) &&
-                        (poll_cb->poll_fds[i].revents & POLLIN) &&
-                        (poll_cb->poll_fds[i].revents & POLLRDNORM)) {
-                        CDBG("%s: mm_stream_data_notify\n", __func__);
-                        if (NULL != poll_cb->poll_entries[i-1].notify_cb) {
-                            poll_cb->poll_entries[i-1].notify_cb(poll_cb->poll_entries[i-1].user_data);
-                        }
-                    }
-                }
-            }
-        } else {
-            /* in error case sleep 10 us and then continue. hard coded here */
-            usleep(10);
-            continue;
-        }
-    } while ((poll_cb != NULL) && (poll_cb->state == MM_CAMERA_POLL_TASK_STATE_POLL));
-    return NULL;
+    engine->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (engine->event_fd < 0) {
+        CDBG_ERROR("%s: eventfd failed, errno = %d", __func__, errno);
+        close(engine->epoll_fd);
+        free(engine);
+        return NULL;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = MM_CAMERA_POLL_CTRL_EVENT;
+    if (epoll_ctl(engine->epoll_fd, EPOLL_CTL_ADD, engine->event_fd, &ev) < 0) {
+        CDBG_ERROR("%s: epoll add eventfd failed, errno = %d", __func__, errno);
+        close(engine->event_fd);
+        close(engine->epoll_fd);
+        free(engine);
+        return NULL;
+    }
+
+    pthread_mutex_init(&engine->mutex, NULL);
+    pthread_cond_init(&engine->cond_v, NULL);
+    if (pthread_create(&engine->pid, NULL, mm_camera_poll_engine_fn,
+            (void *)engine) != 0) {
+        CDBG_ERROR("%s: failed to launch %s", __func__, name);
+        pthread_mutex_destroy(&engine->mutex);
+        pthread_cond_destroy(&engine->cond_v);
+        close(engine->event_fd);
+        close(engine->epoll_fd);
+        free(engine);
+        return NULL;
+    }
+    CDBG("%s: %s epoll fd = %d, event fd = %d", __func__, name,
+            engine->epoll_fd, engine->event_fd);
+    return engine;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_thread
+ * FUNCTION   : mm_camera_poll_engine_destroy
  *
- * DESCRIPTION: polling thread entry function
+ * DESCRIPTION: stop poll engine thread and free its resources
  *
  * PARAMETERS :
- *   @data    : ptr to poll thread object
+ *   @engine  : ptr to poll engine
  *
  * RETURN     : none
  *==========================================================================*/
-static void *mm_camera_poll_thread(void *data)
+static void mm_camera_poll_engine_destroy(mm_camera_poll_engine_t *engine)
 {
-    mm_camera_poll_thread_t *poll_cb = (mm_camera_poll_thread_t *)data;
-
-    mm_camera_cmd_thread_name(poll_cb->threadName);
-    /* add pipe read fd into poll first */
-    poll_cb->poll_fds[poll_cb->num_fds++].fd = poll_cb->pfds[0];
+    pthread_mutex_lock(&engine->mutex);
+    engine->exit = TRUE;
+    pthread_mutex_unlock(&engine->mutex);
+    mm_camera_poll_engine_wakeup(engine);
 
-    mm_camera_poll_sig_done(poll_cb);
-    mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_POLL);
-    return mm_camera_poll_fn(poll_cb);
+    /* wait until poll thread exits */
+    if (pthread_join(engine->pid, NULL) != 0) {
+        CDBG_ERROR("%s: pthread dead already\n", __func__);
+    }
+    close(engine->event_fd);
+    close(engine->epoll_fd);
+    pthread_mutex_destroy(&engine->mutex);
+    pthread_cond_destroy(&engine->cond_v);
+    free(engine);
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_thread
+ * FUNCTION   : mm_camera_poll_thread_notify_entries_updated
  *
  * DESCRIPTION: notify the polling thread that entries for polling fd have
  *              been updated
@@ -368,8 +311,8 @@ static void *mm_camera_poll_thread(void *data)
  *==========================================================================*/
 int32_t mm_camera_poll_thread_notify_entries_updated(mm_camera_poll_thread_t * poll_cb)
 {
-    /* send poll entries updated signal to poll thread */
-    return mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
+    /* entries are applied to the epoll set when updated */
+    return mm_camera_poll_thread_commit_updates(poll_cb);
 }
 
 /*===========================================================================
@@ -386,7 +329,18 @@ int32_t mm_camera_poll_thread_notify_entries_updated(mm_camera_poll_thread_t * p
  *==========================================================================*/
 int32_t mm_camera_poll_thread_commit_updates(mm_camera_poll_thread_t * poll_cb)
 {
-    return mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_COMMIT);
+    mm_camera_poll_engine_t *engine = poll_cb->engine;
+
+    if (NULL == engine) {
+        CDBG_ERROR("%s: poll thread is not running", __func__);
+        return -1;
+    }
+    /* async updates already hit the epoll set, only a callback of a
+     * removed fd can still be in flight */
+    pthread_mutex_lock(&engine->mutex);
+    mm_camera_poll_engine_quiesce(engine);
+    pthread_mutex_unlock(&engine->mutex);
+    return 0;
 }
 
 /*===========================================================================
@@ -414,6 +368,15 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
 {
     int32_t rc = -1;
     uint8_t idx = 0;
+    int32_t slot;
+    struct epoll_event ev;
+    mm_camera_poll_entry_t *entry = NULL;
+    mm_camera_poll_engine_t *engine = poll_cb->engine;
+
+    if (NULL == engine) {
+        CDBG_ERROR("%s: poll thread is not running", __func__);
+        return -1;
+    }
 
     if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) {
         /* get stream idx from handler if CH type */
@@ -423,21 +386,51 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
         idx = 0;
     }
 
-    if (MAX_STREAM_NUM_IN_BUNDLE > idx) {
-        poll_cb->poll_entries[idx].fd = fd;
-        poll_cb->poll_entries[idx].handler = handler;
-        poll_cb->poll_entries[idx].notify_cb = notify_cb;
-        poll_cb->poll_entries[idx].user_data = userdata;
-        /* send poll entries updated signal to poll thread */
-        if (call_type == mm_camera_sync_call ) {
-            rc = mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
-        } else {
-            rc = mm_camera_poll_sig_async(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC );
-        }
-    } else {
+    if (MAX_STREAM_NUM_IN_BUNDLE <= idx) {
         CDBG_ERROR("%s: invalid handler %d (%d)",
                    __func__, handler, idx);
+        return -1;
+    }
+
+    /* the fd is live in the epoll set on return, sync and async calls
+     * take the same path */
+    (void)call_type;
+    entry = &poll_cb->poll_entries[idx];
+    pthread_mutex_lock(&engine->mutex);
+    mm_camera_poll_engine_del_entry(engine, entry);
+    for (slot = 0; slot < MM_CAMERA_POLL_ENGINE_MAX_SLOTS; slot++) {
+        if (NULL == engine->slots[slot].entry) {
+            break;
+        }
     }
+    if (MM_CAMERA_POLL_ENGINE_MAX_SLOTS > slot) {
+        entry->fd = fd;
+        entry->handler = handler;
+        entry->notify_cb = notify_cb;
+        entry->user_data = userdata;
+        entry->slot = slot;
+        engine->slots[slot].entry = entry;
+        engine->slots[slot].gen++;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = entry->events;
+        ev.data.u64 = ((uint64_t)engine->slots[slot].gen << 32) |
+                (uint32_t)slot;
+        rc = epoll_ctl(engine->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        if (rc < 0) {
+            CDBG_ERROR("%s: epoll add fd %d failed, errno = %d",
+                    __func__, fd, errno);
+            engine->slots[slot].entry = NULL;
+            entry->slot = -1;
+            entry->fd = -1;
+            entry->handler = 0;
+            entry->notify_cb = NULL;
+            rc = -1;
+        }
+    } else {
+        CDBG_ERROR("%s: no free poll slot for fd %d", __func__, fd);
+    }
+    pthread_mutex_unlock(&engine->mutex);
     return rc;
 }
 
@@ -450,6 +443,7 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
  *   @poll_cb   : ptr to poll thread object
  *   @handler   : stream handle if channel data polling thread,
  *                0 if event polling thread
+ *   @call_type : sync call also waits for a callback in flight
  *
  * RETURN     : int32_t type of status
  *              0  -- success
@@ -461,6 +455,12 @@ int32_t mm_camera_poll_thread_del_poll_fd(mm_camera_poll_thread_t * poll_cb,
 {
     int32_t rc = -1;
     uint8_t idx = 0;
+    mm_camera_poll_engine_t *engine = poll_cb->engine;
+
+    if (NULL == engine) {
+        CDBG_ERROR("%s: poll thread is not running", __func__);
+        return -1;
+    }
 
     if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) {
         /* get stream idx from handler if CH type */
@@ -470,107 +470,385 @@ int32_t mm_camera_poll_thread_del_poll_fd(mm_camera_poll_thread_t * poll_cb,
         idx = 0;
     }
 
+    pthread_mutex_lock(&engine->mutex);
     if ((MAX_STREAM_NUM_IN_BUNDLE > idx) &&
         (handler == poll_cb->poll_entries[idx].handler)) {
         /* reset poll entry */
+        mm_camera_poll_engine_del_entry(engine, &poll_cb->poll_entries[idx]);
         poll_cb->poll_entries[idx].fd = -1; /* set fd to invalid */
         poll_cb->poll_entries[idx].handler = 0;
         poll_cb->poll_entries[idx].notify_cb = NULL;
 
-        /* send poll entries updated signal to poll thread */
-        if (call_type == mm_camera_sync_call ) {
-            rc = mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
-        } else {
-            rc = mm_camera_poll_sig_async(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC );
+        if (call_type == mm_camera_sync_call) {
+            mm_camera_poll_engine_quiesce(engine);
         }
+        rc = 0;
     } else {
         CDBG_ERROR("%s: invalid handler %d (%d)",
                    __func__, handler, idx);
-        return -1;
     }
+    pthread_mutex_unlock(&engine->mutex);
 
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_poll_thread_launch
+ *
+ * DESCRIPTION: attach poll thread object to a poll engine. DATA poll
+ *              threads share one engine, so streams of all channels are
+ *              serviced by a single thread.
+ *
+ * PARAMETERS :
+ *   @poll_cb   : ptr to poll thread object
+ *   @poll_type : poll thread type
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
 int32_t mm_camera_poll_thread_launch(mm_camera_poll_thread_t * poll_cb,
                                      mm_camera_poll_thread_type_t poll_type)
 {
     int32_t rc = 0;
     size_t i = 0, cnt = 0;
+    uint32_t events;
     poll_cb->poll_type = poll_type;
 
-    //Initialize poll_fds
-    cnt = sizeof(poll_cb->poll_fds) / sizeof(poll_cb->poll_fds[0]);
-    for (i = 0; i < cnt; i++) {
-        poll_cb->poll_fds[i].fd = -1;
+    if (MM_CAMERA_POLL_TYPE_EVT == poll_type) {
+        events = EPOLLPRI;
+#ifdef MM_CAMERA_SIM
+        /* the replay backend signals events as readable data, the msm
+         * video node never raises POLLIN on a ctrl fd */
+        events |= EPOLLIN;
+#endif
+    } else {
+        events = EPOLLIN | EPOLLRDNORM;
     }
     //Initialize poll_entries
     cnt = sizeof(poll_cb->poll_entries) / sizeof(poll_cb->poll_entries[0]);
     for (i = 0; i < cnt; i++) {
         poll_cb->poll_entries[i].fd = -1;
+        poll_cb->poll_entries[i].slot = -1;
+        poll_cb->poll_entries[i].events = events;
     }
-    //Initialize pipe fds
-    poll_cb->pfds[0] = -1;
-    poll_cb->pfds[1] = -1;
-    rc = pipe(poll_cb->pfds);
-    if(rc < 0) {
-        CDBG_ERROR("%s: pipe open rc=%d\n", __func__, rc);
-        return -1;
-    }
-
-    poll_cb->timeoutms = -1;  /* Infinite seconds */
 
-    CDBG("%s: poll_type = %d, read fd = %d, write fd = %d timeout = %d",
-        __func__, poll_cb->poll_type,
-        poll_cb->pfds[0], poll_cb->pfds[1],poll_cb->timeoutms);
-
-    pthread_mutex_init(&poll_cb->mutex, NULL);
-    pthread_cond_init(&poll_cb->cond_v, NULL);
-
-    /* launch the thread */
-    pthread_mutex_lock(&poll_cb->mutex);
-    poll_cb->status = 0;
-    pthread_create(&poll_cb->pid, NULL, mm_camera_poll_thread, (void *)poll_cb);
-    if(!poll_cb->status) {
-        pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
+    if (MM_CAMERA_POLL_TYPE_DATA == poll_type) {
+        if (poll_cb->cam_idx >= MM_CAMERA_MAX_NUM_SENSORS) {
+            CDBG_ERROR("%s: invalid camera index %d", __func__,
+                    poll_cb->cam_idx);
+            return -1;
+        }
+        pthread_mutex_lock(&g_poll_engine_lock);
+        if (NULL == g_data_poll_engine[poll_cb->cam_idx]) {
+            char name[THREAD_NAME_SIZE];
+            snprintf(name, sizeof(name), "CAM_dataPoll%d", poll_cb->cam_idx);
+            g_data_poll_engine[poll_cb->cam_idx] =
+                    mm_camera_poll_engine_create(name);
+        }
+        poll_cb->engine = g_data_poll_engine[poll_cb->cam_idx];
+        if (NULL != poll_cb->engine) {
+            poll_cb->engine->ref_cnt++;
+        }
+        pthread_mutex_unlock(&g_poll_engine_lock);
+    } else {
+        poll_cb->engine = mm_camera_poll_engine_create(poll_cb->threadName);
+        if (NULL != poll_cb->engine) {
+            poll_cb->engine->ref_cnt = 1;
+        }
     }
 
-    pthread_mutex_unlock(&poll_cb->mutex);
-    CDBG("%s: End",__func__);
+    if (NULL == poll_cb->engine) {
+        CDBG_ERROR("%s: no poll engine for type %d", __func__, poll_type);
+        return -1;
+    }
+    poll_cb->state = MM_CAMERA_POLL_TASK_STATE_POLL;
+    CDBG("%s: poll_type = %d, engine = %p", __func__, poll_type,
+            poll_cb->engine);
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_poll_thread_release
+ *
+ * DESCRIPTION: remove all fds of the poll thread object and detach it from
+ *              its engine. The engine stops with its last poll thread.
+ *
+ * PARAMETERS :
+ *   @poll_cb   : ptr to poll thread object
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
 int32_t mm_camera_poll_thread_release(mm_camera_poll_thread_t *poll_cb)
 {
     int32_t rc = 0;
-    if(MM_CAMERA_POLL_TASK_STATE_STOPPED == poll_cb->state) {
+    size_t i = 0, cnt = 0;
+    uint8_t destroy = FALSE;
+    mm_camera_poll_engine_t *engine = poll_cb->engine;
+
+    if ((MM_CAMERA_POLL_TASK_STATE_STOPPED == poll_cb->state) ||
+            (NULL == engine)) {
         CDBG_ERROR("%s: err, poll thread is not running.\n", __func__);
         return rc;
     }
 
-    /* send exit signal to poll thread */
-    mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_EXIT);
-    /* wait until poll thread exits */
-    if (pthread_join(poll_cb->pid, NULL) != 0) {
-        CDBG_ERROR("%s: pthread dead already\n", __func__);
+    pthread_mutex_lock(&engine->mutex);
+    cnt = sizeof(poll_cb->poll_entries) / sizeof(poll_cb->poll_entries[0]);
+    for (i = 0; i < cnt; i++) {
+        mm_camera_poll_engine_del_entry(engine, &poll_cb->poll_entries[i]);
     }
+    mm_camera_poll_engine_quiesce(engine);
+    pthread_mutex_unlock(&engine->mutex);
 
-    /* close pipe */
-    if(poll_cb->pfds[0] >= 0) {
-        close(poll_cb->pfds[0]);
+    if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) {
+        pthread_mutex_lock(&g_poll_engine_lock);
+        destroy = (0 == --engine->ref_cnt);
+        if (destroy) {
+            g_data_poll_engine[poll_cb->cam_idx] = NULL;
+        }
+        pthread_mutex_unlock(&g_poll_engine_lock);
+    } else {
+        destroy = TRUE;
     }
-    if(poll_cb->pfds[1] >= 0) {
-        close(poll_cb->pfds[1]);
+    if (destroy) {
+        mm_camera_poll_engine_destroy(engine);
     }
 
-    pthread_mutex_destroy(&poll_cb->mutex);
-    pthread_cond_destroy(&poll_cb->cond_v);
     memset(poll_cb, 0, sizeof(mm_camera_poll_thread_t));
-    poll_cb->pfds[0] = -1;
-    poll_cb->pfds[1] = -1;
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_pool_create
+ *
+ * DESCRIPTION: create a pool of preallocated cmd nodes
+ *
+ * PARAMETERS :
+ *   @name        : pool name used in stats log
+ *   @num_entries : number of preallocated cmd nodes
+ *
+ * RETURN     : ptr to pool, NULL on failure
+ *==========================================================================*/
+mm_camera_cmd_pool_t *mm_camera_cmd_pool_create(const char *name,
+                                                uint32_t num_entries)
+{
+    uint32_t i;
+    mm_camera_cmd_pool_t *pool = NULL;
+
+    if (0 == num_entries) {
+        return NULL;
+    }
+
+    pool = (mm_camera_cmd_pool_t *)malloc(sizeof(mm_camera_cmd_pool_t));
+    if (NULL == pool) {
+        CDBG_ERROR("%s: No memory for cmd pool", __func__);
+        return NULL;
+    }
+    memset(pool, 0, sizeof(mm_camera_cmd_pool_t));
+
+    pool->slab = (mm_camera_cmd_entry_t *)
+            malloc(num_entries * sizeof(mm_camera_cmd_entry_t));
+    if (NULL == pool->slab) {
+        CDBG_ERROR("%s: No memory for %d cmd nodes", __func__, num_entries);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    cam_list_init(&pool->free_list);
+    for (i = 0; i < num_entries; i++) {
+        pool->slab[i].pool = pool;
+        cam_list_add_tail_node(&pool->slab[i].qnode.list, &pool->free_list);
+    }
+    pool->num_entries = num_entries;
+    if (NULL != name) {
+        strlcpy(pool->name, name, sizeof(pool->name));
+    }
+    return pool;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_pool_destroy
+ *
+ * DESCRIPTION: free pool memory once no entry is in use
+ *
+ * PARAMETERS :
+ *   @pool    : ptr to pool
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_cmd_pool_destroy(mm_camera_cmd_pool_t *pool)
+{
+    CDBG_HIGH("%s: %s: %d nodes, high water %d, allocs avoided %d, "
+            "heap fallbacks %d", __func__, pool->name, pool->num_entries,
+            pool->high_water, pool->alloc_avoided, pool->alloc_fallback);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->slab);
+    free(pool);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_pool_release
+ *
+ * DESCRIPTION: release pool by its owner. Entries still queued to a cmd
+ *              thread stay valid, the last mm_camera_cmd_free frees them.
+ *
+ * PARAMETERS :
+ *   @pool    : ptr to pool
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_cmd_pool_release(mm_camera_cmd_pool_t *pool)
+{
+    uint8_t destroy = FALSE;
+
+    if (NULL == pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->released = TRUE;
+    destroy = (0 == pool->in_use);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (destroy) {
+        mm_camera_cmd_pool_destroy(pool);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_alloc
+ *
+ * DESCRIPTION: get a zeroed cmd node, from pool if one is free, otherwise
+ *              from heap
+ *
+ * PARAMETERS :
+ *   @pool    : ptr to pool, can be NULL
+ *
+ * RETURN     : ptr to cmd, NULL if out of memory
+ *==========================================================================*/
+mm_camera_cmdcb_t *mm_camera_cmd_alloc(mm_camera_cmd_pool_t *pool)
+{
+    mm_camera_cmd_entry_t *entry = NULL;
+    struct cam_list *pos = NULL;
+
+    if (NULL != pool) {
+        pthread_mutex_lock(&pool->lock);
+        pos = pool->free_list.next;
+        if (pos != &pool->free_list) {
+            cam_list_del_node(pos);
+            entry = member_of(pos, mm_camera_cmd_entry_t, qnode.list);
+            pool->in_use++;
+            if (pool->in_use > pool->high_water) {
+                pool->high_water = pool->in_use;
+            }
+            pool->alloc_avoided++;
+        } else {
+            pool->alloc_fallback++;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (NULL == entry) {
+        entry = (mm_camera_cmd_entry_t *)malloc(sizeof(mm_camera_cmd_entry_t));
+        if (NULL == entry) {
+            return NULL;
+        }
+        entry->pool = NULL;
+    }
+
+    memset(&entry->cmd, 0, sizeof(mm_camera_cmdcb_t));
+    return &entry->cmd;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_free
+ *
+ * DESCRIPTION: return cmd node obtained from mm_camera_cmd_alloc
+ *
+ * PARAMETERS :
+ *   @cmd     : ptr to cmd
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_cmd_free(mm_camera_cmdcb_t *cmd)
+{
+    mm_camera_cmd_entry_t *entry = NULL;
+    mm_camera_cmd_pool_t *pool = NULL;
+    uint8_t destroy = FALSE;
+
+    if (NULL == cmd) {
+        return;
+    }
+
+    entry = member_of(cmd, mm_camera_cmd_entry_t, cmd);
+    pool = entry->pool;
+    if (NULL == pool) {
+        free(entry);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    cam_list_add_tail_node(&entry->qnode.list, &pool->free_list);
+    pool->in_use--;
+    destroy = (pool->released && (0 == pool->in_use));
+    pthread_mutex_unlock(&pool->lock);
+
+    if (destroy) {
+        mm_camera_cmd_pool_destroy(pool);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_thread_enq
+ *
+ * DESCRIPTION: enqueue cmd obtained from mm_camera_cmd_alloc to cmd thread.
+ *              Caller posts cmd_sem to wake up the thread.
+ *
+ * PARAMETERS :
+ *   @cmd_thread : ptr to cmd thread
+ *   @cmd        : ptr to cmd
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_cmd_thread_enq(mm_camera_cmd_thread_t *cmd_thread,
+                                 mm_camera_cmdcb_t *cmd)
+{
+    mm_camera_cmd_entry_t *entry = NULL;
+
+    if ((NULL == cmd_thread) || (NULL == cmd)) {
+        return -1;
+    }
+
+    entry = member_of(cmd, mm_camera_cmd_entry_t, cmd);
+    cam_queue_enq_node(&cmd_thread->cmd_queue, &entry->qnode, cmd);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_thread_deq
+ *
+ * DESCRIPTION: dequeue next cmd from cmd thread queue
+ *
+ * PARAMETERS :
+ *   @cmd_thread : ptr to cmd thread
+ *
+ * RETURN     : ptr to cmd, NULL if queue is empty
+ *==========================================================================*/
+static mm_camera_cmdcb_t *mm_camera_cmd_thread_deq(
+        mm_camera_cmd_thread_t *cmd_thread)
+{
+    cam_node_t *qnode = cam_queue_deq_node(&cmd_thread->cmd_queue);
+    if (NULL == qnode) {
+        return NULL;
+    }
+    return (mm_camera_cmdcb_t *)qnode->data;
+}
+
 static void *mm_camera_cmd_thread(void *data)
 {
     int running = 1;
@@ -591,7 +869,7 @@ static void *mm_camera_cmd_thread(void *data)
         } while (ret != 0);
 
         /* we got notified about new cmd avail in cmd queue */
-        node = (mm_camera_cmdcb_t*)cam_queue_deq(&cmd_thread->cmd_queue);
+        node = mm_camera_cmd_thread_deq(cmd_thread);
         while (node != NULL) {
             switch (node->cmd_type) {
             case MM_CAMERA_CMD_TYPE_EVT_CB:
@@ -612,8 +890,8 @@ static void *mm_camera_cmd_thread(void *data)
                 running = 0;
                 break;
             }
-            free(node);
-            node = (mm_camera_cmdcb_t*)cam_queue_deq(&cmd_thread->cmd_queue);
+            mm_camera_cmd_free(node);
+            node = mm_camera_cmd_thread_deq(cmd_thread);
         } /* (node != NULL) */
     } while (running);
     return NULL;
@@ -653,16 +931,15 @@ int32_t mm_camera_cmd_thread_name(const char* name)
 int32_t mm_camera_cmd_thread_stop(mm_camera_cmd_thread_t * cmd_thread)
 {
     int32_t rc = 0;
-    mm_camera_cmdcb_t* node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    mm_camera_cmdcb_t* node = mm_camera_cmd_alloc(NULL);
     if (NULL == node) {
         CDBG_ERROR("%s: No memory for mm_camera_cmdcb_t", __func__);
         return -1;
     }
 
-    memset(node, 0, sizeof(mm_camera_cmdcb_t));
     node->cmd_type = MM_CAMERA_CMD_TYPE_EXIT;
 
-    cam_queue_enq(&cmd_thread->cmd_queue, node);
+    mm_camera_cmd_thread_enq(cmd_thread, node);
     cam_sem_post(&cmd_thread->cmd_sem);
 
     /* wait until cmd thread exits */
@@ -675,6 +952,12 @@ int32_t mm_camera_cmd_thread_stop(mm_camera_cmd_thread_t * cmd_thread)
 int32_t mm_camera_cmd_thread_destroy(mm_camera_cmd_thread_t * cmd_thread)
 {
     int32_t rc = 0;
+    mm_camera_cmdcb_t *node = NULL;
+
+    /* cmd nodes are not plain heap nodes, drain them before deinit */
+    while (NULL != (node = mm_camera_cmd_thread_deq(cmd_thread))) {
+        mm_camera_cmd_free(node);
+    }
     cam_queue_deinit(&cmd_thread->cmd_queue);
     cam_sem_destroy(&cmd_thread->cmd_sem);
     cam_sem_destroy(&cmd_thread->sync_sem);
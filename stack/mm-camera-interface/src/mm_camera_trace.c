@@ -0,0 +1,361 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <cutils/properties.h>
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+#include "mm_camera_trace.h"
+
+/* events per thread, power of 2 */
+#define MM_CAMERA_TRACE_RING_SIZE 2048
+#define MM_CAMERA_TRACE_MAX_RINGS 64
+
+/* all fields are accessed atomically, see mm_camera_trace_record */
+typedef struct {
+    uint32_t seq;          /* event number + 1, 0 while being written */
+    uint32_t frame_idx;
+    uint64_t ts_ns;
+    const char *name;
+    int32_t tid;
+    uint32_t info;         /* stream type | phase << 16 */
+} mm_camera_trace_event_t;
+
+/* single writer ring, only the owning thread advances head */
+typedef struct {
+    uint32_t in_use;
+    uint32_t head;
+    int32_t tid;
+    mm_camera_trace_event_t events[MM_CAMERA_TRACE_RING_SIZE];
+} mm_camera_trace_ring_t;
+
+volatile uint32_t g_mm_camera_trace_enabled = 0;
+
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_trace_key;
+static mm_camera_trace_ring_t *g_trace_rings[MM_CAMERA_TRACE_MAX_RINGS];
+static uint32_t g_trace_num_rings;
+static int g_trace_sig_pipe[2] = {-1, -1};
+
+static const char g_trace_phase[] = {'i', 'B', 'E'};
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_release_ring
+ *
+ * DESCRIPTION: thread exit hook, the ring keeps its events and can be
+ *              taken over by a new thread
+ *
+ * PARAMETERS :
+ *   @data    : ring of the exiting thread
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_trace_release_ring(void *data)
+{
+    mm_camera_trace_ring_t *ring = (mm_camera_trace_ring_t *)data;
+    __atomic_store_n(&ring->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_create_key
+ *
+ * DESCRIPTION: create the per thread ring key
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_trace_create_key(void)
+{
+    pthread_key_create(&g_trace_key, mm_camera_trace_release_ring);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_get_ring
+ *
+ * DESCRIPTION: ring of the calling thread, claimed on first use
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : ring ptr, NULL if all rings are taken
+ *==========================================================================*/
+static mm_camera_trace_ring_t *mm_camera_trace_get_ring(void)
+{
+    mm_camera_trace_ring_t *ring;
+    uint32_t i;
+
+    pthread_once(&g_trace_once, mm_camera_trace_create_key);
+    ring = (mm_camera_trace_ring_t *)pthread_getspecific(g_trace_key);
+    if (NULL != ring) {
+        return ring;
+    }
+
+    pthread_mutex_lock(&g_trace_lock);
+    for (i = 0; i < g_trace_num_rings; i++) {
+        if (0 == __atomic_load_n(&g_trace_rings[i]->in_use, __ATOMIC_ACQUIRE)) {
+            ring = g_trace_rings[i];
+            break;
+        }
+    }
+    if ((NULL == ring) && (MM_CAMERA_TRACE_MAX_RINGS > g_trace_num_rings)) {
+        ring = (mm_camera_trace_ring_t *)calloc(1, sizeof(*ring));
+        if (NULL != ring) {
+            g_trace_rings[g_trace_num_rings] = ring;
+            __atomic_store_n(&g_trace_num_rings, g_trace_num_rings + 1,
+                    __ATOMIC_RELEASE);
+        }
+    }
+    if (NULL != ring) {
+        ring->in_use = 1;
+        ring->tid = (int32_t)syscall(__NR_gettid);
+        pthread_setspecific(g_trace_key, ring);
+    }
+    pthread_mutex_unlock(&g_trace_lock);
+    return ring;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_record
+ *
+ * DESCRIPTION: append an event to the ring of the calling thread. Callers
+ *              go through the MM_CAMERA_TRACE_* macros so a disabled trace
+ *              costs one load and branch.
+ *
+ * PARAMETERS :
+ *   @name        : event name, string literal
+ *   @stream_type : cam_stream_type_t of the frame
+ *   @frame_idx   : frame index
+ *   @phase       : instant, begin or end
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_trace_record(const char *name, uint32_t stream_type,
+        uint32_t frame_idx, mm_camera_trace_phase_t phase)
+{
+    struct timespec ts;
+    mm_camera_trace_ring_t *ring = mm_camera_trace_get_ring();
+    mm_camera_trace_event_t *ev;
+    uint32_t head;
+
+    if (NULL == ring) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    head = ring->head;
+    ev = &ring->events[head & (MM_CAMERA_TRACE_RING_SIZE - 1)];
+
+    /* per slot seqlock against a concurrent dump, relaxed stores compile
+     * to plain stores */
+    __atomic_store_n(&ev->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&ev->frame_idx, frame_idx, __ATOMIC_RELAXED);
+    __atomic_store_n(&ev->ts_ns,
+            (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec,
+            __ATOMIC_RELAXED);
+    __atomic_store_n(&ev->name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&ev->tid, ring->tid, __ATOMIC_RELAXED);
+    __atomic_store_n(&ev->info, (stream_type & 0xFFFF) | ((uint32_t)phase << 16),
+            __ATOMIC_RELAXED);
+    __atomic_store_n(&ev->seq, head + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_dump
+ *
+ * DESCRIPTION: write all rings as Chrome trace event JSON, loadable in
+ *              chrome://tracing and Perfetto. Recording goes on while
+ *              the dump runs, events overwritten meanwhile are skipped.
+ *
+ * PARAMETERS :
+ *   @fd      : output fd
+ *
+ * RETURN     : number of events written
+ *==========================================================================*/
+int32_t mm_camera_trace_dump(int fd)
+{
+    uint32_t num_rings = __atomic_load_n(&g_trace_num_rings, __ATOMIC_ACQUIRE);
+    uint32_t r, i, head, start;
+    int32_t count = 0;
+    int pid = getpid();
+    uint32_t frame_idx, info;
+    uint64_t ts_ns;
+    const char *name;
+    int32_t tid;
+
+    dprintf(fd, "{\"traceEvents\":[");
+    for (r = 0; r < num_rings; r++) {
+        mm_camera_trace_ring_t *ring = g_trace_rings[r];
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        start = (head > MM_CAMERA_TRACE_RING_SIZE) ?
+                head - MM_CAMERA_TRACE_RING_SIZE : 0;
+        for (i = start; i < head; i++) {
+            mm_camera_trace_event_t *slot =
+                    &ring->events[i & (MM_CAMERA_TRACE_RING_SIZE - 1)];
+            if ((i + 1) != __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+            frame_idx = __atomic_load_n(&slot->frame_idx, __ATOMIC_RELAXED);
+            ts_ns = __atomic_load_n(&slot->ts_ns, __ATOMIC_RELAXED);
+            name = __atomic_load_n(&slot->name, __ATOMIC_RELAXED);
+            tid = __atomic_load_n(&slot->tid, __ATOMIC_RELAXED);
+            info = __atomic_load_n(&slot->info, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if ((i + 1) != __atomic_load_n(&slot->seq, __ATOMIC_RELAXED)) {
+                continue;
+            }
+            dprintf(fd, "%s\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"%c\","
+                    "\"ts\":%" PRIu64 ".%03u,\"pid\":%d,\"tid\":%d,%s"
+                    "\"args\":{\"frame\":%u,\"stream\":%u}}",
+                    (0 == count) ? "" : ",", name, g_trace_phase[info >> 16],
+                    ts_ns / 1000, (uint32_t)(ts_ns % 1000), pid, tid,
+                    (MM_CAMERA_TRACE_INSTANT == (info >> 16)) ? "\"s\":\"t\"," : "",
+                    frame_idx, info & 0xFFFF);
+            count++;
+        }
+    }
+    dprintf(fd, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    return count;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_signal_handler
+ *
+ * DESCRIPTION: dump signal handler, defers the dump to the dump thread
+ *
+ * PARAMETERS :
+ *   @sig     : signal number
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_trace_signal_handler(int sig)
+{
+    char c = (char)sig;
+    int saved_errno = errno;
+    if (write(g_trace_sig_pipe[1], &c, 1) < 0) {
+        /* dump already pending */
+    }
+    errno = saved_errno;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_dump_routine
+ *
+ * DESCRIPTION: writes a trace file each time the dump signal arrives
+ *
+ * PARAMETERS :
+ *   @data    : unused
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void *mm_camera_trace_dump_routine(void *data)
+{
+    char path[64];
+    char c;
+    uint32_t n = 0;
+    int fd;
+    int32_t count;
+
+    (void)data;
+    pthread_setname_np(pthread_self(), "CAM_TraceDump");
+    while (read(g_trace_sig_pipe[0], &c, 1) >= 0 || EINTR == errno) {
+        snprintf(path, sizeof(path), QCAMERA_DUMP_FRM_LOCATION
+                "cam_frame_trace_%d_%u.json", getpid(), n++);
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (0 > fd) {
+            CDBG_ERROR("%s: cannot open %s (%s)", __func__, path,
+                    strerror(errno));
+            continue;
+        }
+        count = mm_camera_trace_dump(fd);
+        close(fd);
+        CDBG_HIGH("%s: %d events written to %s", __func__, count, path);
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_init
+ *
+ * DESCRIPTION: read the trace properties, install the dump signal. Safe
+ *              to call more than once, only the first call has effect.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_trace_init(void)
+{
+    static uint8_t initialized = 0;
+    char prop[PROPERTY_VALUE_MAX];
+    struct sigaction sa;
+    pthread_t pid;
+    int sig;
+
+    pthread_mutex_lock(&g_trace_lock);
+    if (initialized) {
+        pthread_mutex_unlock(&g_trace_lock);
+        return;
+    }
+    initialized = 1;
+
+    property_get("persist.camera.trace.frames", prop, "0");
+    if (0 >= atoi(prop)) {
+        pthread_mutex_unlock(&g_trace_lock);
+        return;
+    }
+    property_get("persist.camera.trace.signal", prop, "0");
+    sig = atoi(prop);
+    if ((0 < sig) && (0 == pipe2(g_trace_sig_pipe, O_CLOEXEC | O_NONBLOCK))) {
+        /* reader blocks, only the handler side must never block */
+        fcntl(g_trace_sig_pipe[0], F_SETFL, 0);
+        if (0 == pthread_create(&pid, NULL, mm_camera_trace_dump_routine, NULL)) {
+            pthread_detach(pid);
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = mm_camera_trace_signal_handler;
+            sa.sa_flags = SA_RESTART;
+            sigemptyset(&sa.sa_mask);
+            sigaction(sig, &sa, NULL);
+        }
+    }
+    g_mm_camera_trace_enabled = 1;
+    pthread_mutex_unlock(&g_trace_lock);
+    CDBG_HIGH("%s: frame trace enabled, dump signal %d", __func__, sig);
+}
@@ -248,6 +248,10 @@ typedef struct {
     mm_camera_queue_t pp_frames;
     mm_camera_stream_t *reproc_stream;
     metadata_buffer_t *metadata;
+    /* compact metadata and its re-encoded copy, see mm_app_meta_roundtrip */
+    void *meta_blob;
+    void *meta_blob_check;
+    size_t meta_blob_size;
     int8_t is_chromatix_reload;
 } mm_camera_test_obj_t;
 
@@ -470,6 +474,9 @@ extern int mm_app_set_preview_fps_range(mm_camera_test_obj_t *test_obj,
                         cam_fps_range_t *fpsRange);
 extern int mm_app_set_face_detection(mm_camera_test_obj_t *test_obj,
                         cam_fd_set_parm_t *fd_set_parm);
+extern int mm_app_meta_roundtrip(mm_camera_test_obj_t *test_obj,
+                                 metadata_buffer_t *dst,
+                                 const metadata_buffer_t *src);
 extern int mm_app_set_metadata_usercb(mm_camera_test_obj_t *test_obj,
                       cam_stream_user_cb usercb);
 extern int mm_app_set_face_detection(mm_camera_test_obj_t *test_obj,
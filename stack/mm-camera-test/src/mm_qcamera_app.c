@@ -618,13 +618,8 @@ int init_batch_update(parm_buffer_t *p_table)
 int commit_set_batch(mm_camera_test_obj_t *test_obj)
 {
     int rc = MM_CAMERA_OK;
-    int i = 0;
 
-    for(i = 0; i < CAM_INTF_PARM_MAX; i++){
-        if(test_obj->params_buffer->is_valid[i])
-            break;
-    }
-    if (i < CAM_INTF_PARM_MAX) {
+    if (mm_camera_meta_has_valid(test_obj->params_buffer)) {
         CDBG_HIGH("\n set_param p_buffer =%p\n",test_obj->params_buffer);
         rc = test_obj->cam->ops->set_parms(test_obj->cam->camera_handle, test_obj->params_buffer);
     }
@@ -684,6 +679,12 @@ int mm_app_close(mm_camera_test_obj_t *test_obj)
         CDBG_ERROR("%s: release setparm buf failed, rc=%d", __func__, rc);
     }
 
+    free(test_obj->meta_blob);
+    free(test_obj->meta_blob_check);
+    test_obj->meta_blob = NULL;
+    test_obj->meta_blob_check = NULL;
+    test_obj->meta_blob_size = 0;
+
     return MM_CAMERA_OK;
 }
 
@@ -839,14 +840,9 @@ int initBatchUpdate(mm_camera_test_obj_t *test_obj)
 int commitSetBatch(mm_camera_test_obj_t *test_obj)
 {
     int rc = MM_CAMERA_OK;
-    int i = 0;
 
     parm_buffer_t *p_table = ( parm_buffer_t * ) test_obj->parm_buf.mem_info.data;
-    for(i = 0; i < CAM_INTF_PARM_MAX; i++){
-        if(p_table->is_valid[i])
-            break;
-    }
-    if (i < CAM_INTF_PARM_MAX) {
+    if (mm_camera_meta_has_valid(p_table)) {
         rc = test_obj->cam->ops->set_parms(test_obj->cam->camera_handle, p_table);
     }
     return rc;
@@ -856,13 +852,8 @@ int commitSetBatch(mm_camera_test_obj_t *test_obj)
 int commitGetBatch(mm_camera_test_obj_t *test_obj)
 {
     int rc = MM_CAMERA_OK;
-    int i = 0;
     parm_buffer_t *p_table = ( parm_buffer_t * ) test_obj->parm_buf.mem_info.data;
-    for(i = 0; i < CAM_INTF_PARM_MAX; i++){
-        if(p_table->is_valid[i])
-            break;
-    }
-    if (i < CAM_INTF_PARM_MAX) {
+    if (mm_camera_meta_has_valid(p_table)) {
         rc = test_obj->cam->ops->get_parms(test_obj->cam->camera_handle, p_table);
     }
     return rc;
@@ -2393,4 +2384,49 @@ int mm_app_set_metadata_usercb(mm_camera_test_obj_t *test_obj,
     return 0;
 }
 
+/* Copy metadata through its compact form, and check that encoding the copy
+ * again gives the same bytes. Falls back to a sparse copy if the codec
+ * fails, so callers always get the metadata. */
+int mm_app_meta_roundtrip(mm_camera_test_obj_t *test_obj,
+                          metadata_buffer_t *dst,
+                          const metadata_buffer_t *src)
+{
+    size_t len, enc;
+
+    if (test_obj == NULL || dst == NULL || src == NULL) {
+        CDBG_ERROR("%s, invalid params!", __func__);
+        return MM_CAMERA_E_INVALID_INPUT;
+    }
+
+    len = mm_camera_meta_encoded_size(src);
+    if (len > test_obj->meta_blob_size) {
+        free(test_obj->meta_blob);
+        free(test_obj->meta_blob_check);
+        test_obj->meta_blob = malloc(len);
+        test_obj->meta_blob_check = malloc(len);
+        if (test_obj->meta_blob == NULL || test_obj->meta_blob_check == NULL) {
+            CDBG_ERROR("%s: Cannot allocate %zu bytes\n", __func__, len);
+            free(test_obj->meta_blob);
+            free(test_obj->meta_blob_check);
+            test_obj->meta_blob = NULL;
+            test_obj->meta_blob_check = NULL;
+            test_obj->meta_blob_size = 0;
+            mm_camera_meta_copy(dst, src);
+            return -MM_CAMERA_E_NO_MEMORY;
+        }
+        test_obj->meta_blob_size = len;
+    }
+
+    enc = mm_camera_meta_encode(src, test_obj->meta_blob, len);
+    if ((enc != len) ||
+            (mm_camera_meta_decode(test_obj->meta_blob, enc, dst) != 0) ||
+            (mm_camera_meta_encode(dst, test_obj->meta_blob_check, len) != enc) ||
+            memcmp(test_obj->meta_blob, test_obj->meta_blob_check, enc)) {
+        CDBG_ERROR("%s: metadata round trip of %zu bytes failed\n",
+                __func__, len);
+        mm_camera_meta_copy(dst, src);
+        return -MM_CAMERA_E_GENERAL;
+    }
 
+    return MM_CAMERA_OK;
+}
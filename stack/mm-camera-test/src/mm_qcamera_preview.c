@@ -91,7 +91,7 @@ static void mm_app_metadata_notify_cb(mm_camera_super_buf_t *bufs,
         return;
     }
   }
-  memcpy(pme->metadata, frame->buffer, sizeof(metadata_buffer_t));
+  mm_app_meta_roundtrip(pme, pme->metadata, frame->buffer);
 
   pMetadata = (metadata_buffer_t *)frame->buffer;
   IF_META_AVAILABLE(uint32_t, afState, CAM_INTF_META_AF_STATE, pMetadata) {
@@ -406,7 +406,7 @@ static void mm_app_zsl_notify_cb(mm_camera_super_buf_t *bufs,
           }
       }
 
-      memcpy(pme->metadata , md_frame->buffer, sizeof(metadata_buffer_t));
+      mm_camera_meta_copy(pme->metadata, md_frame->buffer);
     }
     /* find snapshot frame */
     for (i = 0; i < bufs->num_bufs; i++) {
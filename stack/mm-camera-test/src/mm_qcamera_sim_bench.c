@@ -0,0 +1,182 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Preview pipeline benchmark on the mm-camera-interface replay backend.
+ * Runs preview + metadata through the regular interface, poll and channel
+ * threads with frames played back from <dir>/cam<idx>_<stream>.bin and
+ * reports frames/s, per stage latency and CPU time per frame, followed by
+ * the interface frame latency histograms.
+ * <dir>/cam<idx>_caps.bin must hold a cam_capability_t dump of the target.
+ * Usage: mm-qcamera-sim-bench [-d replay dir] [-f fps] [-t seconds]
+ *                             [-c camera idx]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "mm_qcamera_dbg.h"
+#include "mm_qcamera_app.h"
+#include "mm_camera_sim.h"
+
+#define BENCH_MAX_STREAMS MM_CAMERA_SIM_MAX_STREAMS
+
+typedef struct {
+    uint32_t frames;
+    uint64_t lat_sum_ns;
+    uint64_t lat_max_ns;
+} bench_cb_stats_t;
+
+static bench_cb_stats_t g_bench_preview;
+
+static uint64_t bench_ts_ns(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+}
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return bench_ts_ns(&ts);
+}
+
+static uint64_t bench_cpu_ns(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ((uint64_t)ru.ru_utime.tv_sec + (uint64_t)ru.ru_stime.tv_sec) *
+            1000000000ULL +
+            ((uint64_t)ru.ru_utime.tv_usec + (uint64_t)ru.ru_stime.tv_usec) *
+            1000ULL;
+}
+
+/* runs on the channel callback thread, frame->ts is the backend ready time */
+static void bench_preview_cb(mm_camera_buf_def_t *frame)
+{
+    uint64_t lat = bench_now_ns() - bench_ts_ns(&frame->ts);
+    g_bench_preview.frames++;
+    g_bench_preview.lat_sum_ns += lat;
+    if (g_bench_preview.lat_max_ns < lat) {
+        g_bench_preview.lat_max_ns = lat;
+    }
+}
+
+static void bench_print_stream(const mm_camera_sim_stream_stats_t *s)
+{
+    printf("stream %2u type %2d: frames %6u drops %5u | ready->dqbuf avg %7.1f us"
+            " max %7.1f us | dqbuf->qbuf avg %8.1f us max %8.1f us\n",
+            s->server_stream_id, s->stream_type, s->frames, s->drops,
+            s->dequeued ? (double)s->dq_lat_sum_ns / s->dequeued / 1000.0 : 0.0,
+            (double)s->dq_lat_max_ns / 1000.0,
+            s->returned ? (double)s->hold_sum_ns / s->returned / 1000.0 : 0.0,
+            (double)s->hold_max_ns / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = NULL;
+    uint32_t fps = 30;
+    uint32_t seconds = 10;
+    int cam_idx = 0;
+    int opt;
+    int rc;
+    mm_camera_lib_handle handle;
+    mm_camera_sim_stream_stats_t stats[BENCH_MAX_STREAMS];
+    uint32_t num_streams = 0;
+    uint32_t i;
+
+    while ((opt = getopt(argc, argv, "d:f:t:c:")) != -1) {
+        switch (opt) {
+        case 'd':
+            dir = optarg;
+            break;
+        case 'f':
+            fps = (uint32_t)atoi(optarg);
+            break;
+        case 't':
+            seconds = (uint32_t)atoi(optarg);
+            break;
+        case 'c':
+            cam_idx = atoi(optarg);
+            break;
+        default:
+            printf("usage: %s [-d replay dir] [-f fps] [-t seconds] [-c camera]\n",
+                    argv[0]);
+            return -1;
+        }
+    }
+    if ((0 > cam_idx) || (MM_CAMERA_MAX_NUM_SENSORS <= cam_idx)) {
+        printf("invalid camera %d\n", cam_idx);
+        return -1;
+    }
+
+    mm_camera_sim_configure(dir, fps, (uint8_t)(cam_idx + 1));
+
+    rc = mm_camera_lib_open(&handle, cam_idx);
+    if (MM_CAMERA_OK != rc) {
+        printf("mm_camera_lib_open failed (%d)\n", rc);
+        return rc;
+    }
+    mm_camera_lib_set_preview_usercb(&handle, bench_preview_cb);
+
+    uint64_t cpu_start = bench_cpu_ns();
+    uint64_t wall_start = bench_now_ns();
+    rc = mm_camera_lib_start_stream(&handle);
+    if (MM_CAMERA_OK != rc) {
+        printf("start stream failed (%d)\n", rc);
+        mm_camera_lib_close(&handle);
+        return rc;
+    }
+    sleep(seconds);
+    mm_camera_sim_get_stats((uint8_t)cam_idx, stats, BENCH_MAX_STREAMS,
+            &num_streams);
+    mm_camera_lib_stop_stream(&handle);
+    uint64_t wall_ns = bench_now_ns() - wall_start;
+    uint64_t cpu_ns = bench_cpu_ns() - cpu_start;
+    handle.test_obj.cam->ops->dump_latency(
+            handle.test_obj.cam->camera_handle, STDOUT_FILENO);
+    mm_camera_lib_close(&handle);
+
+    for (i = 0; i < num_streams; i++) {
+        bench_print_stream(&stats[i]);
+    }
+    printf("preview: %u frames in %.2f s, %.2f fps, ready->app cb avg %.1f us"
+            " max %.1f us\n", g_bench_preview.frames, (double)wall_ns / 1e9,
+            (double)g_bench_preview.frames * 1e9 / (double)wall_ns,
+            g_bench_preview.frames ?
+            (double)g_bench_preview.lat_sum_ns / g_bench_preview.frames / 1000.0 :
+            0.0, (double)g_bench_preview.lat_max_ns / 1000.0);
+    printf("cpu: %.1f ms total, %.1f us per preview frame\n",
+            (double)cpu_ns / 1e6, g_bench_preview.frames ?
+            (double)cpu_ns / g_bench_preview.frames / 1000.0 : 0.0);
+    return 0;
+}
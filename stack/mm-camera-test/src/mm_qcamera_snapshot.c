@@ -236,7 +236,7 @@ static void mm_app_snapshot_metadata_notify_cb(mm_camera_super_buf_t *bufs,
     }
   }
 
-  memcpy(pme->metadata , frame->buffer, sizeof(metadata_buffer_t));
+  mm_camera_meta_copy(pme->metadata, frame->buffer);
 
   pMetadata = (metadata_buffer_t *)frame->buffer;
 
@@ -0,0 +1,205 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Superbuf matching benchmark. Feeds a ZSL style bundle (snapshot, raw and
+ * metadata, metadata one frame late and every 16th metadata lost) straight
+ * into the channel superbuf queue with the look back water mark set to
+ * 2..32 superbufs, and reports the cost of comp_and_enqueue per buffer.
+ * No camera or daemon is needed, the streams are bare objects whose bufs
+ * are never handed to the kernel.
+ * Usage: mm-qcamera-superbuf-bench [-n frames per depth]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "mm_camera.h"
+
+#define BENCH_NUM_STREAMS 3
+#define BENCH_NUM_BUFS 40
+#define BENCH_META_LOSS_PERIOD 16
+
+typedef struct {
+    uint64_t bufs;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+} bench_stats_t;
+
+static const uint32_t g_depths[] = {2, 4, 8, 16, 32};
+
+static const cam_stream_type_t g_types[BENCH_NUM_STREAMS] = {
+    CAM_STREAM_TYPE_SNAPSHOT,
+    CAM_STREAM_TYPE_RAW,
+    CAM_STREAM_TYPE_METADATA,
+};
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_feed(mm_channel_t *ch, uint32_t s_idx, uint32_t frame_idx,
+        mm_camera_buf_def_t *bufs, bench_stats_t *stats)
+{
+    mm_camera_buf_info_t info;
+    mm_camera_buf_def_t *buf = &bufs[frame_idx % BENCH_NUM_BUFS];
+    uint64_t start, ns;
+
+    buf->frame_idx = frame_idx;
+    memset(&info, 0, sizeof(info));
+    info.buf = buf;
+    info.stream_id = ch->streams[s_idx].my_hdl;
+    info.frame_idx = frame_idx;
+
+    start = bench_now_ns();
+    mm_channel_superbuf_comp_and_enqueue(ch, &ch->bundle.superbuf_queue, &info);
+    ns = bench_now_ns() - start;
+
+    /* same as the channel cmd thread after every buffer */
+    mm_channel_superbuf_bufdone_overflow(ch, &ch->bundle.superbuf_queue);
+
+    stats->bufs++;
+    stats->sum_ns += ns;
+    if (stats->max_ns < ns) {
+        stats->max_ns = ns;
+    }
+}
+
+static int bench_run(mm_channel_t *ch, uint32_t depth, uint32_t frames,
+        mm_camera_buf_def_t bufs[][BENCH_NUM_BUFS])
+{
+    mm_channel_queue_t *queue = &ch->bundle.superbuf_queue;
+    bench_stats_t stats;
+    uint32_t f, i;
+
+    memset(queue, 0, sizeof(mm_channel_queue_t));
+    queue->attr.notify_mode = MM_CAMERA_SUPER_BUF_NOTIFY_BURST;
+    queue->attr.water_mark = depth;
+    queue->attr.look_back = depth;
+    queue->attr.max_unmatched_frames = 2;
+    queue->num_streams = BENCH_NUM_STREAMS;
+    for (i = 0; i < BENCH_NUM_STREAMS; i++) {
+        queue->bundled_streams[i] = ch->streams[i].my_hdl;
+    }
+    if (0 != mm_channel_superbuf_queue_init(queue)) {
+        return -1;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    for (f = 1; f <= frames; f++) {
+        bench_feed(ch, 0, f, bufs[0], &stats);
+        bench_feed(ch, 1, f, bufs[1], &stats);
+        if ((f > 1) && (0 != ((f - 1) % BENCH_META_LOSS_PERIOD))) {
+            bench_feed(ch, 2, f - 1, bufs[2], &stats);
+        }
+    }
+
+    printf("depth %2u: %8llu bufs, comp_and_enqueue avg %6.0f ns max %7llu ns,"
+            " queued %2u matched %2u, superbuf heap allocs %u\n",
+            depth, (unsigned long long)stats.bufs,
+            stats.bufs ? (double)stats.sum_ns / (double)stats.bufs : 0.0,
+            (unsigned long long)stats.max_ns, queue->que.size,
+            queue->match_cnt,
+            queue->pool ? queue->pool->alloc_fallback : 0);
+
+    mm_channel_superbuf_flush(ch, queue, CAM_STREAM_TYPE_DEFAULT);
+    mm_channel_superbuf_queue_deinit(queue);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t frames = 100000;
+    int opt;
+    int rc = 0;
+    uint32_t i, j;
+    mm_channel_t *ch = NULL;
+    cam_stream_info_t *infos = NULL;
+    metadata_buffer_t *meta = NULL;
+    mm_camera_buf_def_t (*bufs)[BENCH_NUM_BUFS] = NULL;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = (uint32_t)atoi(optarg);
+            break;
+        default:
+            printf("usage: %s [-n frames per depth]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    ch = (mm_channel_t *)calloc(1, sizeof(mm_channel_t));
+    infos = (cam_stream_info_t *)calloc(BENCH_NUM_STREAMS,
+            sizeof(cam_stream_info_t));
+    meta = (metadata_buffer_t *)calloc(1, sizeof(metadata_buffer_t));
+    bufs = calloc(BENCH_NUM_STREAMS, sizeof(*bufs));
+    if ((NULL == ch) || (NULL == infos) || (NULL == meta) || (NULL == bufs)) {
+        printf("no memory\n");
+        rc = -1;
+        goto end;
+    }
+
+    /* bare active streams, their buf_done finds no ref and skips QBUF */
+    for (i = 0; i < BENCH_NUM_STREAMS; i++) {
+        mm_stream_t *s_obj = &ch->streams[i];
+        s_obj->state = MM_STREAM_STATE_ACTIVE;
+        s_obj->my_hdl = i + 1;
+        s_obj->ch_obj = ch;
+        s_obj->stream_info = &infos[i];
+        infos[i].stream_type = g_types[i];
+        pthread_mutex_init(&s_obj->buf_lock, NULL);
+        for (j = 0; j < BENCH_NUM_BUFS; j++) {
+            bufs[i][j].stream_id = s_obj->my_hdl;
+            bufs[i][j].stream_type = g_types[i];
+            bufs[i][j].buf_idx = j;
+            bufs[i][j].buffer = (CAM_STREAM_TYPE_METADATA == g_types[i]) ?
+                    (void *)meta : NULL;
+        }
+    }
+
+    for (i = 0; (0 == rc) && (i < sizeof(g_depths) / sizeof(g_depths[0])); i++) {
+        rc = bench_run(ch, g_depths[i], frames, bufs);
+    }
+
+    for (i = 0; i < BENCH_NUM_STREAMS; i++) {
+        pthread_mutex_destroy(&ch->streams[i].buf_lock);
+    }
+end:
+    free(bufs);
+    free(meta);
+    free(infos);
+    free(ch);
+    return rc;
+}
@@ -0,0 +1,413 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define LOG_TAG "QCameraCacheTracker"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+#include <cutils/properties.h>
+#include "QCameraCacheTracker.h"
+
+using namespace android;
+
+namespace qcamera {
+
+// dirty range of a buffer whose content is unknown
+#define CACHE_RANGE_ALL ((size_t)-1)
+
+// process wide cache maintenance counters, all memory objects
+static pthread_mutex_t gCacheStatsLock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    uint64_t issuedOps;
+    uint64_t elidedOps;
+    uint64_t issuedBytes;
+    uint64_t savedBytes;
+    nsecs_t windowStart;
+    uint64_t windowSaved;
+    uint64_t savedPerSec;      // over the last full second
+} gCacheStats;
+
+/*===========================================================================
+ * FUNCTION   : QCameraCacheTracker
+ *
+ * DESCRIPTION: default constructor of QCameraCacheTracker
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraCacheTracker::QCameraCacheTracker()
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get("persist.camera.cache.elide", value, "1");
+    mElide = (atoi(value) > 0);
+    pthread_mutex_init(&mLock, NULL);
+    resetAll();
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraCacheTracker
+ *
+ * DESCRIPTION: deconstructor of QCameraCacheTracker
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraCacheTracker::~QCameraCacheTracker()
+{
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : reset
+ *
+ * DESCRIPTION: forget the history of a buffer, e.g. when it was replaced
+ *              or comes back from another process. It is treated as dirty
+ *              over its full size.
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraCacheTracker::reset(uint32_t index)
+{
+    if (index >= CAM_MAX_NUM_BUFS_PER_STREAM) {
+        return;
+    }
+
+    pthread_mutex_lock(&mLock);
+    mBufs[index].state = QCAMERA_CACHE_CPU_DIRTY;
+    mBufs[index].dirtyStart = 0;
+    mBufs[index].dirtyEnd = CACHE_RANGE_ALL;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : resetAll
+ *
+ * DESCRIPTION: forget the history of all buffers
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraCacheTracker::resetAll()
+{
+    for (uint32_t i = 0; i < CAM_MAX_NUM_BUFS_PER_STREAM; i++) {
+        reset(i);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : markCpuWrite
+ *
+ * DESCRIPTION: records a CPU write to a buffer. Nothing is flushed until
+ *              the buffer goes to a hardware reader.
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *   @offset  : offset of the written range
+ *   @len     : length of the written range
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraCacheTracker::markCpuWrite(uint32_t index, size_t offset,
+        size_t len)
+{
+    if ((index >= CAM_MAX_NUM_BUFS_PER_STREAM) || (0 == len)) {
+        return;
+    }
+
+    size_t end = (len > CACHE_RANGE_ALL - offset) ?
+            CACHE_RANGE_ALL : offset + len;
+    pthread_mutex_lock(&mLock);
+    BufState &buf = mBufs[index];
+    if (QCAMERA_CACHE_CPU_DIRTY != buf.state) {
+        buf.state = QCAMERA_CACHE_CPU_DIRTY;
+        buf.dirtyStart = offset;
+        buf.dirtyEnd = end;
+    } else {
+        if (offset < buf.dirtyStart) {
+            buf.dirtyStart = offset;
+        }
+        if (end > buf.dirtyEnd) {
+            buf.dirtyEnd = end;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : makePlan
+ *
+ * DESCRIPTION: builds the op over a range clipped to the buffer, and
+ *              accounts it against the full buffer op issued before
+ *
+ * PARAMETERS :
+ *   @op        : op to issue
+ *   @offset    : start of the range
+ *   @len       : length of the range
+ *   @size      : size of the buffer
+ *   @legacyLen : bytes the untracked path maintained for this transition
+ *
+ * RETURN     : op to issue, QCAMERA_CACHE_OP_NONE if none
+ *==========================================================================*/
+qcamera_cache_plan_t QCameraCacheTracker::makePlan(qcamera_cache_op_t op,
+        size_t offset, size_t len, size_t size, size_t legacyLen)
+{
+    qcamera_cache_plan_t plan;
+
+    if ((offset >= size) || (0 == len)) {
+        op = QCAMERA_CACHE_OP_NONE;
+    } else if (len > size - offset) {
+        len = size - offset;
+    }
+
+    plan.op = op;
+    plan.offset = (QCAMERA_CACHE_OP_NONE == op) ? 0 : offset;
+    plan.len = (QCAMERA_CACHE_OP_NONE == op) ? 0 : len;
+    account(plan.len, (legacyLen > plan.len) ? legacyLen - plan.len : 0);
+    return plan;
+}
+
+/*===========================================================================
+ * FUNCTION   : toDevice
+ *
+ * DESCRIPTION: buffer is queued to the hardware. Only lines the CPU
+ *              dirtied need maintenance, clean lines are dropped by the
+ *              invalidate when the buffer comes back.
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *   @size    : size of the buffer
+ *
+ * RETURN     : op to issue
+ *==========================================================================*/
+qcamera_cache_plan_t QCameraCacheTracker::toDevice(uint32_t index,
+        size_t size)
+{
+    qcamera_cache_plan_t plan;
+
+    if (index >= CAM_MAX_NUM_BUFS_PER_STREAM) {
+        plan.op = QCAMERA_CACHE_OP_INV;
+        plan.offset = 0;
+        plan.len = size;
+        return plan;
+    }
+
+    pthread_mutex_lock(&mLock);
+    BufState &buf = mBufs[index];
+    if (!mElide) {
+        plan = makePlan(QCAMERA_CACHE_OP_INV, 0, size, size, size);
+    } else if (QCAMERA_CACHE_CPU_DIRTY == buf.state) {
+        plan = makePlan(QCAMERA_CACHE_OP_CLEAN_INV, buf.dirtyStart,
+                buf.dirtyEnd - buf.dirtyStart, size, size);
+    } else {
+        plan = makePlan(QCAMERA_CACHE_OP_NONE, 0, 0, size, size);
+    }
+    buf.state = QCAMERA_CACHE_DEVICE;
+    pthread_mutex_unlock(&mLock);
+
+    return plan;
+}
+
+/*===========================================================================
+ * FUNCTION   : toCpu
+ *
+ * DESCRIPTION: buffer is dequeued from the hardware. The whole buffer is
+ *              invalidated, the clean is only needed if the CPU wrote it
+ *              while the hardware owned it.
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *   @size    : size of the buffer
+ *
+ * RETURN     : op to issue
+ *==========================================================================*/
+qcamera_cache_plan_t QCameraCacheTracker::toCpu(uint32_t index, size_t size)
+{
+    qcamera_cache_plan_t plan;
+
+    if (index >= CAM_MAX_NUM_BUFS_PER_STREAM) {
+        plan.op = QCAMERA_CACHE_OP_CLEAN_INV;
+        plan.offset = 0;
+        plan.len = size;
+        return plan;
+    }
+
+    pthread_mutex_lock(&mLock);
+    BufState &buf = mBufs[index];
+    if (!mElide || (QCAMERA_CACHE_CPU_DIRTY == buf.state)) {
+        plan = makePlan(QCAMERA_CACHE_OP_CLEAN_INV, 0, size, size,
+                size);
+    } else {
+        plan = makePlan(QCAMERA_CACHE_OP_INV, 0, size, size, size);
+    }
+    buf.state = QCAMERA_CACHE_CPU_READ;
+    pthread_mutex_unlock(&mLock);
+
+    return plan;
+}
+
+/*===========================================================================
+ * FUNCTION   : flush
+ *
+ * DESCRIPTION: CPU writes must reach memory, e.g. before the buffer is
+ *              handed to a hardware reader. Only the dirty range is
+ *              cleaned, nothing if the CPU reported no write.
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *   @size    : size of the buffer
+ *
+ * RETURN     : op to issue
+ *==========================================================================*/
+qcamera_cache_plan_t QCameraCacheTracker::flush(uint32_t index, size_t size)
+{
+    qcamera_cache_plan_t plan;
+
+    if (index >= CAM_MAX_NUM_BUFS_PER_STREAM) {
+        plan.op = QCAMERA_CACHE_OP_CLEAN;
+        plan.offset = 0;
+        plan.len = size;
+        return plan;
+    }
+
+    pthread_mutex_lock(&mLock);
+    BufState &buf = mBufs[index];
+    if (!mElide) {
+        plan = makePlan(QCAMERA_CACHE_OP_CLEAN, 0, size, size, size);
+    } else if (QCAMERA_CACHE_CPU_DIRTY == buf.state) {
+        plan = makePlan(QCAMERA_CACHE_OP_CLEAN, buf.dirtyStart,
+                buf.dirtyEnd - buf.dirtyStart, size, size);
+    } else {
+        plan = makePlan(QCAMERA_CACHE_OP_NONE, 0, 0, size, size);
+    }
+    if (QCAMERA_CACHE_CPU_DIRTY == buf.state) {
+        buf.state = QCAMERA_CACHE_CPU_READ;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return plan;
+}
+
+/*===========================================================================
+ * FUNCTION   : onFullOp
+ *
+ * DESCRIPTION: records an untracked full buffer op, e.g. cleanCache()
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *   @op      : op issued
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraCacheTracker::onFullOp(uint32_t index, qcamera_cache_op_t op)
+{
+    if (index >= CAM_MAX_NUM_BUFS_PER_STREAM) {
+        return;
+    }
+
+    pthread_mutex_lock(&mLock);
+    BufState &buf = mBufs[index];
+    if ((QCAMERA_CACHE_OP_CLEAN != op) ||
+            (QCAMERA_CACHE_CPU_DIRTY == buf.state)) {
+        buf.state = QCAMERA_CACHE_CPU_READ;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : account
+ *
+ * DESCRIPTION: adds one tracked transition to the process wide counters
+ *
+ * PARAMETERS :
+ *   @issued  : bytes maintained
+ *   @saved   : bytes the untracked path would have maintained on top
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraCacheTracker::account(size_t issued, size_t saved)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    pthread_mutex_lock(&gCacheStatsLock);
+    if (issued > 0) {
+        gCacheStats.issuedOps++;
+    } else {
+        gCacheStats.elidedOps++;
+    }
+    gCacheStats.issuedBytes += issued;
+    gCacheStats.savedBytes += saved;
+    gCacheStats.windowSaved += saved;
+    if (0 == gCacheStats.windowStart) {
+        gCacheStats.windowStart = now;
+    } else if (now - gCacheStats.windowStart >= s2ns(1)) {
+        gCacheStats.savedPerSec = (uint64_t)(gCacheStats.windowSaved *
+                s2ns(1) / (now - gCacheStats.windowStart));
+        ALOGV("%s: %llu KB/s of cache maintenance saved", __func__,
+                (unsigned long long)(gCacheStats.savedPerSec >> 10));
+        gCacheStats.windowStart = now;
+        gCacheStats.windowSaved = 0;
+    }
+    pthread_mutex_unlock(&gCacheStatsLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: prints the process wide cache maintenance counters
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : String8 with the counters
+ *==========================================================================*/
+String8 QCameraCacheTracker::dump()
+{
+    String8 str;
+
+    pthread_mutex_lock(&gCacheStatsLock);
+    str.appendFormat("Cache maintenance: %llu ops (%llu KB) issued, "
+            "%llu elided, %llu KB saved, %llu KB/s saved last second\n",
+            (unsigned long long)gCacheStats.issuedOps,
+            (unsigned long long)(gCacheStats.issuedBytes >> 10),
+            (unsigned long long)gCacheStats.elidedOps,
+            (unsigned long long)(gCacheStats.savedBytes >> 10),
+            (unsigned long long)(gCacheStats.savedPerSec >> 10));
+    pthread_mutex_unlock(&gCacheStatsLock);
+    return str;
+}
+
+}; // namespace qcamera
@@ -0,0 +1,102 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_CACHE_TRACKER_H__
+#define __QCAMERA_CACHE_TRACKER_H__
+
+#include <pthread.h>
+#include <utils/String8.h>
+
+#include "cam_types.h"
+
+namespace qcamera {
+
+// cache maintenance a buffer transition needs
+typedef enum {
+    QCAMERA_CACHE_OP_NONE,
+    QCAMERA_CACHE_OP_CLEAN,
+    QCAMERA_CACHE_OP_INV,
+    QCAMERA_CACHE_OP_CLEAN_INV,
+} qcamera_cache_op_t;
+
+typedef enum {
+    QCAMERA_CACHE_DEVICE,     // queued to hardware, CPU holds no dirty lines
+    QCAMERA_CACHE_CPU_READ,   // CPU view coherent, no dirty lines
+    QCAMERA_CACHE_CPU_DIRTY,  // CPU wrote a range not written back yet
+} qcamera_cache_state_t;
+
+typedef struct {
+    qcamera_cache_op_t op;
+    size_t offset;
+    size_t len;
+} qcamera_cache_plan_t;
+
+/* Ownership and dirty range of the buffers of one memory object. The
+ * memory object asks the tracker which cache op a transition needs:
+ *   toDevice - buffer queued to the hardware
+ *   toCpu    - buffer dequeued from the hardware
+ *   flush    - CPU writes must be visible to a hardware reader
+ * and issues only that op. CPU code that writes a buffer reports the
+ * written range with markCpuWrite, so flushes only cover what changed.
+ * A buffer whose history is unknown (new, or back from another process)
+ * is dirty over its full size until the next op. */
+class QCameraCacheTracker {
+public:
+    QCameraCacheTracker();
+    ~QCameraCacheTracker();
+
+    void reset(uint32_t index);
+    void resetAll();
+    void markCpuWrite(uint32_t index, size_t offset, size_t len);
+    qcamera_cache_plan_t toDevice(uint32_t index, size_t size);
+    qcamera_cache_plan_t toCpu(uint32_t index, size_t size);
+    qcamera_cache_plan_t flush(uint32_t index, size_t size);
+    void onFullOp(uint32_t index, qcamera_cache_op_t op);
+
+    static android::String8 dump();
+
+private:
+    struct BufState {
+        qcamera_cache_state_t state;
+        size_t dirtyStart;
+        size_t dirtyEnd;
+    };
+
+    static qcamera_cache_plan_t makePlan(qcamera_cache_op_t op,
+            size_t offset, size_t len, size_t size, size_t legacyLen);
+    static void account(size_t issued, size_t saved);
+
+    BufState mBufs[CAM_MAX_NUM_BUFS_PER_STREAM];
+    pthread_mutex_t mLock;
+    bool mElide;                // persist.camera.cache.elide
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_CACHE_TRACKER_H__ */
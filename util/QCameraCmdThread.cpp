@@ -46,7 +46,15 @@ namespace qcamera {
  * RETURN     : None
  *==========================================================================*/
 QCameraCmdThread::QCameraCmdThread() :
-    cmd_queue()
+    cmd_queue(),
+    m_bCoalesceJobs(false),
+    m_pendingJobs(0),
+    m_priorityCmds(0),
+    m_batchJobs(0),
+    m_bBatchReady(false),
+    m_coalescedJobs(0),
+    m_batches(0),
+    m_maxBatch(0)
 {
     cmd_pid = 0;
     cam_sem_init(&sync_sem, 0);
@@ -129,16 +137,31 @@ int32_t QCameraCmdThread::setName(const char* name)
  *==========================================================================*/
 int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8_t priority)
 {
+    bool coalesce = m_bCoalesceJobs && (CAMERA_CMD_TYPE_DO_NEXT_JOB == cmd) &&
+            !sync_cmd && !priority;
+    if (coalesce &&
+            (0 != __atomic_fetch_add(&m_pendingJobs, 1, __ATOMIC_ACQ_REL))) {
+        // a DO_NEXT_JOB is already queued and will pick this job up
+        __atomic_fetch_add(&m_coalescedJobs, 1, __ATOMIC_RELAXED);
+        return NO_ERROR;
+    }
+
     camera_cmd_t *node = (camera_cmd_t *)malloc(sizeof(camera_cmd_t));
     if (NULL == node) {
         ALOGE("%s: No memory for camera_cmd_t", __func__);
+        if (coalesce) {
+            __atomic_store_n(&m_pendingJobs, 0, __ATOMIC_RELEASE);
+        }
         return NO_MEMORY;
     }
     memset(node, 0, sizeof(camera_cmd_t));
     node->cmd = cmd;
+    node->priority = priority;
 
     if (priority) {
+        __atomic_fetch_add(&m_priorityCmds, 1, __ATOMIC_ACQ_REL);
         if (!cmd_queue.enqueueWithPriority((void *)node)) {
+            __atomic_fetch_sub(&m_priorityCmds, 1, __ATOMIC_ACQ_REL);
             free(node);
             node = NULL;
         }
@@ -146,6 +169,9 @@ int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8
         if (!cmd_queue.enqueue((void *)node)) {
             free(node);
             node = NULL;
+            if (coalesce) {
+                __atomic_store_n(&m_pendingJobs, 0, __ATOMIC_RELEASE);
+            }
         }
     }
     cam_sem_post(&cmd_sem);
@@ -157,6 +183,27 @@ int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : waitCmd
+ *
+ * DESCRIPTION: wait for next command. Returns at once while jobs of a
+ *              coalesced batch are left and no priority cmd is queued.
+ *              Only called from the cmd thread, paired with getCmd.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : 0 on success, cam_sem_wait error otherwise
+ *==========================================================================*/
+int QCameraCmdThread::waitCmd()
+{
+    if ((m_batchJobs > 0) &&
+            (0 == __atomic_load_n(&m_priorityCmds, __ATOMIC_ACQUIRE))) {
+        m_bBatchReady = true;
+        return 0;
+    }
+    return cam_sem_wait(&cmd_sem);
+}
+
 /*===========================================================================
  * FUNCTION   : getCmd
  *
@@ -169,14 +216,38 @@ int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8
 camera_cmd_type_t QCameraCmdThread::getCmd()
 {
     camera_cmd_type_t cmd = CAMERA_CMD_TYPE_NONE;
+
+    if (m_bBatchReady) {
+        m_bBatchReady = false;
+        m_batchJobs--;
+        return CAMERA_CMD_TYPE_DO_NEXT_JOB;
+    }
+
     camera_cmd_t *node = (camera_cmd_t *)cmd_queue.dequeue();
     if (NULL == node) {
         ALOGD("%s: No notify avail", __func__);
         return CAMERA_CMD_TYPE_NONE;
     } else {
         cmd = node->cmd;
+        if (node->priority) {
+            __atomic_fetch_sub(&m_priorityCmds, 1, __ATOMIC_ACQ_REL);
+        }
         free(node);
     }
+
+    if (m_bCoalesceJobs && (CAMERA_CMD_TYPE_DO_NEXT_JOB == cmd)) {
+        uint32_t jobs = __atomic_exchange_n(&m_pendingJobs, 0, __ATOMIC_ACQ_REL);
+        if (0 == jobs) {
+            // sent as priority or sync cmd, not counted
+            return cmd;
+        }
+        m_batches++;
+        if (jobs > m_maxBatch) {
+            m_maxBatch = jobs;
+        }
+        // this call returns the first job, waitCmd hands out the rest
+        m_batchJobs += jobs - 1;
+    }
     return cmd;
 }
 
@@ -210,6 +281,15 @@ int32_t QCameraCmdThread::exit()
         ALOGD("%s: pthread dead already\n", __func__);
     }
     cmd_pid = 0;
+
+    if (m_bCoalesceJobs) {
+        ALOGD("%s: batches %u, max batch %u, coalesced jobs %u", __func__,
+                m_batches, m_maxBatch,
+                __atomic_load_n(&m_coalescedJobs, __ATOMIC_RELAXED));
+    }
+    // jobs left in a batch belong to the exited thread
+    m_batchJobs = 0;
+    m_bBatchReady = false;
     return rc;
 }
 
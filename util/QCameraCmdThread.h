@@ -50,6 +50,7 @@ typedef enum
 
 typedef struct {
     camera_cmd_type_t cmd;
+    uint8_t priority;
 } camera_cmd_t;
 
 class QCameraCmdThread {
@@ -62,11 +63,25 @@ public:
     int32_t exit();
     int32_t sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8_t priority);
     camera_cmd_type_t getCmd();
+    int waitCmd();
+    void setJobCoalescing(bool enable) {m_bCoalesceJobs = enable;};
 
     QCameraQueue cmd_queue;      /* cmd queue */
     pthread_t cmd_pid;           /* cmd thread ID */
     cam_semaphore_t cmd_sem;               /* semaphore for cmd thread */
     cam_semaphore_t sync_sem;              /* semaphore for synchronized call signal */
+
+private:
+    // DO_NEXT_JOB coalescing: only the first job sent while none is pending
+    // queues a cmd and wakes the thread, the thread then runs all of them
+    bool m_bCoalesceJobs;
+    uint32_t m_pendingJobs;      // jobs sent, not yet picked up by thread
+    uint32_t m_priorityCmds;     // priority cmds queued, they preempt a batch
+    uint32_t m_batchJobs;        // jobs left in current batch, thread only
+    bool m_bBatchReady;          // waitCmd granted next batch job
+    uint32_t m_coalescedJobs;    // jobs that did not need a wakeup
+    uint32_t m_batches;
+    uint32_t m_maxBatch;
 };
 
 }; // namespace qcamera
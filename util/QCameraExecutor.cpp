@@ -0,0 +1,654 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define LOG_TAG "QCameraExecutor"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+#include <cutils/properties.h>
+#include "QCameraExecutor.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCameraExecutorLane
+ *
+ * DESCRIPTION: default constructor of QCameraExecutorLane
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraExecutorLane::QCameraExecutorLane() :
+    m_routine(NULL),
+    m_userData(NULL),
+    m_executor(NULL),
+    m_homeWorker(0),
+    m_bActive(false),
+    m_pending(0),
+    m_bRunning(false),
+    m_runner(0),
+    m_bDetach(false),
+    m_maxDepth(0),
+    m_posted(0),
+    m_runs(0),
+    m_dispatches(0),
+    m_runTimeNs(0),
+    m_maxRunNs(0)
+{
+    memset(m_name, 0, sizeof(m_name));
+    cam_list_init(&m_list);
+    cam_list_init(&m_regList);
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_idleCond, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraExecutorLane
+ *
+ * DESCRIPTION: deconstructor of QCameraExecutorLane
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraExecutorLane::~QCameraExecutorLane()
+{
+    stop();
+    pthread_cond_destroy(&m_idleCond);
+    pthread_mutex_destroy(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : start
+ *
+ * DESCRIPTION: attach lane to the shared executor and accept jobs
+ *
+ * PARAMETERS :
+ *   @name      : lane name shown in dump
+ *   @routine   : routine called once per posted job
+ *   @user_data : user data ptr passed to routine
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraExecutorLane::start(const char *name, lane_job_fn_t routine,
+        void *user_data)
+{
+    int32_t rc = NO_ERROR;
+
+    if ((NULL == routine) || m_bActive || m_bDetach) {
+        return BAD_VALUE;
+    }
+
+    strlcpy(m_name, (NULL != name) ? name : "lane", sizeof(m_name));
+    m_routine = routine;
+    m_userData = user_data;
+    m_maxDepth = 0;
+    m_posted = 0;
+    m_runs = 0;
+    m_dispatches = 0;
+    m_runTimeNs = 0;
+    m_maxRunNs = 0;
+
+    m_executor = &QCameraExecutor::getInstance();
+    rc = m_executor->registerLane(this);
+    if (NO_ERROR != rc) {
+        m_executor = NULL;
+        return rc;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    m_bActive = true;
+    pthread_mutex_unlock(&m_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : post
+ *
+ * DESCRIPTION: post one job to the lane. The lane is queued to a worker
+ *              only if it was idle, a lane already queued or running
+ *              picks the job up.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              NO_INIT   -- lane is not started
+ *==========================================================================*/
+int32_t QCameraExecutorLane::post()
+{
+    uint32_t prev;
+
+    pthread_mutex_lock(&m_lock);
+    if (!m_bActive) {
+        pthread_mutex_unlock(&m_lock);
+        return NO_INIT;
+    }
+    prev = m_pending++;
+    m_posted++;
+    if (m_pending > m_maxDepth) {
+        m_maxDepth = m_pending;
+    }
+    if (0 == prev) {
+        m_executor->schedule(this, m_homeWorker);
+    }
+    pthread_mutex_unlock(&m_lock);
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : stop
+ *
+ * DESCRIPTION: stop accepting jobs and wait until no worker holds the
+ *              lane. Jobs not run yet are dropped, the routine owner
+ *              flushes its own input. A lane still sitting on a run queue
+ *              is taken off it rather than waited for, the workers may all
+ *              be busy (or be the caller). When called from the lane's own
+ *              job there is nothing to wait for, the worker unregisters
+ *              the lane once the job returns; the lane must not be
+ *              destroyed from its own job.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraExecutorLane::stop()
+{
+    bool active;
+
+    pthread_mutex_lock(&m_lock);
+    if (m_bRunning && pthread_equal(m_runner, pthread_self())) {
+        if (m_bActive) {
+            m_bActive = false;
+            m_bDetach = true;
+        }
+        pthread_mutex_unlock(&m_lock);
+        return NO_ERROR;
+    }
+    active = m_bActive;
+    m_bActive = false;
+    while ((m_pending > 0) || m_bDetach) {
+        if ((m_pending > 0) && (NULL != m_executor) &&
+                m_executor->unqueueLane(this)) {
+            m_pending = 0;
+            break;
+        }
+        pthread_cond_wait(&m_idleCond, &m_lock);
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    if (active) {
+        m_executor->unregisterLane(this);
+        m_executor = NULL;
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : getInstance
+ *
+ * DESCRIPTION: get the process wide executor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : reference to executor
+ *==========================================================================*/
+QCameraExecutor& QCameraExecutor::getInstance()
+{
+    static QCameraExecutor instance;
+    return instance;
+}
+
+/*===========================================================================
+ * FUNCTION   : isEnabled
+ *
+ * DESCRIPTION: whether clients should use executor lanes instead of
+ *              dedicated cmd threads
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true if persist.camera.exec.enable is set
+ *==========================================================================*/
+bool QCameraExecutor::isEnabled()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.exec.enable", value, "0");
+    return (atoi(value) > 0);
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraExecutor
+ *
+ * DESCRIPTION: constructor of QCameraExecutor. Workers are launched with
+ *              the first lane.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraExecutor::QCameraExecutor() :
+    m_nextHome(0),
+    m_numWorkers(0),
+    m_cpuMask(0),
+    m_bLaunched(false)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    pthread_mutex_init(&m_lock, NULL);
+    cam_list_init(&m_lanes);
+    cam_sem_init(&m_workSem, 0);
+
+    property_get("persist.camera.exec.workers", value, "2");
+    m_numWorkers = (uint32_t)atoi(value);
+    if (m_numWorkers < 1) {
+        m_numWorkers = 1;
+    } else if (m_numWorkers > QCAMERA_EXECUTOR_MAX_WORKERS) {
+        m_numWorkers = QCAMERA_EXECUTOR_MAX_WORKERS;
+    }
+    property_get("persist.camera.exec.cpumask", value, "0");
+    m_cpuMask = (uint32_t)strtoul(value, NULL, 16);
+
+    memset(m_workers, 0, sizeof(m_workers));
+    for (uint32_t i = 0; i < m_numWorkers; i++) {
+        m_workers[i].executor = this;
+        m_workers[i].id = i;
+        pthread_mutex_init(&m_workers[i].lock, NULL);
+        cam_list_init(&m_workers[i].runq);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraExecutor
+ *
+ * DESCRIPTION: deconstructor of QCameraExecutor. Only runs at process exit,
+ *              workers are left to die with the process.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraExecutor::~QCameraExecutor()
+{
+}
+
+/*===========================================================================
+ * FUNCTION   : launchWorkers
+ *
+ * DESCRIPTION: launch worker threads. Called with m_lock held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraExecutor::launchWorkers()
+{
+    uint32_t launched = 0;
+
+    for (uint32_t i = 0; i < m_numWorkers; i++) {
+        if (pthread_create(&m_workers[i].pid, NULL, workerRoutine,
+                &m_workers[i]) != 0) {
+            ALOGE("%s: failed to launch worker %d", __func__, i);
+            break;
+        }
+        launched++;
+    }
+    if (0 == launched) {
+        return UNKNOWN_ERROR;
+    }
+    // lanes are only homed on workers that exist
+    m_numWorkers = launched;
+    m_bLaunched = true;
+    ALOGD("%s: %d workers, cpumask 0x%x", __func__, m_numWorkers, m_cpuMask);
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : registerLane
+ *
+ * DESCRIPTION: add lane to registry and pick its home worker
+ *
+ * PARAMETERS :
+ *   @lane    : lane to register
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraExecutor::registerLane(QCameraExecutorLane *lane)
+{
+    int32_t rc = NO_ERROR;
+
+    pthread_mutex_lock(&m_lock);
+    if (!m_bLaunched) {
+        rc = launchWorkers();
+    }
+    if (NO_ERROR == rc) {
+        lane->m_homeWorker = m_nextHome++ % m_numWorkers;
+        cam_list_add_tail_node(&lane->m_regList, &m_lanes);
+    }
+    pthread_mutex_unlock(&m_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : unregisterLane
+ *
+ * DESCRIPTION: remove an idle lane from registry
+ *
+ * PARAMETERS :
+ *   @lane    : lane to remove
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraExecutor::unregisterLane(QCameraExecutorLane *lane)
+{
+    pthread_mutex_lock(&m_lock);
+    cam_list_del_node(&lane->m_regList);
+    pthread_mutex_unlock(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : schedule
+ *
+ * DESCRIPTION: queue a runnable lane to a worker run queue
+ *
+ * PARAMETERS :
+ *   @lane    : runnable lane
+ *   @worker  : index of worker run queue
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraExecutor::schedule(QCameraExecutorLane *lane, uint32_t worker)
+{
+    worker_t *w = &m_workers[worker];
+
+    pthread_mutex_lock(&w->lock);
+    cam_list_add_tail_node(&lane->m_list, &w->runq);
+    pthread_mutex_unlock(&w->lock);
+    cam_sem_post(&m_workSem);
+}
+
+/*===========================================================================
+ * FUNCTION   : unqueueLane
+ *
+ * DESCRIPTION: take a lane off whichever run queue it sits on. Called with
+ *              the lane lock held.
+ *
+ * PARAMETERS :
+ *   @lane    : lane to take off
+ *
+ * RETURN     : true if the lane was queued, false if a worker holds it
+ *==========================================================================*/
+bool QCameraExecutor::unqueueLane(QCameraExecutorLane *lane)
+{
+    bool found = false;
+
+    for (uint32_t i = 0; !found && (i < m_numWorkers); i++) {
+        worker_t *w = &m_workers[i];
+        pthread_mutex_lock(&w->lock);
+        for (struct cam_list *pos = w->runq.next; pos != &w->runq;
+                pos = pos->next) {
+            if (pos == &lane->m_list) {
+                cam_list_del_node(pos);
+                found = true;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+    return found;
+}
+
+/*===========================================================================
+ * FUNCTION   : nextLane
+ *
+ * DESCRIPTION: take the next runnable lane, from own run queue head first,
+ *              then from the tail of the other workers' run queues
+ *
+ * PARAMETERS :
+ *   @worker  : worker asking for work
+ *
+ * RETURN     : runnable lane, NULL if there is none
+ *==========================================================================*/
+QCameraExecutorLane *QCameraExecutor::nextLane(worker_t *worker)
+{
+    QCameraExecutorLane *lane = NULL;
+    struct cam_list *pos = NULL;
+
+    pthread_mutex_lock(&worker->lock);
+    pos = worker->runq.next;
+    if (pos != &worker->runq) {
+        cam_list_del_node(pos);
+        lane = member_of(pos, QCameraExecutorLane, m_list);
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    for (uint32_t i = 1; (NULL == lane) && (i < m_numWorkers); i++) {
+        worker_t *victim = &m_workers[(worker->id + i) % m_numWorkers];
+        pthread_mutex_lock(&victim->lock);
+        pos = victim->runq.prev;
+        if (pos != &victim->runq) {
+            cam_list_del_node(pos);
+            lane = member_of(pos, QCameraExecutorLane, m_list);
+            __atomic_fetch_add(&worker->steals, 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return lane;
+}
+
+/*===========================================================================
+ * FUNCTION   : runLane
+ *
+ * DESCRIPTION: run jobs of a lane. Only one worker holds a lane at a time,
+ *              so jobs of one lane never run concurrently. The lane goes
+ *              back to the run queue once it used up its budget.
+ *
+ * PARAMETERS :
+ *   @worker  : worker running the lane
+ *   @lane    : lane taken from a run queue
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraExecutor::runLane(worker_t *worker, QCameraExecutorLane *lane)
+{
+    uint32_t budget = QCAMERA_EXECUTOR_LANE_BUDGET;
+    uint32_t jobs = 0;
+    bool active = false;
+
+    __atomic_fetch_add(&lane->m_dispatches, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&lane->m_lock);
+    lane->m_runner = pthread_self();
+    lane->m_bRunning = true;
+    do {
+        jobs = lane->m_pending;
+        active = lane->m_bActive;
+        pthread_mutex_unlock(&lane->m_lock);
+
+        // a stopped lane drops everything at once
+        if (active && (jobs > budget)) {
+            jobs = budget;
+        }
+        if (active) {
+            // stats are only written here, dump() reads them unlocked
+            for (uint32_t i = 0; i < jobs; i++) {
+                nsecs_t start = systemTime();
+                lane->m_routine(lane->m_userData);
+                nsecs_t elapsed = systemTime() - start;
+                __atomic_fetch_add(&lane->m_runTimeNs, elapsed,
+                        __ATOMIC_RELAXED);
+                if (elapsed > lane->m_maxRunNs) {
+                    __atomic_store_n(&lane->m_maxRunNs, elapsed,
+                            __ATOMIC_RELAXED);
+                }
+                // the job stopped its own lane, set by this thread
+                if (lane->m_bDetach) {
+                    jobs = i + 1;
+                    break;
+                }
+            }
+            __atomic_fetch_add(&lane->m_runs, jobs, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&worker->runs, jobs, __ATOMIC_RELAXED);
+        }
+        budget = (jobs < budget) ? budget - jobs : 0;
+
+        pthread_mutex_lock(&lane->m_lock);
+        lane->m_pending -= jobs;
+    } while ((lane->m_pending > 0) && (budget > 0));
+    lane->m_bRunning = false;
+
+    if ((0 == lane->m_pending) && lane->m_bDetach) {
+        // stopped from its own job, stop() did not unregister
+        pthread_mutex_unlock(&lane->m_lock);
+        unregisterLane(lane);
+        pthread_mutex_lock(&lane->m_lock);
+        lane->m_executor = NULL;
+        lane->m_bDetach = false;
+    }
+    if (0 == lane->m_pending) {
+        // lane is idle, it must not be touched once the lock is dropped
+        pthread_cond_broadcast(&lane->m_idleCond);
+        pthread_mutex_unlock(&lane->m_lock);
+    } else {
+        // requeue under the lane lock, stop() then finds the lane either
+        // held by a worker or on a run queue
+        schedule(lane, worker->id);
+        pthread_mutex_unlock(&lane->m_lock);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : workerRoutine
+ *
+ * DESCRIPTION: worker thread routine
+ *
+ * PARAMETERS :
+ *   @data    : worker_t ptr
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCameraExecutor::workerRoutine(void *data)
+{
+    worker_t *worker = (worker_t *)data;
+    QCameraExecutor *pme = worker->executor;
+    char name[QCAMERA_EXECUTOR_LANE_NAME_SIZE];
+
+    snprintf(name, sizeof(name), "CAM_Exec%d", worker->id);
+    prctl(PR_SET_NAME, (unsigned long)name, 0, 0, 0);
+
+    if (0 != pme->m_cpuMask) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (uint32_t cpu = 0; cpu < 32; cpu++) {
+            if (pme->m_cpuMask & (1U << cpu)) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        if (0 != sched_setaffinity(0, sizeof(cpus), &cpus)) {
+            ALOGE("%s: %s cannot set affinity 0x%x", __func__, name,
+                    pme->m_cpuMask);
+        }
+    }
+
+    while (true) {
+        if (0 != cam_sem_wait(&pme->m_workSem)) {
+            continue;
+        }
+        QCameraExecutorLane *lane = pme->nextLane(worker);
+        if (NULL != lane) {
+            pme->runLane(worker, lane);
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: dump worker and per lane stats
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : String8 with executor stats
+ *==========================================================================*/
+String8 QCameraExecutor::dump()
+{
+    String8 str;
+    struct cam_list *pos = NULL;
+
+    pthread_mutex_lock(&m_lock);
+    str.appendFormat("Executor: %d workers, cpumask 0x%x\n",
+            m_bLaunched ? m_numWorkers : 0, m_cpuMask);
+    for (uint32_t i = 0; m_bLaunched && (i < m_numWorkers); i++) {
+        str.appendFormat("  worker %d: jobs %u steals %u\n", i,
+                __atomic_load_n(&m_workers[i].runs, __ATOMIC_RELAXED),
+                __atomic_load_n(&m_workers[i].steals, __ATOMIC_RELAXED));
+    }
+    for (pos = m_lanes.next; pos != &m_lanes; pos = pos->next) {
+        QCameraExecutorLane *lane =
+                member_of(pos, QCameraExecutorLane, m_regList);
+        uint32_t depth, maxDepth, posted;
+        pthread_mutex_lock(&lane->m_lock);
+        depth = lane->m_pending;
+        maxDepth = lane->m_maxDepth;
+        posted = lane->m_posted;
+        pthread_mutex_unlock(&lane->m_lock);
+
+        uint32_t runs = __atomic_load_n(&lane->m_runs, __ATOMIC_RELAXED);
+        int64_t runTimeNs = __atomic_load_n(&lane->m_runTimeNs, __ATOMIC_RELAXED);
+        str.appendFormat("  lane %s (worker %d): depth %u max %u, "
+                "posted %u run %u dispatches %u, "
+                "avg run %lld us max run %lld us\n",
+                lane->m_name, lane->m_homeWorker, depth, maxDepth,
+                posted, runs,
+                __atomic_load_n(&lane->m_dispatches, __ATOMIC_RELAXED),
+                (long long)((runs > 0) ? runTimeNs / runs / 1000 : 0),
+                (long long)(__atomic_load_n(&lane->m_maxRunNs,
+                        __ATOMIC_RELAXED) / 1000));
+    }
+    pthread_mutex_unlock(&m_lock);
+    return str;
+}
+
+}; // namespace qcamera
@@ -0,0 +1,143 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_EXECUTOR_H__
+#define __QCAMERA_EXECUTOR_H__
+
+#include <pthread.h>
+#include <cam_semaphore.h>
+#include <utils/String8.h>
+
+#include "cam_list.h"
+
+namespace qcamera {
+
+#define QCAMERA_EXECUTOR_MAX_WORKERS 8
+// jobs a lane runs before it goes back to the tail of the run queue
+#define QCAMERA_EXECUTOR_LANE_BUDGET 4
+#define QCAMERA_EXECUTOR_LANE_NAME_SIZE 16
+
+typedef void (*lane_job_fn_t)(void *user_data);
+
+class QCameraExecutor;
+
+/* Ordered lane of a QCameraExecutor. Jobs posted to a lane run one at a
+ * time in post order, on whichever worker picks the lane up. A job is
+ * a call of the lane routine, the routine fetches its own input (e.g.
+ * from a QCameraQueue) the same way a CAMERA_CMD_TYPE_DO_NEXT_JOB
+ * handler does. */
+class QCameraExecutorLane {
+public:
+    QCameraExecutorLane();
+    ~QCameraExecutorLane();
+
+    int32_t start(const char *name, lane_job_fn_t routine, void *user_data);
+    int32_t post();
+    int32_t stop();
+    bool isActive() {return m_bActive;};
+
+private:
+    friend class QCameraExecutor;
+
+    struct cam_list m_list;      // node in worker run queue
+    struct cam_list m_regList;   // node in executor lane registry
+    char m_name[QCAMERA_EXECUTOR_LANE_NAME_SIZE];
+    lane_job_fn_t m_routine;
+    void *m_userData;
+    QCameraExecutor *m_executor;
+    uint32_t m_homeWorker;       // worker the lane is queued to when posted
+
+    pthread_mutex_t m_lock;      // serializes post against stop
+    pthread_cond_t m_idleCond;   // signalled when the lane drains
+    bool m_bActive;
+    uint32_t m_pending;          // posted jobs not yet run, >0 means queued
+    bool m_bRunning;             // a worker is in the lane routine
+    pthread_t m_runner;          // that worker, valid while m_bRunning
+    bool m_bDetach;              // stopped by its own job, worker unregisters
+
+    // stats, run side is only updated by the worker owning the lane
+    uint32_t m_maxDepth;
+    uint32_t m_posted;
+    uint32_t m_runs;
+    uint32_t m_dispatches;
+    int64_t m_runTimeNs;
+    int64_t m_maxRunNs;
+};
+
+/* Process wide pool of workers shared by all camera sessions. Runnable
+ * lanes sit on the run queue of their home worker, idle workers steal
+ * from the others. Worker count and core affinity come from
+ * persist.camera.exec.workers and persist.camera.exec.cpumask. */
+class QCameraExecutor {
+public:
+    static QCameraExecutor& getInstance();
+    static bool isEnabled();
+
+    android::String8 dump();
+
+private:
+    friend class QCameraExecutorLane;
+
+    typedef struct {
+        QCameraExecutor *executor;
+        uint32_t id;
+        pthread_t pid;
+        pthread_mutex_t lock;
+        struct cam_list runq;    // runnable lanes
+        uint32_t runs;
+        uint32_t steals;
+    } worker_t;
+
+    QCameraExecutor();
+    ~QCameraExecutor();
+    QCameraExecutor(const QCameraExecutor&);
+    QCameraExecutor& operator=(const QCameraExecutor&);
+
+    int32_t registerLane(QCameraExecutorLane *lane);
+    void unregisterLane(QCameraExecutorLane *lane);
+    void schedule(QCameraExecutorLane *lane, uint32_t worker);
+    bool unqueueLane(QCameraExecutorLane *lane);
+    QCameraExecutorLane *nextLane(worker_t *worker);
+    void runLane(worker_t *worker, QCameraExecutorLane *lane);
+    int32_t launchWorkers();
+    static void *workerRoutine(void *data);
+
+    pthread_mutex_t m_lock;      // protects lane registry and launch
+    struct cam_list m_lanes;
+    uint32_t m_nextHome;
+    worker_t m_workers[QCAMERA_EXECUTOR_MAX_WORKERS];
+    uint32_t m_numWorkers;
+    uint32_t m_cpuMask;
+    bool m_bLaunched;
+    cam_semaphore_t m_workSem;   // one post per lane made runnable
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_EXECUTOR_H__ */
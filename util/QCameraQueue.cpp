@@ -27,6 +27,7 @@
 *
 */
 
+#include <sched.h>
 #include <utils/Errors.h>
 #include <utils/Log.h>
 #include "QCameraQueue.h"
@@ -50,6 +51,13 @@ QCameraQueue::QCameraQueue()
     m_dataFn = NULL;
     m_userData = NULL;
     m_active = true;
+    m_type = QCAMERA_QUEUE_TYPE_LIST;
+    m_ring = NULL;
+    m_ringMask = 0;
+    m_ringHead = 0;
+    m_ringTail = 0;
+    m_ringProducers = 0;
+    m_ringFullCnt = 0;
 }
 
 /*===========================================================================
@@ -71,6 +79,47 @@ QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data)
     m_dataFn = data_rel_fn;
     m_userData = user_data;
     m_active = true;
+    m_type = QCAMERA_QUEUE_TYPE_LIST;
+    m_ring = NULL;
+    m_ringMask = 0;
+    m_ringHead = 0;
+    m_ringTail = 0;
+    m_ringProducers = 0;
+    m_ringFullCnt = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraQueue
+ *
+ * DESCRIPTION: constructor of QCameraQueue with selectable backing store
+ *
+ * PARAMETERS :
+ *   @data_rel_fn : function ptr to release node data internal resource
+ *   @user_data   : user data ptr
+ *   @type        : list or preallocated ring (single/multi producer)
+ *   @capacity    : max number of pending entries for ring types
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data,
+        qcamera_queue_type_t type, uint32_t capacity)
+{
+    pthread_mutex_init(&m_lock, NULL);
+    cam_list_init(&m_head.list);
+    m_size = 0;
+    m_dataFn = data_rel_fn;
+    m_userData = user_data;
+    m_active = true;
+    m_type = type;
+    m_ring = NULL;
+    m_ringMask = 0;
+    m_ringHead = 0;
+    m_ringTail = 0;
+    m_ringProducers = 0;
+    m_ringFullCnt = 0;
+    if (QCAMERA_QUEUE_TYPE_LIST != m_type) {
+        initRing(capacity);
+    }
 }
 
 /*===========================================================================
@@ -85,9 +134,192 @@ QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data)
 QCameraQueue::~QCameraQueue()
 {
     flush();
+    if (NULL != m_ring) {
+        free(m_ring);
+        m_ring = NULL;
+    }
     pthread_mutex_destroy(&m_lock);
 }
 
+/*===========================================================================
+ * FUNCTION   : initRing
+ *
+ * DESCRIPTION: allocate ring slots. Falls back to the list queue if the
+ *              ring cannot be allocated.
+ *
+ * PARAMETERS :
+ *   @capacity : requested number of slots, rounded up to a power of 2
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraQueue::initRing(uint32_t capacity)
+{
+    uint32_t slots = 2;
+    while ((slots < capacity) && (slots < (1U << 16))) {
+        slots <<= 1;
+    }
+
+    m_ring = (camera_q_slot *)malloc(slots * sizeof(camera_q_slot));
+    if (NULL == m_ring) {
+        ALOGE("%s: No memory for %u ring slots, using list queue",
+                __func__, slots);
+        m_type = QCAMERA_QUEUE_TYPE_LIST;
+        return;
+    }
+
+    for (uint32_t i = 0; i < slots; i++) {
+        m_ring[i].seq = i;
+        m_ring[i].data = NULL;
+    }
+    m_ringMask = slots - 1;
+}
+
+/*===========================================================================
+ * FUNCTION   : enqueueRing
+ *
+ * DESCRIPTION: lock free enqueue into the preallocated ring. A slot whose
+ *              seq equals the producer position is free; the producer
+ *              publishes it by setting seq to position + 1, and the
+ *              consumer frees it again with position + slot count.
+ *
+ * PARAMETERS :
+ *   @data    : data to be enqueued
+ *
+ * RETURN     : true -- success; false -- queue inactive or full
+ *==========================================================================*/
+bool QCameraQueue::enqueueRing(void *data)
+{
+    camera_q_slot *slot = NULL;
+    uint32_t pos;
+    bool rc = false;
+
+    /* Register before checking m_active, flush() waits for registered
+     * producers after deactivating so nothing is published behind it */
+    __atomic_add_fetch(&m_ringProducers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_active, __ATOMIC_SEQ_CST)) {
+        pos = __atomic_load_n(&m_ringTail, __ATOMIC_RELAXED);
+        while (true) {
+            slot = &m_ring[pos & m_ringMask];
+            uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+            int32_t diff = (int32_t)(seq - pos);
+            if (diff == 0) {
+                if (QCAMERA_QUEUE_TYPE_RING_SPSC == m_type) {
+                    __atomic_store_n(&m_ringTail, pos + 1, __ATOMIC_RELAXED);
+                    rc = true;
+                } else {
+                    rc = __atomic_compare_exchange_n(&m_ringTail, &pos,
+                            pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+                }
+                if (rc) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // slot not yet released by the consumer, ring is full
+                __atomic_add_fetch(&m_ringFullCnt, 1, __ATOMIC_RELAXED);
+                break;
+            } else {
+                pos = __atomic_load_n(&m_ringTail, __ATOMIC_RELAXED);
+            }
+        }
+
+        if (rc) {
+            slot->data = data;
+            __atomic_add_fetch(&m_size, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+        }
+    }
+    __atomic_sub_fetch(&m_ringProducers, 1, __ATOMIC_SEQ_CST);
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : isRingSlotReady
+ *
+ * DESCRIPTION: check if the ring slot at given position has been published
+ *
+ * PARAMETERS :
+ *   @pos     : ring position
+ *
+ * RETURN     : true -- slot holds a published entry; false -- otherwise
+ *==========================================================================*/
+bool QCameraQueue::isRingSlotReady(uint32_t pos)
+{
+    camera_q_slot *slot = &m_ring[pos & m_ringMask];
+    return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == (pos + 1);
+}
+
+/*===========================================================================
+ * FUNCTION   : reclaimRingHeadLocked
+ *
+ * DESCRIPTION: hand slots at the ring head that were emptied out of order
+ *              back to the producers. Must be called with m_lock held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraQueue::reclaimRingHeadLocked()
+{
+    while (isRingSlotReady(m_ringHead)) {
+        camera_q_slot *slot = &m_ring[m_ringHead & m_ringMask];
+        if (NULL != slot->data) {
+            break;
+        }
+        __atomic_store_n(&slot->seq, m_ringHead + m_ringMask + 1,
+                __ATOMIC_RELEASE);
+        m_ringHead++;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : popRingSlotLocked
+ *
+ * DESCRIPTION: remove the oldest entry from the ring. Must be called with
+ *              m_lock held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : data ptr. NULL if ring is empty.
+ *==========================================================================*/
+void* QCameraQueue::popRingSlotLocked()
+{
+    void *data = NULL;
+
+    reclaimRingHeadLocked();
+    if (isRingSlotReady(m_ringHead)) {
+        camera_q_slot *slot = &m_ring[m_ringHead & m_ringMask];
+        data = slot->data;
+        slot->data = NULL;
+        __atomic_store_n(&slot->seq, m_ringHead + m_ringMask + 1,
+                __ATOMIC_RELEASE);
+        m_ringHead++;
+        __atomic_sub_fetch(&m_size, 1, __ATOMIC_RELAXED);
+    }
+
+    return data;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseNodeData
+ *
+ * DESCRIPTION: release a flushed entry through the release callback
+ *
+ * PARAMETERS :
+ *   @data    : entry data
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraQueue::releaseNodeData(void *data)
+{
+    if (NULL != data) {
+        if (m_dataFn) {
+            m_dataFn(data, m_userData);
+        }
+        free(data);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : init
  *
@@ -100,7 +332,7 @@ QCameraQueue::~QCameraQueue()
 void QCameraQueue::init()
 {
     pthread_mutex_lock(&m_lock);
-    m_active = true;
+    __atomic_store_n(&m_active, true, __ATOMIC_SEQ_CST);
     pthread_mutex_unlock(&m_lock);
 }
 
@@ -116,6 +348,9 @@ void QCameraQueue::init()
 bool QCameraQueue::isEmpty()
 {
     bool flag = true;
+    if (QCAMERA_QUEUE_TYPE_LIST != m_type) {
+        return (__atomic_load_n(&m_size, __ATOMIC_ACQUIRE) <= 0);
+    }
     pthread_mutex_lock(&m_lock);
     if (m_size > 0) {
         flag = false;
@@ -137,6 +372,10 @@ bool QCameraQueue::isEmpty()
 bool QCameraQueue::enqueue(void *data)
 {
     bool rc;
+    if (QCAMERA_QUEUE_TYPE_LIST != m_type) {
+        return enqueueRing(data);
+    }
+
     camera_q_node *node =
         (camera_q_node *)malloc(sizeof(camera_q_node));
     if (NULL == node) {
@@ -164,7 +403,8 @@ bool QCameraQueue::enqueue(void *data)
  * FUNCTION   : enqueueWithPriority
  *
  * DESCRIPTION: enqueue data into queue with priority, will insert into the
- *              head of the queue
+ *              head of the queue. Ring queues keep priority entries on the
+ *              list, ahead of the ring, so this path still allocates.
  *
  * PARAMETERS :
  *   @data    : data to be enqueued
@@ -193,7 +433,7 @@ bool QCameraQueue::enqueueWithPriority(void *data)
         node->list.next = p_next;
         node->list.prev = &m_head.list;
 
-        m_size++;
+        __atomic_add_fetch(&m_size, 1, __ATOMIC_RELAXED);
         rc = true;
     } else {
         free(node);
@@ -225,6 +465,11 @@ void* QCameraQueue::peek()
         pos = head->next;
         if (pos != head) {
             node = member_of(pos, camera_q_node, list);
+        } else if (QCAMERA_QUEUE_TYPE_LIST != m_type) {
+            reclaimRingHeadLocked();
+            if (isRingSlotReady(m_ringHead)) {
+                data = m_ring[m_ringHead & m_ringMask].data;
+            }
         }
     }
     pthread_mutex_unlock(&m_lock);
@@ -257,6 +502,30 @@ void* QCameraQueue::dequeue(bool bFromHead)
     pthread_mutex_lock(&m_lock);
     if (m_active) {
         head = &m_head.list;
+        if (QCAMERA_QUEUE_TYPE_LIST != m_type) {
+            if (bFromHead && (head->next == head)) {
+                data = popRingSlotLocked();
+            } else if (!bFromHead) {
+                // newest published ring entry, if any
+                uint32_t last = m_ringHead;
+                for (uint32_t i = m_ringHead; isRingSlotReady(i); i++) {
+                    if (NULL != m_ring[i & m_ringMask].data) {
+                        last = i + 1;
+                    }
+                }
+                if (last != m_ringHead) {
+                    camera_q_slot *slot = &m_ring[(last - 1) & m_ringMask];
+                    data = slot->data;
+                    slot->data = NULL;
+                    __atomic_sub_fetch(&m_size, 1, __ATOMIC_RELAXED);
+                    reclaimRingHeadLocked();
+                }
+            }
+            if (NULL != data) {
+                pthread_mutex_unlock(&m_lock);
+                return data;
+            }
+        }
         if (bFromHead) {
             pos = head->next;
         } else {
@@ -265,7 +534,7 @@ void* QCameraQueue::dequeue(bool bFromHead)
         if (pos != head) {
             node = member_of(pos, camera_q_node, list);
             cam_list_del_node(&node->list);
-            m_size--;
+            __atomic_sub_fetch(&m_size, 1, __ATOMIC_RELAXED);
         }
     }
     pthread_mutex_unlock(&m_lock);
@@ -310,7 +579,7 @@ void* QCameraQueue::dequeue(match_fn_data match, void *match_data){
             if (NULL != node) {
                 if ( match(node->data, m_userData, match_data) ) {
                     cam_list_del_node(&node->list);
-                    m_size--;
+                    __atomic_sub_fetch(&m_size, 1, __ATOMIC_RELAXED);
                     data = node->data;
                     free(node);
                     pthread_mutex_unlock(&m_lock);
@@ -318,9 +587,23 @@ void* QCameraQueue::dequeue(match_fn_data match, void *match_data){
                 }
             }
         }
+
+        if (QCAMERA_QUEUE_TYPE_LIST != m_type) {
+            for (uint32_t i = m_ringHead; isRingSlotReady(i); i++) {
+                camera_q_slot *slot = &m_ring[i & m_ringMask];
+                if ((NULL != slot->data) &&
+                        match(slot->data, m_userData, match_data)) {
+                    data = slot->data;
+                    slot->data = NULL;
+                    __atomic_sub_fetch(&m_size, 1, __ATOMIC_RELAXED);
+                    reclaimRingHeadLocked();
+                    break;
+                }
+            }
+        }
     }
     pthread_mutex_unlock(&m_lock);
-    return NULL;
+    return data;
 }
 
 /*===========================================================================
@@ -358,8 +641,21 @@ void QCameraQueue::flush(){
             free(node);
 
         }
-        m_size = 0;
-        m_active = false;
+
+        if (QCAMERA_QUEUE_TYPE_LIST != m_type) {
+            __atomic_store_n(&m_active, false, __ATOMIC_SEQ_CST);
+            // let producers that already passed the active check publish
+            while (__atomic_load_n(&m_ringProducers, __ATOMIC_SEQ_CST) > 0) {
+                sched_yield();
+            }
+            void *data = NULL;
+            while (isRingSlotReady(m_ringHead)) {
+                data = popRingSlotLocked();
+                releaseNodeData(data);
+            }
+        }
+        __atomic_store_n(&m_size, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&m_active, false, __ATOMIC_SEQ_CST);
     }
     pthread_mutex_unlock(&m_lock);
 }
@@ -394,7 +690,7 @@ void QCameraQueue::flushNodes(match_fn match){
             pos = pos->next;
             if ( match(node->data, m_userData) ) {
                 cam_list_del_node(&node->list);
-                m_size--;
+                __atomic_sub_fetch(&m_size, 1, __ATOMIC_RELAXED);
 
                 if (NULL != node->data) {
                     if (m_dataFn) {
@@ -405,6 +701,18 @@ void QCameraQueue::flushNodes(match_fn match){
                 free(node);
             }
         }
+
+        if (QCAMERA_QUEUE_TYPE_LIST != m_type) {
+            for (uint32_t i = m_ringHead; isRingSlotReady(i); i++) {
+                camera_q_slot *slot = &m_ring[i & m_ringMask];
+                if ((NULL != slot->data) && match(slot->data, m_userData)) {
+                    releaseNodeData(slot->data);
+                    slot->data = NULL;
+                    __atomic_sub_fetch(&m_size, 1, __ATOMIC_RELAXED);
+                }
+            }
+            reclaimRingHeadLocked();
+        }
     }
     pthread_mutex_unlock(&m_lock);
 }
@@ -439,7 +747,7 @@ void QCameraQueue::flushNodes(match_fn_data match, void *match_data){
             pos = pos->next;
             if ( match(node->data, m_userData, match_data) ) {
                 cam_list_del_node(&node->list);
-                m_size--;
+                __atomic_sub_fetch(&m_size, 1, __ATOMIC_RELAXED);
 
                 if (NULL != node->data) {
                     if (m_dataFn) {
@@ -450,6 +758,19 @@ void QCameraQueue::flushNodes(match_fn_data match, void *match_data){
                 free(node);
             }
         }
+
+        if (QCAMERA_QUEUE_TYPE_LIST != m_type) {
+            for (uint32_t i = m_ringHead; isRingSlotReady(i); i++) {
+                camera_q_slot *slot = &m_ring[i & m_ringMask];
+                if ((NULL != slot->data) &&
+                        match(slot->data, m_userData, match_data)) {
+                    releaseNodeData(slot->data);
+                    slot->data = NULL;
+                    __atomic_sub_fetch(&m_size, 1, __ATOMIC_RELAXED);
+                }
+            }
+            reclaimRingHeadLocked();
+        }
     }
     pthread_mutex_unlock(&m_lock);
 }
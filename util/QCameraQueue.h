@@ -31,6 +31,7 @@
 #define __QCAMERA_QUEUE_H__
 
 #include <pthread.h>
+#include <stdint.h>
 #include "cam_list.h"
 
 namespace qcamera {
@@ -39,10 +40,21 @@ typedef bool (*match_fn_data)(void *data, void *user_data, void *match_data);
 typedef void (*release_data_fn)(void* data, void *user_data);
 typedef bool (*match_fn)(void *data, void *user_data);
 
+typedef enum {
+    QCAMERA_QUEUE_TYPE_LIST,      /* unbounded list, one node alloc per enqueue */
+    QCAMERA_QUEUE_TYPE_RING_SPSC, /* preallocated ring, single producer thread */
+    QCAMERA_QUEUE_TYPE_RING_MPSC, /* preallocated ring, multiple producer threads */
+} qcamera_queue_type_t;
+
 class QCameraQueue {
 public:
     QCameraQueue();
     QCameraQueue(release_data_fn data_rel_fn, void *user_data);
+    /* Ring queues never allocate on enqueue and producers never take
+     * m_lock. Enqueue fails once capacity (rounded up to a power of 2)
+     * entries are pending, so size it to the number of buffers in flight. */
+    QCameraQueue(release_data_fn data_rel_fn, void *user_data,
+            qcamera_queue_type_t type, uint32_t capacity);
     virtual ~QCameraQueue();
     void init();
     bool enqueue(void *data);
@@ -56,19 +68,43 @@ public:
     void* dequeue(match_fn_data match, void *spec_data);
     void* peek();
     bool isEmpty();
-    int getCurrentSize() {return m_size;}
+    int getCurrentSize() {return __atomic_load_n(&m_size, __ATOMIC_RELAXED);}
+    qcamera_queue_type_t getType() {return m_type;}
+    uint32_t getRingFullCount() {
+        return __atomic_load_n(&m_ringFullCnt, __ATOMIC_RELAXED);
+    }
 private:
     typedef struct {
         struct cam_list list;
         void* data;
     } camera_q_node;
 
-    camera_q_node m_head; // dummy head
+    typedef struct {
+        uint32_t seq;  // slot sequence, see enqueueRing()
+        void* data;    // NULL once removed out of order
+    } camera_q_slot;
+
+    void initRing(uint32_t capacity);
+    bool enqueueRing(void *data);
+    bool isRingSlotReady(uint32_t pos);
+    void* popRingSlotLocked();
+    void reclaimRingHeadLocked();
+    void releaseNodeData(void *data);
+
+    camera_q_node m_head; // dummy head, also holds ring priority entries
     int m_size;
     bool m_active;
-    pthread_mutex_t m_lock;
+    pthread_mutex_t m_lock;  // list lock; consumer side lock for ring
     release_data_fn m_dataFn;
     void * m_userData;
+
+    qcamera_queue_type_t m_type;
+    camera_q_slot *m_ring;
+    uint32_t m_ringMask;
+    uint32_t m_ringHead;     // consumer position, under m_lock
+    uint32_t m_ringTail;     // producer position
+    uint32_t m_ringProducers; // producers between active check and publish
+    uint32_t m_ringFullCnt;
 };
 
 }; // namespace qcamera
@@ -22,6 +22,7 @@
 
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 #include <utils/Trace.h>
+#include "mm_camera_trace.h"
 
 #undef ATRACE_CALL
 #undef ATRACE_NAME
@@ -83,6 +84,11 @@ if (gKpiDebugLevel >= KPI_DBG) { \
 #define ATRACE_INT ATRACE_INT_DBG
 #define ATRACE_END ATRACE_END_DBG
 
+//frame trace, see mm_camera_trace.h. name must be a string literal
+#define CAM_FRAME_TRACE(name, type, idx) MM_CAMERA_TRACE_FRAME(name, type, idx)
+#define CAM_FRAME_TRACE_SCOPE(name, type, idx) \
+    qcamera::ScopedFrameTrace ___frame_tracer(name, type, idx)
+
 #define KPI_ATRACE_NAME(name) qcamera::ScopedTraceKpi ___tracer(ATRACE_TAG, name)
 #define ATRACE_NAME(name) qcamera::ScopedTraceDbg ___tracer(ATRACE_TAG, name)
 #define KPI_ATRACE_CALL() KPI_ATRACE_NAME(__FUNCTION__)
@@ -127,6 +133,23 @@ public:
     private:
         uint64_t mTag;
 };
+
+class ScopedFrameTrace {
+public:
+    inline ScopedFrameTrace(const char *name, uint32_t type, uint32_t idx)
+    : mName(name), mType(type), mIdx(idx) {
+        MM_CAMERA_TRACE_FRAME_BEGIN(mName, mType, mIdx);
+    }
+
+    inline ~ScopedFrameTrace() {
+        MM_CAMERA_TRACE_FRAME_END(mName, mType, mIdx);
+    }
+
+    private:
+        const char *mName;
+        uint32_t mType;
+        uint32_t mIdx;
+};
 };
 
 extern volatile uint32_t gKpiDebugLevel;
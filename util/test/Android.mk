@@ -0,0 +1,24 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    qcamera_queue_bench.cpp \
+    ../QCameraQueue.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/.. \
+    $(LOCAL_PATH)/../../stack/common
+
+LOCAL_SHARED_LIBRARIES:= \
+    liblog \
+    libutils \
+    libcutils
+
+LOCAL_CFLAGS += -Wall -Wextra -Werror -Wno-unused-parameter
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+LOCAL_MODULE:= qcamera_queue_bench
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,168 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Microbenchmark for QCameraQueue: list queue vs preallocated ring.
+ * The burst run measures per-op cost on one thread, the threaded runs
+ * measure producer/consumer throughput and need more than one core.
+ * Usage: qcamera_queue_bench [-n items per producer] [-p producers]
+ *                            [-c ring capacity]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include "QCameraQueue.h"
+
+using namespace qcamera;
+
+#define BENCH_MAX_PRODUCERS 8
+#define BENCH_DEFAULT_CAPACITY 64 // CAM_MAX_NUM_BUFS_PER_STREAM
+
+typedef struct {
+    QCameraQueue *queue;
+    uint32_t items;
+    uint32_t retries;
+} bench_producer_t;
+
+static uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void *bench_producer(void *data)
+{
+    bench_producer_t *p = (bench_producer_t *)data;
+    for (uint32_t i = 0; i < p->items; i++) {
+        // payload is never dereferenced, any non NULL value will do
+        while (!p->queue->enqueue((void *)(uintptr_t)(i + 1))) {
+            p->retries++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void bench_burst(const char *name, QCameraQueue *queue,
+        uint32_t burst, uint32_t items)
+{
+    uint32_t rounds = items / burst;
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < burst; i++) {
+            queue->enqueue((void *)(uintptr_t)(i + 1));
+        }
+        for (uint32_t i = 0; i < burst; i++) {
+            queue->dequeue();
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    printf("%-10s burst %u: %8.1f ns per enqueue+dequeue\n",
+            name, burst, (double)elapsed / (double)(rounds * burst));
+}
+
+static void bench_run(const char *name, QCameraQueue *queue,
+        uint32_t producers, uint32_t items)
+{
+    pthread_t tid[BENCH_MAX_PRODUCERS];
+    bench_producer_t prod[BENCH_MAX_PRODUCERS];
+    uint64_t total = (uint64_t)producers * items;
+    uint64_t received = 0;
+    uint32_t retries = 0;
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < producers; i++) {
+        prod[i].queue = queue;
+        prod[i].items = items;
+        prod[i].retries = 0;
+        pthread_create(&tid[i], NULL, bench_producer, &prod[i]);
+    }
+    while (received < total) {
+        if (NULL != queue->dequeue()) {
+            received++;
+        } else {
+            sched_yield();
+        }
+    }
+    for (uint32_t i = 0; i < producers; i++) {
+        pthread_join(tid[i], NULL);
+        retries += prod[i].retries;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    printf("%-10s producers %u: %8.1f ns/item, %6.2f Mitems/s, full retries %u\n",
+            name, producers, (double)elapsed / (double)total,
+            (double)total * 1000.0 / (double)elapsed, retries);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t items = 1000000;
+    uint32_t producers = 4;
+    uint32_t capacity = BENCH_DEFAULT_CAPACITY;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:c:")) != -1) {
+        switch (opt) {
+        case 'n':
+            items = (uint32_t)atoi(optarg);
+            break;
+        case 'p':
+            producers = (uint32_t)atoi(optarg);
+            break;
+        case 'c':
+            capacity = (uint32_t)atoi(optarg);
+            break;
+        default:
+            printf("usage: %s [-n items] [-p producers] [-c capacity]\n",
+                    argv[0]);
+            return -1;
+        }
+    }
+    if ((producers == 0) || (producers > BENCH_MAX_PRODUCERS)) {
+        producers = BENCH_MAX_PRODUCERS;
+    }
+
+    QCameraQueue listQ;
+    QCameraQueue spscQ(NULL, NULL, QCAMERA_QUEUE_TYPE_RING_SPSC, capacity);
+    QCameraQueue mpscQ(NULL, NULL, QCAMERA_QUEUE_TYPE_RING_MPSC, capacity);
+
+    bench_burst("list", &listQ, 8, items);
+    bench_burst("ring-spsc", &spscQ, 8, items);
+    bench_run("list", &listQ, 1, items);
+    bench_run("ring-spsc", &spscQ, 1, items);
+    bench_run("list", &listQ, producers, items);
+    bench_run("ring-mpsc", &mpscQ, producers, items);
+    return 0;
+}